@@ -28,6 +28,9 @@ struct chidb_stmt
 	Schema *schema;
 	uint8_t type;
 	SQLStatement *sql;
+	chidb *db;
+	char *cache_key;	/* Normalized SQL text */
+	uint32_t schema_cookie;	/* Schema cookie the program was compiled against */
 };
 
 
@@ -46,6 +49,14 @@ struct chidb_stmt
  *       use it as a representation of a chidb database to pass along
  *       to other API functions.
  *
+ * A chidb database may be shared by several threads, as long as each
+ * statement is only used by one thread at a time. INSERTs and
+ * chidb_import (which may add rows to the same table) run concurrently;
+ * the other statements that write run one at a time, a step waiting for
+ * the steps of other kinds already running to finish. Statements that
+ * only read (SELECT) never wait: each sees the file as it was when it
+ * was prepared, whatever is written meanwhile (see chidb_prepare).
+ *
  * Return
  * - CHIDB_OK: Operation successful
  * - CHIDB_ENOMEM: Could not allocate memory
@@ -56,7 +67,39 @@ struct chidb_stmt
 int chidb_open(const char *file, chidb **db); 
 
 
+/* Opens a chidb file, creating it with a given page size
+ *
+ * Same as chidb_open, but if the file does not exist, it is created
+ * with pages of page_size bytes instead of the default 1024. Larger
+ * pages (4096 to 16384 bytes, say) make for shallower B-Trees and
+ * fewer, larger reads. The page size of an existing file is the one
+ * it was created with, and page_size is ignored.
+ *
+ * Parameters
+ * - file: Filename of the chidb file to open/create
+ * - db: Out parameter. Returns a pointer to a chidb struct.
+ * - page_size: Page size of a new file. Must be a power of two between
+ *              512 and 65536.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Invalid page size
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_ECANTOPEN: Unable to open the database file
+ * - CHIDB_ECORRUPT: The database file is not well formed
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_open_pagesize(const char *file, chidb **db, uint32_t page_size);
+
+
 /* Prepares a SQL statement for execution
+ *
+ * A SELECT statement reads the file as of the last write committed
+ * before it was prepared (a step of a statement that writes commits
+ * along with those running alongside it; chidb_import commits once it
+ * is done), also when it is reset and run again. Prepare it again to
+ * see later writes. The older versions of the pages it reads are kept
+ * until it is finalized.
  *
  * Parameters
  * - db: chidb database
@@ -97,6 +140,59 @@ int chidb_prepare(chidb *db, const char *sql, chidb_stmt **stmt);
 int chidb_step(chidb_stmt *stmt);
 
 
+/* Binds an integer to a parameter of a prepared SQL statement
+ *
+ * Parameters are the ? placeholders in the SQL statement, numbered
+ * from 1 in the order they appear. A parameter that is never bound
+ * has a NULL value. Parameters can only be bound before the statement
+ * is first stepped, or after it has been reset; bindings are kept
+ * across resets.
+ *
+ * Parameters
+ * - stmt: Prepared SQL statement
+ * - param: Parameter number
+ * - value: Integer value
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: No such parameter, or the statement is running
+ */
+int chidb_bind_int(chidb_stmt *stmt, int param, int value);
+
+
+/* Binds a string to a parameter of a prepared SQL statement
+ *
+ * See chidb_bind_int. The string is copied, so the API client may
+ * free it as soon as this function returns.
+ *
+ * Parameters
+ * - stmt: Prepared SQL statement
+ * - param: Parameter number
+ * - value: Null-terminated string
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: No such parameter, or the statement is running
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_bind_text(chidb_stmt *stmt, int param, const char *value);
+
+
+/* Resets a prepared SQL statement so it can be stepped again
+ *
+ * The compiled statement is kept, so running it again (usually with
+ * new parameter values) does not require calling chidb_prepare.
+ *
+ * Parameters
+ * - stmt: Prepared SQL statement
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Statement was already finalized
+ */
+int chidb_reset(chidb_stmt *stmt);
+
+
 /* Finalizes a SQL statement, freeing all resources associated with it.
  *
  * Parameters
@@ -175,6 +271,36 @@ int chidb_column_int(chidb_stmt *stmt, int col);
 const char *chidb_column_text(chidb_stmt *stmt, int col);
 
 
+/* Loads the rows of a CSV file into a table
+ *
+ * Each line of the file is one row, with one field per column of the
+ * table, in the order given by its CREATE TABLE. Fields are converted to
+ * the column types; empty fields are NULL, except for the primary key.
+ * The file is streamed and the rows go straight into the table's B-Tree
+ * (and into its indexes), without building (or parsing) any SQL. Rows
+ * loaded before an error are kept.
+ *
+ * Parameters
+ * - db: chidb database
+ * - file: Name of the CSV file
+ * - table: Name of the table
+ * - nrows: Out parameter. Returns the number of rows loaded
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ECANTOPEN: Could not open the CSV file
+ * - CHIDB_EINVALIDSQL: No such table
+ * - CHIDB_EMISUSE: The table has no primary key
+ * - CHIDB_EMISMATCH: A row does not have one value of the right type for
+ *   each column, or has a NULL in the first column of an index
+ * - CHIDB_ECONSTRAINT: Duplicate primary key, duplicate key in a
+ *   single-column index, or a row too large for a covering index
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the files
+ */
+int chidb_import(chidb *db, const char *file, const char *table, uint32_t *nrows);
+
+
 /* Closes a chidb database
  *
  * Parameters
@@ -16,6 +16,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <assert.h>
+#include <pthread.h>
 
 // Public codes (specified in Architecture document)
 #define CHIDB_OK (0)
@@ -42,6 +43,11 @@
 
 
 #define DEFAULT_PAGE_SIZE (1024)
+#define MIN_PAGE_SIZE (512)
+#define MAX_PAGE_SIZE (65536)
+
+/* Page sizes must be a power of two between MIN_PAGE_SIZE and MAX_PAGE_SIZE */
+#define VALID_PAGE_SIZE(ps) ((ps) >= MIN_PAGE_SIZE && (ps) <= MAX_PAGE_SIZE && ((ps) & ((ps) - 1)) == 0)
 
 #define SQL_NOTVALID (-1)
 #define SQL_NULL (0)
@@ -63,15 +69,54 @@ typedef struct {
   uint32_t *table_sizes;
 } Catalog;
 
+/* Prepared statements that have been finalized are kept here, keyed by
+ * their normalized SQL text, so preparing the same SQL again can reuse
+ * the compiled program. Least recently used first. */
+#define CHIDB_STMTCACHE_SIZE (16)
+
+typedef struct {
+  struct chidb_stmt *stmts[CHIDB_STMTCACHE_SIZE];
+  uint32_t nstmts;
+} StmtCache;
+
+/* Statements that write take the connection's lock in one of two modes.
+ * Those that only insert hold it alongside each other (the B-Trees latch
+ * the nodes they change, see chidb_Btree_insert); any other statement
+ * holds it alone. Threads get the lock in the order they asked for it,
+ * along with those right behind them asking for the same (shared) mode.
+ * Statements that only read never take it: they read a snapshot of the
+ * file (see chidb_Pager_openSnapshot). */
+typedef enum {
+  CHIDB_LOCK_INSERT,
+  CHIDB_LOCK_WRITE
+} ChidbLockMode;
+
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  uint64_t next_ticket;   /* Ticket of the next thread to ask for the lock */
+  uint64_t serving;       /* Ticket of the next thread to get it */
+  uint32_t holders;       /* Threads holding the lock */
+  ChidbLockMode mode;     /* Mode it is held in */
+} ChidbLock;
+
 /* A chidb database is initially only a BTree.
  * This presuposes that only the btree.c module has been implemented.
  * If other parts of the chidb Architecture are implemented, the
  * chidb struct may have to be modified.
+ *
+ * A connection may be used by several threads at once (each with its own
+ * statements); those writing take turns through its lock.
  */
 struct chidb
 {
 	BTree   *bt;
   Catalog stats;
+  StmtCache cache;
+  struct Schema *schema;  /* Parsed schema, shared by the statements */
+  uint32_t schema_cookie; /* Schema cookie the schema was loaded at */
+  pthread_mutex_t mutex;  /* Guards stats, cache and schema */
+  ChidbLock lock;         /* Held while a statement writes */
 };
 typedef struct chidb chidb;
 
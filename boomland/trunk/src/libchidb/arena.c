@@ -0,0 +1,190 @@
+/*****************************************************************************
+ *
+ *																 chidb
+ *
+ * Arena (bump) allocator.
+ *
+ * Memory is handed out from large blocks, in order, and is never freed
+ * one allocation at a time. A DBM uses arenas for everything that lives
+ * as long as the statement, a run of the statement, or a single row:
+ * taking a mark before a row and releasing back to it afterwards frees
+ * the row's memory without a single call to free().
+ *
+ *   ArenaMark mark = chidb_Arena_mark(&arena);
+ *   char *s = chidb_Arena_alloc(&arena, 42);
+ *   ...
+ *   chidb_Arena_release(&arena, mark); // s is gone
+ *
+\*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/* All allocations are aligned to this many bytes */
+#define ARENA_ALIGN (8)
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+/* Usable memory of a block starts right after its header */
+#define ARENA_BLOCK_DATA(b) ((uint8_t *) (b) + ARENA_ROUND(sizeof(ArenaBlock)))
+
+
+/* Initialize an empty arena
+ *
+ * No memory is allocated until the first allocation.
+ *
+ * Parameters
+ * - arena: Arena to initialize
+ * - block_size: Size of the blocks memory is carved out of (larger
+ *   allocations get a block of their own)
+ */
+void chidb_Arena_init(Arena *arena, size_t block_size)
+{
+	arena->block = NULL;
+	arena->block_size = block_size;
+	arena->last = NULL;
+	arena->spare = NULL;
+}
+
+
+/* Allocate memory from an arena
+ *
+ * Parameters
+ * - arena: Arena to allocate from
+ * - size: Number of bytes
+ *
+ * Return
+ * - Pointer to the memory, or NULL if it could not be allocated
+ */
+void *chidb_Arena_alloc(Arena *arena, size_t size)
+{
+	ArenaBlock *block = arena->block;
+	size = ARENA_ROUND(size);
+
+	if (block == NULL || block->used + size > block->size)
+	{
+		size_t block_size = size > arena->block_size ? size : arena->block_size;
+
+		if (arena->spare != NULL && arena->spare->size >= block_size)
+		{
+			block = arena->spare;
+			arena->spare = NULL;
+		}
+		else
+		{
+			block = malloc(ARENA_ROUND(sizeof(ArenaBlock)) + block_size);
+			if (block == NULL)
+				return NULL;
+			block->size = block_size;
+		}
+		block->used = 0;
+		block->prev = arena->block;
+		arena->block = block;
+	}
+
+	arena->last = ARENA_BLOCK_DATA(block) + block->used;
+	block->used += size;
+	return arena->last;
+}
+
+
+/* Grow an allocation made from an arena
+ *
+ * If the allocation is the most recent one and there is room left in its
+ * block, it is extended in place. Otherwise, new memory is allocated and
+ * the contents are copied over (the old memory is only reclaimed when
+ * the arena is released past it).
+ *
+ * Parameters
+ * - arena: Arena the allocation was made from
+ * - ptr: Allocation to grow (may be NULL)
+ * - old_size: Current size of the allocation
+ * - new_size: Requested size
+ *
+ * Return
+ * - Pointer to the (possibly moved) memory, or NULL if it could not be
+ *   allocated (in which case ptr is left untouched)
+ */
+void *chidb_Arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+	if (ptr != NULL && ptr == arena->last)
+	{
+		ArenaBlock *block = arena->block;
+		size_t start = (uint8_t *) ptr - ARENA_BLOCK_DATA(block);
+
+		if (start + ARENA_ROUND(new_size) <= block->size)
+		{
+			block->used = start + ARENA_ROUND(new_size);
+			return ptr;
+		}
+	}
+
+	void *grown = chidb_Arena_alloc(arena, new_size);
+	if (grown != NULL && ptr != NULL)
+		memcpy(grown, ptr, old_size < new_size ? old_size : new_size);
+	return grown;
+}
+
+
+/* Remember how much of an arena is in use
+ *
+ * Parameters
+ * - arena: Arena to mark
+ *
+ * Return
+ * - A mark that can be passed to chidb_Arena_release
+ */
+ArenaMark chidb_Arena_mark(Arena *arena)
+{
+	ArenaMark mark;
+	mark.block = arena->block;
+	mark.used = arena->block ? arena->block->used : 0;
+	return mark;
+}
+
+
+/* Release everything allocated from an arena after a mark
+ *
+ * Parameters
+ * - arena: Arena to release
+ * - mark: A mark taken earlier on the same arena (and not released past)
+ */
+void chidb_Arena_release(Arena *arena, ArenaMark mark)
+{
+	while (arena->block != mark.block)
+	{
+		ArenaBlock *prev = arena->block->prev;
+
+		// Keep one block around, rows tend to need the same amount again
+		if (arena->spare == NULL || arena->spare->size < arena->block->size)
+		{
+			free(arena->spare);
+			arena->spare = arena->block;
+		}
+		else
+			free(arena->block);
+		arena->block = prev;
+	}
+
+	if (arena->block != NULL)
+		arena->block->used = mark.used;
+	arena->last = NULL;
+}
+
+
+/* Free all the memory of an arena
+ *
+ * The arena is left empty and can be used again.
+ *
+ * Parameters
+ * - arena: Arena to free
+ */
+void chidb_Arena_destroy(Arena *arena)
+{
+	ArenaMark empty = {NULL, 0};
+	chidb_Arena_release(arena, empty);
+	free(arena->spare);
+	arena->spare = NULL;
+}
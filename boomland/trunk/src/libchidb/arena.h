@@ -0,0 +1,45 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+#include <chidbInt.h>
+
+/* An arena is a bump allocator: memory is carved out of large blocks
+ * and is never freed piece by piece. Instead, everything allocated after
+ * a mark is released at once (chidb_Arena_release), and the whole arena
+ * is freed with chidb_Arena_destroy. */
+
+typedef struct ArenaBlock ArenaBlock;
+struct ArenaBlock
+{
+	ArenaBlock *prev;	/* Previously filled block */
+	size_t size;		/* Usable bytes in this block */
+	size_t used;		/* Bytes handed out so far */
+};
+
+struct Arena
+{
+	ArenaBlock *block;	/* Block currently being filled */
+	size_t block_size;	/* Default size of new blocks */
+	void *last;		/* Most recent allocation (can grow in place) */
+	ArenaBlock *spare;	/* Released block kept for reuse */
+};
+typedef struct Arena Arena;
+
+struct ArenaMark
+{
+	ArenaBlock *block;
+	size_t used;
+};
+typedef struct ArenaMark ArenaMark;
+
+#define ARENA_BLOCK_SIZE (4096)
+
+void chidb_Arena_init(Arena *arena, size_t block_size);
+void *chidb_Arena_alloc(Arena *arena, size_t size);
+void *chidb_Arena_grow(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+ArenaMark chidb_Arena_mark(Arena *arena);
+void chidb_Arena_release(Arena *arena, ArenaMark mark);
+void chidb_Arena_destroy(Arena *arena);
+
+#endif /*ARENA_H_*/
@@ -21,6 +21,7 @@
 #include "record.h"
 #include "pager.h"
 #include "util.h"
+#include "filter.h"
 /* Open a B-Tree file
  * 
  * This function opens a database file and verifies that the file
@@ -44,13 +45,48 @@
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
 int chidb_Btree_open(const char *filename, chidb *db, BTree **bt)
+{
+	return chidb_Btree_openPageSize(filename, db, bt, DEFAULT_PAGE_SIZE);
+}
+
+/* Open a B-Tree file, creating it with a given page size
+ * 
+ * Same as chidb_Btree_open, but a file that has to be initialized gets
+ * pages of page_size bytes. The page size of an existing file is
+ * always the one in its header.
+ * 
+ * Parameters
+ * - filename: Database file (might not exist)
+ * - db: A chidb struct. Its bt field must be set to the newly
+ *			 created BTree.
+ * - bt: An out parameter. Used to return a pointer to the
+ *			 newly created BTree.
+ * - page_size: Page size of a new file. Must be a power of two
+ *			 between MIN_PAGE_SIZE and MAX_PAGE_SIZE.
+ * 
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Invalid page size
+ * - CHIDB_ECORRUPTHEADER: Database file contains an invalid header
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_openPageSize(const char *filename, chidb *db, BTree **bt, uint32_t page_size)
 {
 	int error;
+
+	if (!VALID_PAGE_SIZE(page_size)) {
+		return CHIDB_EMISUSE;
+	}
+
 	BTree *newTree = (BTree *) malloc(sizeof(BTree));
 
 	if (newTree == NULL) {
 		return CHIDB_ENOMEM;
 	}
+	pthread_mutex_init(&newTree->alloc_lock, NULL);
+	pthread_mutex_init(&newTree->latches_lock, NULL);
+	memset(newTree->latches, 0, sizeof(newTree->latches));
 
 	error = chidb_Pager_open(&(newTree->pager), filename);
 	if (error != CHIDB_OK) {
@@ -62,7 +98,7 @@ int chidb_Btree_open(const char *filename, chidb *db, BTree **bt)
 
 	if (chidb_Pager_readHeader(newTree->pager, header) == CHIDB_NOHEADER) {
 		/* no header, so we have to initialize the file */
-		chidb_Pager_setPageSize(newTree->pager, DEFAULT_PAGE_SIZE);
+		chidb_Pager_setPageSize(newTree->pager, page_size);
 		newTree->pager->n_pages = 1;
 
 		MemPage *firstPage;
@@ -74,21 +110,21 @@ int chidb_Btree_open(const char *filename, chidb *db, BTree **bt)
 			free(newTree);
 			return error;
 		}
-		chidb_initialize_file_header(firstPage->data);
+		chidb_initialize_file_header(firstPage->data, page_size);
 		chidb_Pager_writePage(newTree->pager, firstPage);
 		chidb_Pager_releaseMemPage(newTree->pager, firstPage);
 
 		chidb_Btree_initEmptyNode(newTree, 1, PGTYPE_TABLE_LEAF);
 	} else {
-		/* otherwise, validate the header */
-		newTree->pager->page_size = get2byte(header + 0x10);
-		chidb_Pager_getRealDBSize(newTree->pager, &(newTree->pager->n_pages));
-
+		/* otherwise, validate the header (before trusting its page size) */
 		if (chidb_validate_file_header(header) == CHIDB_ECORRUPTHEADER) {
 			chidb_Pager_close(newTree->pager);
 			free(newTree);
 			return CHIDB_ECORRUPTHEADER;
 		}
+
+		newTree->pager->page_size = DECODE_PAGE_SIZE(get2byte(header + FILEHEADER_PAGESIZE_OFFSET));
+		chidb_Pager_getRealDBSize(newTree->pager, &(newTree->pager->n_pages));
 	}
 
 	*bt = newTree;	
@@ -100,11 +136,11 @@ int chidb_Btree_open(const char *filename, chidb *db, BTree **bt)
  * Initializes a chidb file header according to the format specified
  * in "The chidb File Format".
  */
-void chidb_initialize_file_header(uint8_t *header) {
+void chidb_initialize_file_header(uint8_t *header, uint32_t page_size) {
 	strcpy(header, "SQLite format 3");
 
-	/* page size */
-	*(header + 0x10) = (uint16_t) DEFAULT_PAGE_SIZE;
+	/* page size (65536 is stored as 1) */
+	put2byte(header + FILEHEADER_PAGESIZE_OFFSET, (page_size == 65536) ? 1 : page_size);
 	/* constants (unused by chidb) */
 	*(header + 0x12) = 0x01; *(header + 0x13) = 0x01; *(header + 0x14) = 0x0;
 	*(header + 0x15) = 0x40; *(header + 0x16) = 0x20; *(header + 0x17) = 0x20;
@@ -124,16 +160,16 @@ void chidb_initialize_file_header(uint8_t *header) {
  */
 int chidb_validate_file_header(uint8_t *header) {
 	int valid = 1;
+	uint32_t page_size = DECODE_PAGE_SIZE(get2byte(header + FILEHEADER_PAGESIZE_OFFSET));
 	valid = !strncmp(header, "SQLite format 3", 15);
 	
+	valid &= VALID_PAGE_SIZE(page_size);
 	valid &= (*(header + 0x12) == 0x01);
 	valid &= (*(header + 0x13) == 0x01);
 	valid &= (*(header + 0x14) == 0x0);
 	valid &= (*(header + 0x15) == 0x40);
 	valid &= (*(header + 0x16) == 0x20);
 	valid &= (*(header + 0x17) == 0x20);
-	valid &= (get4byte(header + 0x20) == 0x0);
-	valid &= (get4byte(header + 0x24) == 0x0);
 	valid &= (get4byte(header + 0x2C) == 0x1);
 	valid &= (get4byte(header + 0x30) == 20000);
 	valid &= (get4byte(header + 0x34) == 0x0);
@@ -147,819 +183,2765 @@ int chidb_validate_file_header(uint8_t *header) {
 	}
 }
 
-/* Close a B-Tree file
- * 
- * This function closes a database file, freeing any resource
- * used in memory, such as the pager.
- * 
+/* Read the schema cookie
+ *
+ * The schema cookie (header offset 0x28) changes every time the schema
+ * of the file changes, so anything derived from the schema (such as a
+ * compiled statement) can be checked for staleness against it.
+ *
  * Parameters
- * - bt: B-Tree file to close
- * 
+ * - bt: B-Tree file
+ * - cookie: Out parameter where the schema cookie is stored
+ *
  * Return
  * - CHIDB_OK: Operation successful
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_Btree_close(BTree *bt)
+int chidb_Btree_getSchemaCookie(BTree *bt, uint32_t *cookie)
 {
-	chidb_Pager_close(bt->pager);
-	free(bt);
+	uint8_t header[100];
 
+	if (chidb_Pager_readHeader(bt->pager, header) != CHIDB_OK)
+		return CHIDB_EIO;
+	*cookie = get4byte(header + 0x28);
 	return CHIDB_OK;
 }
 
-
-/* Loads a B-Tree node from disk
- * 
- * Reads a B-Tree node from a page in the disk. All the information regarding
- * the node is stored in a BTreeNode struct (see header file for more details
- * on this struct). *This is the only function that can allocate memory for
- * a BTreeNode struct*. Always use chidb_Btree_freeMemNode to free the memory
- * allocated for a BTreeNode (do not use free() directly on a BTreeNode variable)
- * Any changes made to a BTreeNode variable will not be effective in the database
- * until chidb_Btree_writeNode is called on that BTreeNode.
- * 
+/* Read the schema cookie as a snapshot sees it
+ *
  * Parameters
  * - bt: B-Tree file
- * - npage: Page of node to load
- * - btn: Out parameter. Used to return a pointer to newly created BTreeNode
- * 
+ * - snapshot: An open snapshot (see chidb_Pager_openSnapshot)
+ * - cookie: Out parameter where the schema cookie is stored
+ *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EPAGENO: The provided page number is not valid
  * - CHIDB_ENOMEM: Could not allocate memory
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_Btree_getNodeByPage(BTree *bt, npage_t npage, BTreeNode **btn)
+int chidb_Btree_getSchemaCookieAt(BTree *bt, uint64_t snapshot, uint32_t *cookie)
 {
-	MemPage *page; 
-	int error = chidb_Pager_readPage(bt->pager, npage, &page);
-	if (error != CHIDB_OK) {
-		return error;
-	}
+	MemPage *firstPage;
+	int error;
 
-	*btn = (BTreeNode *) malloc(sizeof(BTreeNode));
-	
-	uint8_t *data = page->data;
-	if (npage == 1) data += 100; /* skip file header on the first page */
+	if (snapshot == PAGER_LATEST)
+		return chidb_Btree_getSchemaCookie(bt, cookie);
 
-	(*btn)->page = page;
-	(*btn)->type = *(data + PGHEADER_PGTYPE_OFFSET);
-	(*btn)->free_offset = get2byte(data + PGHEADER_FREE_OFFSET);
-	(*btn)->n_cells = get2byte(data + PGHEADER_NCELLS_OFFSET);
-	(*btn)->cells_offset = get2byte(data + PGHEADER_CELL_OFFSET);
-	
-	if ((*btn)->type == PGTYPE_TABLE_INTERNAL || (*btn)->type == PGTYPE_INDEX_INTERNAL) {
-		(*btn)->right_page = get4byte(data + PGHEADER_RIGHTPG_OFFSET);
-		(*btn)->celloffset_array =  data + 12;
-	} else {
-		(*btn)->right_page = 0;
-		(*btn)->celloffset_array = data + 8;
-	}
-								   
+	error = chidb_Pager_readPageAt(bt->pager, 1, snapshot, &firstPage);
+	if (error != CHIDB_OK) return error;
+	*cookie = get4byte(firstPage->data + 0x28);
+	chidb_Pager_releaseMemPage(bt->pager, firstPage);
 	return CHIDB_OK;
 }
 
-
-/* Frees the memory allocated to an in-memory B-Tree node
- * 
- * Frees the memory allocated to an in-memory B-Tree node, and 
- * the in-memory page returned by the pages (stored in the
- * "page" field of BTreeNode)
- * 
+/* Increment the schema cookie
+ *
+ * Must be called by any operation that changes the schema of the file.
+ *
  * Parameters
  * - bt: B-Tree file
- * - btn: BTreeNode to free
- * 
+ *
  * Return
  * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_Btree_freeMemNode(BTree *bt, BTreeNode *btn)
+int chidb_Btree_incrSchemaCookie(BTree *bt)
 {
-	chidb_Pager_releaseMemPage(bt->pager,btn->page);
-	free(btn);
+	MemPage *firstPage;
+	int error;
 
-	return CHIDB_OK;
+	error = chidb_Pager_readPage(bt->pager, 1, &firstPage);
+	if (error != CHIDB_OK) return error;
+
+	put4byte(firstPage->data + 0x28, get4byte(firstPage->data + 0x28) + 1);
+	error = chidb_Pager_writePage(bt->pager, firstPage);
+	chidb_Pager_releaseMemPage(bt->pager, firstPage);
+	return error;
 }
 
+/* Take a page off the free-list (or extend the file), with alloc_lock held */
+static int chidb_Btree_popFreePage(BTree *bt, npage_t *npage)
+{
+	MemPage *firstPage, *trunk;
+	int error;
+
+	error = chidb_Pager_readPage(bt->pager, 1, &firstPage);
+	if (error != CHIDB_OK) return error;
 
-/* Create a new B-Tree node
- * 
- * Allocates a new page in the file and initializes it as a B-Tree node.
- * 
+	npage_t ntrunk = get4byte(firstPage->data + 0x20);
+	if (ntrunk == 0) {
+		chidb_Pager_releaseMemPage(bt->pager, firstPage);
+		return chidb_Pager_allocatePage(bt->pager, npage);
+	}
+
+	error = chidb_Pager_readPage(bt->pager, ntrunk, &trunk);
+	if (error != CHIDB_OK) {
+		chidb_Pager_releaseMemPage(bt->pager, firstPage);
+		return error;
+	}
+
+	uint32_t nleaves = get4byte(trunk->data + 4);
+	if (nleaves > 0) {
+		*npage = get4byte(trunk->data + 8 + 4 * (nleaves - 1));
+		put4byte(trunk->data + 4, nleaves - 1);
+		error = chidb_Pager_writePage(bt->pager, trunk);
+	} else {
+		*npage = ntrunk;
+		put4byte(firstPage->data + 0x20, get4byte(trunk->data));
+	}
+
+	if (error == CHIDB_OK) {
+		put4byte(firstPage->data + 0x24, get4byte(firstPage->data + 0x24) - 1);
+		error = chidb_Pager_writePage(bt->pager, firstPage);
+	}
+	chidb_Pager_releaseMemPage(bt->pager, trunk);
+	chidb_Pager_releaseMemPage(bt->pager, firstPage);
+	return error;
+}
+
+/* Allocate a page
+ *
+ * Pages on the free-list are reused before the file is extended. Pages
+ * may be allocated by several threads at once, which take turns. The
+ * free-list is a chain of trunk pages: the file header holds the first
+ * trunk page (offset 0x20) and the number of free pages (offset 0x24),
+ * and each trunk page holds the next trunk page, the number of leaf
+ * pages it lists, and their page numbers. Leaf pages are handed out
+ * first; once a trunk lists none, the trunk page itself is reused.
+ *
+ * The contents of a reused page are not cleared (chidb_Btree_newNode
+ * initializes the node anyway).
+ *
  * Parameters
  * - bt: B-Tree file
- * - npage: Out parameter. Returns the number of the page that
- *					was allocated.
- * - type: Type of B-Tree node (PGTYPE_TABLE_INTERNAL, PGTYPE_TABLE_LEAF,
- *				 PGTYPE_INDEX_INTERNAL, or PGTYPE_INDEX_LEAF)
- * 
+ * - npage: Out parameter. Returns the number of the page.
+ *
  * Return
  * - CHIDB_OK: Operation successful
  * - CHIDB_ENOMEM: Could not allocate memory
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_Btree_newNode(BTree *bt, npage_t *npage, uint8_t type)
+int chidb_Btree_allocatePage(BTree *bt, npage_t *npage)
 {
 	int error;
-	chidb_Pager_allocatePage(bt->pager, npage);
-
-	error = chidb_Btree_initEmptyNode(bt, *npage, type);
-	if (error != CHIDB_OK) {
-		bt->pager->n_pages -= 1;
-		return error;
-	}
 
-	return CHIDB_OK;
+	pthread_mutex_lock(&bt->alloc_lock);
+	error = chidb_Btree_popFreePage(bt, npage);
+	pthread_mutex_unlock(&bt->alloc_lock);
+	return error;
 }
 
+/* Put a page on the free-list, with alloc_lock held */
+static int chidb_Btree_pushFreePage(BTree *bt, npage_t npage)
+{
+	MemPage *firstPage, *trunk, *page;
+	int error;
+	bool listed = false;
 
+	if (npage <= 1 || npage > bt->pager->n_pages)
+		return CHIDB_EPAGENO;
 
-/* Initialize a B-Tree node
- * 
- * Initializes a database page to contain an empty B-Tree node. The
- * database page is assumed to exist and to have been already allocated
- * by the pager.
- * 
+	error = chidb_Pager_readPage(bt->pager, 1, &firstPage);
+	if (error != CHIDB_OK) return error;
+
+	npage_t ntrunk = get4byte(firstPage->data + 0x20);
+	if (ntrunk != 0) {
+		error = chidb_Pager_readPage(bt->pager, ntrunk, &trunk);
+		if (error != CHIDB_OK) {
+			chidb_Pager_releaseMemPage(bt->pager, firstPage);
+			return error;
+		}
+
+		uint32_t nleaves = get4byte(trunk->data + 4);
+		if (nleaves < FREELIST_TRUNK_LEAVES(bt->pager->page_size)) {
+			put4byte(trunk->data + 8 + 4 * nleaves, npage);
+			put4byte(trunk->data + 4, nleaves + 1);
+			error = chidb_Pager_writePage(bt->pager, trunk);
+			listed = true;
+		}
+		chidb_Pager_releaseMemPage(bt->pager, trunk);
+	}
+
+	if (error == CHIDB_OK)
+		error = chidb_Pager_readPage(bt->pager, npage, &page);
+	if (error == CHIDB_OK) {
+		memset(page->data, 0, bt->pager->page_size);
+		if (!listed) {
+			/* The page is the new first trunk, with no leaves */
+			put4byte(page->data, ntrunk);
+			put4byte(firstPage->data + 0x20, npage);
+		}
+		error = chidb_Pager_writePage(bt->pager, page);
+		chidb_Pager_releaseMemPage(bt->pager, page);
+	}
+
+	if (error == CHIDB_OK) {
+		put4byte(firstPage->data + 0x24, get4byte(firstPage->data + 0x24) + 1);
+		error = chidb_Pager_writePage(bt->pager, firstPage);
+	}
+	chidb_Pager_releaseMemPage(bt->pager, firstPage);
+	return error;
+}
+
+/* Release a page to the free-list
+ *
+ * The page is wiped, so that it is never mistaken for a B-Tree node, and
+ * added to the first trunk page of the free-list. If that trunk is full
+ * (or there is none), the page becomes the new first trunk instead. See
+ * chidb_Btree_allocatePage for the format of the free-list.
+ *
  * Parameters
  * - bt: B-Tree file
- * - npage: Database page where the node will be created.
- * - type: Type of B-Tree node (PGTYPE_TABLE_INTERNAL, PGTYPE_TABLE_LEAF,
- *				 PGTYPE_INDEX_INTERNAL, or PGTYPE_INDEX_LEAF)
- * 
+ * - npage: Page to release. Must not be used by anything else.
+ *
  * Return
  * - CHIDB_OK: Operation successful
+ * - CHIDB_EPAGENO: The page cannot be released (e.g., page 1)
  * - CHIDB_ENOMEM: Could not allocate memory
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_Btree_initEmptyNode(BTree *bt, npage_t npage, uint8_t type)
+int chidb_Btree_freePage(BTree *bt, npage_t npage)
 {
 	int error;
-	MemPage *emptyPage;
 
-	error = chidb_Pager_readPage(bt->pager, npage, &emptyPage);
-	if (error != CHIDB_OK) {
-		return error;
-	}
+	pthread_mutex_lock(&bt->alloc_lock);
+	error = chidb_Btree_pushFreePage(bt, npage);
+	pthread_mutex_unlock(&bt->alloc_lock);
+	return error;
+}
 
-	uint8_t *data = emptyPage->data;
-	if (npage == 1) data += 100; /* skip file header on first page */
+/* Latch a page
+ *
+ * Waits until the page can be latched: a shared latch can be held by
+ * several threads at once, an exclusive one only by one thread. A thread
+ * must not latch a page it already holds a latch on.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - npage: Page to latch
+ * - exclusive: True for an exclusive latch, false for a shared one
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_Btree_latch(BTree *bt, npage_t npage, bool exclusive)
+{
+	BTreeLatch **bucket = &bt->latches[npage % BTREE_LATCH_BUCKETS];
+	BTreeLatch *latch;
 
-	*(data + PGHEADER_PGTYPE_OFFSET) = type;
-	if (ISLEAF(type)) {
-		/* offsets counted from top of page, not beginning of page header */
-		put2byte(data + PGHEADER_FREE_OFFSET, 8 + ((npage == 1) ? 100 : 0));
-	} else {
-		put2byte(data + PGHEADER_FREE_OFFSET, 12 + ((npage == 1) ? 100 : 0));
+	pthread_mutex_lock(&bt->latches_lock);
+	for (latch = *bucket; latch != NULL; latch = latch->next)
+		if (latch->npage == npage)
+			break;
+	if (latch == NULL) {
+		latch = malloc(sizeof(BTreeLatch));
+		if (latch == NULL) {
+			pthread_mutex_unlock(&bt->latches_lock);
+			return CHIDB_ENOMEM;
+		}
+		latch->npage = npage;
+		latch->refs = 0;
+		pthread_rwlock_init(&latch->lock, NULL);
+		latch->next = *bucket;
+		*bucket = latch;
 	}
-	put4byte(data + PGHEADER_NCELLS_OFFSET, 0);
-	put2byte(data + PGHEADER_CELL_OFFSET, bt->pager->page_size);
+	latch->refs++;
+	pthread_mutex_unlock(&bt->latches_lock);
 
-	error = chidb_Pager_writePage(bt->pager, emptyPage);
-	chidb_Pager_releaseMemPage(bt->pager, emptyPage);
+	if (exclusive)
+		pthread_rwlock_wrlock(&latch->lock);
+	else
+		pthread_rwlock_rdlock(&latch->lock);
+	return CHIDB_OK;
+}
 
-	if (error != CHIDB_OK) {
-		return error;
+/* Let go of a latch taken with chidb_Btree_latch
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - npage: Latched page
+ */
+void chidb_Btree_unlatch(BTree *bt, npage_t npage)
+{
+	BTreeLatch **link = &bt->latches[npage % BTREE_LATCH_BUCKETS];
+	BTreeLatch *latch;
+
+	pthread_mutex_lock(&bt->latches_lock);
+	while ((*link)->npage != npage)
+		link = &(*link)->next;
+	latch = *link;
+	pthread_rwlock_unlock(&latch->lock);
+	if (--latch->refs == 0) {
+		*link = latch->next;
+		pthread_rwlock_destroy(&latch->lock);
+		free(latch);
 	}
-
-	return CHIDB_OK;
+	pthread_mutex_unlock(&bt->latches_lock);
 }
 
+/* Number of bytes of a table leaf entry's data held in its cell
+ *
+ * Data of up to TABLELEAFCELL_MAX_LOCAL bytes is held whole. Otherwise
+ * the cell holds TABLELEAFCELL_MIN_LOCAL bytes, plus what would only
+ * partly fill the last overflow page if that keeps it under the maximum.
+ */
+static uint32_t chidb_Btree_localSize(uint32_t pageSize, uint32_t dataSize)
+{
+	uint32_t maxLocal = TABLELEAFCELL_MAX_LOCAL(pageSize);
+	uint32_t minLocal = TABLELEAFCELL_MIN_LOCAL(pageSize);
+	uint32_t local;
 
+	if (dataSize <= maxLocal)
+		return dataSize;
 
-/* Write an in-memory B-Tree node to disk
- * 
- * Writes an in-memory B-Tree node to disk. To do this, we need to update
- * the in-memory page according to the chidb page format. Since the cell
- * offset array and the cells themselves are modified directly on the
- * page, the only thing to do is to store the values of "type",
- * "free_offset", "n_cells", "cells_offset" and "right_page" in the
- * in-memory page.
- * 
+	local = minLocal + (dataSize - minLocal) % (pageSize - OVERFLOWPG_DATA_OFFSET);
+	return (local <= maxLocal) ? local : minLocal;
+}
+
+/* Store the data of a table leaf cell that does not fit in the cell
+ *
+ * The data after the part held in the cell is written to a new chain of
+ * overflow pages, and the cell's overflow_page is set to its first page
+ * (or to 0, if there is nothing to write). If writing fails, the pages
+ * already allocated to the chain are not reclaimed.
+ *
  * Parameters
  * - bt: B-Tree file
- * - btn: BTreeNode to write to disk
- * 
+ * - btc: Table leaf cell with the entry's data
+ *
  * Return
  * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_Btree_writeNode(BTree *bt, BTreeNode *btn)
+static int chidb_Btree_writeOverflow(BTree *bt, BTreeCell *btc)
 {
+	uint32_t pageSize = bt->pager->page_size;
+	uint32_t size = btc->fields.tableLeaf.data_size;
+	uint32_t offset = chidb_Btree_localSize(pageSize, size);
+	npage_t npage, next;
+	MemPage *page;
 	int error;
-	uint8_t *data = btn->page->data;
 
-	if (btn->page->npage == 1) data += 100; /* skip file header on the first page */
+	btc->fields.tableLeaf.overflow_page = 0;
+	if (offset == size)
+		return CHIDB_OK;
 
-	*(data + PGHEADER_PGTYPE_OFFSET) = btn->type;
-	put2byte(data + PGHEADER_FREE_OFFSET, btn->free_offset);
-	if (!ISLEAF(btn->type)) {
-		put4byte(data + PGHEADER_RIGHTPG_OFFSET, btn->right_page);
-	}
-	put2byte(data + PGHEADER_NCELLS_OFFSET, btn->n_cells);
-	put2byte(data+ PGHEADER_CELL_OFFSET, btn->cells_offset);
-	
-	error = chidb_Pager_writePage(bt->pager, btn->page);
-	if (error != CHIDB_OK) {
-		return error;
+	error = chidb_Btree_allocatePage(bt, &npage);
+	if (error != CHIDB_OK) return error;
+	btc->fields.tableLeaf.overflow_page = npage;
+
+	/* each page is written once the page after it is known */
+	while (error == CHIDB_OK && offset < size) {
+		uint32_t len = size - offset;
+		if (len > pageSize - OVERFLOWPG_DATA_OFFSET)
+			len = pageSize - OVERFLOWPG_DATA_OFFSET;
+
+		next = 0;
+		if (offset + len < size)
+			error = chidb_Btree_allocatePage(bt, &next);
+		if (error == CHIDB_OK)
+			error = chidb_Pager_readPage(bt->pager, npage, &page);
+		if (error != CHIDB_OK) break;
+
+		memset(page->data, 0, pageSize);
+		put4byte(page->data + OVERFLOWPG_NEXT_OFFSET, next);
+		memcpy(page->data + OVERFLOWPG_DATA_OFFSET, btc->fields.tableLeaf.data + offset, len);
+		error = chidb_Pager_writePage(bt->pager, page);
+		chidb_Pager_releaseMemPage(bt->pager, page);
+
+		offset += len;
+		npage = next;
 	}
-	
-	return CHIDB_OK;
-}
 
+	/* a partly written chain cannot be followed to free it */
+	if (error != CHIDB_OK)
+		btc->fields.tableLeaf.overflow_page = 0;
+	return error;
+}
 
-/* Read the contents of a cell
- * 
- * Reads the contents of a cell from a BTreeNode and stores them in a BTreeCell.
- * This involves the following:
- *	1. Find out the offset of the requested cell.
- *	2. Read the cell from the in-memory page, and parse its
- *		 contents (refer to The chidb File Format document for
- *		 the format of cells).
- *	
+/* Release a chain of overflow pages to the free-list
+ *
  * Parameters
- * - btn: BTreeNode where cell is contained
- * - ncell: Cell number
- * - cell: BTreeCell where contents must be stored.
- * 
+ * - bt: B-Tree file
+ * - npage: First page of the chain (0 for none)
+ *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ECELLNO: The provided cell number is invalid
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_Btree_getCell(BTreeNode *btn, ncell_t ncell, BTreeCell *cell)
-{		
-	if(btn->n_cells <= ncell) 
-		return CHIDB_ECELLNO;
+static int chidb_Btree_freeOverflow(BTree *bt, npage_t npage)
+{
+	MemPage *page;
+	int error = CHIDB_OK;
 
-	uint8_t *rawCell =  btn->page->data + get2byte(btn->celloffset_array + 2*ncell);	
+	while (npage != 0 && error == CHIDB_OK) {
+		error = chidb_Pager_readPage(bt->pager, npage, &page);
+		if (error != CHIDB_OK) break;
+		npage_t next = get4byte(page->data + OVERFLOWPG_NEXT_OFFSET);
+		chidb_Pager_releaseMemPage(bt->pager, page);
 
-	cell->type = btn->type;
+		error = chidb_Btree_freePage(bt, npage);
+		npage = next;
+	}
 
-	switch (btn->type) {
-	case PGTYPE_TABLE_INTERNAL:
-		getVarint32(rawCell + TABLEINTCELL_KEY_OFFSET, &(cell->key)); 
-		(cell->fields).tableInternal.child_page = get4byte(rawCell + TABLEINTCELL_CHILD_OFFSET);
-		break;
-	case PGTYPE_TABLE_LEAF:
-	    getVarint32(rawCell + TABLELEAFCELL_KEY_OFFSET, &(cell->key));
-		getVarint32(rawCell + TABLELEAFCELL_SIZE_OFFSET, &((cell->fields).tableLeaf.data_size));
-		(cell->fields).tableLeaf.data = rawCell + TABLELEAFCELL_DATA_OFFSET;
-		break;
-	case PGTYPE_INDEX_INTERNAL:
-		cell->key = get4byte(rawCell + INDEXINTCELL_KEYIDX_OFFSET);
-		(cell->fields).indexInternal.keyPk = get4byte(rawCell + INDEXINTCELL_KEYPK_OFFSET); 
-		(cell->fields).indexInternal.child_page = get4byte(rawCell + INDEXINTCELL_CHILD_OFFSET); 
-		break;
-	case PGTYPE_INDEX_LEAF:
-		cell->key = get4byte(rawCell + INDEXLEAFCELL_KEYIDX_OFFSET); 
-		(cell->fields).indexLeaf.keyPk = get4byte(rawCell + INDEXLEAFCELL_KEYPK_OFFSET); 
-		break;
-	default:
-		break;
+	return error;
+}
+
+/* Release all the pages of a B-Tree
+ *
+ * Used to drop a table or an index: every page of the B-Tree rooted at
+ * nroot, including the root and the overflow pages of its entries, goes
+ * to the free-list.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EPAGENO: The B-Tree cannot be released (e.g., the schema table)
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_freeTree(BTree *bt, npage_t nroot)
+{
+	BTreeNode *btn;
+	BTreeCell cell;
+	int error;
+
+	error = chidb_Btree_getNodeByPage(bt, nroot, &btn);
+	if (error != CHIDB_OK) return error;
+
+	if (!ISLEAF(btn->type)) {
+		for (ncell_t i = 0; i < btn->n_cells && error == CHIDB_OK; i++) {
+			chidb_Btree_getCell(btn, i, &cell);
+			error = chidb_Btree_freeTree(bt, (btn->type == PGTYPE_TABLE_INTERNAL) ?
+			                                 cell.fields.tableInternal.child_page :
+			                                 cell.fields.indexInternal.child_page);
+		}
+		if (error == CHIDB_OK)
+			error = chidb_Btree_freeTree(bt, btn->right_page);
+	} else if (btn->type == PGTYPE_TABLE_LEAF) {
+		for (ncell_t i = 0; i < btn->n_cells && error == CHIDB_OK; i++) {
+			chidb_Btree_getCell(btn, i, &cell);
+			error = chidb_Btree_freeOverflow(bt, cell.fields.tableLeaf.overflow_page);
+		}
 	}
-			
+	chidb_Btree_freeMemNode(bt, btn);
+
+	if (error != CHIDB_OK) return error;
+	return chidb_Btree_freePage(bt, nroot);
+}
+
+/* Close a B-Tree file
+ * 
+ * This function closes a database file, freeing any resource
+ * used in memory, such as the pager.
+ * 
+ * Parameters
+ * - bt: B-Tree file to close
+ * 
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_close(BTree *bt)
+{
+	chidb_Pager_close(bt->pager);
+	pthread_mutex_destroy(&bt->alloc_lock);
+	pthread_mutex_destroy(&bt->latches_lock);
+	free(bt);
+
 	return CHIDB_OK;
 }
 
 
-int chidb_Btree_cellSize(BTreeCell *cell) {
-	int cellSize;
+/* Loads a B-Tree node from disk
+ * 
+ * Reads a B-Tree node from a page in the disk. All the information regarding
+ * the node is stored in a BTreeNode struct (see header file for more details
+ * on this struct). *This is the only function that can allocate memory for
+ * a BTreeNode struct*. Always use chidb_Btree_freeMemNode to free the memory
+ * allocated for a BTreeNode (do not use free() directly on a BTreeNode variable)
+ * Any changes made to a BTreeNode variable will not be effective in the database
+ * until chidb_Btree_writeNode is called on that BTreeNode.
+ * 
+ * Parameters
+ * - bt: B-Tree file
+ * - npage: Page of node to load
+ * - btn: Out parameter. Used to return a pointer to newly created BTreeNode
+ * 
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EPAGENO: The provided page number is not valid
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_getNodeByPage(BTree *bt, npage_t npage, BTreeNode **btn)
+{
+	return chidb_Btree_getNodeAt(bt, npage, PAGER_LATEST, btn);
+}
 
-	/* we assume that cell and btn have the same type */
-	switch(cell->type){	
-	case PGTYPE_TABLE_INTERNAL:
-		cellSize = TABLEINTCELL_SIZE;
-		break;
-	case PGTYPE_TABLE_LEAF:
-		cellSize = TABLELEAFCELL_SIZE_WITHOUTDATA + (cell->fields).tableLeaf.data_size;
-		break;
-	case PGTYPE_INDEX_INTERNAL:
-		cellSize = INDEXINTCELL_SIZE;
-		break;
-	case PGTYPE_INDEX_LEAF:
-		cellSize = INDEXLEAFCELL_SIZE;
-		break;
-	default:
-		break;
 
+/* Load a B-Tree node as a snapshot sees it
+ *
+ * Like chidb_Btree_getNodeByPage, but the node is read as it was when
+ * the snapshot was opened (see chidb_Pager_openSnapshot).
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - npage: Page of node to load
+ * - snapshot: An open snapshot, or PAGER_LATEST
+ * - btn: Out parameter. Used to return a pointer to newly created BTreeNode
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EPAGENO: The provided page number is not valid
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_getNodeAt(BTree *bt, npage_t npage, uint64_t snapshot, BTreeNode **btn)
+{
+	MemPage *page; 
+	int error = chidb_Pager_readPageAt(bt->pager, npage, snapshot, &page);
+	if (error != CHIDB_OK) {
+		return error;
 	}
 
-	return cellSize;
+	*btn = (BTreeNode *) malloc(sizeof(BTreeNode));
+	
+	uint8_t *data = page->data;
+	if (npage == 1) data += 100; /* skip file header on the first page */
+
+	(*btn)->page = page;
+	(*btn)->type = *(data + PGHEADER_PGTYPE_OFFSET);
+	(*btn)->free_offset = get2byte(data + PGHEADER_FREE_OFFSET);
+	(*btn)->n_cells = get2byte(data + PGHEADER_NCELLS_OFFSET);
+	(*btn)->cells_offset = DECODE_CELLS_OFFSET(get2byte(data + PGHEADER_CELL_OFFSET));
+	(*btn)->page_size = bt->pager->page_size;
+	
+	if ((*btn)->type == PGTYPE_TABLE_INTERNAL || (*btn)->type == PGTYPE_INDEX_INTERNAL) {
+		(*btn)->right_page = get4byte(data + PGHEADER_RIGHTPG_OFFSET);
+		(*btn)->celloffset_array =  data + 12;
+	} else {
+		(*btn)->right_page = 0;
+		(*btn)->celloffset_array = data + 8;
+	}
+								   
+	return CHIDB_OK;
 }
 
-/* Insert a new cell into a B-Tree node
+
+/* Frees the memory allocated to an in-memory B-Tree node
+ * 
+ * Frees the memory allocated to an in-memory B-Tree node, and 
+ * the in-memory page returned by the pages (stored in the
+ * "page" field of BTreeNode)
  * 
- * Inserts a new cell into a B-Tree node at a specified position ncell.
- * This involves the following:
- *	1. Add the cell at the top of the cell area. This involves "translating"
- *		 the BTreeCell into the chidb format (refer to The chidb File Format 
- *		 document for the format of cells).
- *	2. Modify cells_offset in BTreeNode to reflect the growth in the cell area.
- *	3. Modify the cell offset array so that all values in positions >= ncell
- *		 are shifted one position forward in the array. Then, set the value of
- *		 position ncell to be the offset of the newly added cell.
- *
- * This function assumes that there is enough space for this cell in this node.
- *	
  * Parameters
- * - btn: BTreeNode to insert cell in
- * - ncell: Cell number
- * - cell: BTreeCell to insert.
+ * - bt: B-Tree file
+ * - btn: BTreeNode to free
  * 
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ECELLNO: The provided cell number is invalid
  */
-int chidb_Btree_insertCell(BTreeNode *btn, ncell_t ncell, BTreeCell *cell)
+int chidb_Btree_freeMemNode(BTree *bt, BTreeNode *btn)
 {
-	if (ncell > btn->n_cells) 
-		return CHIDB_ECELLNO;
+	chidb_Pager_releaseMemPage(bt->pager,btn->page);
+	free(btn);
 
-	int cellSize = chidb_Btree_cellSize(cell);
+	return CHIDB_OK;
+}
 
-	if ((btn->cells_offset - btn->free_offset) < (2 + cellSize)) {
-		/* there's not enough space to add another cell */
-		return CHIDB_ECELLNO;
+
+/* Create a new B-Tree node
+ * 
+ * Allocates a new page in the file (reusing a page from the free-list,
+ * if there is one) and initializes it as a B-Tree node.
+ * 
+ * Parameters
+ * - bt: B-Tree file
+ * - npage: Out parameter. Returns the number of the page that
+ *					was allocated.
+ * - type: Type of B-Tree node (PGTYPE_TABLE_INTERNAL, PGTYPE_TABLE_LEAF,
+ *				 PGTYPE_INDEX_INTERNAL, or PGTYPE_INDEX_LEAF)
+ * 
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_newNode(BTree *bt, npage_t *npage, uint8_t type)
+{
+	int error;
+	error = chidb_Btree_allocatePage(bt, npage);
+	if (error != CHIDB_OK) {
+		return error;
 	}
 
-	uint8_t *rawCell = btn->page->data + btn->cells_offset - cellSize;
-	uint32_t dataSize;
+	error = chidb_Btree_initEmptyNode(bt, *npage, type);
+	if (error != CHIDB_OK) {
+		chidb_Btree_freePage(bt, *npage);
+		return error;
+	}
 
-	switch (btn->type){
-	case PGTYPE_TABLE_INTERNAL:
-		putVarint32(rawCell + TABLEINTCELL_KEY_OFFSET, cell->key); 
-		put4byte(rawCell + TABLEINTCELL_CHILD_OFFSET, (cell->fields).tableInternal.child_page);
-		break;
-	case PGTYPE_TABLE_LEAF:
-		putVarint32(rawCell + TABLELEAFCELL_KEY_OFFSET,cell->key);
-		dataSize = (cell->fields).tableLeaf.data_size;
-		putVarint32(rawCell + TABLELEAFCELL_SIZE_OFFSET, dataSize);
-		memcpy(rawCell + TABLELEAFCELL_DATA_OFFSET, (cell->fields).tableLeaf.data, dataSize);
-		break;
-	case PGTYPE_INDEX_INTERNAL:
-		put4byte(rawCell + INDEXINTCELL_KEYIDX_OFFSET, 	cell->key);
-		put4byte(rawCell + INDEXINTCELL_KEYPK_OFFSET, (cell->fields).indexInternal.keyPk); 
-		put4byte(rawCell + INDEXINTCELL_CHILD_OFFSET, (cell->fields).indexInternal.child_page); 
-		break;
-	case PGTYPE_INDEX_LEAF:
-		put4byte(rawCell + INDEXLEAFCELL_KEYIDX_OFFSET, cell->key); 
-		put4byte(rawCell + INDEXLEAFCELL_KEYPK_OFFSET, (cell->fields).indexLeaf.keyPk); 
-		break;
-	default:
-		break;
-	}	
+	return CHIDB_OK;
+}
 
-	memmove(btn->celloffset_array + 2*ncell + 2,
-			btn->celloffset_array + 2*ncell,
-			2*(btn->n_cells - ncell));
 
-	put2byte(btn->celloffset_array + 2*ncell, (btn->cells_offset - cellSize));
 
-	btn->free_offset += 2;
-	btn->n_cells += 1;
-	btn->cells_offset -= cellSize;
+/* Initialize a B-Tree node
+ * 
+ * Initializes a database page to contain an empty B-Tree node. The
+ * database page is assumed to exist and to have been already allocated
+ * by the pager.
+ * 
+ * Parameters
+ * - bt: B-Tree file
+ * - npage: Database page where the node will be created.
+ * - type: Type of B-Tree node (PGTYPE_TABLE_INTERNAL, PGTYPE_TABLE_LEAF,
+ *				 PGTYPE_INDEX_INTERNAL, or PGTYPE_INDEX_LEAF)
+ * 
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_initEmptyNode(BTree *bt, npage_t npage, uint8_t type)
+{
+	int error;
+	MemPage *emptyPage;
+
+	error = chidb_Pager_readPage(bt->pager, npage, &emptyPage);
+	if (error != CHIDB_OK) {
+		return error;
+	}
+
+	uint8_t *data = emptyPage->data;
+	if (npage == 1) data += 100; /* skip file header on first page */
+
+	*(data + PGHEADER_PGTYPE_OFFSET) = type;
+	if (ISLEAF(type)) {
+		/* offsets counted from top of page, not beginning of page header */
+		put2byte(data + PGHEADER_FREE_OFFSET, 8 + ((npage == 1) ? 100 : 0));
+	} else {
+		put2byte(data + PGHEADER_FREE_OFFSET, 12 + ((npage == 1) ? 100 : 0));
+		put4byte(data + PGHEADER_RIGHTPG_OFFSET, 0); /* reused pages are not blank */
+	}
+	put4byte(data + PGHEADER_NCELLS_OFFSET, 0);
+	put2byte(data + PGHEADER_CELL_OFFSET, bt->pager->page_size);
+
+	error = chidb_Pager_writePage(bt->pager, emptyPage);
+	chidb_Pager_releaseMemPage(bt->pager, emptyPage);
+
+	if (error != CHIDB_OK) {
+		return error;
+	}
+
+	return CHIDB_OK;
+}
+
+
+
+/* Write an in-memory B-Tree node to disk
+ * 
+ * Writes an in-memory B-Tree node to disk. To do this, we need to update
+ * the in-memory page according to the chidb page format. Since the cell
+ * offset array and the cells themselves are modified directly on the
+ * page, the only thing to do is to store the values of "type",
+ * "free_offset", "n_cells", "cells_offset" and "right_page" in the
+ * in-memory page.
+ * 
+ * Parameters
+ * - bt: B-Tree file
+ * - btn: BTreeNode to write to disk
+ * 
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_writeNode(BTree *bt, BTreeNode *btn)
+{
+	int error;
+	uint8_t *data = btn->page->data;
+
+	if (btn->page->npage == 1) {
+		/* The file header may have changed since the node was read (e.g.,
+		 * a page was taken from the free-list to split this node), so
+		 * write the current one back rather than the stale copy. */
+		if (chidb_Pager_readHeader(bt->pager, btn->page->data) != CHIDB_OK)
+			return CHIDB_EIO;
+		data += 100; /* skip file header on the first page */
+	}
+
+	*(data + PGHEADER_PGTYPE_OFFSET) = btn->type;
+	put2byte(data + PGHEADER_FREE_OFFSET, btn->free_offset);
+	if (!ISLEAF(btn->type)) {
+		put4byte(data + PGHEADER_RIGHTPG_OFFSET, btn->right_page);
+	}
+	put2byte(data + PGHEADER_NCELLS_OFFSET, btn->n_cells);
+	put2byte(data+ PGHEADER_CELL_OFFSET, btn->cells_offset);
+	
+	error = chidb_Pager_writePage(bt->pager, btn->page);
+	if (error != CHIDB_OK) {
+		return error;
+	}
+	
+	return CHIDB_OK;
+}
+
+
+/* Read the contents of a cell
+ * 
+ * Reads the contents of a cell from a BTreeNode and stores them in a BTreeCell.
+ * This involves the following:
+ *	1. Find out the offset of the requested cell.
+ *	2. Read the cell from the in-memory page, and parse its
+ *		 contents (refer to The chidb File Format document for
+ *		 the format of cells).
+ *	
+ * Parameters
+ * - btn: BTreeNode where cell is contained
+ * - ncell: Cell number
+ * - cell: BTreeCell where contents must be stored.
+ * 
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ECELLNO: The provided cell number is invalid
+ */
+int chidb_Btree_getCell(BTreeNode *btn, ncell_t ncell, BTreeCell *cell)
+{		
+	if(btn->n_cells <= ncell) 
+		return CHIDB_ECELLNO;
+
+	uint8_t *rawCell =  btn->page->data + get2byte(btn->celloffset_array + 2*ncell);	
+	uint32_t local;
+
+	cell->type = btn->type;
+
+	switch (btn->type) {
+	case PGTYPE_TABLE_INTERNAL:
+		getVarint32(rawCell + TABLEINTCELL_KEY_OFFSET, &(cell->key)); 
+		(cell->fields).tableInternal.child_page = get4byte(rawCell + TABLEINTCELL_CHILD_OFFSET);
+		break;
+	case PGTYPE_TABLE_LEAF:
+	    getVarint32(rawCell + TABLELEAFCELL_KEY_OFFSET, &(cell->key));
+		getVarint32(rawCell + TABLELEAFCELL_SIZE_OFFSET, &((cell->fields).tableLeaf.data_size));
+		(cell->fields).tableLeaf.data = rawCell + TABLELEAFCELL_DATA_OFFSET;
+		local = chidb_Btree_localSize(btn->page_size, (cell->fields).tableLeaf.data_size);
+		(cell->fields).tableLeaf.overflow_page = (local < (cell->fields).tableLeaf.data_size)
+			? get4byte(rawCell + TABLELEAFCELL_DATA_OFFSET + local) : 0;
+		break;
+	case PGTYPE_INDEX_INTERNAL:
+		cell->key = get4byte(rawCell + INDEXINTCELL_KEYIDX_OFFSET);
+		(cell->fields).indexInternal.keyPk = get4byte(rawCell + INDEXINTCELL_KEYPK_OFFSET); 
+		(cell->fields).indexInternal.child_page = get4byte(rawCell + INDEXINTCELL_CHILD_OFFSET); 
+		(cell->fields).indexInternal.extra = NULL;
+		(cell->fields).indexInternal.extra_size = 0;
+		if (INDEXCELL_IS_COVERING(rawCell + INDEXINTCELL_SIZE_OFFSET)) {
+			getVarint32(rawCell + INDEXINTCELL_SIZE_OFFSET, &((cell->fields).indexInternal.extra_size));
+			(cell->fields).indexInternal.extra = rawCell + INDEXINTCELL_EXTRA_OFFSET;
+		}
+		break;
+	case PGTYPE_INDEX_LEAF:
+		cell->key = get4byte(rawCell + INDEXLEAFCELL_KEYIDX_OFFSET); 
+		(cell->fields).indexLeaf.keyPk = get4byte(rawCell + INDEXLEAFCELL_KEYPK_OFFSET); 
+		(cell->fields).indexLeaf.extra = NULL;
+		(cell->fields).indexLeaf.extra_size = 0;
+		if (INDEXCELL_IS_COVERING(rawCell + INDEXLEAFCELL_SIZE_OFFSET)) {
+			getVarint32(rawCell + INDEXLEAFCELL_SIZE_OFFSET, &((cell->fields).indexLeaf.extra_size));
+			(cell->fields).indexLeaf.extra = rawCell + INDEXLEAFCELL_EXTRA_OFFSET;
+		}
+		break;
+	default:
+		break;
+	}
+			
+	return CHIDB_OK;
+}
+
+
+/* Forget a node's key directory, once its cells have changed. The page
+ * is no longer a copy of the cached image, so a directory built from it
+ * must not be handed to the cache (until the page is written) */
+static void chidb_Btree_dropKeys(BTreeNode *btn)
+{
+	chidb_Pager_releaseKeys(btn->page->keys);
+	btn->page->keys = NULL;
+	btn->page->image = 0;
+}
+
+
+/* Find the first cell of a node whose key is not less than a key
+ *
+ * The key of every cell is decoded once per page image into a key
+ * directory (see PageKeys in pager.h), a dense array kept with the page
+ * in the Pager's cache, so that searching a node (any in-memory copy of
+ * it, until the page is written) is a rank of the key among them: all
+ * the keys are compared at once with SIMD instructions, rather than
+ * decoding one cell and branching on its key after the other (see
+ * chidb_Filter_rank). If the directory cannot be allocated, the cells are
+ * searched one by one.
+ *
+ * In a table node, that is the cell with the key, or (in an internal
+ * node) the one whose child holds it. In an index node, it is the first
+ * entry with that KeyIdx (or a greater one), whatever its KeyPk.
+ *
+ * Parameters
+ * - btn: In-memory node
+ * - key: Key to look for
+ *
+ * Return
+ * - Position of the cell, or btn->n_cells if every key is less than key
+ */
+ncell_t chidb_Btree_findSlot(BTreeNode *btn, key_t key)
+{
+	PageKeys *keys = btn->page->keys;
+	BTreeCell btc;
+
+	if (keys == NULL && btn->n_cells > 0) {
+		keys = malloc(sizeof(PageKeys) + btn->n_cells * sizeof(key_t));
+		for (ncell_t i = 0; i < btn->n_cells && keys != NULL; i++) {
+			uint8_t *rawCell = btn->page->data + get2byte(btn->celloffset_array + 2*i);
+			switch (btn->type) {
+			case PGTYPE_TABLE_INTERNAL:
+				getVarint32(rawCell + TABLEINTCELL_KEY_OFFSET, &keys->keys[i]);
+				break;
+			case PGTYPE_TABLE_LEAF:
+				getVarint32(rawCell + TABLELEAFCELL_KEY_OFFSET, &keys->keys[i]);
+				break;
+			case PGTYPE_INDEX_INTERNAL:
+				keys->keys[i] = get4byte(rawCell + INDEXINTCELL_KEYIDX_OFFSET);
+				break;
+			default:
+				keys->keys[i] = get4byte(rawCell + INDEXLEAFCELL_KEYIDX_OFFSET);
+				break;
+			}
+		}
+		if (keys != NULL) {
+			keys->refs = 1;
+			keys->n = btn->n_cells;
+			btn->page->keys = keys;
+		}
+	}
+
+	if (keys != NULL)
+		return chidb_Filter_rank(keys->keys, btn->n_cells, key);
+
+	ncell_t cellPos;
+	for (cellPos = 0; cellPos < btn->n_cells; cellPos++) {
+		chidb_Btree_getCell(btn, cellPos, &btc);
+		if (key <= btc.key) break;
+	}
+	return cellPos;
+}
+
+
+/* Read the data of a table leaf cell
+ *
+ * Copies the part of the data held in the cell, followed by the rest of
+ * it from the cell's overflow pages (if any).
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - btc: Table leaf cell, as returned by chidb_Btree_getCell
+ * - data: Buffer of at least btc->fields.tableLeaf.data_size bytes
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ECORRUPT: The chain of overflow pages ends early
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_getCellData(BTree *bt, BTreeCell *btc, uint8_t *data)
+{
+	return chidb_Btree_getCellDataAt(bt, btc, PAGER_LATEST, data);
+}
+
+
+/* Read the data of a table leaf cell as a snapshot sees it
+ *
+ * Like chidb_Btree_getCellData, for a cell of a node loaded with
+ * chidb_Btree_getNodeAt.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - btc: Table leaf cell, as returned by chidb_Btree_getCell
+ * - snapshot: The snapshot the cell's node was loaded at, or PAGER_LATEST
+ * - data: Buffer of at least btc->fields.tableLeaf.data_size bytes
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ECORRUPT: The chain of overflow pages ends early
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_getCellDataAt(BTree *bt, BTreeCell *btc, uint64_t snapshot, uint8_t *data)
+{
+	uint32_t pageSize = bt->pager->page_size;
+	uint32_t size = btc->fields.tableLeaf.data_size;
+	uint32_t offset = chidb_Btree_localSize(pageSize, size);
+	npage_t npage = btc->fields.tableLeaf.overflow_page;
+	MemPage *page;
+	int error;
+
+	memcpy(data, btc->fields.tableLeaf.data, offset);
+
+	while (offset < size) {
+		if (npage == 0)
+			return CHIDB_ECORRUPT;
+		error = chidb_Pager_readPageAt(bt->pager, npage, snapshot, &page);
+		if (error != CHIDB_OK) return error;
+
+		uint32_t len = size - offset;
+		if (len > pageSize - OVERFLOWPG_DATA_OFFSET)
+			len = pageSize - OVERFLOWPG_DATA_OFFSET;
+		memcpy(data + offset, page->data + OVERFLOWPG_DATA_OFFSET, len);
+		npage = get4byte(page->data + OVERFLOWPG_NEXT_OFFSET);
+		chidb_Pager_releaseMemPage(bt->pager, page);
+		offset += len;
+	}
+
+	return CHIDB_OK;
+}
+
+
+int chidb_Btree_cellSize(BTreeNode *btn, BTreeCell *cell) {
+	int cellSize;
+	uint32_t local;
+
+	/* we assume that cell and btn have the same type */
+	switch(cell->type){	
+	case PGTYPE_TABLE_INTERNAL:
+		cellSize = TABLEINTCELL_SIZE;
+		break;
+	case PGTYPE_TABLE_LEAF:
+		local = chidb_Btree_localSize(btn->page_size, (cell->fields).tableLeaf.data_size);
+		cellSize = TABLELEAFCELL_SIZE_WITHOUTDATA + local;
+		if (local < (cell->fields).tableLeaf.data_size)
+			cellSize += TABLELEAFCELL_OVERFLOW_SIZE;
+		break;
+	case PGTYPE_INDEX_INTERNAL:
+		cellSize = INDEXINTCELL_SIZE + (cell->fields).indexInternal.extra_size;
+		break;
+	case PGTYPE_INDEX_LEAF:
+		cellSize = INDEXLEAFCELL_SIZE + (cell->fields).indexLeaf.extra_size;
+		break;
+	default:
+		break;
+
+	}
+
+	return cellSize;
+}
+
+/* Insert a new cell into a B-Tree node
+ * 
+ * Inserts a new cell into a B-Tree node at a specified position ncell.
+ * This involves the following:
+ *	1. Add the cell at the top of the cell area. This involves "translating"
+ *		 the BTreeCell into the chidb format (refer to The chidb File Format 
+ *		 document for the format of cells).
+ *	2. Modify cells_offset in BTreeNode to reflect the growth in the cell area.
+ *	3. Modify the cell offset array so that all values in positions >= ncell
+ *		 are shifted one position forward in the array. Then, set the value of
+ *		 position ncell to be the offset of the newly added cell.
+ *
+ * This function assumes that there is enough space for this cell in this node.
+ * A table leaf cell too large to be held whole must already have its
+ * overflow pages (see chidb_Btree_insert); only the part of the data
+ * held in the cell is copied.
+ *	
+ * Parameters
+ * - btn: BTreeNode to insert cell in
+ * - ncell: Cell number
+ * - cell: BTreeCell to insert.
+ * 
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ECELLNO: The provided cell number is invalid
+ */
+int chidb_Btree_insertCell(BTreeNode *btn, ncell_t ncell, BTreeCell *cell)
+{
+	if (ncell > btn->n_cells) 
+		return CHIDB_ECELLNO;
+
+	int cellSize = chidb_Btree_cellSize(btn, cell);
+
+	if ((int) (btn->cells_offset - btn->free_offset) < (2 + cellSize)) {
+		/* there's not enough space to add another cell */
+		return CHIDB_ECELLNO;
+	}
+
+	uint8_t *rawCell = btn->page->data + btn->cells_offset - cellSize;
+	uint32_t dataSize, local;
+
+	switch (btn->type){
+	case PGTYPE_TABLE_INTERNAL:
+		putVarint32(rawCell + TABLEINTCELL_KEY_OFFSET, cell->key); 
+		put4byte(rawCell + TABLEINTCELL_CHILD_OFFSET, (cell->fields).tableInternal.child_page);
+		break;
+	case PGTYPE_TABLE_LEAF:
+		putVarint32(rawCell + TABLELEAFCELL_KEY_OFFSET,cell->key);
+		dataSize = (cell->fields).tableLeaf.data_size;
+		putVarint32(rawCell + TABLELEAFCELL_SIZE_OFFSET, dataSize);
+		local = chidb_Btree_localSize(btn->page_size, dataSize);
+		memcpy(rawCell + TABLELEAFCELL_DATA_OFFSET, (cell->fields).tableLeaf.data, local);
+		if (local < dataSize)
+			put4byte(rawCell + TABLELEAFCELL_DATA_OFFSET + local, (cell->fields).tableLeaf.overflow_page);
+		break;
+	case PGTYPE_INDEX_INTERNAL:
+		put4byte(rawCell + INDEXINTCELL_KEYIDX_OFFSET, 	cell->key);
+		put4byte(rawCell + INDEXINTCELL_KEYPK_OFFSET, (cell->fields).indexInternal.keyPk); 
+		put4byte(rawCell + INDEXINTCELL_CHILD_OFFSET, (cell->fields).indexInternal.child_page); 
+		if ((cell->fields).indexInternal.extra != NULL) {
+			putVarint32(rawCell + INDEXINTCELL_SIZE_OFFSET, (cell->fields).indexInternal.extra_size);
+			memcpy(rawCell + INDEXINTCELL_EXTRA_OFFSET, (cell->fields).indexInternal.extra,
+			       (cell->fields).indexInternal.extra_size);
+		} else {
+			put4byte(rawCell + INDEXINTCELL_SIZE_OFFSET, INDEXCELL_PLAIN_HEADER);
+		}
+		break;
+	case PGTYPE_INDEX_LEAF:
+		put4byte(rawCell + INDEXLEAFCELL_KEYIDX_OFFSET, cell->key); 
+		put4byte(rawCell + INDEXLEAFCELL_KEYPK_OFFSET, (cell->fields).indexLeaf.keyPk); 
+		if ((cell->fields).indexLeaf.extra != NULL) {
+			putVarint32(rawCell + INDEXLEAFCELL_SIZE_OFFSET, (cell->fields).indexLeaf.extra_size);
+			memcpy(rawCell + INDEXLEAFCELL_EXTRA_OFFSET, (cell->fields).indexLeaf.extra,
+			       (cell->fields).indexLeaf.extra_size);
+		} else {
+			put4byte(rawCell + INDEXLEAFCELL_SIZE_OFFSET, INDEXCELL_PLAIN_HEADER);
+		}
+		break;
+	default:
+		break;
+	}	
+
+	memmove(btn->celloffset_array + 2*ncell + 2,
+			btn->celloffset_array + 2*ncell,
+			2*(btn->n_cells - ncell));
+
+	put2byte(btn->celloffset_array + 2*ncell, (btn->cells_offset - cellSize));
+
+	btn->free_offset += 2;
+	btn->n_cells += 1;
+	btn->cells_offset -= cellSize;
+	chidb_Btree_dropKeys(btn);
+
+	return CHIDB_OK;
+}
+
+
+/* Count the entries in a table B-Tree
+ * 
+ * Walks the B-Tree from its root and adds up the n_cells field of every
+ * leaf node. Leaf cells are never decoded; only the child pointers of
+ * internal nodes are followed.
+ * 
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree
+ * - count: Out-parameter where the number of entries is stored
+ * 
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ECORRUPT: A node in the B-Tree is not a table node
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_countEntries(BTree *bt, npage_t nroot, uint32_t *count)
+{
+	return chidb_Btree_countEntriesAt(bt, nroot, PAGER_LATEST, count);
+}
+
+
+/* Count the entries of a table B-Tree as a snapshot sees it
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree
+ * - snapshot: An open snapshot, or PAGER_LATEST
+ * - count: Out-parameter where the number of entries is stored
+ *
+ * Return
+ * - As chidb_Btree_countEntries
+ */
+int chidb_Btree_countEntriesAt(BTree *bt, npage_t nroot, uint64_t snapshot, uint32_t *count)
+{
+	BTreeNode *btn;
+	BTreeCell btc;
+	uint32_t subtree;
+	int error;
+
+	error = chidb_Btree_getNodeAt(bt, nroot, snapshot, &btn);
+	if (error != CHIDB_OK) return error;
+
+	if (btn->type == PGTYPE_TABLE_LEAF) {
+		*count = btn->n_cells;
+		chidb_Btree_freeMemNode(bt, btn);
+		return CHIDB_OK;
+	}
+
+	if (btn->type != PGTYPE_TABLE_INTERNAL) {
+		chidb_Btree_freeMemNode(bt, btn);
+		return CHIDB_ECORRUPT;
+	}
+
+	/* right page first, then the left child of every cell */
+	error = chidb_Btree_countEntriesAt(bt, btn->right_page, snapshot, count);
+	for (ncell_t i = 0; i < btn->n_cells && error == CHIDB_OK; i++) {
+		chidb_Btree_getCell(btn, i, &btc);
+		error = chidb_Btree_countEntriesAt(bt, btc.fields.tableInternal.child_page, snapshot, &subtree);
+		if (error != CHIDB_OK) break;
+		*count += subtree;
+	}
+
+	chidb_Btree_freeMemNode(bt, btn);
+	return error;
+}
+
+
+/* Find an entry in a table B-Tree
+ * 
+ * Finds the data associated for a given key in a table B-Tree
+ * 
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree we want search in
+ * - key: Entry key
+ * - data: Out-parameter where a copy of the data must be stored
+ * - size: Number of bytes of data
+ * 
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: No entry with the given key was found
+ * - CHIDB_ECORRUPT: The entry's chain of overflow pages ends early
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_find(BTree *bt, npage_t nroot, key_t key, 
+		     uint8_t **data, uint32_t *size) {
+	BTreeNode *btn;
+	BTreeCell btc;
+	int cellPos, ncells, error;
+	uint32_t nextPage;
+
+	error = chidb_Btree_getNodeByPage(bt, nroot, &btn);
+	if (error != CHIDB_OK) return error;
+
+	if (btn->type == PGTYPE_TABLE_INTERNAL || btn->type == PGTYPE_TABLE_LEAF) {
+		while (btn->type == PGTYPE_TABLE_INTERNAL) {
+			/* look through keys */
+			ncells = btn->n_cells;
+			for (cellPos = chidb_Btree_findSlot(btn, key); cellPos < ncells; cellPos++) {
+				chidb_Btree_getCell(btn, cellPos, &btc);
+				if (key <= btc.key) {
+					/* look at left child of this key */
+					chidb_Btree_freeMemNode(bt, btn);
+					error = chidb_Btree_getNodeByPage(bt, btc.fields.tableInternal.child_page, &btn);
+					if (error != CHIDB_OK) return error;
+					break;
+				}
+			}
+			if (cellPos == ncells) {
+				/* look at rightmost child */
+				nextPage = btn->right_page;
+				chidb_Btree_freeMemNode(bt, btn);
+				error = chidb_Btree_getNodeByPage(bt, nextPage, &btn);
+				if (error != CHIDB_OK) return error;
+			}
+		}
+
+		/* search for key in this leaf */
+		for (cellPos = chidb_Btree_findSlot(btn, key); cellPos < btn->n_cells; cellPos++) {
+			chidb_Btree_getCell(btn, cellPos, &btc);
+			if (key == btc.key) {
+				*data = (uint8_t *) malloc(btc.fields.tableLeaf.data_size);
+				if (*data == NULL) {
+					chidb_Btree_freeMemNode(bt, btn);
+					return CHIDB_ENOMEM;
+				}
+				error = chidb_Btree_getCellData(bt, &btc, *data);
+				chidb_Btree_freeMemNode(bt, btn);
+				if (error != CHIDB_OK) {
+					free(*data);
+					return error;
+				}
+				*size = btc.fields.tableLeaf.data_size;
+				return CHIDB_OK;
+			}
+		}
+	} else {
+		while (true) {
+			/* look through keys */
+			ncells = btn->n_cells;
+			for (cellPos = chidb_Btree_findSlot(btn, key); cellPos < ncells; cellPos++) {
+				chidb_Btree_getCell(btn, cellPos, &btc);
+				if (key < btc.key) {
+					/* look at left child of this key */
+					chidb_Btree_freeMemNode(bt, btn);
+					error = chidb_Btree_getNodeByPage(bt, btc.fields.indexInternal.child_page, &btn);
+					if (error != CHIDB_OK) return error;
+					break;
+				} else if (key == btc.key) {
+					*data = (uint8_t *) malloc(sizeof(key_t));
+					if (*data == NULL) {
+						chidb_Btree_freeMemNode(bt, btn);
+						return CHIDB_ENOMEM;
+					}
+					if (ISLEAF(btc.type))
+						memcpy(data, &(btc.fields.indexLeaf.keyPk), sizeof(key_t));
+					else
+						memcpy(data, &(btc.fields.indexInternal.keyPk), sizeof(key_t));
+					*size = sizeof(key_t);
+					return CHIDB_OK;
+				}
+			}
+			if (cellPos == ncells) {
+				if (ISLEAF(btn->type)) {
+					/* can't find the key*/
+					return CHIDB_ENOTFOUND;
+				} else {
+					/* look at rightmost child */
+					nextPage = btn->right_page;
+					chidb_Btree_freeMemNode(bt, btn);
+					error = chidb_Btree_getNodeByPage(bt, nextPage, &btn);
+					if (error != CHIDB_OK) return error;
+				}
+			}
+		}
+	}
+	return CHIDB_ENOTFOUND;
+}
+
+
+	
+/* Insert an entry into a table B-Tree
+ *
+ * This is a convenience function that wraps around chidb_Btree_insert.
+ * It takes a key and data, and creates a BTreeCell that can be passed
+ * along to chidb_Btree_insert.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree we want to insert
+ *					this entry in.
+ * - key: Entry key
+ * - data: Pointer to data we want to insert
+ * - size: Number of bytes of data
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EDUPLICATE: An entry with that key already exists
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_insertInTable(BTree *bt, npage_t nroot, key_t key, 
+			      uint8_t *data, uint32_t size)
+{
+	BTreeCell btc;
+
+	btc.type = PGTYPE_TABLE_LEAF;
+	btc.key = key;
+	btc.fields.tableLeaf.data = data;
+	btc.fields.tableLeaf.data_size = size;
+
+	return chidb_Btree_insert(bt, nroot, &btc);
+}
+
+
+/* Insert an entry into an index B-Tree
+ *
+ * This is a convenience function that wraps around chidb_Btree_insert.
+ * It takes a KeyIdx and a KeyPk, and creates a BTreeCell that can be passed
+ * along to chidb_Btree_insert.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree we want to insert
+ *					this entry in.
+ * - keyIdx: See The chidb File Format.
+ * - keyPk: See The chidb File Format.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EDUPLICATE: An entry with that key already exists
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_insertInIndex(BTree *bt, npage_t nroot, key_t keyIdx, key_t keyPk)
+{
+	BTreeCell btc;
+
+	btc.type = PGTYPE_INDEX_LEAF;
+	btc.key = keyIdx;
+	btc.fields.indexLeaf.keyPk = keyPk;
+	btc.fields.indexLeaf.extra = NULL;
+	btc.fields.indexLeaf.extra_size = 0;
+
+	return chidb_Btree_insert(bt, nroot, &btc);
+}
+
+
+/* Insert an entry into a covering index B-Tree
+ *
+ * Like chidb_Btree_insertInIndex, but the entry also holds a database
+ * record with the other columns of the index (the rest of its key
+ * columns, then its included columns), so that queries on them can be
+ * answered from the index alone. Since the first column of a multi-column
+ * index needs not be unique, entries of covering indexes are ordered by
+ * KeyIdx and then by KeyPk.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree we want to insert
+ *					this entry in.
+ * - keyIdx: See The chidb File Format.
+ * - keyPk: See The chidb File Format.
+ * - record: Database record with the other columns
+ * - size: Number of bytes of the record
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EDUPLICATE: An entry with that KeyIdx and KeyPk already exists
+ * - CHIDB_ECONSTRAINT: The record is larger than INDEXCELL_MAX_EXTRA bytes
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_insertInCoveringIndex(BTree *bt, npage_t nroot, key_t keyIdx, key_t keyPk,
+				      uint8_t *record, uint32_t size)
+{
+	BTreeCell btc;
+
+	if (size > INDEXCELL_MAX_EXTRA(bt->pager->page_size))
+		return CHIDB_ECONSTRAINT;
+
+	btc.type = PGTYPE_INDEX_LEAF;
+	btc.key = keyIdx;
+	btc.fields.indexLeaf.keyPk = keyPk;
+	btc.fields.indexLeaf.extra = record;
+	btc.fields.indexLeaf.extra_size = size;
+
+	return chidb_Btree_insert(bt, nroot, &btc);
+}
+
+
+/* Fill one level of an index B-Tree built bottom-up
+ *
+ * The entries are put in new nodes, from left to right, and each node is
+ * written once it is full. An entry that does not fit in a full node is
+ * added to the level above instead, as the separator between that node
+ * and the next one; except for the very last entry, which goes in the
+ * next node, the last entry of the full node going up in its place, so
+ * that no node is left empty.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - in: Entries of the level, sorted. The entries of internal nodes have
+ *       their left child in the child field.
+ * - leaf: True for the leaves, false for internal nodes
+ * - right: Right page of the last internal node (the last node of the
+ *          level below)
+ * - out: Sorter for the entries of the level above
+ * - last: Out parameter. Returns the last node of the level.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EDUPLICATE: Two entries of a plain index have the same KeyIdx
+ * - CHIDB_ECONSTRAINT: A record is larger than INDEXCELL_MAX_EXTRA bytes
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the files
+ */
+static int chidb_Btree_bulkLoadLevel(BTree *bt, Sorter *in, bool leaf, npage_t right,
+				     Sorter *out, npage_t *last)
+{
+	int rc;
+	uint8_t type = leaf ? PGTYPE_INDEX_LEAF : PGTYPE_INDEX_INTERNAL;
+	uint64_t nentry = 0;
+	npage_t npage;
+	BTreeNode *node;
+	BTreeCell btc, up;
+	SorterEntry *e;
+	key_t prevIdx = 0;
+
+	rc = chidb_Btree_newNode(bt, &npage, type);
+	if (rc == CHIDB_OK)
+		rc = chidb_Btree_getNodeByPage(bt, npage, &node);
+	if (rc != CHIDB_OK)
+		return rc;
+
+	while ((rc = chidb_Sorter_next(in, &e)) == CHIDB_ROW)
+	{
+		if (e->size > INDEXCELL_MAX_EXTRA(bt->pager->page_size))
+		{
+			rc = CHIDB_ECONSTRAINT;
+			break;
+		}
+		/* plain entries are unique on KeyIdx (see chidb_Btree_compareKeys) */
+		if (leaf && e->size == 0 && nentry > 0 && e->keyIdx == prevIdx)
+		{
+			rc = CHIDB_EDUPLICATE;
+			break;
+		}
+		prevIdx = e->keyIdx;
+
+		btc.type = type;
+		btc.key = e->keyIdx;
+		if (leaf)
+		{
+			btc.fields.indexLeaf.keyPk = e->keyPk;
+			btc.fields.indexLeaf.extra = e->extra;
+			btc.fields.indexLeaf.extra_size = e->size;
+		}
+		else
+		{
+			btc.fields.indexInternal.keyPk = e->keyPk;
+			btc.fields.indexInternal.child_page = e->child;
+			btc.fields.indexInternal.extra = e->extra;
+			btc.fields.indexInternal.extra_size = e->size;
+		}
+
+		if ((int) (node->cells_offset - node->free_offset) >= 2 + chidb_Btree_cellSize(node, &btc))
+		{
+			chidb_Btree_insertCell(node, node->n_cells, &btc);
+			nentry++;
+			continue;
+		}
+
+		if (nentry == in->count - 1)
+		{
+			/* the last entry: the last one of the node goes up */
+			chidb_Btree_getCell(node, node->n_cells - 1, &up);
+			if (leaf)
+				rc = chidb_Sorter_add(out, up.key, up.fields.indexLeaf.keyPk, npage,
+						      up.fields.indexLeaf.extra, up.fields.indexLeaf.extra_size);
+			else
+			{
+				node->right_page = up.fields.indexInternal.child_page;
+				rc = chidb_Sorter_add(out, up.key, up.fields.indexInternal.keyPk, npage,
+						      up.fields.indexInternal.extra, up.fields.indexInternal.extra_size);
+			}
+			if (rc == CHIDB_OK)
+				rc = chidb_Btree_removeCell(node, node->n_cells - 1);
+		}
+		else
+		{
+			if (!leaf)
+				node->right_page = e->child;
+			rc = chidb_Sorter_add(out, e->keyIdx, e->keyPk, npage, e->extra, e->size);
+		}
+
+		if (rc == CHIDB_OK)
+			rc = chidb_Btree_writeNode(bt, node);
+		chidb_Btree_freeMemNode(bt, node);
+		if (rc == CHIDB_OK)
+			rc = chidb_Btree_newNode(bt, &npage, type);
+		if (rc == CHIDB_OK)
+			rc = chidb_Btree_getNodeByPage(bt, npage, &node);
+		if (rc != CHIDB_OK)
+			return rc;
+
+		if (nentry == in->count - 1)
+			chidb_Btree_insertCell(node, 0, &btc);
+		nentry++;
+	}
+
+	if (rc == CHIDB_DONE)
+	{
+		if (!leaf)
+			node->right_page = right;
+		rc = chidb_Btree_writeNode(bt, node);
+		*last = npage;
+	}
+	chidb_Btree_freeMemNode(bt, node);
+
+	return rc;
+}
+
+
+/* Build an index B-Tree bottom-up from its entries
+ *
+ * Inserting the entries of a new index one by one goes from the root to
+ * a leaf each time, writes pages all over the file, and leaves nodes half
+ * full after they split. Instead, the entries are sorted first (see
+ * sorter.c) and packed into full leaves, from left to right, in new pages
+ * (see chidb_Btree_bulkLoadLevel). The entries between the leaves make up
+ * the level above, which is built in the same way, and so on until a
+ * level fits in a single node, which is then copied to the root page.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Root page of an empty index B-Tree
+ * - sorter: Entries of the index, sorted (see chidb_Sorter_sort). Entries
+ *           with a record are those of a covering index; a plain index
+ *           cannot have two entries with the same KeyIdx.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EDUPLICATE: Two entries of a plain index have the same KeyIdx
+ * - CHIDB_ECONSTRAINT: A record is larger than INDEXCELL_MAX_EXTRA bytes
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the files
+ */
+int chidb_Btree_bulkLoadIndex(BTree *bt, npage_t nroot, Sorter *sorter)
+{
+	int rc = CHIDB_OK;
+	Sorter levels[2];
+	Sorter *in = sorter, *out;
+	npage_t last = 0;
+	MemPage *top, *root;
+
+	if (sorter->count == 0)
+		return CHIDB_OK;
+
+	for (int level = 0; ; level++)
+	{
+		out = &levels[level % 2];
+		chidb_Sorter_init(out, sorter->memory, sorter->nthreads);
+		rc = chidb_Btree_bulkLoadLevel(bt, in, level == 0, last, out, &last);
+		if (in != sorter)
+			chidb_Sorter_close(in);
+		if (rc == CHIDB_OK && out->count > 0)
+			rc = chidb_Sorter_sort(out);
+		if (rc != CHIDB_OK || out->count == 0)
+		{
+			chidb_Sorter_close(out);
+			break;
+		}
+		in = out;
+	}
+	if (rc != CHIDB_OK)
+		return rc;
+
+	/* the single node of the top level becomes the root */
+	rc = chidb_Pager_readPage(bt->pager, last, &top);
+	if (rc != CHIDB_OK)
+		return rc;
+	rc = chidb_Pager_readPage(bt->pager, nroot, &root);
+	if (rc == CHIDB_OK)
+	{
+		memcpy(root->data, top->data, bt->pager->page_size);
+		rc = chidb_Pager_writePage(bt->pager, root);
+		chidb_Pager_releaseMemPage(bt->pager, root);
+	}
+	chidb_Pager_releaseMemPage(bt->pager, top);
+	if (rc != CHIDB_OK)
+		return rc;
+
+	return chidb_Btree_freePage(bt, last);
+}
+
+
+/* Compare the key of a new entry with that of a cell in a node
+ *
+ * Entries of covering indexes are ordered by KeyIdx and then by KeyPk
+ * (see chidb_Btree_insertInCoveringIndex); all others by their key alone.
+ *
+ * Return
+ * - Less than, equal to, or greater than 0 if the new entry goes before,
+ *   at the same place as, or after the cell
+ */
+static int chidb_Btree_compareKeys(BTreeCell *newCell, BTreeCell *btc)
+{
+	if (newCell->key != btc->key)
+		return (newCell->key < btc->key) ? -1 : 1;
+
+	if (newCell->type == PGTYPE_INDEX_LEAF && newCell->fields.indexLeaf.extra != NULL) {
+		key_t keyPk = ISLEAF(btc->type)
+			? btc->fields.indexLeaf.keyPk
+			: btc->fields.indexInternal.keyPk;
+		if (newCell->fields.indexLeaf.keyPk != keyPk)
+			return (newCell->fields.indexLeaf.keyPk < keyPk) ? -1 : 1;
+	}
+	return 0;
+}
+
+
+/* Space a node needs for a new entry to go into its subtree without
+ * splitting it
+ *
+ * Entries of covering indexes vary in size, and the median entry of any
+ * child split on the way down moves up into the node, so room is kept
+ * for the largest one.
+ */
+static int chidb_Btree_insertSize(BTreeNode *btn, BTreeCell *btc)
+{
+	if (btc->type == PGTYPE_INDEX_LEAF && btc->fields.indexLeaf.extra != NULL)
+		return INDEXINTCELL_SIZE + INDEXCELL_MAX_EXTRA(btn->page_size);
+	return chidb_Btree_cellSize(btn, btc);
+}
+
+
+/* Insert a BTreeCell into a B-Tree
+ *
+ * The chidb_Btree_insert and chidb_Btree_insertNonFull functions
+ * are responsible for inserting new entries into a B-Tree, although
+ * chidb_Btree_insertNonFull is the one that actually does the
+ * insertion. chidb_Btree_insert, however, first checks if the root
+ * has to be split (a splitting operation that is different from
+ * splitting any other node). If so, chidb_Btree_split is called
+ * before calling chidb_Btree_insertNonFull.
+ *
+ * The data of a table leaf cell that is too large to be held whole in
+ * the cell is first written to overflow pages (the overflow_page field
+ * of btc is set accordingly).
+ *
+ * Several threads may insert into the same B-Tree at once (and into
+ * different B-Trees of the file), but nothing else may change or read
+ * the file in the meantime, and the schema B-Tree (whose root is page 1,
+ * which also holds the free-list) must not be inserted into alongside
+ * anything else. The root is latched first; see chidb_Btree_insertNonFull
+ * for how latches are handed down.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree we want to insert
+ *					this cell in.
+ * - btc: BTreeCell to insert into B-Tree
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EDUPLICATE: An entry with that key already exists
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_insert(BTree *bt, npage_t nroot, BTreeCell *btc)
+{
+	int error, newPageRight, newPageLeft, headerOffset;
+	BTreeNode *root, *newNodeRight;
+
+	/* data that does not fit in a table leaf cell goes to overflow pages
+	 * first, the cell only points to them */
+	if (btc->type == PGTYPE_TABLE_LEAF) {
+		error = chidb_Btree_writeOverflow(bt, btc);
+		if (error != CHIDB_OK) return error;
+	}
+
+	error = chidb_Btree_latch(bt, nroot, true);
+	if (error != CHIDB_OK) return error;
+	error = chidb_Btree_getNodeByPage(bt, nroot, &root);
+	if (error != CHIDB_OK) {
+		chidb_Btree_unlatch(bt, nroot);
+		return error;
+	}
+
+	int cellSize = chidb_Btree_insertSize(root, btc);
+	
+	/* if the root is full, split it */
+	if ((int) (root->cells_offset - root->free_offset) < (2 + cellSize)) {
+		headerOffset = (nroot == 1) ? 100 : 0;
+		/* first, make a new empty page and copy the root to it */
+		chidb_Btree_newNode(bt, &newPageRight, root->type);
+		chidb_Btree_getNodeByPage(bt, newPageRight, &newNodeRight);
+		memcpy(newNodeRight->page->data,
+			   root->page->data + headerOffset,
+			   bt->pager->page_size - headerOffset);
+		newNodeRight->type = root->type;
+		newNodeRight->free_offset = root->free_offset - headerOffset;
+		newNodeRight->n_cells = root->n_cells;
+		chidb_Btree_dropKeys(newNodeRight);
+		newNodeRight->cells_offset = root->cells_offset;
+		newNodeRight->right_page = root->right_page;
+		memmove(newNodeRight->page->data + newNodeRight->cells_offset,
+				newNodeRight->page->data + newNodeRight->cells_offset - headerOffset,
+				bt->pager->page_size - newNodeRight->cells_offset);
+		chidb_Btree_writeNode(bt, newNodeRight);
+		
+		/* empty the current root */
+		if (root->type == PGTYPE_TABLE_LEAF) root->type = PGTYPE_TABLE_INTERNAL;
+		if (root->type == PGTYPE_INDEX_LEAF) root->type = PGTYPE_INDEX_INTERNAL;
+
+		root->free_offset = headerOffset + INTPG_CELLSOFFSET_OFFSET;
+		root->n_cells = 0;
+		root->cells_offset = bt->pager->page_size;
+		chidb_Btree_dropKeys(root);
+		root->right_page = newPageRight;
+		memset(root->page->data + headerOffset, 0, bt->pager->page_size - headerOffset);
+		chidb_Btree_writeNode(bt, root);
+
+		/* split the new right child, which contains the old root data */
+		chidb_Btree_split(bt, nroot, newPageRight, 0, &newPageLeft);
+		
+		chidb_Btree_getNodeByPage(bt, nroot, &root);
+		chidb_Btree_getNodeByPage(bt, newPageRight, &newNodeRight);
+		BTreeNode *newNodeLeft;
+		chidb_Btree_getNodeByPage(bt, newPageLeft, &newNodeLeft);
+
+		chidb_Btree_freeMemNode(bt, root);
+		chidb_Btree_freeMemNode(bt, newNodeRight);
+		chidb_Btree_freeMemNode(bt, newNodeLeft);
+	} else {
+		chidb_Btree_freeMemNode(bt, root);
+	}
+	/* the root is not full any more; insertNonFull lets go of its latch */
+	error = chidb_Btree_insertNonFull(bt, nroot, btc);
+
+	if (error != CHIDB_OK && btc->type == PGTYPE_TABLE_LEAF)
+		chidb_Btree_freeOverflow(bt, btc->fields.tableLeaf.overflow_page);
+	return error;
+}
+
+/* Insert a BTreeCell into a non-full B-Tree node
+ *
+ * chidb_Btree_insertNonFull inserts a BTreeCell into a node that is
+ * assumed not to be full (i.e., does not require splitting). If the
+ * node is a leaf node, the cell is directly added in the appropriate
+ * position according to its key. If the node is an internal node, the
+ * function will determine what child node it must insert it in, and
+ * calls itself recursively on that child node. However, before doing so
+ * it will check if the child node is full or not. If it is, then it will
+ * have to be split first.
+ *
+ * The caller must hold an exclusive latch on the node, which is let go
+ * of before returning. The child is latched before that, and once it is
+ * known not to split (it is not full, or has just been split), nothing
+ * above it will change any more, so the node's latch is let go of right
+ * away: an insertion never holds more than two latches at a time.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree we want to insert
+ *					this cell in.
+ * - btc: BTreeCell to insert into B-Tree
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EDUPLICATE: An entry with that key already exists
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_insertNonFull(BTree *bt, npage_t npage, BTreeCell *newCell)
+{
+	int error, cellPos, cellSize;
+	BTreeNode *btn, *childNode;
+	BTreeCell btc;
+	npage_t childPage, newChild;
+	error = chidb_Btree_getNodeByPage(bt, npage, &btn);
+	if (error != CHIDB_OK) {
+		chidb_Btree_unlatch(bt, npage);
+		return error;
+	}
+
+	cellSize = chidb_Btree_insertSize(btn, newCell);
+
+	/* cells before the slot of the new key sort before the new cell */
+	for (cellPos = chidb_Btree_findSlot(btn, newCell->key); cellPos < btn->n_cells; cellPos++) {
+		chidb_Btree_getCell(btn, cellPos, &btc);
+		int cmp = chidb_Btree_compareKeys(newCell, &btc);
+		if (cmp < 0) {
+			break;
+		} else if (cmp == 0) {
+			/* keys in table internal nodes are only separators (the
+			 * entry itself may have been deleted) */
+			if (btn->type == PGTYPE_TABLE_INTERNAL) break;
+			chidb_Btree_freeMemNode(bt, btn);
+			chidb_Btree_unlatch(bt, npage);
+			return CHIDB_EDUPLICATE;
+		}
+	}
+
+	/* if this is a leaf, put it here */
+	if (ISLEAF(btn->type)) {
+		error = chidb_Btree_insertCell(btn, cellPos, newCell);
+		chidb_Btree_writeNode(bt, btn);
+		chidb_Btree_freeMemNode(bt, btn);
+		chidb_Btree_unlatch(bt, npage);
+		return error;
+	} else {
+		if (cellPos < btn->n_cells) {
+			childPage = (btc.type == PGTYPE_INDEX_INTERNAL)
+				? btc.fields.indexInternal.child_page
+				: btc.fields.tableInternal.child_page;
+		} else {
+			childPage = btn->right_page;
+		}
+		error = chidb_Btree_latch(bt, childPage, true);
+		if (error != CHIDB_OK) {
+			chidb_Btree_freeMemNode(bt, btn);
+			chidb_Btree_unlatch(bt, npage);
+			return error;
+		}
+		chidb_Btree_getNodeByPage(bt, childPage, &childNode);
+
+		if ((int) (childNode->cells_offset - childNode->free_offset) < (2 + cellSize)) {
+			/* if child is full, split it */
+			chidb_Btree_split(bt, npage, childPage, cellPos, &newChild);
+			chidb_Btree_freeMemNode(bt, btn);
+			chidb_Btree_getNodeByPage(bt, npage, &btn);
+			chidb_Btree_getCell(btn, cellPos, &btc);
+			int cmp = chidb_Btree_compareKeys(newCell, &btc);
+			if (cmp == 0 && btn->type == PGTYPE_INDEX_INTERNAL) {
+				/* the entry that moved up is the one being inserted */
+				error = CHIDB_EDUPLICATE;
+				chidb_Btree_unlatch(bt, childPage);
+			} else if (cmp <= 0) {
+				/* nobody else can get to the new child before
+				 * this node is let go of */
+				error = chidb_Btree_latch(bt, newChild, true);
+				chidb_Btree_unlatch(bt, childPage);
+				childPage = newChild;
+			}
+		}
+		chidb_Btree_freeMemNode(bt, childNode);
+		chidb_Btree_freeMemNode(bt, btn);
+		chidb_Btree_unlatch(bt, npage);
+		if (error != CHIDB_OK) return error;
+
+		return chidb_Btree_insertNonFull(bt, childPage, newCell);
+	}
+
+	return CHIDB_OK;
+}
+
+
+/* Split a B-Tree node
+ *
+ * Splits a B-Tree node N. This involves the following:
+ * - Find the median cell in N (the one that halves the bytes its
+ *	 cells use).
+ * - Create a new B-Tree node M.
+ * - Move the cells before the median cell to M (if the
+ *	 cell is a table leaf cell, the median cell is moved too)
+ * - Add a cell to the parent (which, by definition, will be an
+ *	 internal page) with the median key and the page number of M.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - npage_parent: Page number of the parent node
+ * - npage_child: Page number of the node to split
+ * - parent_ncell: Position in the parent where the new cell will
+ *								 be inserted.
+ * - npage_child2: Out parameter. Used to return the page of the new child node.
+ * - btc: BTreeCell to insert into B-Tree
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_split(BTree *bt, npage_t npage_parent, npage_t npage_child, 
+		      ncell_t parent_ncell, npage_t *npage_child2)
+{
+	BTreeNode *parentNode, *childNode, *newChildNode;
+	BTreeCell medianCell, cell;
+	int cellPos, cellSize, medianIdx, medianKeyPk, moveIdx;
+	uint32_t offset, largestOffset, newCellsOffset, medianExtraSize, usedSize;
+	uint8_t *medianExtra;
+	npage_t medianChild;
+
+	chidb_Btree_getNodeByPage(bt, npage_parent, &parentNode);
+	chidb_Btree_getNodeByPage(bt, npage_child, &childNode);
+
+	/* create new node */
+	chidb_Btree_newNode(bt, npage_child2, childNode->type);
+	chidb_Btree_getNodeByPage(bt, *npage_child2, &newChildNode);
+
+	/* find the median cell and bump it up. Cells vary in size, so the
+	 * median halves the bytes used rather than the number of cells: as
+	 * no cell takes more than a quarter of a page, both halves then have
+	 * room for the cell being inserted, whichever one it goes to */
+	usedSize = 0;
+	for (cellPos = 0; cellPos < childNode->n_cells; cellPos++) {
+		chidb_Btree_getCell(childNode, cellPos, &cell);
+		usedSize += chidb_Btree_cellSize(childNode, &cell) + 2;
+	}
+	medianIdx = 0;
+	for (offset = 0; medianIdx < childNode->n_cells - 2; medianIdx++) {
+		chidb_Btree_getCell(childNode, medianIdx, &cell);
+		offset += chidb_Btree_cellSize(childNode, &cell) + 2;
+		if (2 * offset >= usedSize) break;
+	}
+	if (medianIdx == 0) medianIdx = 1;
+	chidb_Btree_getCell(childNode, medianIdx, &medianCell);
+	medianKeyPk = (ISLEAF(medianCell.type)) 
+		? medianCell.fields.indexLeaf.keyPk
+		: medianCell.fields.indexInternal.keyPk;
+	medianExtra = (ISLEAF(medianCell.type))
+		? medianCell.fields.indexLeaf.extra
+		: medianCell.fields.indexInternal.extra;
+	medianExtraSize = (ISLEAF(medianCell.type))
+		? medianCell.fields.indexLeaf.extra_size
+		: medianCell.fields.indexInternal.extra_size;
+	
+
+	if (parentNode->type == PGTYPE_INDEX_INTERNAL) {
+		medianChild = medianCell.fields.indexInternal.child_page;
+
+		medianCell.type = PGTYPE_INDEX_INTERNAL;
+		medianCell.fields.indexInternal.child_page = *npage_child2;
+		medianCell.fields.indexInternal.keyPk = medianKeyPk;
+		medianCell.fields.indexInternal.extra = medianExtra;
+		medianCell.fields.indexInternal.extra_size = medianExtraSize;
+	} else {
+		medianChild = medianCell.fields.tableInternal.child_page;
+
+		medianCell.type = PGTYPE_TABLE_INTERNAL;
+		medianCell.fields.tableInternal.child_page = *npage_child2;
+	}
+
+	chidb_Btree_insertCell(parentNode, parent_ncell, &medianCell);
+
+	/* move cells before the median to the new node */
+	for (cellPos = 0; cellPos < medianIdx; cellPos++) {
+		chidb_Btree_getCell(childNode, cellPos, &cell);
+		chidb_Btree_insertCell(newChildNode, cellPos, &cell);
+	}
+	/* table leaves keep the median entry; in internal nodes its child
+	 * becomes the right page of the new node instead */
+	if (childNode->type == PGTYPE_TABLE_LEAF) {
+		chidb_Btree_getCell(childNode, medianIdx, &cell);
+		chidb_Btree_insertCell(newChildNode, medianIdx, &cell);
+	}
+	newChildNode->right_page = medianChild;
+
+	/* shift the cell offset array up */
+	childNode->n_cells -= medianIdx + 1;
+	chidb_Btree_dropKeys(childNode);
+	memmove(childNode->celloffset_array,
+			childNode->celloffset_array + 2*(medianIdx + 1), 2*childNode->n_cells);
+	childNode->free_offset -= 2*(medianIdx + 1);
+
+	/* defragment the remaining cells in original child */
+	newCellsOffset = bt->pager->page_size;
+	for (int i = 0; i < childNode->n_cells; i++) {
+		largestOffset = 0;
+		for (cellPos = 0; cellPos < childNode->n_cells; cellPos++) {
+			chidb_Btree_getCell(childNode, cellPos, &cell);
+			offset = get2byte(childNode->celloffset_array + 2*cellPos);
+			if (offset > largestOffset && offset < newCellsOffset) {
+				largestOffset = offset;
+				moveIdx = cellPos;
+			}
+		}
+		chidb_Btree_getCell(childNode, moveIdx, &cell);
+		cellSize = chidb_Btree_cellSize(childNode, &cell);
+		newCellsOffset -= cellSize;
+		childNode->cells_offset = newCellsOffset;
+		memmove(childNode->page->data + newCellsOffset, 
+				childNode->page->data + largestOffset, cellSize);
+		/* update cell offset array */
+		put2byte(childNode->celloffset_array + 2*moveIdx, newCellsOffset);
+	}
+
+	chidb_Btree_writeNode(bt, parentNode);
+	chidb_Btree_writeNode(bt, childNode);
+	chidb_Btree_writeNode(bt, newChildNode);
+
+	chidb_Btree_freeMemNode(bt, parentNode);
+	chidb_Btree_freeMemNode(bt, childNode);
+	chidb_Btree_freeMemNode(bt, newChildNode);
+
+	return CHIDB_OK;
+}
+
+/* Remove a cell from a B-Tree node
+ *
+ * The space used by the cell is reclaimed right away: the cells above it
+ * in the cell area are moved down, so that the free space of the node
+ * stays in one piece (chidb_Btree_insertCell only allocates from the top
+ * of the cell area).
+ *
+ * Parameters
+ * - btn: BTreeNode to remove the cell from
+ * - ncell: Cell number
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ECELLNO: The provided cell number is invalid
+ */
+int chidb_Btree_removeCell(BTreeNode *btn, ncell_t ncell)
+{
+	BTreeCell cell;
+	uint32_t offset, cellOffset;
+	int cellSize;
+
+	if (ncell >= btn->n_cells)
+		return CHIDB_ECELLNO;
+
+	chidb_Btree_getCell(btn, ncell, &cell);
+	cellSize = chidb_Btree_cellSize(btn, &cell);
+	cellOffset = get2byte(btn->celloffset_array + 2*ncell);
+
+	/* close the gap in the cell area */
+	memmove(btn->page->data + btn->cells_offset + cellSize,
+			btn->page->data + btn->cells_offset,
+			cellOffset - btn->cells_offset);
+	for (ncell_t i = 0; i < btn->n_cells; i++) {
+		offset = get2byte(btn->celloffset_array + 2*i);
+		if (offset < cellOffset)
+			put2byte(btn->celloffset_array + 2*i, offset + cellSize);
+	}
+
+	memmove(btn->celloffset_array + 2*ncell,
+			btn->celloffset_array + 2*ncell + 2,
+			2*(btn->n_cells - ncell - 1));
+
+	btn->free_offset -= 2;
+	btn->n_cells -= 1;
+	btn->cells_offset += cellSize;
+	chidb_Btree_dropKeys(btn);
 
 	return CHIDB_OK;
 }
 
 
-/* Find an entry in a table B-Tree
- * 
- * Finds the data associated for a given key in a table B-Tree
- * 
- * Parameters
- * - bt: B-Tree file
- * - nroot: Page number of the root node of the B-Tree we want search in
- * - key: Entry key
- * - data: Out-parameter where a copy of the data must be stored
- * - size: Number of bytes of data
- * 
- * Return
- * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: No entry with the given key was found
- * - CHIDB_ENOMEM: Could not allocate memory
- * - CHIDB_EIO: An I/O error has occurred when accessing the file
- */
-int chidb_Btree_find(BTree *bt, npage_t nroot, key_t key, 
-		     uint8_t **data, uint16_t *size) {
-	BTreeNode *btn;
-	BTreeCell btc;
-	int cellPos, ncells, error;
-	uint32_t nextPage;
+/* Pointer to a cell in the in-memory page of a node */
+static uint8_t *chidb_Btree_cellPtr(BTreeNode *btn, ncell_t ncell)
+{
+	return btn->page->data + get2byte(btn->celloffset_array + 2*ncell);
+}
 
-	error = chidb_Btree_getNodeByPage(bt, nroot, &btn);
-	if (error != CHIDB_OK) return error;
 
-	if (btn->type == PGTYPE_TABLE_INTERNAL || btn->type == PGTYPE_TABLE_LEAF) {
-		while (btn->type == PGTYPE_TABLE_INTERNAL) {
-			/* look through keys */
-			ncells = btn->n_cells;
-			for (cellPos = 0; cellPos < ncells; cellPos++) {
-				chidb_Btree_getCell(btn, cellPos, &btc);
-				if (key <= btc.key) {
-					/* look at left child of this key */
-					chidb_Btree_freeMemNode(bt, btn);
-					error = chidb_Btree_getNodeByPage(bt, btc.fields.tableInternal.child_page, &btn);
-					if (error != CHIDB_OK) return error;
-					break;
-				}
-			}
-			if (cellPos == ncells) {
-				/* look at rightmost child */
-				nextPage = btn->right_page;
-				chidb_Btree_freeMemNode(bt, btn);
-				error = chidb_Btree_getNodeByPage(bt, nextPage, &btn);
-				if (error != CHIDB_OK) return error;
-			}
-		}
+/* Bytes available for cells (and their offsets) in a node of a given type */
+static uint32_t chidb_Btree_nodeSpace(BTree *bt, npage_t npage, uint8_t type)
+{
+	return bt->pager->page_size - ((npage == 1) ? 100 : 0) -
+		(ISLEAF(type) ? LEAFPG_CELLSOFFSET_OFFSET : INTPG_CELLSOFFSET_OFFSET);
+}
 
-		/* search for key in this leaf */
-		for (cellPos = 0; cellPos < btn->n_cells; cellPos++) {
-			chidb_Btree_getCell(btn, cellPos, &btc);
-			if (key == btc.key) {
-				*data = (uint8_t *) malloc(btc.fields.tableLeaf.data_size);
-				if (*data == NULL) {
-					chidb_Btree_freeMemNode(bt, btn);
-					return CHIDB_ENOMEM;
-				}
-				memcpy(*data, btc.fields.tableLeaf.data, btc.fields.tableLeaf.data_size);
-				*size = btc.fields.tableLeaf.data_size;
-				return CHIDB_OK;
-			}
-		}
-	} else {
-		while (true) {
-			/* look through keys */
-			ncells = btn->n_cells;
-			for (cellPos = 0; cellPos < ncells; cellPos++) {
-				chidb_Btree_getCell(btn, cellPos, &btc);
-				if (key < btc.key) {
-					/* look at left child of this key */
-					chidb_Btree_freeMemNode(bt, btn);
-					error = chidb_Btree_getNodeByPage(bt, btc.fields.indexInternal.child_page, &btn);
-					if (error != CHIDB_OK) return error;
-					break;
-				} else if (key == btc.key) {
-					*data = (uint8_t *) malloc(sizeof(key_t));
-					if (*data == NULL) {
-						chidb_Btree_freeMemNode(bt, btn);
-						return CHIDB_ENOMEM;
-					}
-					if (ISLEAF(btc.type))
-						memcpy(data, &(btc.fields.indexLeaf.keyPk), sizeof(key_t));
-					else
-						memcpy(data, &(btc.fields.indexInternal.keyPk), sizeof(key_t));
-					*size = sizeof(key_t);
-					return CHIDB_OK;
-				}
-			}
-			if (cellPos == ncells) {
-				if (ISLEAF(btc.type)) {
-					/* can't find the key*/
-					return CHIDB_ENOTFOUND;
-				} else {
-					/* look at rightmost child */
-					nextPage = btn->right_page;
-					chidb_Btree_freeMemNode(bt, btn);
-					error = chidb_Btree_getNodeByPage(bt, nextPage, &btn);
-					if (error != CHIDB_OK) return error;
-				}
-			}
-		}
-	}
-	return CHIDB_ENOTFOUND;
+
+/* Bytes used by the cells (and their offsets) of a node */
+static uint32_t chidb_Btree_nodeUsed(BTree *bt, BTreeNode *btn)
+{
+	return (bt->pager->page_size - btn->cells_offset) + 2 * btn->n_cells;
 }
 
 
-	
-/* Insert an entry into a table B-Tree
- *
- * This is a convenience function that wraps around chidb_Btree_insert.
- * It takes a key and data, and creates a BTreeCell that can be passed
- * along to chidb_Btree_insert.
- *
- * Parameters
- * - bt: B-Tree file
- * - nroot: Page number of the root node of the B-Tree we want to insert
- *					this entry in.
- * - key: Entry key
- * - data: Pointer to data we want to insert
- * - size: Number of bytes of data
+/* Empty an in-memory node, so it can be filled again with insertCell */
+static void chidb_Btree_resetNode(BTree *bt, BTreeNode *btn, uint8_t type)
+{
+	uint32_t headerOffset = (btn->page->npage == 1) ? 100 : 0;
+
+	btn->type = type;
+	btn->free_offset = headerOffset +
+		(ISLEAF(type) ? LEAFPG_CELLSOFFSET_OFFSET : INTPG_CELLSOFFSET_OFFSET);
+	btn->n_cells = 0;
+	btn->cells_offset = bt->pager->page_size;
+	btn->right_page = 0;
+	btn->celloffset_array = btn->page->data + btn->free_offset;
+	chidb_Btree_dropKeys(btn);
+}
+
+
+/* Read all the cells of a node from a copy of its page
  *
- * Return
- * - CHIDB_OK: Operation successful
- * - CHIDB_EDUPLICATE: An entry with that key already exists
- * - CHIDB_ENOMEM: Could not allocate memory
- * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ * Table leaf cells point to their data, and covering index cells to their
+ * record, in the copy, so the node itself can be rewritten while the cells
+ * are still in use.
  */
-int chidb_Btree_insertInTable(BTree *bt, npage_t nroot, key_t key, 
-			      uint8_t *data, uint16_t size)
+static void chidb_Btree_copyCells(BTreeNode *btn, uint8_t *copy, BTreeCell *cells, uint32_t *ncells)
 {
-	BTreeCell btc;
+	for (ncell_t i = 0; i < btn->n_cells; i++) {
+		BTreeCell *cell = &cells[(*ncells)++];
+		chidb_Btree_getCell(btn, i, cell);
+		if (cell->type == PGTYPE_TABLE_LEAF)
+			cell->fields.tableLeaf.data = copy + (cell->fields.tableLeaf.data - btn->page->data);
+		else if (cell->type == PGTYPE_INDEX_LEAF && cell->fields.indexLeaf.extra != NULL)
+			cell->fields.indexLeaf.extra = copy + (cell->fields.indexLeaf.extra - btn->page->data);
+		else if (cell->type == PGTYPE_INDEX_INTERNAL && cell->fields.indexInternal.extra != NULL)
+			cell->fields.indexInternal.extra = copy + (cell->fields.indexInternal.extra - btn->page->data);
+	}
+}
 
-	btc.type = PGTYPE_TABLE_LEAF;
-	btc.key = key;
-	btc.fields.tableLeaf.data = data;
-	btc.fields.tableLeaf.data_size = size;
 
-	return chidb_Btree_insert(bt, nroot, &btc);
+/* Child page of an internal cell (table or index) */
+static npage_t chidb_Btree_childPage(BTreeCell *cell)
+{
+	return (cell->type == PGTYPE_TABLE_INTERNAL) ?
+		cell->fields.tableInternal.child_page : cell->fields.indexInternal.child_page;
 }
 
 
-/* Insert an entry into an index B-Tree
+/* Turn an index cell into a cell of a node of the given type, so that an
+ * entry can move between leaves and internal nodes. The child page is
+ * only used for internal nodes. */
+static void chidb_Btree_indexCellAs(BTreeCell *cell, uint8_t type, npage_t child)
+{
+	key_t keyPk;
+	uint8_t *extra;
+	uint32_t size;
+
+	if (cell->type == PGTYPE_INDEX_INTERNAL) {
+		keyPk = cell->fields.indexInternal.keyPk;
+		extra = cell->fields.indexInternal.extra;
+		size = cell->fields.indexInternal.extra_size;
+	} else {
+		keyPk = cell->fields.indexLeaf.keyPk;
+		extra = cell->fields.indexLeaf.extra;
+		size = cell->fields.indexLeaf.extra_size;
+	}
+
+	cell->type = type;
+	if (type == PGTYPE_INDEX_INTERNAL) {
+		cell->fields.indexInternal.keyPk = keyPk;
+		cell->fields.indexInternal.child_page = child;
+		cell->fields.indexInternal.extra = extra;
+		cell->fields.indexInternal.extra_size = size;
+	} else {
+		cell->fields.indexLeaf.keyPk = keyPk;
+		cell->fields.indexLeaf.extra = extra;
+		cell->fields.indexLeaf.extra_size = size;
+	}
+}
+
+
+/* Fix an underflowing node by merging it with a sibling, or by moving
+ * cells over from the sibling
  *
- * This is a convenience function that wraps around chidb_Btree_insert.
- * It takes a KeyIdx and a KeyPk, and creates a BTreeCell that can be passed
- * along to chidb_Btree_insert.
+ * The two siblings are the children of the parent's cell ncell and of the
+ * cell after it (or the parent's right page). If all of their cells fit in
+ * one node, they are merged into the left node, the right node's page
+ * goes to the free-list and the separator is removed from the parent.
+ * Otherwise, the cells are split between the two nodes as evenly as
+ * possible, and the separator key is updated.
+ *
+ * In an index B-Tree the separator is an entry of the index: it comes
+ * down into the siblings, and the cell at the split goes up in its place.
+ * The new separator may be larger than the old one (covering entries have
+ * records of different sizes); if no split gives one that fits in the
+ * parent, the siblings are left as they are.
+ *
+ * The parent is only modified in memory; it is up to the caller to
+ * write it.
  *
  * Parameters
  * - bt: B-Tree file
- * - nroot: Page number of the root node of the B-Tree we want to insert
- *					this entry in.
- * - keyIdx: See The chidb File Format.
- * - keyPk: See The chidb File Format.
+ * - parent: Parent of the two siblings (an internal node)
+ * - ncell: Cell of the parent pointing to the left sibling
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EDUPLICATE: An entry with that key already exists
  * - CHIDB_ENOMEM: Could not allocate memory
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_Btree_insertInIndex(BTree *bt, npage_t nroot, key_t keyIdx, key_t keyPk)
+static int chidb_Btree_rebalance(BTree *bt, BTreeNode *parent, ncell_t ncell)
 {
-	BTreeCell btc;
+	BTreeNode *left, *right;
+	BTreeCell separator, cell;
+	npage_t nleft, nright, rightPage;
+	uint32_t pageSize = bt->pager->page_size;
+	bool index = (parent->type == PGTYPE_INDEX_INTERNAL);
+	int error;
 
-	btc.type = PGTYPE_INDEX_LEAF;
-	btc.key = keyIdx;
-	btc.fields.indexLeaf.keyPk = keyPk;
+	chidb_Btree_getCell(parent, ncell, &separator);
+	nleft = chidb_Btree_childPage(&separator);
+	if (ncell + 1 < parent->n_cells) {
+		chidb_Btree_getCell(parent, ncell + 1, &cell);
+		nright = chidb_Btree_childPage(&cell);
+	} else {
+		nright = parent->right_page;
+	}
 
-	return chidb_Btree_insert(bt, nroot, &btc);
+	error = chidb_Btree_getNodeByPage(bt, nleft, &left);
+	if (error != CHIDB_OK) return error;
+	error = chidb_Btree_getNodeByPage(bt, nright, &right);
+	if (error != CHIDB_OK) {
+		chidb_Btree_freeMemNode(bt, left);
+		return error;
+	}
+
+	/* gather the cells of both siblings, in key order. Between internal
+	 * nodes (and always in an index), the separator comes down, pointing
+	 * to the left right page. The parent's page is copied too, since the
+	 * separator's record may go back up once the parent has changed */
+	uint32_t ncells = 0;
+	BTreeCell *cells = malloc((left->n_cells + right->n_cells + 1) * sizeof(BTreeCell));
+	uint8_t *copy = malloc(3 * pageSize);
+	if (cells == NULL || copy == NULL) {
+		free(cells);
+		free(copy);
+		chidb_Btree_freeMemNode(bt, left);
+		chidb_Btree_freeMemNode(bt, right);
+		return CHIDB_ENOMEM;
+	}
+	memcpy(copy, left->page->data, pageSize);
+	memcpy(copy + pageSize, right->page->data, pageSize);
+	memcpy(copy + 2 * pageSize, parent->page->data, pageSize);
+
+	uint8_t type = left->type;
+	chidb_Btree_copyCells(left, copy, cells, &ncells);
+	if (index) {
+		cell = separator;
+		if (cell.fields.indexInternal.extra != NULL)
+			cell.fields.indexInternal.extra = copy + 2 * pageSize +
+				(cell.fields.indexInternal.extra - parent->page->data);
+		chidb_Btree_indexCellAs(&cell, type, left->right_page);
+		cells[ncells++] = cell;
+	} else if (type == PGTYPE_TABLE_INTERNAL) {
+		cell.type = PGTYPE_TABLE_INTERNAL;
+		cell.key = separator.key;
+		cell.fields.tableInternal.child_page = left->right_page;
+		cells[ncells++] = cell;
+	}
+	chidb_Btree_copyCells(right, copy + pageSize, cells, &ncells);
+	rightPage = right->right_page;
+
+	uint32_t space = chidb_Btree_nodeSpace(bt, nleft, type);
+	uint32_t total = 0;
+	for (uint32_t i = 0; i < ncells; i++)
+		total += 2 + chidb_Btree_cellSize(left, &cells[i]);
+
+	if (total <= space) {
+		/* merge everything into the left node */
+		chidb_Btree_resetNode(bt, left, type);
+		for (uint32_t i = 0; i < ncells; i++)
+			chidb_Btree_insertCell(left, i, &cells[i]);
+		left->right_page = rightPage;
+		error = chidb_Btree_writeNode(bt, left);
+
+		/* whatever pointed to the right node now points to the left one */
+		chidb_Btree_removeCell(parent, ncell);
+		if (ncell < parent->n_cells)
+			put4byte(chidb_Btree_cellPtr(parent, ncell) +
+			         (index ? INDEXINTCELL_CHILD_OFFSET : TABLEINTCELL_CHILD_OFFSET), nleft);
+		else
+			parent->right_page = nleft;
+
+		chidb_Btree_freeMemNode(bt, right);
+		if (error == CHIDB_OK)
+			error = chidb_Btree_freePage(bt, nright);
+	} else {
+		/* split the cells where both halves are closest in size. Between
+		 * internal nodes (and always in an index), the cell at the split
+		 * goes up as the separator */
+		uint32_t split = 0, bestDiff = UINT32_MAX, before = 0;
+		uint32_t up = (index || type == PGTYPE_TABLE_INTERNAL) ? 1 : 0;
+		uint32_t parentSpace = (parent->cells_offset - parent->free_offset) +
+			chidb_Btree_cellSize(parent, &separator);
+		for (uint32_t k = 1; k + up < ncells; k++) {
+			before += 2 + chidb_Btree_cellSize(left, &cells[k - 1]);
+			uint32_t after = total - before - (up ? 2 + chidb_Btree_cellSize(left, &cells[k]) : 0);
+			uint32_t diff = (before > after) ? before - after : after - before;
+			if (index) {
+				cell = cells[k];
+				chidb_Btree_indexCellAs(&cell, PGTYPE_INDEX_INTERNAL, nleft);
+				if ((uint32_t) chidb_Btree_cellSize(parent, &cell) > parentSpace)
+					continue;
+			}
+			if (before <= space && after <= space && diff < bestDiff) {
+				split = k;
+				bestDiff = diff;
+			}
+		}
+
+		if (split == 0) {
+			chidb_Btree_freeMemNode(bt, right);
+			chidb_Btree_freeMemNode(bt, left);
+			free(cells);
+			free(copy);
+			return CHIDB_OK;
+		}
+
+		chidb_Btree_resetNode(bt, left, type);
+		chidb_Btree_resetNode(bt, right, type);
+		for (uint32_t i = 0; i < split; i++)
+			chidb_Btree_insertCell(left, i, &cells[i]);
+		for (uint32_t i = split + up; i < ncells; i++)
+			chidb_Btree_insertCell(right, i - split - up, &cells[i]);
+		if (!ISLEAF(type)) {
+			left->right_page = chidb_Btree_childPage(&cells[split]);
+			right->right_page = rightPage;
+		}
+		key_t separatorKey = cells[up ? split : split - 1].key;
+
+		error = chidb_Btree_writeNode(bt, left);
+		if (error == CHIDB_OK)
+			error = chidb_Btree_writeNode(bt, right);
+		if (index) {
+			cell = cells[split];
+			chidb_Btree_indexCellAs(&cell, PGTYPE_INDEX_INTERNAL, nleft);
+			chidb_Btree_removeCell(parent, ncell);
+			chidb_Btree_insertCell(parent, ncell, &cell);
+		} else {
+			putVarint32(chidb_Btree_cellPtr(parent, ncell) + TABLEINTCELL_KEY_OFFSET, separatorKey);
+			chidb_Btree_dropKeys(parent);
+		}
+
+		chidb_Btree_freeMemNode(bt, right);
+	}
+
+	chidb_Btree_freeMemNode(bt, left);
+	free(cells);
+	free(copy);
+	return error;
 }
 
 
-/* Insert a BTreeCell into a B-Tree
- *
- * The chidb_Btree_insert and chidb_Btree_insertNonFull functions
- * are responsible for inserting new entries into a B-Tree, although
- * chidb_Btree_insertNonFull is the one that actually does the
- * insertion. chidb_Btree_insert, however, first checks if the root
- * has to be split (a splitting operation that is different from
- * splitting any other node). If so, chidb_Btree_split is called
- * before calling chidb_Btree_insertNonFull.
+/* Delete an entry from the subtree rooted at a node
  *
  * Parameters
  * - bt: B-Tree file
- * - nroot: Page number of the root node of the B-Tree we want to insert
- *					this cell in.
- * - btc: BTreeCell to insert into B-Tree
+ * - npage: Page of the node
+ * - key: Key of the entry
+ * - underflow: Out parameter. Set if the node is left less than
+ *              BTREE_MIN_FILL full, so that the caller rebalances it.
  *
  * Return
- * - CHIDB_OK: Operation successful
- * - CHIDB_EDUPLICATE: An entry with that key already exists
- * - CHIDB_ENOMEM: Could not allocate memory
- * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ * - See chidb_Btree_delete
  */
-int chidb_Btree_insert(BTree *bt, npage_t nroot, BTreeCell *btc)
+static int chidb_Btree_deleteInNode(BTree *bt, npage_t npage, key_t key, bool *underflow)
 {
-	int error, newPageRight, newPageLeft, headerOffset;
-	BTreeNode *root, *newNodeRight;
-	error = chidb_Btree_getNodeByPage(bt, nroot, &root);
+	BTreeNode *btn;
+	BTreeCell btc;
+	ncell_t cellPos;
+	int error;
+
+	error = chidb_Btree_getNodeByPage(bt, npage, &btn);
 	if (error != CHIDB_OK) return error;
 
-	int cellSize = chidb_Btree_cellSize(btc);
-	
-	/* if the root is full, split it */
-	if ((root->cells_offset - root->free_offset) < (2 + cellSize)) {
-		headerOffset = (nroot == 1) ? 100 : 0;
-		/* first, make a new empty page and copy the root to it */
-		chidb_Btree_newNode(bt, &newPageRight, root->type);
-		chidb_Btree_getNodeByPage(bt, newPageRight, &newNodeRight);
-		memcpy(newNodeRight->page->data,
-			   root->page->data + headerOffset,
-			   bt->pager->page_size - headerOffset);
-		newNodeRight->type = root->type;
-		newNodeRight->free_offset = root->free_offset - headerOffset;
-		newNodeRight->n_cells = root->n_cells;
-		newNodeRight->cells_offset = root->cells_offset;
-		newNodeRight->right_page = root->right_page;
-		memmove(newNodeRight->page->data + newNodeRight->cells_offset,
-				newNodeRight->page->data + newNodeRight->cells_offset - headerOffset,
-				bt->pager->page_size - newNodeRight->cells_offset);
-		chidb_Btree_writeNode(bt, newNodeRight);
-		
-		/* empty the current root */
-		if (root->type == PGTYPE_TABLE_LEAF) root->type = PGTYPE_TABLE_INTERNAL;
-		if (root->type == PGTYPE_INDEX_LEAF) root->type = PGTYPE_INDEX_INTERNAL;
+	if (btn->type != PGTYPE_TABLE_LEAF && btn->type != PGTYPE_TABLE_INTERNAL) {
+		chidb_Btree_freeMemNode(bt, btn);
+		return CHIDB_EMISUSE;
+	}
 
-		root->free_offset = headerOffset + INTPG_CELLSOFFSET_OFFSET;
-		root->n_cells = 0;
-		root->cells_offset = bt->pager->page_size;
-		root->right_page = newPageRight;
-		memset(root->page->data + headerOffset, 0, bt->pager->page_size - headerOffset);
-		chidb_Btree_writeNode(bt, root);
+	cellPos = chidb_Btree_findSlot(btn, key);
+	if (cellPos < btn->n_cells)
+		chidb_Btree_getCell(btn, cellPos, &btc);
+
+	if (btn->type == PGTYPE_TABLE_LEAF) {
+		if (cellPos == btn->n_cells || btc.key != key) {
+			error = CHIDB_ENOTFOUND;
+		} else {
+			chidb_Btree_removeCell(btn, cellPos);
+			error = chidb_Btree_writeNode(bt, btn);
+			if (error == CHIDB_OK)
+				error = chidb_Btree_freeOverflow(bt, btc.fields.tableLeaf.overflow_page);
+		}
+	} else {
+		bool childUnderflow = false;
+		npage_t childPage = (cellPos < btn->n_cells) ? btc.fields.tableInternal.child_page : btn->right_page;
+
+		error = chidb_Btree_deleteInNode(bt, childPage, key, &childUnderflow);
+
+		/* the child is rebalanced with its right sibling, or with its
+		 * left one if it is the rightmost child */
+		if (error == CHIDB_OK && childUnderflow && btn->n_cells > 0) {
+			error = chidb_Btree_rebalance(bt, btn, (cellPos < btn->n_cells) ? cellPos : btn->n_cells - 1);
+			if (error == CHIDB_OK)
+				error = chidb_Btree_writeNode(bt, btn);
+		}
+	}
+
+	*underflow = chidb_Btree_nodeUsed(bt, btn) < BTREE_MIN_FILL(chidb_Btree_nodeSpace(bt, npage, btn->type));
+	chidb_Btree_freeMemNode(bt, btn);
+	return error;
+}
 
-		/* split the new right child, which contains the old root data */
-		chidb_Btree_split(bt, nroot, newPageRight, 0, &newPageLeft);
-		
-		chidb_Btree_getNodeByPage(bt, nroot, &root);
-		chidb_Btree_getNodeByPage(bt, newPageRight, &newNodeRight);
-		BTreeNode *newNodeLeft;
-		chidb_Btree_getNodeByPage(bt, newPageLeft, &newNodeLeft);
 
-		chidb_Btree_freeMemNode(bt, root);
-		chidb_Btree_freeMemNode(bt, newNodeRight);
-		chidb_Btree_freeMemNode(bt, newNodeLeft);
-	}	
-	error = chidb_Btree_insertNonFull(bt, nroot, btc);
+/* Move the only child of a B-Tree's root into the root, once the root
+ * has no cells left (see chidb_Btree_delete) */
+static int chidb_Btree_collapseRoot(BTree *bt, npage_t nroot)
+{
+	BTreeNode *root, *child;
+	BTreeCell cell;
+	int error;
+
+	error = chidb_Btree_getNodeByPage(bt, nroot, &root);
+	if (error != CHIDB_OK) return error;
+
+	if (!ISLEAF(root->type) && root->n_cells == 0) {
+		npage_t nchild = root->right_page;
+		error = chidb_Btree_getNodeByPage(bt, nchild, &child);
+
+		/* on page 1 the child may not fit (the file header takes up space),
+		 * in which case the root is left with just its right page */
+		if (error == CHIDB_OK &&
+		    chidb_Btree_nodeUsed(bt, child) <= chidb_Btree_nodeSpace(bt, nroot, child->type)) {
+			chidb_Btree_resetNode(bt, root, child->type);
+			for (ncell_t i = 0; i < child->n_cells; i++) {
+				chidb_Btree_getCell(child, i, &cell);
+				chidb_Btree_insertCell(root, i, &cell);
+			}
+			root->right_page = child->right_page;
+			error = chidb_Btree_writeNode(bt, root);
+			chidb_Btree_freeMemNode(bt, child);
+			if (error == CHIDB_OK)
+				error = chidb_Btree_freePage(bt, nchild);
+		} else if (error == CHIDB_OK) {
+			chidb_Btree_freeMemNode(bt, child);
+		}
+	}
 
+	chidb_Btree_freeMemNode(bt, root);
 	return error;
 }
 
-/* Insert a BTreeCell into a non-full B-Tree node
+
+/* Delete an entry from a table B-Tree
  *
- * chidb_Btree_insertNonFull inserts a BTreeCell into a node that is
- * assumed not to be full (i.e., does not require splitting). If the
- * node is a leaf node, the cell is directly added in the appropriate
- * position according to its key. If the node is an internal node, the
- * function will determine what child node it must insert it in, and
- * calls itself recursively on that child node. However, before doing so
- * it will check if the child node is full or not. If it is, then it will
- * have to be split first.
+ * The entry is removed from its leaf, and its overflow pages (if any)
+ * go to the free-list. A node left less than
+ * BTREE_MIN_FILL full is merged with a sibling (if both fit in one node)
+ * or takes cells from it, on the way back up to the root; pages freed by
+ * merges go to the free-list. If the root ends up with a single child,
+ * the child is moved up into the root (the root page of a B-Tree never
+ * changes, since the schema refers to it).
+ *
+ * Entries of index B-Trees are deleted with chidb_Btree_deleteFromIndex.
  *
  * Parameters
  * - bt: B-Tree file
- * - nroot: Page number of the root node of the B-Tree we want to insert
- *					this cell in.
- * - btc: BTreeCell to insert into B-Tree
+ * - nroot: Page number of the root node of the B-Tree
+ * - key: Key of the entry to delete
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EDUPLICATE: An entry with that key already exists
+ * - CHIDB_ENOTFOUND: No entry with the given key was found
+ * - CHIDB_EMISUSE: The B-Tree is not a table B-Tree
  * - CHIDB_ENOMEM: Could not allocate memory
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_Btree_insertNonFull(BTree *bt, npage_t npage, BTreeCell *newCell)
+int chidb_Btree_delete(BTree *bt, npage_t nroot, key_t key)
 {
-	int error, cellPos, cellSize;
-	BTreeNode *btn, *childNode;
-	BTreeCell btc;
-	npage_t childPage, newChild;
-	error = chidb_Btree_getNodeByPage(bt, npage, &btn);
+	bool underflow;
+	int error;
+
+	error = chidb_Btree_deleteInNode(bt, nroot, key, &underflow);
 	if (error != CHIDB_OK) return error;
 
-	cellSize = chidb_Btree_cellSize(newCell);
+	return chidb_Btree_collapseRoot(bt, nroot);
+}
 
-	for (cellPos = 0; cellPos < btn->n_cells; cellPos++) {
-		chidb_Btree_getCell(btn, cellPos, &btc);
-		if (newCell->key < btc.key) {
+
+/* Find the first or last entry of the subtree rooted at a node of an
+ * index B-Tree (always in a leaf)
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - npage: Page of the node
+ * - last: True for the last entry, false for the first one
+ * - cell: Out parameter. The entry, as a leaf cell.
+ * - extra: Out parameter. A copy of the entry's record (or NULL), which
+ *          cell points to, to be freed by the caller.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ECORRUPT: The subtree has an empty leaf
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+static int chidb_Btree_indexEdge(BTree *bt, npage_t npage, bool last, BTreeCell *cell, uint8_t **extra)
+{
+	BTreeNode *btn;
+	int error;
+
+	*extra = NULL;
+	for (;;) {
+		error = chidb_Btree_getNodeByPage(bt, npage, &btn);
+		if (error != CHIDB_OK) return error;
+		if (btn->n_cells == 0) {
+			chidb_Btree_freeMemNode(bt, btn);
+			return CHIDB_ECORRUPT;
+		}
+		if (ISLEAF(btn->type))
 			break;
-		} else if (newCell->key == btc.key) {
+		if (last) {
+			npage = btn->right_page;
+		} else {
+			chidb_Btree_getCell(btn, 0, cell);
+			npage = cell->fields.indexInternal.child_page;
+		}
+		chidb_Btree_freeMemNode(bt, btn);
+	}
+
+	chidb_Btree_getCell(btn, last ? btn->n_cells - 1 : 0, cell);
+	if (cell->fields.indexLeaf.extra != NULL) {
+		*extra = malloc(cell->fields.indexLeaf.extra_size);
+		if (*extra == NULL) {
 			chidb_Btree_freeMemNode(bt, btn);
-			return CHIDB_EDUPLICATE;
+			return CHIDB_ENOMEM;
 		}
+		memcpy(*extra, cell->fields.indexLeaf.extra, cell->fields.indexLeaf.extra_size);
+		cell->fields.indexLeaf.extra = *extra;
 	}
+	chidb_Btree_freeMemNode(bt, btn);
+	return CHIDB_OK;
+}
 
-	/* if this is a leaf, put it here */
-	if (ISLEAF(btn->type)) {
-		error = chidb_Btree_insertCell(btn, cellPos, newCell);
-		chidb_Btree_writeNode(bt, btn);
+
+/* Delete an entry from the subtree rooted at a node of an index B-Tree
+ *
+ * An entry of a leaf is simply removed. An entry of an internal node is
+ * replaced by the entry just before it (the last one of its child), or
+ * failing that by the one just after it (the first one of the next
+ * child), which is then deleted from that child's subtree. Nothing is
+ * modified if neither fits in the node.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - npage: Page of the node
+ * - keyIdx: Key of the entry
+ * - keyPk: Primary key of the entry
+ * - underflow: Out parameter. Set if the node is left less than
+ *              BTREE_MIN_FILL full, so that the caller rebalances it.
+ *
+ * Return
+ * - CHIDB_ECELLNO: Neither entry next to the deleted one fits in its
+ *                  place (see chidb_Btree_rebuildIndex)
+ * - See chidb_Btree_deleteFromIndex
+ */
+static int chidb_Btree_deleteIndexInNode(BTree *bt, npage_t npage, key_t keyIdx, key_t keyPk, bool *underflow)
+{
+	BTreeNode *btn;
+	BTreeCell btc, repl;
+	ncell_t cellPos, childPos;
+	npage_t childPage;
+	uint8_t *extra = NULL;
+	bool found, modified = false, childUnderflow = false;
+	int error;
+
+	error = chidb_Btree_getNodeByPage(bt, npage, &btn);
+	if (error != CHIDB_OK) return error;
+
+	if (btn->type != PGTYPE_INDEX_LEAF && btn->type != PGTYPE_INDEX_INTERNAL) {
 		chidb_Btree_freeMemNode(bt, btn);
-		return error;
+		return CHIDB_EMISUSE;
+	}
+
+	/* entries with the same KeyIdx are ordered by KeyPk */
+	key_t cellPk = 0;
+	for (cellPos = chidb_Btree_findSlot(btn, keyIdx); cellPos < btn->n_cells; cellPos++) {
+		chidb_Btree_getCell(btn, cellPos, &btc);
+		cellPk = (btn->type == PGTYPE_INDEX_INTERNAL) ?
+			btc.fields.indexInternal.keyPk : btc.fields.indexLeaf.keyPk;
+		if (btc.key != keyIdx || cellPk >= keyPk)
+			break;
+	}
+	found = cellPos < btn->n_cells && btc.key == keyIdx && cellPk == keyPk;
+
+	if (btn->type == PGTYPE_INDEX_LEAF) {
+		if (!found) {
+			error = CHIDB_ENOTFOUND;
+		} else {
+			chidb_Btree_removeCell(btn, cellPos);
+			error = chidb_Btree_writeNode(bt, btn);
+		}
 	} else {
-		if (cellPos < btn->n_cells) {
-			childPage = (btc.type == PGTYPE_INDEX_INTERNAL)
-				? btc.fields.indexInternal.child_page
-				: btc.fields.tableInternal.child_page;
+		childPos = cellPos;
+		childPage = (cellPos < btn->n_cells) ? btc.fields.indexInternal.child_page : btn->right_page;
+
+		if (found) {
+			uint32_t space = (btn->cells_offset - btn->free_offset) + chidb_Btree_cellSize(btn, &btc);
+
+			error = chidb_Btree_indexEdge(bt, childPage, true, &repl, &extra);
+			if (error == CHIDB_OK && INDEXINTCELL_SIZE + repl.fields.indexLeaf.extra_size > space) {
+				free(extra);
+				childPos = cellPos + 1;
+				if (childPos < btn->n_cells) {
+					chidb_Btree_getCell(btn, childPos, &repl);
+					childPage = repl.fields.indexInternal.child_page;
+				} else {
+					childPage = btn->right_page;
+				}
+				error = chidb_Btree_indexEdge(bt, childPage, false, &repl, &extra);
+				if (error == CHIDB_OK && INDEXINTCELL_SIZE + repl.fields.indexLeaf.extra_size > space)
+					error = CHIDB_ECELLNO;
+			}
+
+			/* the entry next to the deleted one takes its place, and is
+			 * then deleted from the leaf it came from */
+			if (error == CHIDB_OK) {
+				chidb_Btree_indexCellAs(&repl, PGTYPE_INDEX_INTERNAL, btc.fields.indexInternal.child_page);
+				chidb_Btree_removeCell(btn, cellPos);
+				chidb_Btree_insertCell(btn, cellPos, &repl);
+				modified = true;
+				error = chidb_Btree_deleteIndexInNode(bt, childPage, repl.key,
+				                                      repl.fields.indexInternal.keyPk, &childUnderflow);
+			}
+			free(extra);
 		} else {
-			childPage = btn->right_page;
+			error = chidb_Btree_deleteIndexInNode(bt, childPage, keyIdx, keyPk, &childUnderflow);
 		}
-		chidb_Btree_getNodeByPage(bt, childPage, &childNode);
 
-		if ((childNode->cells_offset - childNode->free_offset) < (2 + cellSize)) {
-			/* if child is full, split it */
-			chidb_Btree_split(bt, btn->page->npage, childPage, cellPos, &newChild);
-			chidb_Btree_getNodeByPage(bt, btn->page->npage, &btn);
-			chidb_Btree_getCell(btn, cellPos, &btc);
-			if (newCell->key < btc.key) childPage = newChild;
+		if (error == CHIDB_OK && childUnderflow && btn->n_cells > 0) {
+			error = chidb_Btree_rebalance(bt, btn, (childPos < btn->n_cells) ? childPos : btn->n_cells - 1);
+			modified = true;
 		}
+		if (error == CHIDB_OK && modified)
+			error = chidb_Btree_writeNode(bt, btn);
+	}
 
-		return chidb_Btree_insertNonFull(bt, childPage, newCell);
+	*underflow = chidb_Btree_nodeUsed(bt, btn) < BTREE_MIN_FILL(chidb_Btree_nodeSpace(bt, npage, btn->type));
+	chidb_Btree_freeMemNode(bt, btn);
+	return error;
+}
+
+
+/* Add the entries of the subtree rooted at a node of an index B-Tree to
+ * a sorter, all but one */
+static int chidb_Btree_gatherIndex(BTree *bt, npage_t npage, key_t keyIdx, key_t keyPk, Sorter *sorter)
+{
+	BTreeNode *btn;
+	BTreeCell btc;
+	int error;
+
+	error = chidb_Btree_getNodeByPage(bt, npage, &btn);
+	if (error != CHIDB_OK) return error;
+
+	for (ncell_t i = 0; i < btn->n_cells && error == CHIDB_OK; i++) {
+		chidb_Btree_getCell(btn, i, &btc);
+		if (btn->type == PGTYPE_INDEX_INTERNAL)
+			error = chidb_Btree_gatherIndex(bt, btc.fields.indexInternal.child_page, keyIdx, keyPk, sorter);
+		chidb_Btree_indexCellAs(&btc, PGTYPE_INDEX_LEAF, 0);
+		if (error == CHIDB_OK && (btc.key != keyIdx || btc.fields.indexLeaf.keyPk != keyPk))
+			error = chidb_Sorter_add(sorter, btc.key, btc.fields.indexLeaf.keyPk, 0,
+			                         btc.fields.indexLeaf.extra, btc.fields.indexLeaf.extra_size);
 	}
+	if (error == CHIDB_OK && btn->type == PGTYPE_INDEX_INTERNAL)
+		error = chidb_Btree_gatherIndex(bt, btn->right_page, keyIdx, keyPk, sorter);
 
-	return CHIDB_OK;
+	chidb_Btree_freeMemNode(bt, btn);
+	return error;
 }
 
 
-/* Split a B-Tree node
+/* Rebuild an index B-Tree without one of its entries
  *
- * Splits a B-Tree node N. This involves the following:
- * - Find the median cell in N.
- * - Create a new B-Tree node M.
- * - Move the cells before the median cell to M (if the
- *	 cell is a table leaf cell, the median cell is moved too)
- * - Add a cell to the parent (which, by definition, will be an
- *	 internal page) with the median key and the page number of M.
+ * Used when the entry is in an internal node and can be replaced by
+ * neither of the entries next to it, which have larger records. The
+ * other entries are sorted, the B-Tree's pages (but the root) go to the
+ * free-list, and the B-Tree is built again from the root (see
+ * chidb_Btree_bulkLoadIndex).
+ */
+static int chidb_Btree_rebuildIndex(BTree *bt, npage_t nroot, key_t keyIdx, key_t keyPk)
+{
+	Sorter sorter;
+	BTreeNode *root;
+	BTreeCell btc;
+	int error;
+
+	chidb_Sorter_init(&sorter, 0, 1);
+	error = chidb_Btree_gatherIndex(bt, nroot, keyIdx, keyPk, &sorter);
+	if (error == CHIDB_OK)
+		error = chidb_Sorter_sort(&sorter);
+
+	if (error == CHIDB_OK)
+		error = chidb_Btree_getNodeByPage(bt, nroot, &root);
+	if (error == CHIDB_OK) {
+		for (ncell_t i = 0; i < root->n_cells && !ISLEAF(root->type) && error == CHIDB_OK; i++) {
+			chidb_Btree_getCell(root, i, &btc);
+			error = chidb_Btree_freeTree(bt, btc.fields.indexInternal.child_page);
+		}
+		if (error == CHIDB_OK && !ISLEAF(root->type))
+			error = chidb_Btree_freeTree(bt, root->right_page);
+		chidb_Btree_freeMemNode(bt, root);
+	}
+
+	if (error == CHIDB_OK)
+		error = chidb_Btree_initEmptyNode(bt, nroot, PGTYPE_INDEX_LEAF);
+	if (error == CHIDB_OK)
+		error = chidb_Btree_bulkLoadIndex(bt, nroot, &sorter);
+
+	chidb_Sorter_close(&sorter);
+	return error;
+}
+
+
+/* Delete an entry from an index B-Tree
+ *
+ * As in chidb_Btree_delete, underflowing nodes are merged with a sibling
+ * or take entries from it on the way back up, and the root takes the
+ * place of its only child. The entry is identified by both its keys,
+ * since a covering index may have several entries with the same KeyIdx.
  *
  * Parameters
  * - bt: B-Tree file
- * - npage_parent: Page number of the parent node
- * - npage_child: Page number of the node to split
- * - parent_ncell: Position in the parent where the new cell will
- *								 be inserted.
- * - npage_child2: Out parameter. Used to return the page of the new child node.
- * - btc: BTreeCell to insert into B-Tree
+ * - nroot: Page number of the root node of the B-Tree
+ * - keyIdx: Key of the entry to delete
+ * - keyPk: Primary key of the entry to delete
  *
  * Return
  * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: No entry with the given keys was found
+ * - CHIDB_EMISUSE: The B-Tree is not an index B-Tree
  * - CHIDB_ENOMEM: Could not allocate memory
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_Btree_split(BTree *bt, npage_t npage_parent, npage_t npage_child, 
-		      ncell_t parent_ncell, npage_t *npage_child2)
+int chidb_Btree_deleteFromIndex(BTree *bt, npage_t nroot, key_t keyIdx, key_t keyPk)
 {
-	BTreeNode *parentNode, *childNode, *newChildNode;
-	BTreeCell medianCell, cell;
-	int cellPos, cellSize, medianIdx, medianKeyPk, moveIdx;
-	uint16_t offset, largestOffset, newCellsOffset;
-	npage_t medianChild;
+	bool underflow;
+	int error;
 
-	chidb_Btree_getNodeByPage(bt, npage_parent, &parentNode);
-	chidb_Btree_getNodeByPage(bt, npage_child, &childNode);
+	error = chidb_Btree_deleteIndexInNode(bt, nroot, keyIdx, keyPk, &underflow);
+	if (error == CHIDB_ECELLNO)
+		error = chidb_Btree_rebuildIndex(bt, nroot, keyIdx, keyPk);
+	if (error != CHIDB_OK) return error;
 
-	/* create new node */
-	chidb_Btree_newNode(bt, npage_child2, childNode->type);
-	chidb_Btree_getNodeByPage(bt, *npage_child2, &newChildNode);
+	return chidb_Btree_collapseRoot(bt, nroot);
+}
 
-	/* find the median cell and bump it up */
-	medianIdx = (childNode->n_cells)/2;
-	chidb_Btree_getCell(childNode, medianIdx, &medianCell);
-	medianKeyPk = (ISLEAF(medianCell.type)) 
-		? medianCell.fields.indexLeaf.keyPk
-		: medianCell.fields.indexInternal.keyPk;
-	
 
-	if (parentNode->type == PGTYPE_INDEX_INTERNAL) {
-		medianChild = medianCell.fields.indexInternal.child_page;
+/* Replace the data of an entry in a table B-Tree
+ *
+ * If the new data has the same size as the old one, and both are held
+ * whole in the cell, it is written over it, in place. Otherwise the
+ * entry is deleted and inserted again.
+ *
+ * Parameters
+ * - bt: B-Tree file
+ * - nroot: Page number of the root node of the B-Tree
+ * - key: Key of the entry to update
+ * - data: New data
+ * - size: Number of bytes of data
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: No entry with the given key was found
+ * - CHIDB_EMISUSE: The B-Tree is not a table B-Tree
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_Btree_update(BTree *bt, npage_t nroot, key_t key, uint8_t *data, uint32_t size)
+{
+	BTreeNode *btn;
+	BTreeCell btc;
+	ncell_t cellPos;
+	npage_t nextPage;
+	int error;
 
-		medianCell.type = PGTYPE_INDEX_INTERNAL;
-		medianCell.fields.indexInternal.child_page = *npage_child2;
-		medianCell.fields.indexInternal.keyPk = medianKeyPk;
-	} else {
-		medianChild = medianCell.fields.tableInternal.child_page;
+	error = chidb_Btree_getNodeByPage(bt, nroot, &btn);
+	if (error != CHIDB_OK) return error;
 
-		medianCell.type = PGTYPE_TABLE_INTERNAL;
-		medianCell.fields.tableInternal.child_page = *npage_child2;
+	while (btn->type == PGTYPE_TABLE_INTERNAL) {
+		nextPage = btn->right_page;
+		cellPos = chidb_Btree_findSlot(btn, key);
+		if (cellPos < btn->n_cells) {
+			chidb_Btree_getCell(btn, cellPos, &btc);
+			nextPage = btc.fields.tableInternal.child_page;
+		}
+		chidb_Btree_freeMemNode(bt, btn);
+		error = chidb_Btree_getNodeByPage(bt, nextPage, &btn);
+		if (error != CHIDB_OK) return error;
 	}
 
-	chidb_Btree_insertCell(parentNode, parent_ncell, &medianCell);
-
-	/* move cells before the median to the new node */
-	for (cellPos = 0; cellPos < medianIdx; cellPos++) {
-		chidb_Btree_getCell(childNode, cellPos, &cell);
-		chidb_Btree_insertCell(newChildNode, cellPos, &cell);
-	}
-	if (parentNode->type == PGTYPE_TABLE_INTERNAL) {
-		chidb_Btree_getCell(childNode, medianIdx, &cell);
-		chidb_Btree_insertCell(newChildNode, medianIdx, &cell);
+	if (btn->type != PGTYPE_TABLE_LEAF) {
+		chidb_Btree_freeMemNode(bt, btn);
+		return CHIDB_EMISUSE;
 	}
-	newChildNode->right_page = medianChild;
-
-	/* shift the cell offset array up */
-	childNode->n_cells = (childNode->n_cells - 1)/2;
-	memmove(childNode->celloffset_array,
-			childNode->celloffset_array + 2*(medianIdx + 1), 2*(medianIdx + 1));
-	childNode->free_offset -= 2*(medianIdx + 1);
 
-	/* defragment the remaining cells in original child */
-	newCellsOffset = bt->pager->page_size;
-	for (int i = 0; i < childNode->n_cells; i++) {
-		largestOffset = 0;
-		for (cellPos = 0; cellPos < childNode->n_cells; cellPos++) {
-			chidb_Btree_getCell(childNode, cellPos, &cell);
-			offset = get2byte(childNode->celloffset_array + 2*cellPos);
-			if (offset > largestOffset && offset < newCellsOffset) {
-				largestOffset = offset;
-				moveIdx = cellPos;
-			}
-		}
-		chidb_Btree_getCell(childNode, moveIdx, &cell);
-		cellSize = chidb_Btree_cellSize(&cell);
-		newCellsOffset -= cellSize;
-		childNode->cells_offset = newCellsOffset;
-		memmove(childNode->page->data + newCellsOffset, 
-				childNode->page->data + largestOffset, cellSize);
-		/* update cell offset array */
-		put2byte(childNode->celloffset_array + 2*moveIdx, newCellsOffset);
+	cellPos = chidb_Btree_findSlot(btn, key);
+	if (cellPos < btn->n_cells)
+		chidb_Btree_getCell(btn, cellPos, &btc);
+	if (cellPos == btn->n_cells || btc.key != key) {
+		chidb_Btree_freeMemNode(bt, btn);
+		return CHIDB_ENOTFOUND;
 	}
 
-	chidb_Btree_writeNode(bt, parentNode);
-	chidb_Btree_writeNode(bt, childNode);
-	chidb_Btree_writeNode(bt, newChildNode);
-
-	chidb_Btree_freeMemNode(bt, parentNode);
-	chidb_Btree_freeMemNode(bt, childNode);
-	chidb_Btree_freeMemNode(bt, newChildNode);
+	if (btc.fields.tableLeaf.data_size == size && btc.fields.tableLeaf.overflow_page == 0) {
+		memcpy(btc.fields.tableLeaf.data, data, size);
+		error = chidb_Btree_writeNode(bt, btn);
+		chidb_Btree_freeMemNode(bt, btn);
+		return error;
+	}
+	chidb_Btree_freeMemNode(bt, btn);
 
-	return CHIDB_OK;
+	error = chidb_Btree_delete(bt, nroot, key);
+	if (error != CHIDB_OK) return error;
+	return chidb_Btree_insertInTable(bt, nroot, key, data, size);
 }
 
 void SHOW_ALL_KEYS_AT_NODE(BTreeNode *node)
@@ -3,6 +3,7 @@
 
 #include "chidbInt.h"
 #include "pager.h"
+#include "sorter.h"
 
 /* Page header offsets and sizes */
 
@@ -21,6 +22,13 @@
 #define LEAFPG_CELLSOFFSET_OFFSET (8)
 #define INTPG_CELLSOFFSET_OFFSET (12)
 
+/* The page size is stored in two bytes at this offset of the file header.
+ * 65536 does not fit, so it is stored as 1 (and the Cells-Offset of an
+ * empty 65536-byte page is stored as 0) */
+#define FILEHEADER_PAGESIZE_OFFSET (0x10)
+#define DECODE_PAGE_SIZE(v) ((v) == 1 ? 65536 : (v))
+#define DECODE_CELLS_OFFSET(v) ((v) == 0 ? 65536 : (v))
+
 /* Cell offsets and sizes */
 
 #define TABLEINTCELL_CHILD_OFFSET (0)
@@ -34,22 +42,77 @@
 #define TABLELEAFCELL_SIZE_WITHOUTDATA (8)
 
 #define INDEXINTCELL_CHILD_OFFSET (0)
+#define INDEXINTCELL_SIZE_OFFSET (4)
 #define INDEXINTCELL_KEYIDX_OFFSET (8)
 #define INDEXINTCELL_KEYPK_OFFSET (12)
+#define INDEXINTCELL_EXTRA_OFFSET (16)
 
 #define INDEXLEAFCELL_SIZE_OFFSET (0)
 #define INDEXLEAFCELL_KEYIDX_OFFSET (4)
 #define INDEXLEAFCELL_KEYPK_OFFSET (8)
+#define INDEXLEAFCELL_EXTRA_OFFSET (12)
 
 #define INDEXINTCELL_SIZE (16)
 #define INDEXLEAFCELL_SIZE (12)
 
+/* The four bytes at INDEX*CELL_SIZE_OFFSET hold the header of the entry.
+ * A plain entry (just Key-Idx and Key-Pk) has INDEXCELL_PLAIN_HEADER there.
+ * An entry of a covering index is followed by a database record with the
+ * other columns of the index, and has the size of that record there
+ * instead, as a varint32 (so the highest bit of its first byte is set).
+ * The record is always held whole in the cell, and can take up at most
+ * INDEXCELL_MAX_EXTRA bytes, so that at least four cells fit in a page. */
+#define INDEXCELL_PLAIN_HEADER (0x0B030404)
+#define INDEXCELL_IS_COVERING(header) ((header)[0] & 0x80)
+#define INDEXCELL_MAX_EXTRA(page_size) (((page_size) - INTPG_CELLSOFFSET_OFFSET) / 4 - 2 \
+	- INDEXINTCELL_SIZE)
+
+/* A table leaf cell holds at most TABLELEAFCELL_MAX_LOCAL bytes of its
+ * data, so that at least four cells fit in a page. The rest of a larger
+ * record goes to a chain of overflow pages, and the cell ends with the
+ * number of the first one. Each overflow page starts with the number of
+ * the next page in the chain (0 in the last one), followed by data. */
+#define TABLELEAFCELL_OVERFLOW_SIZE (4)
+#define TABLELEAFCELL_MAX_LOCAL(page_size) (((page_size) - INTPG_CELLSOFFSET_OFFSET) / 4 - 2 \
+	- TABLELEAFCELL_SIZE_WITHOUTDATA - TABLELEAFCELL_OVERFLOW_SIZE)
+#define TABLELEAFCELL_MIN_LOCAL(page_size) (((page_size) - INTPG_CELLSOFFSET_OFFSET) / 8 - 2 \
+	- TABLELEAFCELL_SIZE_WITHOUTDATA - TABLELEAFCELL_OVERFLOW_SIZE)
+
+#define OVERFLOWPG_NEXT_OFFSET (0)
+#define OVERFLOWPG_DATA_OFFSET (4)
+
+/* Number of leaf pages a free-list trunk page can list: after the next
+ * trunk page and the number of leaves, the rest of the page holds 4-byte
+ * page numbers */
+#define FREELIST_TRUNK_LEAVES(page_size) ((uint32_t) ((page_size) - 8) / 4)
+
+/* A node (other than a root) is rebalanced when a deletion leaves less
+ * than a third of its space in use */
+#define BTREE_MIN_FILL(space) ((space) / 3)
+
 #define ISLEAF(type) ((type == PGTYPE_TABLE_LEAF) || (type == PGTYPE_INDEX_LEAF))
 
 // Advance declarations
 typedef struct BTreeCell BTreeCell;
 typedef struct BTreeNode BTreeNode;
 
+/* Several threads may insert into the same B-Tree at once. An insertion
+ * holds a latch on each node it works on: it latches a child before
+ * letting go of its parent, and lets go of the parent as soon as the child
+ * is known not to split (see chidb_Btree_insertNonFull). Latches are
+ * made when a page is first latched, and freed once nobody holds or waits
+ * for them. */
+#define BTREE_LATCH_BUCKETS (64)
+
+struct BTreeLatch
+{
+	npage_t npage;
+	pthread_rwlock_t lock;
+	uint32_t refs;			/* Threads holding or waiting for the latch */
+	struct BTreeLatch *next;	/* Next latch in the same bucket */
+};
+typedef struct BTreeLatch BTreeLatch;
+
 /* The BTree struct represent a "B-Tree file". It contains a pointer to the
  * chidb database it is a part of, and a pointer to a Pager, which it will
  * use to access pages on the file */
@@ -57,6 +120,9 @@ struct BTree
 {
 	chidb *db;
 	Pager *pager;
+	pthread_mutex_t alloc_lock;	/* Held while a page is allocated or freed */
+	pthread_mutex_t latches_lock;	/* Guards latches */
+	BTreeLatch *latches[BTREE_LATCH_BUCKETS];	/* Latches in use, by page number */
 };
 
 /* The BTreeNode struct is an in-memory representation of a B-Tree node. Thus,
@@ -77,8 +143,9 @@ struct BTreeNode
 	uint8_t type;              /* Type of page  */
 	uint16_t free_offset;      /* Byte offset of free space in page */ 
 	ncell_t n_cells;           /* Number of cells */
-	uint16_t cells_offset;     /* Byte offset of start of cells in page */
+	uint32_t cells_offset;     /* Byte offset of start of cells in page */
 	npage_t right_page;        /* Right page (internal nodes only) */
+	uint32_t page_size;        /* Size of the page (tells how much of a record its cell holds) */
 	uint8_t *celloffset_array; /* Pointer to start of cell offset array in the in-memory page */
 };
 
@@ -96,46 +163,77 @@ struct BTreeCell
 		} tableInternal;
 		struct
 		{
-			uint32_t data_size;  /* Number of bytes of data stored in this cell */
-			uint8_t *data;       /* Pointer to in-memory copy of data stored in this cell */
+			uint32_t data_size;  /* Number of bytes of data of this entry */
+			uint8_t *data;       /* Pointer to in-memory copy of data stored in this cell
+			                        (only the first bytes if there are overflow pages) */
+			npage_t overflow_page; /* First overflow page (0 if the cell holds all the data) */
 		} tableLeaf;
 		struct
 		{
 			key_t keyPk;         /* Primary key of row where the indexed field is equal to key */
 			npage_t child_page;  /* Child page with keys < key */
+			uint8_t *extra;      /* Pointer to in-memory record with the other columns of a
+			                        covering index (NULL in plain entries) */
+			uint32_t extra_size; /* Number of bytes of extra */
 		} indexInternal;
 		struct
 		{
 			key_t keyPk;         /* Primary key of row where the indexed field is equal to key */
+			uint8_t *extra;      /* As in indexInternal */
+			uint32_t extra_size;
 		} indexLeaf;
 	} fields;
 };
 
  
 int chidb_Btree_open(const char *filename, chidb *db, BTree **bt);
+int chidb_Btree_openPageSize(const char *filename, chidb *db, BTree **bt, uint32_t page_size);
 int chidb_Btree_close(BTree *bt);
 
 int chidb_Btree_getNodeByPage(BTree *bt, npage_t npage, BTreeNode **node);
+int chidb_Btree_getNodeAt(BTree *bt, npage_t npage, uint64_t snapshot, BTreeNode **node);
 int chidb_Btree_freeMemNode(BTree *bt, BTreeNode *btn);
 
+int chidb_Btree_allocatePage(BTree *bt, npage_t *npage);
+int chidb_Btree_freePage(BTree *bt, npage_t npage);
+int chidb_Btree_freeTree(BTree *bt, npage_t nroot);
+
+int chidb_Btree_latch(BTree *bt, npage_t npage, bool exclusive);
+void chidb_Btree_unlatch(BTree *bt, npage_t npage);
+
 int chidb_Btree_newNode(BTree *bt, npage_t *npage, uint8_t type);
 int chidb_Btree_initEmptyNode(BTree *bt, npage_t npage, uint8_t type);
 int chidb_Btree_writeNode(BTree *bt, BTreeNode *node);
 
 int chidb_Btree_getCell(BTreeNode *btn, ncell_t ncell, BTreeCell *cell);
+ncell_t chidb_Btree_findSlot(BTreeNode *btn, key_t key);
 int chidb_Btree_insertCell(BTreeNode *btn, ncell_t ncell, BTreeCell *cell);
+int chidb_Btree_removeCell(BTreeNode *btn, ncell_t ncell);
+int chidb_Btree_getCellData(BTree *bt, BTreeCell *btc, uint8_t *data);
+int chidb_Btree_getCellDataAt(BTree *bt, BTreeCell *btc, uint64_t snapshot, uint8_t *data);
 
-int chidb_Btree_find(BTree *bt, npage_t nroot, key_t key, uint8_t **data, uint16_t *size);
+int chidb_Btree_find(BTree *bt, npage_t nroot, key_t key, uint8_t **data, uint32_t *size);
+int chidb_Btree_countEntries(BTree *bt, npage_t nroot, uint32_t *count);
+int chidb_Btree_countEntriesAt(BTree *bt, npage_t nroot, uint64_t snapshot, uint32_t *count);
 
-int chidb_Btree_insertInTable(BTree *bt, npage_t nroot, key_t key, uint8_t *data, uint16_t size);
+int chidb_Btree_insertInTable(BTree *bt, npage_t nroot, key_t key, uint8_t *data, uint32_t size);
 int chidb_Btree_insertInIndex(BTree *bt, npage_t nroot, key_t keyIdx, key_t keyPk);
+int chidb_Btree_insertInCoveringIndex(BTree *bt, npage_t nroot, key_t keyIdx, key_t keyPk,
+				      uint8_t *record, uint32_t size);
+int chidb_Btree_bulkLoadIndex(BTree *bt, npage_t nroot, Sorter *sorter);
 int chidb_Btree_insert(BTree *bt, npage_t nroot, BTreeCell *btc);
 int chidb_Btree_insertNonFull(BTree *bt, npage_t npage, BTreeCell *btc);
+int chidb_Btree_delete(BTree *bt, npage_t nroot, key_t key);
+int chidb_Btree_deleteFromIndex(BTree *bt, npage_t nroot, key_t keyIdx, key_t keyPk);
+int chidb_Btree_update(BTree *bt, npage_t nroot, key_t key, uint8_t *data, uint32_t size);
 int chidb_Btree_split(BTree *bt, npage_t npage_parent, npage_t npage_child, ncell_t parent_cell, npage_t *npage_child2);
 
-void chidb_initialize_file_header(uint8_t *header);
+void chidb_initialize_file_header(uint8_t *header, uint32_t page_size);
 int chidb_validate_file_header(uint8_t *header);
-int chidb_Btree_cellSize(BTreeCell *cell);
+int chidb_Btree_getSchemaCookie(BTree *bt, uint32_t *cookie);
+int chidb_Btree_getSchemaCookieAt(BTree *bt, uint64_t snapshot, uint32_t *cookie);
+int chidb_Btree_incrSchemaCookie(BTree *bt);
+int chidb_Btree_cellSize(BTreeNode *btn, BTreeCell *cell);
 
 void SHOW_ALL_KEYS_AT_NODE(BTreeNode *node);
 void SHOW_ALL_KEYS(BTree *bt);
@@ -0,0 +1,255 @@
+/*****************************************************************************
+ *
+ *																 chidb
+ *
+ * Streaming CSV reader.
+ *
+ * The file is read in chunks of CSV_CHUNK_SIZE bytes, and parsed one row
+ * at a time into a buffer that is reused from row to row, so files of any
+ * size are read with a constant amount of memory:
+ *
+ *   CSVReader csv;
+ *   chidb_CSV_open(&csv, f);
+ *   while ((rc = chidb_CSV_next(&csv)) == CHIDB_ROW)
+ *       for (int i = 0; i < csv.nfields; i++)
+ *           printf("%s\n", csv.row + csv.fields[i]);
+ *   chidb_CSV_close(&csv);
+ *
+\*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "csv.h"
+
+
+/* Append a byte to the current row
+ *
+ * Parameters
+ * - csv: The CSVReader
+ * - c: Byte to append
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+static int chidb_CSV_append(CSVReader *csv, char c)
+{
+	if (csv->row_len == csv->row_size)
+	{
+		uint32_t size = csv->row_size ? 2 * csv->row_size : 256;
+		char *row = realloc(csv->row, size);
+		if (row == NULL)
+			return CHIDB_ENOMEM;
+		csv->row = row;
+		csv->row_size = size;
+	}
+
+	csv->row[csv->row_len++] = c;
+	return CHIDB_OK;
+}
+
+
+/* Start a new field in the current row
+ *
+ * Parameters
+ * - csv: The CSVReader
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+static int chidb_CSV_startField(CSVReader *csv)
+{
+	if (csv->nfields == csv->fields_size)
+	{
+		uint32_t size = csv->fields_size ? 2 * csv->fields_size : 16;
+		uint32_t *fields = realloc(csv->fields, size * sizeof(uint32_t));
+		if (fields == NULL)
+			return CHIDB_ENOMEM;
+		csv->fields = fields;
+		uint32_t *lengths = realloc(csv->lengths, size * sizeof(uint32_t));
+		if (lengths == NULL)
+			return CHIDB_ENOMEM;
+		csv->lengths = lengths;
+		csv->fields_size = size;
+	}
+
+	csv->fields[csv->nfields++] = csv->row_len;
+	return CHIDB_OK;
+}
+
+
+/* Finish the last field of the current row
+ *
+ * Parameters
+ * - csv: The CSVReader
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+static int chidb_CSV_endField(CSVReader *csv)
+{
+	csv->lengths[csv->nfields - 1] = csv->row_len - csv->fields[csv->nfields - 1];
+	return chidb_CSV_append(csv, '\0');
+}
+
+
+/* Start reading a CSV file
+ *
+ * Parameters
+ * - csv: Reader to initialize
+ * - f: File to read, positioned at the first row
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_CSV_open(CSVReader *csv, FILE *f)
+{
+	memset(csv, 0, sizeof(CSVReader));
+	csv->f = f;
+	csv->buf = malloc(CSV_CHUNK_SIZE);
+	if (csv->buf == NULL)
+		return CHIDB_ENOMEM;
+
+	return CHIDB_OK;
+}
+
+
+/* Read the next row of a CSV file
+ *
+ * Empty lines are skipped. The fields of the row are valid until the
+ * next call.
+ *
+ * Parameters
+ * - csv: The CSVReader
+ *
+ * Return
+ * - CHIDB_ROW: A row was read into csv->row
+ * - CHIDB_DONE: There are no more rows
+ * - CHIDB_EMISMATCH: A quoted field is never closed
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when reading the file
+ */
+int chidb_CSV_next(CSVReader *csv)
+{
+	enum { FIELD_START, UNQUOTED, QUOTED, QUOTE_IN_QUOTED } state = FIELD_START;
+	bool blank = true;
+	int rc = CHIDB_OK;
+
+	csv->row_len = 0;
+	csv->nfields = 0;
+
+	while (rc == CHIDB_OK)
+	{
+		if (csv->buf_pos == csv->buf_len)
+		{
+			csv->buf_len = fread(csv->buf, 1, CSV_CHUNK_SIZE, csv->f);
+			csv->buf_pos = 0;
+			if (csv->buf_len == 0)
+			{
+				if (ferror(csv->f))
+					return CHIDB_EIO;
+				if (state == QUOTED)
+					return CHIDB_EMISMATCH;
+				if (blank)
+					return CHIDB_DONE;
+
+				// Last row, without a newline at the end
+				if (state == FIELD_START)
+					rc = chidb_CSV_startField(csv);
+				if (rc == CHIDB_OK)
+					rc = chidb_CSV_endField(csv);
+				return (rc == CHIDB_OK) ? CHIDB_ROW : rc;
+			}
+		}
+
+		char c = csv->buf[csv->buf_pos++];
+		switch (state)
+		{
+			case FIELD_START:
+				rc = chidb_CSV_startField(csv);
+				if (c == '"')
+				{
+					blank = false;
+					state = QUOTED;
+					break;
+				}
+				state = UNQUOTED;
+				/* Fall through */
+
+			case UNQUOTED:
+				if (c == ',')
+				{
+					blank = false;
+					rc = chidb_CSV_endField(csv);
+					state = FIELD_START;
+				}
+				else if (c == '\n')
+				{
+					csv->line++;
+					if (blank)
+					{
+						csv->row_len = 0;
+						csv->nfields = 0;
+						state = FIELD_START;
+						break;
+					}
+					rc = chidb_CSV_endField(csv);
+					return (rc == CHIDB_OK) ? CHIDB_ROW : rc;
+				}
+				else if (c != '\r')
+				{
+					blank = false;
+					rc = chidb_CSV_append(csv, c);
+				}
+				break;
+
+			case QUOTED:
+				if (c == '"')
+					state = QUOTE_IN_QUOTED;
+				else
+				{
+					if (c == '\n')
+						csv->line++;
+					rc = chidb_CSV_append(csv, c);
+				}
+				break;
+
+			case QUOTE_IN_QUOTED:
+				if (c == '"')
+				{
+					// A quote written twice is a literal quote
+					rc = chidb_CSV_append(csv, c);
+					state = QUOTED;
+				}
+				else
+				{
+					// End of the quoted part, read c again as an unquoted byte
+					csv->buf_pos--;
+					state = UNQUOTED;
+				}
+				break;
+		}
+	}
+
+	return rc;
+}
+
+
+/* Free the memory used by a CSVReader
+ *
+ * The file itself is not closed.
+ *
+ * Parameters
+ * - csv: The CSVReader
+ */
+void chidb_CSV_close(CSVReader *csv)
+{
+	free(csv->buf);
+	free(csv->row);
+	free(csv->fields);
+	free(csv->lengths);
+}
@@ -0,0 +1,35 @@
+#ifndef CSV_H_
+#define CSV_H_
+
+#include <chidbInt.h>
+
+/* A CSVReader reads a CSV file one row at a time, in large chunks.
+ * Fields are separated by commas and rows by newlines (a CR before the
+ * newline is ignored). Fields may be enclosed in double quotes, in which
+ * case they can contain commas, newlines, and quotes (written twice). */
+
+#define CSV_CHUNK_SIZE (1 << 16)
+
+struct CSVReader
+{
+	FILE *f;
+	char *buf;		/* Chunk of the file being parsed */
+	size_t buf_len;		/* Bytes in the chunk */
+	size_t buf_pos;		/* Next byte to parse */
+	uint32_t line;		/* Lines read so far */
+
+	char *row;		/* Fields of the current row, each NUL-terminated */
+	uint32_t row_len;	/* Bytes used in row */
+	uint32_t row_size;	/* Allocated length of row */
+	uint32_t *fields;	/* Offset of each field in row */
+	uint32_t *lengths;	/* Length of each field */
+	uint32_t nfields;	/* Number of fields in the current row */
+	uint32_t fields_size;	/* Allocated length of fields and lengths */
+};
+typedef struct CSVReader CSVReader;
+
+int chidb_CSV_open(CSVReader *csv, FILE *f);
+int chidb_CSV_next(CSVReader *csv);
+void chidb_CSV_close(CSVReader *csv);
+
+#endif /*CSV_H_*/
@@ -15,32 +15,35 @@ int chidb_DBM_create(chidb *db, DBM **machine) {
   DBM *newMachine = (DBM *) malloc(sizeof(DBM));
   if (NULL == newMachine) return CHIDB_ENOMEM;
 
-  // Nothing in the machine just yet, but allocate space anyway
-  newMachine->pc            = 0;
-  newMachine->instructions  = malloc(sizeof(DBMInstruction));
-  newMachine->ninstructions = 0;
-  newMachine->registers     = malloc(sizeof(DBMRegister));
-  newMachine->nregisters    = 0;
-  newMachine->cursors       = malloc(sizeof(DBMCursor));
-  newMachine->ncursors      = 0;
-  newMachine->db            = db;
-
-  newMachine->nnodes = newMachine->db->bt->pager->n_pages;
-  newMachine->nodes  = malloc(newMachine->nnodes * sizeof(BTreeNode));
-
-  int rc;
-  BTreeNode *btn;
-  for (npage_t i = 1; i <= newMachine->nnodes; ++i) {
-    rc = chidb_Btree_getNodeByPage(newMachine->db->bt, i, &btn);
-    if (CHIDB_OK != rc) return rc;
-    newMachine->nodes[i-1] = btn;
-  }
-
-  newMachine->ncells = 0;
-  newMachine->cells  = malloc(sizeof(DBMCell));
-  if (NULL == newMachine->cells) return CHIDB_ENOMEM;
-  rc = chidb_DBM_grab_cells(newMachine);
-  if (CHIDB_OK != rc) return rc;
+  // Everything the machine needs is allocated from its arenas as it goes
+  chidb_Arena_init(&newMachine->arena, ARENA_BLOCK_SIZE);
+  chidb_Arena_init(&newMachine->row_arena, ARENA_BLOCK_SIZE);
+  newMachine->running    = false;
+  newMachine->row_marked = false;
+
+  // Nothing in the machine just yet
+  newMachine->pc                = 0;
+  newMachine->instructions      = NULL;
+  newMachine->ninstructions     = 0;
+  newMachine->instructions_size = 0;
+  newMachine->registers         = NULL;
+  newMachine->nregisters        = 0;
+  newMachine->registers_size    = 0;
+  newMachine->cursors           = NULL;
+  newMachine->ncursors          = 0;
+  newMachine->cursors_size      = 0;
+  newMachine->db                = db;
+
+  // B-Tree nodes are only loaded when a cursor is first opened
+  newMachine->snapshot        = PAGER_LATEST;
+  newMachine->snapshot_npages = 0;
+  newMachine->nodes  = NULL;
+  newMachine->nnodes = 0;
+  newMachine->ncells     = 0;
+  newMachine->cells_size = 0;
+  newMachine->record_cell = NULL;
+  newMachine->record      = NULL;
+  newMachine->cells      = NULL;
 
   newMachine->jumped    = false;
   newMachine->returned  = false;
@@ -48,7 +51,40 @@ int chidb_DBM_create(chidb *db, DBM **machine) {
   newMachine->root_page =    -1; // Bogus
   newMachine->maps      =  NULL;
   newMachine->nmaps     =     0;
-  newMachine->result    =  NULL;
+  newMachine->result      = NULL;
+  newMachine->nresult     = 0;
+  newMachine->result_size = 0;
+
+  newMachine->record_fields = NULL;
+  newMachine->record_size   = 0;
+
+  newMachine->groups          = NULL;
+  newMachine->ngroups         = 0;
+  newMachine->group_nkeys     = 0;
+  newMachine->group_keys      = NULL;
+  newMachine->group_keys_size = 0;
+  newMachine->group_naggs     = 0;
+  newMachine->group_buckets   = NULL;
+  newMachine->group_nbuckets  = 0;
+  newMachine->group_current   = 0;
+  newMachine->group_emitted   = 0;
+  newMachine->group_output    = 0;
+
+  newMachine->params  = NULL;
+  newMachine->nparams = 0;
+
+  // Scans are split across one thread per processor, when large enough
+  long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+  newMachine->nthreads       = (nprocs < 1) ? 1 : (nprocs > DBM_SCAN_MAX_THREADS) ? DBM_SCAN_MAX_THREADS : nprocs;
+  newMachine->scan_min_cells = DBM_SCAN_MIN_CELLS;
+  newMachine->scan           = NULL;
+
+  // Scan loops run a batch of rows at a time
+  newMachine->batch_size = DBM_BATCH_SIZE;
+  newMachine->batch      = NULL;
+
+  newMachine->err     = 0;
+  newMachine->err_msg = NULL;
 
   *machine = newMachine;
   return CHIDB_OK;
@@ -70,31 +106,28 @@ int chidb_DBM_create(chidb *db, DBM **machine) {
 int chidb_DBM_destroy(DBM *machine) {
   int rc;
 
-  for (uint32_t i = 0; i < machine->ncursors; ++i) {
-    rc = chidb_DBM_execute_Close(machine, &machine->cursors[i]);
+  chidb_DBM_end_scan(machine);
+  while (machine->ncursors > 0) {
+    rc = chidb_DBM_execute_Close(machine, &machine->cursors[0]);
     if (CHIDB_OK != rc) return rc;
   }
 
-  for (uint32_t i = 0; i < machine->nregisters; ++i) {
-    chidb_DBM_free_register(&machine->registers[i]);
-  }
-
-  for (uint32_t i = 0; i < machine->nnodes; ++i) {
-    rc = chidb_Btree_freeMemNode(machine->db->bt, machine->nodes[i]);
-    if (CHIDB_OK != rc) return rc;
-  }
+  rc = chidb_DBM_free_nodes(machine);
+  if (CHIDB_OK != rc) return rc;
 
-  if (machine->nmaps > 0) {
-    free(machine->maps);
+  for (uint32_t i = 0; i < machine->nparams; ++i) {
+    chidb_DBM_free_register(&machine->params[i]);
   }
 
   if (machine->err > 0) {
     free(machine->err_msg);
   }
 
-  if (machine->result != NULL) {
-    chidb_DBRecord_destroy(machine->result);
-  }
+  chidb_DBM_free_groups(machine);
+
+  // Program, registers, cursors, cells, rows...
+  chidb_Arena_destroy(&machine->row_arena);
+  chidb_Arena_destroy(&machine->arena);
 
   free(machine);
   machine = NULL;
@@ -103,6 +136,61 @@ int chidb_DBM_destroy(DBM *machine) {
 
 
 
+/* Remember where the memory of the current row starts
+ *
+ * Only the first call of a run marks the row arena; memory allocated
+ * before it (if any) lasts until the machine is reset.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ */
+void chidb_DBM_mark_row(DBM *machine) {
+  if (!machine->row_marked) {
+    machine->row_mark   = chidb_Arena_mark(&machine->row_arena);
+    machine->row_marked = true;
+  }
+}
+
+
+
+/* Release the memory of the current row
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ */
+void chidb_DBM_release_row(DBM *machine) {
+  if (machine->row_marked) chidb_Arena_release(&machine->row_arena, machine->row_mark);
+  machine->record_cell = NULL;
+  machine->record      = NULL;
+}
+
+
+
+/* Grow an array allocated from the machine's arena
+ *
+ * The capacity doubles each time, so adding n elements one by one only
+ * copies the array about log(n) times.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - array: Array to grow (may be NULL)
+ * - size: In/out parameter; allocated length of the array
+ * - elem_size: Size of one element
+ *
+ * Return
+ * - Pointer to the (possibly moved) array, or NULL if it could not be
+ *   allocated (in which case array and size are left untouched)
+ */
+void *chidb_DBM_grow_array(DBM *machine, void *array, uint32_t *size, size_t elem_size) {
+  uint32_t new_size = (*size == 0) ? 8 : 2 * *size;
+  void *grown = chidb_Arena_grow(&machine->arena, array, *size * elem_size, new_size * elem_size);
+  if (NULL == grown) return NULL;
+  *size = new_size;
+  return grown;
+}
+
+
+
 /* Add an instruction to the machine's program
  *
  * Parameters
@@ -114,8 +202,11 @@ int chidb_DBM_destroy(DBM *machine) {
  * - CHIDB_ENOMEM: Could not allocate memory
  */
 int chidb_DBM_add_instruction(DBM *machine, DBMInstruction *instruction) {
-  machine->instructions = realloc(machine->instructions, (machine->ninstructions + 1) * sizeof(DBMInstruction));
-  if (NULL == machine->instructions) return CHIDB_ENOMEM;
+  if (machine->ninstructions == machine->instructions_size) {
+    void *grown = chidb_DBM_grow_array(machine, machine->instructions, &machine->instructions_size, sizeof(DBMInstruction));
+    if (NULL == grown) return CHIDB_ENOMEM;
+    machine->instructions = grown;
+  }
 
   machine->instructions[machine->ninstructions]         = *instruction;
   machine->instructions[machine->ninstructions].machine = machine;
@@ -143,6 +234,16 @@ int chidb_DBM_execute(DBM *machine) {
   machine->returned = false;
   machine->jumped   = false;
 
+  // The rows of a split scan are handed out before going on
+  if (NULL != machine->scan) return chidb_DBM_scan_row(machine);
+  if (NULL != machine->batch) return chidb_DBM_batch_row(machine);
+
+  // Running off the end of the program (or an empty one) halts the machine
+  if (machine->pc >= machine->ninstructions) {
+    machine->halted = true;
+    return CHIDB_OK;
+  }
+
   DBMInstruction *inst = &machine->instructions[machine->pc];
 
   if (_OpenRead_ == inst->op) {
@@ -176,7 +277,13 @@ int chidb_DBM_execute(DBM *machine) {
     DBMCursor *cursor;
     rc = chidb_DBM_find_cursor(machine, inst->p1, &cursor);
     if (CHIDB_OK != rc) return rc;
-    rc = chidb_DBM_execute_Rewind(machine, cursor, inst->p2);
+    // p3 marks a scan loop that may be split across threads, or run a batch at a time
+    if (0 != inst->p3 && machine->nthreads > 1)
+      rc = chidb_DBM_execute_ParallelScan(machine, cursor, inst->p2);
+    else if (0 != inst->p3)
+      rc = chidb_DBM_execute_BatchScan(machine, cursor, inst->p2);
+    else
+      rc = chidb_DBM_execute_Rewind(machine, cursor, inst->p2);
   }
 
   if (_Next_ == inst->op) {
@@ -279,10 +386,7 @@ int chidb_DBM_execute(DBM *machine) {
 
     // Must have an integer key and a db-record stored in a string
     if (DBM_STRING_REGISTER_TYPE == reg1->type && DBM_INTEGER_REGISTER_TYPE == reg2->type) {
-      DBRecord *record;
-      rc = chidb_DBRecord_unpack(&record, reg1->fields.string.data);
-      if (CHIDB_OK != rc) return rc;
-      rc = chidb_DBM_execute_Insert(machine, cursor, reg2->fields.integer, record);
+      rc = chidb_DBM_execute_Insert(machine, cursor, reg2->fields.integer, reg1);
     }
   }
 
@@ -293,7 +397,7 @@ int chidb_DBM_execute(DBM *machine) {
     DBMRegister *reg2;
     rc = chidb_DBM_find_register(machine, inst->p3, &reg2);
     if (CHIDB_OK != rc) return rc;
-    rc = chidb_DBM_execute_Eq(machine, *reg1, *reg2, inst->p2);
+    rc = chidb_DBM_execute_Eq(machine, reg1, reg2, inst->p2);
   }
 
   if (_Ne_ == inst->op) {
@@ -303,7 +407,7 @@ int chidb_DBM_execute(DBM *machine) {
     DBMRegister *reg2;
     rc = chidb_DBM_find_register(machine, inst->p3, &reg2);
     if (CHIDB_OK != rc) return rc;
-    rc = chidb_DBM_execute_Ne(machine, *reg1, *reg2, inst->p2);
+    rc = chidb_DBM_execute_Ne(machine, reg1, reg2, inst->p2);
   }
 
   if (_Lt_ == inst->op) {
@@ -313,7 +417,7 @@ int chidb_DBM_execute(DBM *machine) {
     DBMRegister *reg2;
     rc = chidb_DBM_find_register(machine, inst->p3, &reg2);
     if (CHIDB_OK != rc) return rc;
-    rc = chidb_DBM_execute_Lt(machine, *reg1, *reg2, inst->p2);
+    rc = chidb_DBM_execute_Lt(machine, reg1, reg2, inst->p2);
   }
 
   if (_Le_ == inst->op) {
@@ -323,7 +427,7 @@ int chidb_DBM_execute(DBM *machine) {
     DBMRegister *reg2;
     rc = chidb_DBM_find_register(machine, inst->p3, &reg2);
     if (CHIDB_OK != rc) return rc;
-    rc = chidb_DBM_execute_Le(machine, *reg1, *reg2, inst->p2);
+    rc = chidb_DBM_execute_Le(machine, reg1, reg2, inst->p2);
   }
 
   if (_Gt_ == inst->op) {
@@ -333,7 +437,7 @@ int chidb_DBM_execute(DBM *machine) {
     DBMRegister *reg2;
     rc = chidb_DBM_find_register(machine, inst->p3, &reg2);
     if (CHIDB_OK != rc) return rc;
-    rc = chidb_DBM_execute_Gt(machine, *reg1, *reg2, inst->p2);
+    rc = chidb_DBM_execute_Gt(machine, reg1, reg2, inst->p2);
   }
 
   if (_Ge_ == inst->op) {
@@ -343,7 +447,7 @@ int chidb_DBM_execute(DBM *machine) {
     DBMRegister *reg2;
     rc = chidb_DBM_find_register(machine, inst->p3, &reg2);
     if (CHIDB_OK != rc) return rc;
-    rc = chidb_DBM_execute_Ge(machine, *reg1, *reg2, inst->p2);
+    rc = chidb_DBM_execute_Ge(machine, reg1, reg2, inst->p2);
   }
 
   if (_IdxGt_ == inst->op) {
@@ -397,7 +501,7 @@ int chidb_DBM_execute(DBM *machine) {
   }
 
   if (_IdxInsert_ == inst->op) {
-    DBMRegister *reg1, *reg2;
+    DBMRegister *reg1, *reg2, *record = NULL;
     DBMCursor *cursor;
     rc = chidb_DBM_find_register(machine, inst->p2, &reg1);
     if(CHIDB_OK != rc) return rc;
@@ -405,22 +509,36 @@ int chidb_DBM_execute(DBM *machine) {
     if(CHIDB_OK != rc) return rc;
     rc = chidb_DBM_find_cursor(machine, inst->p1,&cursor); 
     if(CHIDB_OK != rc) return rc;
-    rc = chidb_DBM_execute_IdxInsert(machine,*reg1,*reg2,*cursor);
+    // Covering indexes are opened with their number of columns, plain ones with 0
+    if (cursor->ncols > 0) {
+      rc = chidb_DBM_find_register(machine, inst->p3 + 1, &record);
+      if(CHIDB_OK != rc) return rc;
+    }
+    rc = chidb_DBM_execute_IdxInsert(machine,*reg1,*reg2,record,cursor);
   }
 
-/*
-  if (_CreateTable_ == inst->op) {}
+  if (_CreateTable_ == inst->op) {
+    DBMRegister *reg;
+    rc = chidb_DBM_find_or_create_register(machine, inst->p1, &reg);
+    if (CHIDB_OK != rc) return rc;
+    rc = chidb_DBM_execute_CreateTable(machine, reg);
+  }
 
-  if (_CreateIndex_ == inst->op) {}
-*/
+  if (_CreateIndex_ == inst->op) {
+    DBMRegister *reg;
+    rc = chidb_DBM_find_or_create_register(machine, inst->p1, &reg);
+    if (CHIDB_OK != rc) return rc;
+    rc = chidb_DBM_execute_CreateIndex(machine, reg);
+  }
 
   if (_SCopy_ == inst->op) {
+    // The target first: creating it may move the other registers
+    DBMRegister *reg2;
+    rc = chidb_DBM_find_or_create_register(machine, inst->p2, &reg2);
+    if (CHIDB_OK != rc) return rc;
     DBMRegister *reg1;
     rc = chidb_DBM_find_register(machine, inst->p1, &reg1);
     if (CHIDB_OK != rc) return rc;
-    DBMRegister *reg2;
-    rc = chidb_DBM_find_register(machine, inst->p2, &reg2);
-    if (CHIDB_OK != rc) return rc;
     rc = chidb_DBM_execute_SCopy(machine, reg1, reg2);
   }
 
@@ -428,6 +546,112 @@ int chidb_DBM_execute(DBM *machine) {
     rc = chidb_DBM_execute_Halt(machine, inst->p1, inst->p4);
   }
 
+  if (_GroupSelect_ == inst->op) {
+    rc = chidb_DBM_execute_GroupSelect(machine, inst->p1, inst->p2, inst->p3);
+  }
+
+  if (_AggStep_ == inst->op) {
+    DBMRegister *reg = NULL; // COUNT(*) has no input register
+    if (inst->p2 >= 0) {
+      rc = chidb_DBM_find_register(machine, inst->p2, &reg);
+      if (CHIDB_OK != rc) return rc;
+    }
+    rc = chidb_DBM_execute_AggStep(machine, inst->p1, reg, inst->p3);
+  }
+
+  if (_GroupEmit_ == inst->op) {
+    rc = chidb_DBM_execute_GroupEmit(machine, inst->p2, inst->p3);
+  }
+
+  if (_GroupKey_ == inst->op) {
+    DBMRegister *reg;
+    rc = chidb_DBM_find_or_create_register(machine, inst->p2, &reg);
+    if (CHIDB_OK != rc) return rc;
+    rc = chidb_DBM_execute_GroupKey(machine, inst->p1, reg);
+  }
+
+  if (_AggFinal_ == inst->op) {
+    DBMRegister *reg;
+    rc = chidb_DBM_find_or_create_register(machine, inst->p2, &reg);
+    if (CHIDB_OK != rc) return rc;
+    rc = chidb_DBM_execute_AggFinal(machine, inst->p1, reg, inst->p3);
+  }
+
+  if (_Goto_ == inst->op) {
+    rc = chidb_DBM_execute_Goto(machine, inst->p2);
+  }
+
+  if (_Count_ == inst->op) {
+    DBMRegister *reg;
+    rc = chidb_DBM_find_or_create_register(machine, inst->p2, &reg);
+    if (CHIDB_OK != rc) return rc;
+    rc = chidb_DBM_execute_Count(machine, inst->p1, reg);
+  }
+
+  if (_Variable_ == inst->op) {
+    DBMRegister *reg;
+    rc = chidb_DBM_find_or_create_register(machine, inst->p2, &reg);
+    if (CHIDB_OK != rc) return rc;
+    rc = chidb_DBM_execute_Variable(machine, inst->p1, reg);
+  }
+
+  if (_Delete_ == inst->op) {
+    DBMCursor *cursor;
+    rc = chidb_DBM_find_cursor(machine, inst->p1, &cursor);
+    if (CHIDB_OK != rc) return rc;
+    DBMRegister *reg;
+    rc = chidb_DBM_find_register(machine, inst->p2, &reg);
+    if (CHIDB_OK != rc) return rc;
+
+    if (DBM_INTEGER_REGISTER_TYPE != reg->type) return CHIDB_EMISMATCH;
+    rc = chidb_DBM_execute_Delete(machine, cursor, reg->fields.integer);
+  }
+
+  if (_Update_ == inst->op) {
+    DBMCursor *cursor;
+    rc = chidb_DBM_find_cursor(machine, inst->p1, &cursor);
+    if (CHIDB_OK != rc) return rc;
+    DBMRegister *reg1;
+    rc = chidb_DBM_find_register(machine, inst->p2, &reg1);
+    if (CHIDB_OK != rc) return rc;
+    DBMRegister *reg2;
+    rc = chidb_DBM_find_register(machine, inst->p3, &reg2);
+    if (CHIDB_OK != rc) return rc;
+
+    // Same operands as Insert
+    if (DBM_STRING_REGISTER_TYPE != reg1->type || DBM_INTEGER_REGISTER_TYPE != reg2->type) return CHIDB_EMISMATCH;
+    rc = chidb_DBM_execute_Update(machine, cursor, reg2->fields.integer, reg1);
+  }
+
+  if (_SorterOpen_ == inst->op) {
+    DBMCursor *cursor;
+    rc = chidb_DBM_find_or_create_cursor(machine, inst->p1, &cursor);
+    if (CHIDB_OK != rc) return rc;
+    rc = chidb_DBM_execute_SorterOpen(machine, cursor, inst->p2);
+  }
+
+  if (_BulkLoad_ == inst->op) {
+    DBMCursor *sorter, *cursor;
+    rc = chidb_DBM_find_cursor(machine, inst->p1, &sorter);
+    if (CHIDB_OK != rc) return rc;
+    rc = chidb_DBM_find_cursor(machine, inst->p2, &cursor);
+    if (CHIDB_OK != rc) return rc;
+    rc = chidb_DBM_execute_BulkLoad(machine, sorter, cursor);
+  }
+
+  if (_IdxDelete_ == inst->op) {
+    DBMCursor *cursor;
+    rc = chidb_DBM_find_cursor(machine, inst->p1, &cursor);
+    if (CHIDB_OK != rc) return rc;
+    DBMRegister *reg1;
+    rc = chidb_DBM_find_register(machine, inst->p2, &reg1);
+    if (CHIDB_OK != rc) return rc;
+    DBMRegister *reg2;
+    rc = chidb_DBM_find_register(machine, inst->p3, &reg2);
+    if (CHIDB_OK != rc) return rc;
+    rc = chidb_DBM_execute_IdxDelete(machine, reg1, reg2, cursor);
+  }
+
   if (CHIDB_OK == rc && !machine->jumped) ++machine->pc;
   return rc;
 }
@@ -446,6 +670,14 @@ int chidb_DBM_execute(DBM *machine) {
  */
 int chidb_DBM_step(DBM *machine) {
   int rc;
+  machine->nresult = 0;
+
+  // Everything allocated from here on belongs to this run of the program
+  if (!machine->running) {
+    machine->run_mark = chidb_Arena_mark(&machine->arena);
+    machine->running  = true;
+  }
+
   do {
     rc = chidb_DBM_execute(machine);
     if (CHIDB_OK == rc && machine->returned) {
@@ -457,276 +689,355 @@ int chidb_DBM_step(DBM *machine) {
 
 
 
-/* Fill in cells given the machine current B-Tree nodes
+/* Rewind the machine so its program can be run again
+ *
+ * Cursors, groups and loaded B-Tree nodes are dropped, so the next run
+ * sees any changes made to the file in the meantime (unless the machine
+ * reads the file at a snapshot, which it keeps). All the memory
+ * allocated by the run is released at once; the program and bound
+ * parameters are kept.
  *
  * Parameters
  * - machine: DBM to act upon
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_grab_cells(DBM *machine) {
+int chidb_DBM_reset(DBM *machine) {
   int rc;
-  BTreeCell btc;
-
-  // Skip schema on page 1 (index 0 in DBM)
-  for (npage_t i = 1; i < machine->nnodes; ++i) {
-    uint32_t ncells = machine->nodes[i]->n_cells;
 
-    // Only read in table leaf cells
-    if (PGTYPE_TABLE_LEAF != machine->nodes[i]->type) continue;
-
-    // Remember, we'll have multiple tables, so store
-    // in each cell the offset where the table starts
-    uint32_t node_id_offset = machine->ncells;
+  chidb_DBM_end_scan(machine);
+  machine->batch = NULL;
+  while (machine->ncursors > 0) {
+    rc = chidb_DBM_execute_Close(machine, &machine->cursors[0]);
+    if (CHIDB_OK != rc) return rc;
+  }
 
-    for (uint32_t j = 0; j < ncells; ++j) {
-      rc = chidb_Btree_getCell(machine->nodes[i], j, &btc);
-      if (CHIDB_OK != rc) return rc;
+  rc = chidb_DBM_free_nodes(machine);
+  if (CHIDB_OK != rc) return rc;
 
-      // Insert cell into machine->cells in key order
-      if (PGTYPE_TABLE_LEAF == btc.type) {
-        machine->cells                              = realloc(machine->cells, (machine->ncells + 1) * sizeof(DBMCell));
-        machine->cells[machine->ncells].entry       = btc;
-        machine->cells[machine->ncells].node        = machine->nodes[i];
-        machine->cells[machine->ncells].node_offset = node_id_offset;
-        ++machine->ncells;
-      }
-    }
-  }
+  chidb_DBM_free_groups(machine);
 
+  if (machine->err > 0) {
+    free(machine->err_msg);
+    machine->err     = 0;
+    machine->err_msg = NULL;
+  }
+
+  if (machine->running) {
+    chidb_Arena_release(&machine->arena, machine->run_mark);
+    machine->running = false;
+  }
+  chidb_Arena_destroy(&machine->row_arena);
+  machine->row_marked = false;
+
+  machine->registers      = NULL;
+  machine->nregisters     = 0;
+  machine->registers_size = 0;
+  machine->cursors        = NULL;
+  machine->cursors_size   = 0;
+  machine->cells          = NULL;
+  machine->cells_size     = 0;
+  machine->record_cell    = NULL;
+  machine->record         = NULL;
+  machine->result         = NULL;
+  machine->result_size    = 0;
+  machine->record_fields  = NULL;
+  machine->record_size    = 0;
+
+  machine->group_keys      = NULL;
+  machine->group_keys_size = 0;
+
+  machine->pc       = 0;
+  machine->nresult  = 0;
+  machine->jumped   = false;
+  machine->returned = false;
+  machine->halted   = true;
   return CHIDB_OK;
 }
 
 
 
-/* Jump to a given instruction (i.e. repoint the pc)
+/* Find the register holding the value of a ? placeholder
  *
  * Parameters
  * - machine: DBM to act upon
- * - instruction_id: Identifier of instruction to jump to
+ * - param: Placeholder number (numbered from 1, in order of appearance)
+ * - reg: Out parameter; will point to the parameter register
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: Could not find instruction
+ * - CHIDB_EMISUSE: No such placeholder
  */
-int chidb_DBM_jump(DBM *machine, uint32_t instruction_id) {
-  for (uint32_t i = 0; i < machine->ninstructions; ++i) {
-    if (instruction_id == machine->instructions[i].id) {
-      machine->pc     = machine->instructions[i].id;
-      machine->jumped = true;
-      return CHIDB_OK;
-    }
-  }
-
-  return CHIDB_ENOTFOUND;
+int chidb_DBM_find_param(DBM *machine, uint32_t param, DBMRegister **reg) {
+  if (param < 1 || param > machine->nparams) return CHIDB_EMISUSE;
+  *reg = &machine->params[param - 1];
+  return CHIDB_OK;
 }
 
 
 
-/* Find a particular DBM instruction
+/* Bind an integer to a ? placeholder
+ *
+ * Only allowed before the program starts running, or after a reset.
  *
  * Parameters
  * - machine: DBM to act upon
- * - instruction_id: Instruction identifier
- * - instruction: Out parameter; will point to instruction
+ * - param: Placeholder number (numbered from 1)
+ * - value: Value to bind
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: Could not find instruction
+ * - CHIDB_EMISUSE: No such placeholder, or the machine is running
  */
-int chidb_DBM_find_instruction(DBM *machine, uint32_t instruction_id, DBMInstruction **instruction) {
-  for (uint32_t i = 0; i < machine->ninstructions; ++i) {
-    if (instruction_id == machine->instructions[i].id) {
-      *instruction = &machine->instructions[i];
-      return CHIDB_OK;
-    }
-  }
+int chidb_DBM_bind_int(DBM *machine, uint32_t param, int32_t value) {
+  int rc;
+  DBMRegister *reg;
 
-  return CHIDB_ENOTFOUND;
+  if (machine->pc != 0) return CHIDB_EMISUSE;
+  rc = chidb_DBM_find_param(machine, param, &reg);
+  if (CHIDB_OK != rc) return rc;
+  chidb_DBM_free_register(reg);
+  return chidb_DBM_execute_Integer(machine, reg, value);
 }
 
 
 
-/* Find a particular DBM register
+/* Bind a string to a ? placeholder
+ *
+ * The string is copied, so the caller may free it after binding.
  *
  * Parameters
  * - machine: DBM to act upon
- * - reg_id: Register identifier
- * - reg: Out parameter; will point to register
+ * - param: Placeholder number (numbered from 1)
+ * - value: Null-terminated string to bind
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: Could not find register
+ * - CHIDB_EMISUSE: No such placeholder, or the machine is running
+ * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_find_register(DBM *machine, uint32_t reg_id, DBMRegister **reg) {
-  for (uint32_t i = 0; i < machine->nregisters; ++i) {
-    if (reg_id == machine->registers[i].id) {
-      *reg = &machine->registers[i];
-      return CHIDB_OK;
-    }
-  }
+int chidb_DBM_bind_text(DBM *machine, uint32_t param, const char *value) {
+  int rc;
+  DBMRegister *reg;
+  DBMRegister text;
 
-  return CHIDB_ENOTFOUND;
+  if (machine->pc != 0) return CHIDB_EMISUSE;
+  rc = chidb_DBM_find_param(machine, param, &reg);
+  if (CHIDB_OK != rc) return rc;
+
+  // Parameters outlive any run of the program, so they keep a heap copy
+  text.type               = DBM_STRING_REGISTER_TYPE;
+  text.fields.string.len  = strlen(value);
+  text.fields.string.data = (uint8_t *) value;
+  return chidb_DBM_copy_register(reg, &text);
 }
 
 
 
-/* Create a new register
- * 
+
+/* Set every ? placeholder back to NULL
+ *
  * Parameters
  * - machine: DBM to act upon
- * - reg_id: Register identifier
- * - reg: Out parameter; will point to new register
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_create_register(DBM *machine, uint32_t reg_id, DBMRegister **reg) {
-  DBMRegister *newRegister;
-  machine->registers = realloc(machine->registers, (machine->nregisters + 1) * sizeof(DBMRegister));
-  if (NULL == machine->registers) return CHIDB_ENOMEM;  
-  newRegister     = &machine->registers[machine->nregisters];
-  newRegister->id = reg_id;
-  *reg = newRegister;
-  machine->nregisters++;
+int chidb_DBM_clear_bindings(DBM *machine) {
+  for (uint32_t i = 0; i < machine->nparams; ++i) {
+    chidb_DBM_free_register(&machine->params[i]);
+  }
   return CHIDB_OK;
 }
 
 
 
-/* Find a specific register or create it if it doesn't exist
- * 
+/* Load every B-Tree node of the file, and their cells, into the machine
+ *
+ * Only done once, the first time a cursor is opened. Programs that never
+ * open a cursor (e.g. INSERT or a bare COUNT(*)) skip it entirely. A
+ * machine with a snapshot loads the nodes as of its snapshot.
+ *
  * Parameters
  * - machine: DBM to act upon
- * - reg_id: Register identifier
- * - reg: Out parameter; will point to register
  *
  * Return
  * - CHIDB_OK: Operation successful
  * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_DBM_find_or_create_register(DBM *machine, uint32_t reg_id, DBMRegister **reg) {
+int chidb_DBM_load_nodes(DBM *machine) {
   int rc;
-  rc = chidb_DBM_find_register(machine, reg_id, reg);
-  if (CHIDB_ENOTFOUND == rc) {
-    rc = chidb_DBM_create_register(machine, reg_id, reg);
+  BTreeNode *btn;
+
+  if (machine->nnodes > 0) return CHIDB_OK;
+
+  npage_t npages = machine->snapshot_npages;
+  if (PAGER_LATEST == machine->snapshot) npages = machine->db->bt->pager->n_pages;
+  machine->nodes = chidb_Arena_alloc(&machine->arena, npages * sizeof(BTreeNode *));
+  if (NULL == machine->nodes) return CHIDB_ENOMEM;
+
+  for (npage_t i = 1; i <= npages; ++i) {
+    rc = chidb_Btree_getNodeAt(machine->db->bt, i, machine->snapshot, &btn);
+    if (CHIDB_OK != rc) return rc;
+    machine->nodes[i-1] = btn;
+    machine->nnodes     = i;
   }
-  return rc;
+
+  return CHIDB_OK;
 }
 
 
 
-/* Free any data stored in a register
- * 
+/* Release the B-Tree nodes and cells loaded by chidb_DBM_load_nodes
+ *
  * Parameters
- * - reg: Register to free
+ * - machine: DBM to act upon
  *
  * Return
  * - CHIDB_OK: Operation successful
  */
-int chidb_DBM_free_register(DBMRegister *reg) {
-  if (NULL != reg) {
-    if (DBM_STRING_REGISTER_TYPE == reg->type && NULL != reg->fields.string.data) {
-      free(reg->fields.string.data);
-    }
-    
-    // Set the type to NULL to avoid freeing if called again
-    reg->type = DBM_NULL_REGISTER_TYPE;
-  }
+int chidb_DBM_free_nodes(DBM *machine) {
+  int rc;
 
+  for (uint32_t i = 0; i < machine->nnodes; ++i) {
+    rc = chidb_Btree_freeMemNode(machine->db->bt, machine->nodes[i]);
+    if (CHIDB_OK != rc) return rc;
+  }
+  machine->nodes  = NULL;
+  machine->nnodes = 0;
+  machine->ncells = 0;
   return CHIDB_OK;
 }
 
 
 
-/* Find a particular DBM cursor
+/* Append the cells of a B-Tree to the machine's cells, in key order
+ *
+ * The tree is walked from the given node, so a cursor can scan the whole
+ * table (or index) by moving through consecutive cells. Table rows are
+ * only in the leaves, visited left to right; index entries are in every
+ * node, so each entry of an internal node comes between the entries of
+ * the children around it.
  *
  * Parameters
  * - machine: DBM to act upon
- * - cursor_id: Cursor identifier
- * - cursor: Out parameter; will point to cursor
+ * - npage: Page of the (sub)tree's root node
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: Could not find cursor
+ * - CHIDB_ENOTFOUND: The tree refers to a page that was not loaded
+ * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_find_cursor(DBM *machine, uint32_t cursor_id, DBMCursor **cursor) {
-  for (uint32_t i = 0; i < machine->ncursors; ++i) {
-    if (cursor_id == machine->cursors[i].id) {
-      *cursor = &machine->cursors[i];
-      return CHIDB_OK;
+int chidb_DBM_grab_cells(DBM *machine, npage_t npage) {
+  int rc;
+  BTreeNode *btn;
+  BTreeCell btc;
+
+  rc = chidb_DBM_find_node(machine, npage, &btn);
+  if (CHIDB_OK != rc) return rc;
+
+  if (PGTYPE_TABLE_INTERNAL == btn->type) {
+    for (uint32_t i = 0; i < btn->n_cells; ++i) {
+      rc = chidb_Btree_getCell(btn, i, &btc);
+      if (CHIDB_OK != rc) return rc;
+      rc = chidb_DBM_grab_cells(machine, btc.fields.tableInternal.child_page);
+      if (CHIDB_OK != rc) return rc;
     }
+    return chidb_DBM_grab_cells(machine, btn->right_page);
   }
 
-  return CHIDB_ENOTFOUND;
+  for (uint32_t i = 0; i < btn->n_cells; ++i) {
+    rc = chidb_Btree_getCell(btn, i, &btc);
+    if (CHIDB_OK != rc) return rc;
+
+    // Index entries of internal nodes come after those of their left child
+    if (PGTYPE_INDEX_INTERNAL == btn->type) {
+      rc = chidb_DBM_grab_cells(machine, btc.fields.indexInternal.child_page);
+      if (CHIDB_OK != rc) return rc;
+    }
+
+    if (machine->ncells == machine->cells_size) {
+      void *grown = chidb_DBM_grow_array(machine, machine->cells, &machine->cells_size, sizeof(DBMCell));
+      if (NULL == grown) return CHIDB_ENOMEM;
+      machine->cells = grown;
+    }
+    machine->cells[machine->ncells].entry = btc;
+    machine->cells[machine->ncells].node  = btn;
+    ++machine->ncells;
+  }
+
+  if (PGTYPE_INDEX_INTERNAL == btn->type)
+    return chidb_DBM_grab_cells(machine, btn->right_page);
+  return CHIDB_OK;
 }
 
 
 
-/* Create a new cursor
- * 
+/* Jump to a given instruction (i.e. repoint the pc)
+ *
  * Parameters
  * - machine: DBM to act upon
- * - cursor_id: Cursor identifier
- * - cursor: Out parameter; will point to new cursor
+ * - instruction_id: Identifier of instruction to jump to
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_ENOTFOUND: Could not find instruction
  */
-int chidb_DBM_create_cursor(DBM *machine, uint32_t cursor_id, DBMCursor **cursor) {
-  DBMCursor *newCursor;
-  machine->cursors = realloc(machine->cursors, (machine->ncursors + 1) * sizeof(DBMCursor));
-  if (NULL == machine->cursors) return CHIDB_ENOMEM;  
-  newCursor     = &machine->cursors[machine->ncursors];
-  newCursor->id = cursor_id;
-  *cursor = newCursor;
-  machine->ncursors++;
-  return CHIDB_OK;
+int chidb_DBM_jump(DBM *machine, uint32_t instruction_id) {
+  for (uint32_t i = 0; i < machine->ninstructions; ++i) {
+    if (instruction_id == machine->instructions[i].id) {
+      machine->pc     = machine->instructions[i].id;
+      machine->jumped = true;
+      return CHIDB_OK;
+    }
+  }
+
+  return CHIDB_ENOTFOUND;
 }
 
 
 
-/* Find a specific cursor or create it if it doesn't exist
- * 
+/* Find a particular DBM instruction
+ *
  * Parameters
  * - machine: DBM to act upon
- * - cursor_id: Cursor identifier
- * - cursor: Out parameter; will point to cursor
+ * - instruction_id: Instruction identifier
+ * - instruction: Out parameter; will point to instruction
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_ENOTFOUND: Could not find instruction
  */
-int chidb_DBM_find_or_create_cursor(DBM *machine, uint32_t cursor_id, DBMCursor **cursor) {
-  int rc;
-  rc = chidb_DBM_find_cursor(machine, cursor_id, cursor);
-  if (CHIDB_ENOTFOUND == rc) {
-    rc = chidb_DBM_create_cursor(machine, cursor_id, cursor);
+int chidb_DBM_find_instruction(DBM *machine, uint32_t instruction_id, DBMInstruction **instruction) {
+  for (uint32_t i = 0; i < machine->ninstructions; ++i) {
+    if (instruction_id == machine->instructions[i].id) {
+      *instruction = &machine->instructions[i];
+      return CHIDB_OK;
+    }
   }
-  return rc;
+
+  return CHIDB_ENOTFOUND;
 }
 
 
 
-/* Find a particular B-Tree node in the DBM's cache
+/* Find a particular DBM register
  *
  * Parameters
  * - machine: DBM to act upon
- * - page_num: Page number of node
- * - node: Out parameter; will point to B-Tree node
+ * - reg_id: Register identifier
+ * - reg: Out parameter; will point to register
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: Could not find node
+ * - CHIDB_ENOTFOUND: Could not find register
  */
-int chidb_DBM_find_node(DBM *machine, npage_t page_num, BTreeNode **node) {
-  for (uint32_t i = 0; i < machine->nnodes; ++i) {
-    if (page_num == machine->nodes[i]->page->npage) {
-      *node = machine->nodes[i];
+int chidb_DBM_find_register(DBM *machine, uint32_t reg_id, DBMRegister **reg) {
+  for (uint32_t i = 0; i < machine->nregisters; ++i) {
+    if (reg_id == machine->registers[i].id) {
+      *reg = &machine->registers[i];
       return CHIDB_OK;
     }
   }
@@ -736,769 +1047,2470 @@ int chidb_DBM_find_node(DBM *machine, npage_t page_num, BTreeNode **node) {
 
 
 
-/* Open a B-Tree
+/* Create a new register
  * 
  * Parameters
  * - machine: DBM to act upon
- * - cursor: Cursor to store B-Tree information within
- * - reg: Register with page number in integer field
- * - ncols: Number of columns in table
- * - mode: File access mode
- * 
+ * - reg_id: Register identifier
+ * - reg: Out parameter; will point to new register
+ *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EPAGENO: The provided page number is not valid
+ * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_execute_Open(DBM *machine, DBMCursor *cursor, DBMRegister *reg, uint32_t ncols, uint8_t mode) {
-  int rc;
-
-  // Must have an integer register where we store the page number
-  if (DBM_INTEGER_REGISTER_TYPE != reg->type) return CHIDB_EPAGENO;
-  npage_t page  = reg->fields.integer;
-  cursor->mode  = mode;
-  cursor->ncols = ncols;
-
-  BTreeNode *btn;
-  rc = chidb_DBM_find_node(machine, page, &btn);
-  if (CHIDB_OK != rc) return rc;
-
-  BTreeCell btc;
-  chidb_Btree_getCell(btn, 1, &btc);
-  if (CHIDB_OK != rc) return rc;
-
-  cursor->cell_id = 0;
-  for (uint32_t i = 0; i < machine->ncells; ++i) {
-    if (btc.key == machine->cells[i].entry.key && page == machine->cells[i].node->page->npage) {
-      cursor->cell_id = i;
-      break;
-    }
-  }
-
+int chidb_DBM_create_register(DBM *machine, uint32_t reg_id, DBMRegister **reg) {
+  DBMRegister *newRegister;
+  if (machine->nregisters == machine->registers_size) {
+    void *grown = chidb_DBM_grow_array(machine, machine->registers, &machine->registers_size, sizeof(DBMRegister));
+    if (NULL == grown) return CHIDB_ENOMEM;
+    machine->registers = grown;
+  }
+  newRegister       = &machine->registers[machine->nregisters];
+  newRegister->id   = reg_id;
+  newRegister->type = DBM_NULL_REGISTER_TYPE;
+  *reg = newRegister;
+  machine->nregisters++;
   return CHIDB_OK;
 }
 
-/* Open a B-Tree for reading */
-int chidb_DBM_execute_OpenRead(DBM *machine, DBMCursor *cursor, DBMRegister *reg, uint32_t ncols) {
-  return chidb_DBM_execute_Open(machine, cursor, reg, ncols, DBM_READONLY);
-}
-
-/* Open a B-Tree for reading and writing */
-int chidb_DBM_execute_OpenWrite(DBM *machine, DBMCursor *cursor, DBMRegister *reg, uint32_t ncols) {
-  return chidb_DBM_execute_Open(machine, cursor, reg, ncols, DBM_READWRITE);
-}
-
 
 
-/* Close a cursor
+/* Find a specific register or create it if it doesn't exist
  * 
  * Parameters
  * - machine: DBM to act upon
- * - cursor: Cursor to close
- * 
+ * - reg_id: Register identifier
+ * - reg: Out parameter; will point to register
+ *
  * Return
  * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_execute_Close(DBM *machine, DBMCursor *cursor) {
-  size_t len = (machine->cursors + machine->ncursors) - (cursor + 1);
-  if (len > 0) memmove(cursor, cursor + 1, len);
-  machine->ncursors--;
-  machine->cursors = realloc(machine->cursors, machine->ncursors * sizeof(DBMCursor));
-  return CHIDB_OK;
+int chidb_DBM_find_or_create_register(DBM *machine, uint32_t reg_id, DBMRegister **reg) {
+  int rc;
+  rc = chidb_DBM_find_register(machine, reg_id, reg);
+  if (CHIDB_ENOTFOUND == rc) {
+    rc = chidb_DBM_create_register(machine, reg_id, reg);
+  }
+  return rc;
 }
 
 
 
-/* Point a cursor to the first entry in the B-tree
+/* Free any data stored in a register
  *
+ * Only for registers whose strings were allocated with
+ * chidb_DBM_copy_register (parameters and group keys); the machine's own
+ * registers point into its arenas.
+ * 
  * Parameters
- * - machine: DBM to act upon
- * - cursor: Cursor to rewind
- * - instruction_id: Instruction identifier for failure jump
+ * - reg: Register to free
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: Could not find instruction
  */
-int chidb_DBM_execute_Rewind(DBM *machine, DBMCursor *cursor, uint32_t instruction_id) {
-  if (machine->cells[cursor->cell_id].node->n_cells == 0) {
-    // B-tree is empty, jump
-    return chidb_DBM_jump(machine, instruction_id);
+int chidb_DBM_free_register(DBMRegister *reg) {
+  if (NULL != reg) {
+    if (DBM_STRING_REGISTER_TYPE == reg->type && NULL != reg->fields.string.data) {
+      free(reg->fields.string.data);
+    }
+    
+    // Set the type to NULL to avoid freeing if called again
+    reg->type = DBM_NULL_REGISTER_TYPE;
   }
 
-  cursor->cell_id = machine->cells[cursor->cell_id].node_offset;
   return CHIDB_OK;
 }
 
 
 
-/* Advance a cursor to the next entry in the B-tree (if any)
+/* Find a particular DBM cursor
  *
  * Parameters
  * - machine: DBM to act upon
- * - cursor: Cursor to advance
- * - instruction_id: Instruction identifier for jump
+ * - cursor_id: Cursor identifier
+ * - cursor: Out parameter; will point to cursor
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: Could not find instruction
+ * - CHIDB_ENOTFOUND: Could not find cursor
  */
-int chidb_DBM_execute_Next(DBM *machine, DBMCursor *cursor, uint32_t instruction_id) {
-  if (cursor->cell_id - machine->cells[cursor->cell_id].node_offset + 1 < machine->cells[cursor->cell_id].node->n_cells) {
-    ++cursor->cell_id;
-    return chidb_DBM_jump(machine, instruction_id);
+int chidb_DBM_find_cursor(DBM *machine, uint32_t cursor_id, DBMCursor **cursor) {
+  for (uint32_t i = 0; i < machine->ncursors; ++i) {
+    if (cursor_id == machine->cursors[i].id) {
+      *cursor = &machine->cursors[i];
+      return CHIDB_OK;
+    }
   }
 
-  return CHIDB_OK;
+  return CHIDB_ENOTFOUND;
 }
 
 
 
-/* Move a cursor to the previous entry in the B-tree (if any)
- *
+/* Create a new cursor
+ * 
  * Parameters
  * - machine: DBM to act upon
- * - cursor: Cursor to move
- * - instruction_id: Instruction identifier for jump
+ * - cursor_id: Cursor identifier
+ * - cursor: Out parameter; will point to new cursor
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: Could not find instruction
+ * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_execute_Prev(DBM *machine, DBMCursor *cursor, uint32_t instruction_id) {
-  if (cursor->cell_id - machine->cells[cursor->cell_id].node_offset > 1 ) {
-    --cursor->cell_id;
-    return chidb_DBM_jump(machine, instruction_id);
-  }
-
+int chidb_DBM_create_cursor(DBM *machine, uint32_t cursor_id, DBMCursor **cursor) {
+  DBMCursor *newCursor;
+  if (machine->ncursors == machine->cursors_size) {
+    void *grown = chidb_DBM_grow_array(machine, machine->cursors, &machine->cursors_size, sizeof(DBMCursor));
+    if (NULL == grown) return CHIDB_ENOMEM;
+    machine->cursors = grown;
+  }
+  newCursor         = &machine->cursors[machine->ncursors];
+  newCursor->id     = cursor_id;
+  newCursor->sorter = NULL;
+  *cursor = newCursor;
+  machine->ncursors++;
   return CHIDB_OK;
 }
 
 
 
-/* Move a cursor to the entry with a given key (if any)
- *
+/* Find a specific cursor or create it if it doesn't exist
+ * 
  * Parameters
  * - machine: DBM to act upon
- * - cursor: Cursor to move
- * - key: Key of B-Tree entry
- * - instruction_id: Instruction identifier for failure jump
+ * - cursor_id: Cursor identifier
+ * - cursor: Out parameter; will point to cursor
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: Could not find instruction
+ * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_execute_Seek(DBM *machine, DBMCursor *cursor, key_t key, uint32_t instruction_id) {
-  for (uint32_t i = machine->cells[cursor->cell_id].node_offset; i < machine->cells[cursor->cell_id].node->n_cells; ++i) {
-    if (key == machine->cells[i].entry.key) {
-      cursor->cell_id = i;
-      return CHIDB_OK;
-    }
+int chidb_DBM_find_or_create_cursor(DBM *machine, uint32_t cursor_id, DBMCursor **cursor) {
+  int rc;
+  rc = chidb_DBM_find_cursor(machine, cursor_id, cursor);
+  if (CHIDB_ENOTFOUND == rc) {
+    rc = chidb_DBM_create_cursor(machine, cursor_id, cursor);
   }
-
-  return chidb_DBM_jump(machine, instruction_id);
+  return rc;
 }
 
 
 
-/* Move a cursor to the entry key greater than a given key (if any)
+/* Find a particular B-Tree node in the DBM's cache
  *
  * Parameters
  * - machine: DBM to act upon
- * - cursor: Cursor to move
- * - key: Key of B-Tree entry
- * - instruction_id: Instruction identifier for failure jump
+ * - page_num: Page number of node
+ * - node: Out parameter; will point to B-Tree node
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: Could not find instruction
+ * - CHIDB_ENOTFOUND: Could not find node
  */
-int chidb_DBM_execute_SeekGt(DBM *machine, DBMCursor *cursor, key_t key, uint32_t instruction_id) {
-  for (uint32_t i = machine->cells[cursor->cell_id].node_offset; i < machine->cells[cursor->cell_id].node->n_cells; ++i) {
-    if (key < machine->cells[i].entry.key) {
-      cursor->cell_id = i;
-      return CHIDB_OK;
-    }
-  }
+int chidb_DBM_find_node(DBM *machine, npage_t page_num, BTreeNode **node) {
+  // Nodes are loaded in page order, page n is nodes[n-1]
+  if (page_num < 1 || page_num > machine->nnodes) return CHIDB_ENOTFOUND;
 
-  return chidb_DBM_jump(machine, instruction_id);
+  *node = machine->nodes[page_num - 1];
+  return CHIDB_OK;
 }
 
 
 
-/* Move a cursor to the entry key greater than a given key (if any)
+/* Make a deep copy of a register
  *
  * Parameters
- * - machine: DBM to act upon
- * - cursor: Cursor to move
- * - key: Key of B-Tree entry
- * - instruction_id: Instruction identifier for failure jump
+ * - dst: Register for storage (its previous contents are freed)
+ * - src: Register to copy
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOTFOUND: Could not find instruction
+ * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_execute_SeekGe(DBM *machine, DBMCursor *cursor, key_t key, uint32_t instruction_id) {
-  for (uint32_t i = machine->cells[cursor->cell_id].node_offset; i < machine->cells[cursor->cell_id].node->n_cells; ++i) {
-    if (key <= machine->cells[i].entry.key) {
-      cursor->cell_id = i;
-      return CHIDB_OK;
-    }
+int chidb_DBM_copy_register(DBMRegister *dst, DBMRegister *src) {
+  chidb_DBM_free_register(dst);
+  dst->type   = src->type;
+  dst->fields = src->fields;
+
+  if (DBM_STRING_REGISTER_TYPE == src->type) {
+    dst->fields.string.data = malloc(src->fields.string.len + 1);
+    if (NULL == dst->fields.string.data) return CHIDB_ENOMEM;
+    memcpy(dst->fields.string.data, src->fields.string.data, src->fields.string.len);
+    dst->fields.string.data[src->fields.string.len] = '\0';
   }
 
-  return chidb_DBM_jump(machine, instruction_id);
+  return CHIDB_OK;
 }
 
 
 
-/* Store a column's value into a register
+/* Read the value of an integer register, whatever its width
  *
  * Parameters
- * - machine: DBM to act upon
- * - cursor: Cursor to inspect
- * - col_num: Column id to inspect
- * - reg: Register to modify
+ * - reg: Register to read
+ * - value: Out parameter; the widened value
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EMISMATCH
- * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EMISMATCH: Register does not hold an integer
  */
-int chidb_DBM_execute_Column(DBM *machine, DBMCursor *cursor, int32_t col_num, DBMRegister *reg) {
-  if (NULL == machine->maps) return CHIDB_EIO;
-
-  // If I'm getting this right, the B-Tree cell should be, in the case of table cells, table leaf cells
-  BTreeCell btc = machine->cells[cursor->cell_id].entry;
-  if (PGTYPE_TABLE_INTERNAL == btc.type) return CHIDB_EMISMATCH;
-
-  if (col_num < 0 || col_num >= machine->maps[cursor->id].colMap.ncols) return CHIDB_EMISUSE;
-
-
-  // First things first: Let's see where exactly in the db-record we are
-  uint32_t text_length;                               // Will store length of any text data
-  uint8_t data_offset   = *btc.fields.tableLeaf.data; // Offset for actual data (just header length for now)
-  uint8_t header_offset = 1;                          // Offset in header (already read in header length)
-
-  for (int32_t i = 0; i < col_num; ++i) {
-    text_length = 0;
-    switch (*(btc.fields.tableLeaf.data + header_offset)) {
-      case SQL_NULL:
-        ++header_offset;
-        break;
-      case SQL_INTEGER_1BYTE:
-        ++header_offset;
-        data_offset += 1;
-        break;
-      case SQL_INTEGER_2BYTE:
-        ++header_offset;
-        data_offset += 2;
-        break;
-      case SQL_INTEGER_4BYTE:
-        ++header_offset;
-        data_offset += 4;
-        break;
-      default:
-        getVarint32(btc.fields.tableLeaf.data + header_offset, &text_length);
-        data_offset += (text_length - 13) / 2;
-        header_offset += 4;
-        break;
-    }
-  }
-
-
-  // Now we've gotta combine our db-record result type with the type given by the schema
-  uint8_t data_type   = *(btc.fields.tableLeaf.data + header_offset);
-  ColumnSchema schema = machine->maps[cursor->id].colMap.cols[col_num];
-
-  // Primary key values aren't actually stored in the DB record, but rather in the B-tree cell itself
-  if (machine->maps[cursor->id].colMap.primary_col >= 0 && machine->maps[cursor->id].colMap.primary_col == col_num) {
-    reg->type           = DBM_INTEGER_REGISTER_TYPE;
-    reg->fields.integer = btc.key;
-    return CHIDB_OK;
-  }
-
-  // NULL value in database, just skip it
-  if (SQL_NULL == data_type) {
-    reg->type = DBM_NULL_REGISTER_TYPE;
-    return CHIDB_OK;
+int chidb_DBM_register_integer(DBMRegister *reg, int64_t *value) {
+  switch (reg->type) {
+    case DBM_INTEGER_REGISTER_TYPE:
+      *value = reg->fields.integer;
+      return CHIDB_OK;
+    case DBM_SMALLINT_REGISTER_TYPE:
+      *value = reg->fields.smallint;
+      return CHIDB_OK;
+    case DBM_BYTE_REGISTER_TYPE:
+      *value = reg->fields.byte;
+      return CHIDB_OK;
   }
 
-  // Value was returned, let's grab it
-  switch (schema.type) {
-    case SQL_INTEGER_1BYTE:
-      reg->type        = DBM_BYTE_REGISTER_TYPE;
-      reg->fields.byte = *((uint8_t *) btc.fields.tableLeaf.data + data_offset + 3 /* Stored in last of 4 bytes */);
-      break;
+  return CHIDB_EMISMATCH;
+}
 
-    case SQL_INTEGER_2BYTE:
-      reg->type            = DBM_SMALLINT_REGISTER_TYPE;
-      reg->fields.smallint = get2byte(btc.fields.tableLeaf.data + data_offset);
-      break;
 
-    case SQL_INTEGER_4BYTE:
-      reg->type           = DBM_INTEGER_REGISTER_TYPE;
-      reg->fields.integer = get4byte(btc.fields.tableLeaf.data + data_offset);
-      break;
 
-    case SQL_TEXT:
-      reg->type = DBM_STRING_REGISTER_TYPE;
-      reg->fields.string.len  = btc.fields.tableLeaf.data_size;
-      reg->fields.string.data = malloc(reg->fields.string.len * sizeof(uint8_t));
-      if (NULL == memcpy((char *) reg->fields.string.data, (char *) btc.fields.tableLeaf.data + data_offset, reg->fields.string.len * sizeof(uint8_t))) return CHIDB_ENOMEM;
-      break;
+/* Hash the values held in consecutive registers (FNV-1a)
+ *
+ * Integers hash by value, so the same number stored in a BYTE and an
+ * INTEGER register lands in the same bucket. Strings hash up to their
+ * terminating NUL.
+ *
+ * Parameters
+ * - regs: First register
+ * - nregs: Number of registers
+ *
+ * Return
+ * - The hash value
+ */
+uint32_t chidb_DBM_hash_registers(DBMRegister *regs, uint32_t nregs) {
+  uint32_t hash = 2166136261u;
+  int64_t value;
+
+  for (uint32_t i = 0; i < nregs; ++i) {
+    if (CHIDB_OK == chidb_DBM_register_integer(&regs[i], &value)) {
+      /* the widened value alone, whatever the width of the register */
+      hash = (hash ^ DBM_INTEGER_REGISTER_TYPE) * 16777619u;
+      for (int b = 0; b < 8; ++b) {
+        hash = (hash ^ (uint8_t) (value >> (8 * b))) * 16777619u;
+      }
+      continue;
+    }
+    hash = (hash ^ regs[i].type) * 16777619u;
+    if (DBM_STRING_REGISTER_TYPE == regs[i].type) {
+      for (size_t b = 0; b < regs[i].fields.string.len && regs[i].fields.string.data[b]; ++b) {
+        hash = (hash ^ regs[i].fields.string.data[b]) * 16777619u;
+      }
+    }
   }
 
-  return CHIDB_OK;
+  return hash;
 }
 
 
 
-/* Store a cursor's key into a register
+/* Compare the values held in two runs of registers
+ *
+ * NULLs compare equal to each other, which is what GROUP BY needs.
  *
  * Parameters
- * - machine: DBM to act upon
- * - cursor: Cursor to inspect
- * - reg: Register to update
+ * - regs1: First register of the first run
+ * - regs2: First register of the second run
+ * - nregs: Number of registers in each run
  *
  * Return
- * - CHIDB_OK: Operation successful
+ * - true if every pair of registers holds the same value
  */
-int chidb_DBM_execute_Key(DBM *machine, DBMCursor cursor, DBMRegister *reg) {
-  chidb_DBM_free_register(reg);
-  reg->type = DBM_INTEGER_REGISTER_TYPE;
-  reg->fields.integer = machine->cells[cursor.cell_id].entry.key;
-  return CHIDB_OK;
+bool chidb_DBM_registers_equal(DBMRegister *regs1, DBMRegister *regs2, uint32_t nregs) {
+  int64_t value1, value2;
+
+  for (uint32_t i = 0; i < nregs; ++i) {
+    if (CHIDB_OK == chidb_DBM_register_integer(&regs1[i], &value1)) {
+      if (CHIDB_OK != chidb_DBM_register_integer(&regs2[i], &value2) || value1 != value2) return false;
+    } else if (regs1[i].type != regs2[i].type) {
+      return false;
+    } else if (DBM_STRING_REGISTER_TYPE == regs1[i].type) {
+      size_t len1 = strnlen((char *) regs1[i].fields.string.data, regs1[i].fields.string.len);
+      size_t len2 = strnlen((char *) regs2[i].fields.string.data, regs2[i].fields.string.len);
+      if (len1 != len2 || 0 != memcmp(regs1[i].fields.string.data, regs2[i].fields.string.data, len1)) return false;
+    }
+  }
+
+  return true;
 }
 
 
 
-/* Store an integer in a register
+/* Append a new group, copying its key registers
  *
  * Parameters
  * - machine: DBM to act upon
- * - integer: Integer to store
- * - reg: Register for storage
+ * - keys: First key register (machine->group_nkeys of them)
+ * - hash: Hash of the key registers
  *
  * Return
- * - CHIDB_OK: Operation successful
+ * - CHIDB_OK: Operation successful (the new group becomes the current one)
+ * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_execute_Integer(DBM *machine, DBMRegister *reg, int32_t integer) {
-  chidb_DBM_free_register(reg);
-  reg->type = DBM_INTEGER_REGISTER_TYPE;
-  reg->fields.integer = integer;
+int chidb_DBM_new_group(DBM *machine, DBMRegister *keys, uint32_t hash) {
+  int rc;
+  DBMGroup *groups = realloc(machine->groups, (machine->ngroups + 1) * sizeof(DBMGroup));
+  if (NULL == groups) return CHIDB_ENOMEM;
+  machine->groups = groups;
+
+  DBMGroup *group = &machine->groups[machine->ngroups];
+  group->hash = hash;
+  group->next = -1;
+  group->keys = calloc(machine->group_nkeys + 1, sizeof(DBMRegister));
+  group->aggs = calloc(machine->group_naggs + 1, sizeof(DBMAggregate));
+  if (NULL == group->keys || NULL == group->aggs) return CHIDB_ENOMEM;
+
+  for (uint32_t i = 0; i < machine->group_nkeys; ++i) {
+    rc = chidb_DBM_copy_register(&group->keys[i], &keys[i]);
+    if (CHIDB_OK != rc) return rc;
+  }
+
+  machine->group_current = machine->ngroups;
+  machine->ngroups++;
   return CHIDB_OK;
 }
 
 
 
-/* Store a string in a register
+/* Free every group and the hash buckets that index them
  *
  * Parameters
  * - machine: DBM to act upon
- * - len: Length of string data
- * - reg: Register for storage
- * - data: Pointer to start of datastore
  *
  * Return
  * - CHIDB_OK: Operation successful
  */
-int chidb_DBM_execute_String(DBM *machine, DBMRegister *reg, void *data, size_t len) {
-  chidb_DBM_free_register(reg);
-  reg->type = DBM_STRING_REGISTER_TYPE;
-  reg->fields.string.len  = len;
-  reg->fields.string.data = malloc(len); // Freed with chidb_DBM_free_register
-  if (NULL == memcpy((char *) reg->fields.string.data, (char *) data, len)) return CHIDB_ENOMEM;
+int chidb_DBM_free_groups(DBM *machine) {
+  for (uint32_t i = 0; i < machine->ngroups; ++i) {
+    for (uint32_t k = 0; k < machine->group_nkeys; ++k) {
+      chidb_DBM_free_register(&machine->groups[i].keys[k]);
+    }
+    free(machine->groups[i].keys);
+    free(machine->groups[i].aggs);
+  }
+
+  free(machine->groups);
+  free(machine->group_buckets);
+  machine->groups         = NULL;
+  machine->ngroups        = 0;
+  machine->group_buckets  = NULL;
+  machine->group_nbuckets = 0;
+  machine->group_current  = 0;
+  machine->group_emitted  = 0;
+  machine->group_output   = 0;
   return CHIDB_OK;
 }
 
 
 
-/* Store a NULL value in a register
+/* Free the sorter of a cursor opened with SorterOpen, if any
  *
  * Parameters
- * - machine: DBM to act upon
- * - reg: Register for storage
- *
- * Return
- * - CHIDB_OK: Operation successful
+ * - cursor: Cursor to act upon
  */
-int chidb_DBM_execute_Null(DBM *machine, DBMRegister *reg) {
-  chidb_DBM_free_register(reg);
-  reg->type = DBM_NULL_REGISTER_TYPE;
-  return CHIDB_OK;
+void chidb_DBM_close_sorter(DBMCursor *cursor) {
+  if (NULL != cursor->sorter) {
+    chidb_Sorter_close(cursor->sorter);
+    free(cursor->sorter);
+    cursor->sorter = NULL;
+  }
 }
 
 
 
-/* Return result row (registers) to database user
+// A subtree a split scan is cut into (see chidb_DBM_scan_bounds)
+typedef struct {
+  npage_t page;    // Root page of the subtree
+  uint32_t extra;  // Entries of index internal nodes that come right after it
+  uint32_t ncells; // Cells a cursor goes through in it (extra included)
+} DBMScanUnit;
+
+
+
+/* Count the cells a cursor goes through in a B-Tree
  *
  * Parameters
  * - machine: DBM to act upon
- * - reg_id: Identifier for first register
- * - ncols: Number of columns to return (total r+n-1)
+ * - npage: Page of the (sub)tree's root node
+ * - ncells: Out parameter; table rows (in the leaves) or index entries
+ *   (in every node)
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_ENOMEM: Could not allocate memory
- * - CHIDB_ENOTFOUND: Could not find register
+ * - CHIDB_ENOTFOUND: The tree refers to a page that was not loaded
  */
-int chidb_DBM_execute_ResultRow(DBM *machine, uint32_t reg_id, int32_t ncols) {
+int chidb_DBM_count_cells(DBM *machine, npage_t npage, uint32_t *ncells) {
   int rc;
-  DBRecordBuffer buf;
-  rc = chidb_DBRecord_create_empty(&buf, ncols);
+  BTreeNode *btn;
+  BTreeCell btc;
+
+  rc = chidb_DBM_find_node(machine, npage, &btn);
   if (CHIDB_OK != rc) return rc;
 
-  DBMRegister *reg;
-  for (int32_t i = 0; i < ncols; ++i) {
-    rc = chidb_DBM_find_register(machine, reg_id + i, &reg);
-    if (CHIDB_OK != rc) return rc;
+  *ncells = (PGTYPE_TABLE_INTERNAL == btn->type) ? 0 : btn->n_cells;
+  if (PGTYPE_TABLE_LEAF == btn->type || PGTYPE_INDEX_LEAF == btn->type) return CHIDB_OK;
 
-    switch (reg->type) {
-      case DBM_NULL_REGISTER_TYPE:
-        chidb_DBRecord_appendNull(&buf);
-        break;
-      case DBM_INTEGER_REGISTER_TYPE:
-        chidb_DBRecord_appendInt32(&buf, reg->fields.integer);
-        break;
-      case DBM_SMALLINT_REGISTER_TYPE:
-        chidb_DBRecord_appendInt16(&buf, reg->fields.smallint);
-        break;
-      case DBM_BYTE_REGISTER_TYPE:
-        chidb_DBRecord_appendInt8(&buf, reg->fields.byte);
-        break;
-      case DBM_STRING_REGISTER_TYPE:
-        chidb_DBRecord_appendString(&buf, (char *) reg->fields.string.data);
-        break;
+  for (uint32_t i = 0; i <= btn->n_cells; ++i) {
+    npage_t child = btn->right_page;
+    if (i < btn->n_cells) {
+      rc = chidb_Btree_getCell(btn, i, &btc);
+      if (CHIDB_OK != rc) return rc;
+      child = (PGTYPE_TABLE_INTERNAL == btn->type) ? btc.fields.tableInternal.child_page : btc.fields.indexInternal.child_page;
     }
-  }
 
-  if (machine->result != NULL) chidb_DBRecord_destroy(machine->result);
-  rc = chidb_DBRecord_finalize(&buf, &machine->result);
-  if (CHIDB_OK == rc) machine->returned = true;
-  return rc;
+    uint32_t n;
+    rc = chidb_DBM_count_cells(machine, child, &n);
+    if (CHIDB_OK != rc) return rc;
+    *ncells += n;
+  }
+  return CHIDB_OK;
 }
 
 
 
-/* Store a result row (registers) into another register
+/* Split the cells of a read cursor into partitions of about the same size
+ *
+ * The B-Tree is cut along its internal nodes: starting from the root,
+ * internal nodes are replaced with their children, level by level, until
+ * there are DBM_SCAN_UNITS subtrees per partition (or only leaves are
+ * left). A cursor goes through the subtrees one after the other, so
+ * consecutive subtrees are consecutive cells, and they are handed out to
+ * the partitions in order. The entries of an index's internal node go
+ * with the subtree on their left, which they come right after.
  *
  * Parameters
  * - machine: DBM to act upon
- * - reg_id: Identifier for first register
- * - ncols: Number of columns to return (total r+n-1)
- * - result_reg: Register for storage
+ * - cursor: Read cursor on the B-Tree
+ * - nparts: In/out parameter; most partitions to make, and the number
+ *   made (1 if the B-Tree is too small to be split)
+ * - bounds: Out parameter; partition i has cells bounds[i] to
+ *   bounds[i+1] - 1 (room is needed for *nparts + 1 of them)
  *
  * Return
  * - CHIDB_OK: Operation successful
  * - CHIDB_ENOMEM: Could not allocate memory
- * - CHIDB_ENOTFOUND: Could not find register
+ * - CHIDB_ENOTFOUND: The tree refers to a page that was not loaded
  */
-int chidb_DBM_execute_MakeRecord(DBM *machine, uint32_t reg_id, int32_t ncols, DBMRegister *result_reg) {
+int chidb_DBM_scan_bounds(DBM *machine, DBMCursor *cursor, uint32_t *nparts, uint32_t *bounds) {
   int rc;
-  DBRecordBuffer buf;
-  rc = chidb_DBRecord_create_empty(&buf, ncols);
-  if (CHIDB_OK != rc) return rc;
+  BTreeNode *btn;
+  BTreeCell btc;
 
-  DBMRegister *reg;
-  for (int32_t i = 0; i < ncols; ++i) {
-    rc = chidb_DBM_find_register(machine, reg_id + i, &reg);
-    if (CHIDB_OK != rc) return rc;
+  // Every partition gets at least scan_min_cells cells
+  uint32_t ncells    = cursor->end - cursor->start;
+  uint32_t max_parts = *nparts;
+  if (ncells / machine->scan_min_cells < max_parts) max_parts = ncells / machine->scan_min_cells;
+  *nparts = 1;
+  if (max_parts < 2) return CHIDB_OK;
+
+  DBMScanUnit *units = chidb_Arena_alloc(&machine->arena, sizeof(DBMScanUnit));
+  if (NULL == units) return CHIDB_ENOMEM;
+  units[0].page  = cursor->root_page;
+  units[0].extra = 0;
+  uint32_t nunits = 1;
+
+  bool cut = true;
+  while (cut && nunits < max_parts * DBM_SCAN_UNITS) {
+    uint32_t nchildren = 0;
+    for (uint32_t i = 0; i < nunits; ++i) {
+      rc = chidb_DBM_find_node(machine, units[i].page, &btn);
+      if (CHIDB_OK != rc) return rc;
+      bool leaf = (PGTYPE_TABLE_LEAF == btn->type || PGTYPE_INDEX_LEAF == btn->type);
+      nchildren += leaf ? 1 : btn->n_cells + 1;
+    }
 
-    switch (reg->type) {
-      case DBM_NULL_REGISTER_TYPE:
-        chidb_DBRecord_appendNull(&buf);
-        break;
-      case DBM_INTEGER_REGISTER_TYPE:
-        chidb_DBRecord_appendInt32(&buf, reg->fields.integer);
-        break;
-      case DBM_SMALLINT_REGISTER_TYPE:
-        chidb_DBRecord_appendInt16(&buf, reg->fields.smallint);
-        break;
-      case DBM_BYTE_REGISTER_TYPE:
-        chidb_DBRecord_appendInt8(&buf, reg->fields.byte);
-        break;
-      case DBM_STRING_REGISTER_TYPE:
-        chidb_DBRecord_appendString(&buf, (char *) reg->fields.string.data);
-        break;
+    DBMScanUnit *children = chidb_Arena_alloc(&machine->arena, nchildren * sizeof(DBMScanUnit));
+    if (NULL == children) return CHIDB_ENOMEM;
+
+    cut = false;
+    nchildren = 0;
+    for (uint32_t i = 0; i < nunits; ++i) {
+      rc = chidb_DBM_find_node(machine, units[i].page, &btn);
+      if (CHIDB_OK != rc) return rc;
+      if (PGTYPE_TABLE_LEAF == btn->type || PGTYPE_INDEX_LEAF == btn->type) {
+        children[nchildren++] = units[i];
+        continue;
+      }
+
+      for (uint32_t j = 0; j < btn->n_cells; ++j) {
+        rc = chidb_Btree_getCell(btn, j, &btc);
+        if (CHIDB_OK != rc) return rc;
+        if (PGTYPE_TABLE_INTERNAL == btn->type) {
+          children[nchildren].page  = btc.fields.tableInternal.child_page;
+          children[nchildren].extra = 0;
+        } else {
+          children[nchildren].page  = btc.fields.indexInternal.child_page;
+          children[nchildren].extra = 1;
+        }
+        nchildren++;
+      }
+      children[nchildren].page  = btn->right_page;
+      children[nchildren].extra = units[i].extra;
+      nchildren++;
+      cut = true;
     }
+
+    units  = children;
+    nunits = nchildren;
   }
 
-  chidb_DBM_free_register(result_reg);
-  result_reg->type               = DBM_STRING_REGISTER_TYPE;
-  result_reg->fields.string.len  = buf.buf_size;
-  DBRecord *result;
-  rc = chidb_DBRecord_finalize(&buf, &result);
-  if (CHIDB_OK != rc) return rc;
-  rc = chidb_DBRecord_pack(result, &result_reg->fields.string.data);
-  if (CHIDB_OK != rc) return rc;
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < nunits; ++i) {
+    rc = chidb_DBM_count_cells(machine, units[i].page, &units[i].ncells);
+    if (CHIDB_OK != rc) return rc;
+    units[i].ncells += units[i].extra;
+    total           += units[i].ncells;
+  }
+  if (total != ncells) return CHIDB_OK; // Not the B-Tree the cursor went through
+
+  // Consecutive subtrees, until a partition has its share of the cells
+  uint32_t k = 1, n = 0;
+  bounds[0] = cursor->start;
+  for (uint32_t i = 0; i < nunits && k < max_parts; ++i) {
+    n += units[i].ncells;
+    if (n < total && (uint64_t) n * max_parts >= (uint64_t) total * k)
+      bounds[k++] = cursor->start + n;
+  }
+  bounds[k] = cursor->end;
+  *nparts   = k;
   return CHIDB_OK;
 }
 
 
 
-/* Insert a DB record into the B-tree entry pointed by a cursor
+/* Create a worker machine to run a partition of a split scan
+ *
+ * The worker shares the program, the bound parameters, the maps and the
+ * loaded B-Tree nodes and cells with the machine, and only reads them.
+ * Its registers and cursors start as copies of the machine's, except for
+ * the scanned cursor, which only goes through the cells of the partition.
+ * The worker starts at the machine's current instruction (the Rewind of
+ * the scan), so it runs the scan loop over its partition and then the
+ * rest of the program.
  *
  * Parameters
- * - machine: DBM to act upon
- * - cursor: Cursor to act upon
- * - key: Key of database record
- * - record: Database record to insert
+ * - machine: DBM whose scan is split
+ * - cursor: Cursor being scanned
+ * - start, end: First cell of the partition, and one past its last
+ * - worker: Out parameter; the worker (see chidb_DBM_free_worker)
  *
  * Return
  * - CHIDB_OK: Operation successful
  * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_execute_Insert(DBM *machine, DBMCursor *cursor, key_t key, DBRecord *record) {
-  if (cursor->mode != DBM_READWRITE) return CHIDB_EMISUSE;
+int chidb_DBM_scan_worker(DBM *machine, DBMCursor *cursor, uint32_t start, uint32_t end, DBM **worker) {
   int rc;
+  DBM *w;
 
-  // DEBUG
-  printf("\n\t");
-  chidb_DBRecord_print(record);
+  rc = chidb_DBM_create(machine->db, &w);
+  if (CHIDB_OK != rc) return rc;
 
-  // Result cell
-  BTreeCell rcell;
-  rcell.type = PGTYPE_TABLE_LEAF;
-  rcell.key  = key;
+  w->instructions  = machine->instructions;
+  w->ninstructions = machine->ninstructions;
+  w->params        = machine->params;
+  w->snapshot      = machine->snapshot;
+  w->nparams       = machine->nparams;
+  w->maps          = machine->maps;
+  w->nmaps         = machine->nmaps;
+  w->nodes         = machine->nodes;
+  w->nnodes        = machine->nnodes;
+  w->cells         = machine->cells;
+  w->ncells        = machine->ncells;
+  w->root_page     = machine->root_page;
+  w->pc            = machine->pc;
+  w->nthreads      = 1;
+  w->batch_size    = machine->batch_size;
+
+  w->registers = chidb_Arena_alloc(&w->arena, machine->nregisters * sizeof(DBMRegister));
+  w->cursors   = chidb_Arena_alloc(&w->arena, machine->ncursors * sizeof(DBMCursor));
+  if (NULL == w->registers || NULL == w->cursors) {
+    chidb_DBM_free_worker(w);
+    return CHIDB_ENOMEM;
+  }
+
+  memcpy(w->registers, machine->registers, machine->nregisters * sizeof(DBMRegister));
+  w->nregisters     = machine->nregisters;
+  w->registers_size = machine->nregisters;
+  for (uint32_t i = 0; i < w->nregisters; ++i) {
+    w->registers[i].machine = w;
+  }
+
+  memcpy(w->cursors, machine->cursors, machine->ncursors * sizeof(DBMCursor));
+  w->ncursors     = machine->ncursors;
+  w->cursors_size = machine->ncursors;
+  for (uint32_t i = 0; i < w->ncursors; ++i) {
+    w->cursors[i].machine = w;
+    w->cursors[i].sorter  = NULL;
+  }
+
+  DBMCursor *scanned = &w->cursors[cursor - machine->cursors];
+  scanned->start   = start;
+  scanned->end     = end;
+  scanned->cell_id = start;
+
+  *worker = w;
+  return CHIDB_OK;
+}
 
-  // Buffer for B-Tree cell data
-  uint8_t *buffer = malloc(sizeof(uint8_t)); // Header byte
-  if (NULL == buffer) return CHIDB_ENOMEM;
 
-  uint8_t header_size = 1;
-  uint8_t *data; // Current position within the buffer
 
+/* Destroy a worker machine, leaving what it shares with its machine alone
+ *
+ * Parameters
+ * - worker: Worker created by chidb_DBM_scan_worker
+ */
+void chidb_DBM_free_worker(DBM *worker) {
+  worker->nodes   = NULL;
+  worker->nnodes  = 0;
+  worker->params  = NULL;
+  worker->nparams = 0;
+  chidb_DBM_destroy(worker);
+}
 
-  // Add our types to the header
-  for (uint32_t i = 0; i < record->nfields; ++i) {
-    data = buffer + header_size;
-    int type = chidb_DBRecord_getType(record, i);
-    uint32_t text_length = 0;
 
-    // Primary keys aren't actually stored in the cell
-    if (machine->maps[cursor->id].colMap.primary_col >= 0 && (uint32_t) machine->maps[cursor->id].colMap.primary_col == i) {
-      buffer = realloc(buffer, header_size + 1);
-      data   = buffer + header_size;
-      *data  = (uint8_t) SQL_NULL;
-      ++header_size;
-      continue;
-    }
 
-    switch (type) {
-      case SQL_NULL:
-      case SQL_INTEGER_1BYTE:
-      case SQL_INTEGER_2BYTE:
-      case SQL_INTEGER_4BYTE:
-        buffer = realloc(buffer, header_size + 1);
-        data   = buffer + header_size;
-        *data  = (uint8_t) type;
-        ++header_size;
-        break;
-      case SQL_TEXT:
-        chidb_DBRecord_getStringLength(record, i, (int *) &text_length);
-        buffer = realloc(buffer, header_size + 4);
-        data   = buffer + header_size;
-        putVarint32(data, 2 * (text_length + 1) + 13);
-        header_size += 4;
-        break;
+/* Queue the current result row of a partition's worker
+ *
+ * Waits for a free slot if the queue is full. The values are copied
+ * (strings included) into the slot, as the row memory is released when
+ * the worker moves on to the next row. The slot is the worker's until
+ * the row is queued, so it is filled without holding the lock.
+ *
+ * Parameters
+ * - part: Partition whose worker just returned a row
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_DONE: The scan was cancelled; the row was not queued
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_DBM_queue_row(DBMPartition *part) {
+  DBM *worker = part->worker;
+  uint32_t slot;
+
+  pthread_mutex_lock(&part->lock);
+  while (DBM_SCAN_QUEUE == part->count && !part->cancelled) {
+    pthread_cond_wait(&part->room, &part->lock);
+  }
+  bool cancelled = part->cancelled;
+  slot = (part->head + part->count) % DBM_SCAN_QUEUE;
+  pthread_mutex_unlock(&part->lock);
+  if (cancelled) return CHIDB_DONE;
+
+  // The row length is only known once the first row is out
+  if (NULL == part->rows) {
+    part->nresult = worker->nresult;
+    part->rows    = malloc(DBM_SCAN_QUEUE * part->nresult * sizeof(DBMRegister));
+    if (NULL == part->rows) return CHIDB_ENOMEM;
+  }
+
+  DBMRegister *row  = &part->rows[slot * part->nresult];
+  DBMScanSlot *data = &part->slots[slot];
+  size_t len = 0;
+  for (uint32_t i = 0; i < part->nresult; ++i) {
+    if (DBM_STRING_REGISTER_TYPE == worker->result[i]->type) len += worker->result[i]->fields.string.len + 1;
+  }
+  if (len > data->data_size) {
+    uint8_t *grown = realloc(data->data, len);
+    if (NULL == grown) return CHIDB_ENOMEM;
+    data->data      = grown;
+    data->data_size = len;
+  }
+
+  len = 0;
+  for (uint32_t i = 0; i < part->nresult; ++i) {
+    row[i] = *worker->result[i];
+    if (DBM_STRING_REGISTER_TYPE == row[i].type) {
+      uint8_t *copy = data->data + len;
+      memcpy(copy, row[i].fields.string.data, row[i].fields.string.len);
+      copy[row[i].fields.string.len] = '\0';
+      row[i].fields.string.data = copy;
+      len += row[i].fields.string.len + 1;
     }
   }
 
-  *buffer = header_size; // Store header size in first byte
+  pthread_mutex_lock(&part->lock);
+  part->count++;
+  pthread_cond_signal(&part->ready);
+  pthread_mutex_unlock(&part->lock);
+  return CHIDB_OK;
+}
 
 
-  // Insert actual field values
-  data               = buffer + header_size;
-  uint32_t data_size = 0;
-  for (uint32_t i = 0; i < record->nfields; ++i) {
-    // Primary keys aren't actually stored in the cell
-    if (machine->maps[cursor->id].colMap.primary_col >= 0 && (uint32_t) machine->maps[cursor->id].colMap.primary_col == i) {
-      continue;
-    }
 
-    data = buffer + header_size + data_size;
-    int type = chidb_DBRecord_getType(record, i);
-    uint32_t text_length = 0;
-    int8_t value8;
-    int16_t value16;
-    int32_t value32;
+/* Run a partition of a split scan on a thread of its own, queueing its
+ * result rows as they come
+ *
+ * Parameters
+ * - arg: Partition (DBMPartition) to run; once done, its rc is set to
+ *   how the run ended
+ */
+static void *chidb_DBM_run_partition(void *arg) {
+  DBMPartition *part = arg;
+  int rc;
 
-    switch (type) {
-      case SQL_INTEGER_1BYTE:
-        buffer     = realloc(buffer, header_size + data_size + 1);
-        data       = buffer + header_size + data_size;
-        chidb_DBRecord_getInt8(record, i, &value8);
-        bzero(data, 4);
-        data      += 3;
-        *data      = value8;
-        data_size += 1;
-        break;
-      case SQL_INTEGER_2BYTE:
-        buffer     = realloc(buffer, header_size + data_size + 2);
-        data       = buffer + header_size + data_size;
-        chidb_DBRecord_getInt16(record, i, &value16);
-        put2byte(data, value16);
-        data_size += 2;
-        break;
-      case SQL_INTEGER_4BYTE:
-        buffer     = realloc(buffer, header_size + data_size + 4);
-        data       = buffer + header_size + data_size;
-        chidb_DBRecord_getInt32(record, i, &value32);
-        put4byte(data, value32);
-        data_size += 4;
-        break;
-      case SQL_TEXT:        
-        chidb_DBRecord_getStringLength(record, i, (int *) &text_length);
-        buffer = realloc(buffer, header_size + data_size + text_length + 1);
-        data   = buffer + header_size + data_size;
-
-        char *record_string;
-        chidb_DBRecord_getString(record, i, (char **) &record_string);
-        strncpy((char *) data, record_string, text_length);
-        *(data + text_length) = 0;
-        free(record_string);
-
-        data_size += text_length + 1;
-        break;
-    }
+  while (CHIDB_ROW == (rc = chidb_DBM_step(part->worker))) {
+    rc = chidb_DBM_queue_row(part);
+    if (CHIDB_OK != rc) break;
   }
 
-  uint32_t buffer_size = header_size + data_size;
-
-  // Insert B-Tree cell
-  rcell.fields.tableLeaf.data      = buffer;
-  rcell.fields.tableLeaf.data_size = buffer_size;
-  rc = chidb_Btree_insert(machine->db->bt, machine->root_page, &rcell);
-  free(buffer);
-  return rc;
+  pthread_mutex_lock(&part->lock);
+  part->rc   = rc;
+  part->done = true;
+  pthread_cond_signal(&part->ready);
+  pthread_mutex_unlock(&part->lock);
+  return NULL;
 }
 
 
 
-/* Compare two registers for equality
+/* Destroy a partition of a split scan
+ *
+ * A worker still running on its thread is cancelled (it stops at its
+ * next row, or once done) and waited for first.
  *
  * Parameters
- * - machine: DBM to act upon
- * - reg1: First register
- * - reg2: Second register
- * - instruction_id: Instruction identifier for success jump
+ * - part: Partition to destroy
+ */
+static void chidb_DBM_free_partition(DBMPartition *part) {
+  if (part->threaded) {
+    pthread_mutex_lock(&part->lock);
+    part->cancelled = true;
+    pthread_cond_signal(&part->room);
+    pthread_mutex_unlock(&part->lock);
+    pthread_join(part->thread, NULL);
+    part->threaded = false;
+  }
+  if (NULL != part->worker) chidb_DBM_free_worker(part->worker);
+  part->worker = NULL;
+
+  free(part->rows);
+  part->rows = NULL;
+  for (uint32_t i = 0; i < DBM_SCAN_QUEUE; ++i) {
+    free(part->slots[i].data);
+    part->slots[i].data = NULL;
+  }
+  pthread_cond_destroy(&part->room);
+  pthread_cond_destroy(&part->ready);
+  pthread_mutex_destroy(&part->lock);
+}
+
+
+
+/* Point the result row of the machine to nresult registers
+ *
+ * Parameters
+ * - machine: DBM with a split scan
+ * - row: Registers of the row (if regs is NULL)
+ * - regs: Pointers to the registers of the row (if not NULL)
+ * - nresult: Number of columns in the row
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EMISMATCH: Registers have different types
+ * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_execute_Eq(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint32_t instruction_id) {
-  if (reg1.type != reg2.type) return CHIDB_EMISMATCH;
+static int chidb_DBM_scan_result(DBM *machine, DBMRegister *row, DBMRegister **regs, uint32_t nresult) {
+  if (nresult > machine->result_size) {
+    DBMRegister **result = chidb_Arena_alloc(&machine->arena, nresult * sizeof(DBMRegister *));
+    if (NULL == result) return CHIDB_ENOMEM;
+    machine->result      = result;
+    machine->result_size = nresult;
+  }
+  for (uint32_t i = 0; i < nresult; ++i) {
+    machine->result[i] = (NULL != regs) ? regs[i] : &row[i];
+  }
+  machine->nresult  = nresult;
+  machine->returned = true;
+  return CHIDB_OK;
+}
 
-  switch (reg1.type) {
-    case DBM_STRING_REGISTER_TYPE:
-      if (reg1.fields.string.len == reg2.fields.string.len) {
-        if (0 == strncmp((char *) reg1.fields.string.data, (char *) reg2.fields.string.data, reg1.fields.string.len)) {
-          chidb_DBM_jump(machine, instruction_id);
-        }
-      }
-      break;
-    case DBM_INTEGER_REGISTER_TYPE:
-      if (reg1.fields.integer == reg2.fields.integer) {
-        chidb_DBM_jump(machine, instruction_id);
+
+
+/* Hand out the next row of a split scan
+ *
+ * Rows are handed out partition by partition, so in the order a single
+ * cursor would have returned them, while the workers on threads of their
+ * own go on filling their queues. A row handed out from a queue keeps its
+ * slot until the next call (a result row only lasts until the next step),
+ * and a worker run inline is only stepped here, for its next row. A
+ * partition is destroyed once all its rows are out. After the last row,
+ * the machine goes on with the instruction the scan jumped to.
+ *
+ * Parameters
+ * - machine: DBM with a split scan
+ *
+ * Return
+ * - CHIDB_OK: Operation successful (machine->returned is set if a row
+ *   was handed out)
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - Any error a worker ran into, once the rows before it are out
+ */
+int chidb_DBM_scan_row(DBM *machine) {
+  DBMScan *scan = machine->scan;
+
+  while (scan->part < scan->nparts) {
+    DBMPartition *part = &scan->parts[scan->part];
+    int rc;
+
+    if (!part->threaded) {
+      rc = chidb_DBM_step(part->worker);
+      if (CHIDB_ROW == rc) return chidb_DBM_scan_result(machine, NULL, part->worker->result, part->worker->nresult);
+    } else {
+      pthread_mutex_lock(&part->lock);
+      if (scan->held) {
+        part->head = (part->head + 1) % DBM_SCAN_QUEUE;
+        part->count--;
+        scan->held = false;
+        pthread_cond_signal(&part->room);
       }
-      break;
-    case DBM_SMALLINT_REGISTER_TYPE:
-      if (reg1.fields.smallint == reg2.fields.smallint) {
-        chidb_DBM_jump(machine, instruction_id);
+      while (0 == part->count && !part->done) {
+        pthread_cond_wait(&part->ready, &part->lock);
       }
-      break;
-    case DBM_BYTE_REGISTER_TYPE:
-      if (reg1.fields.byte == reg2.fields.byte) {
-        chidb_DBM_jump(machine, instruction_id);
+      if (part->count > 0) {
+        DBMRegister *row = &part->rows[part->head * part->nresult];
+        uint32_t nresult = part->nresult;
+        scan->held = true;
+        pthread_mutex_unlock(&part->lock);
+        return chidb_DBM_scan_result(machine, row, NULL, nresult);
       }
-      break;
-    case DBM_NULL_REGISTER_TYPE:
-      chidb_DBM_jump(machine, instruction_id);
-      break;
+      rc = part->rc;
+      pthread_mutex_unlock(&part->lock);
+    }
+
+    chidb_DBM_free_partition(part);
+    scan->part++;
+    if (CHIDB_DONE != rc) {
+      chidb_DBM_end_scan(machine);
+      return rc;
+    }
   }
 
+  chidb_DBM_end_scan(machine);
   return CHIDB_OK;
 }
 
 
 
-/* Compare two registers for inequality
+/* Destroy the partitions of a split scan, if any are left
+ *
+ * Workers still running are cancelled and waited for.
  *
  * Parameters
  * - machine: DBM to act upon
- * - reg1: First register
- * - reg2: Second register
- * - instruction_id: Instruction identifier for success jump
+ */
+void chidb_DBM_end_scan(DBM *machine) {
+  if (NULL == machine->scan) return;
+
+  for (uint32_t i = machine->scan->part; i < machine->scan->nparts; ++i) {
+    chidb_DBM_free_partition(&machine->scan->parts[i]);
+  }
+  machine->scan = NULL;
+}
+
+
+
+/* Resolve a register a batch loop reads
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - vectors: Column vector of each register the loop writes (NULL for
+ *   the others), by position in the machine's registers
+ * - reg_id: Register identifier
+ * - operand: Out parameter; the register's column vector, or the register
+ *   itself if the loop never writes it
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EMISMATCH: Registers have different types
+ * - CHIDB_ENOTFOUND: Could not find register
+ */
+int chidb_DBM_batch_operand(DBM *machine, DBMRegister **vectors, uint32_t reg_id, DBMBatchOperand *operand) {
+  DBMRegister *reg;
+  int rc = chidb_DBM_find_register(machine, reg_id, &reg);
+  if (CHIDB_OK != rc) return rc;
+
+  DBMRegister *vector = vectors[reg - machine->registers];
+  operand->reg    = (NULL != vector) ? vector : reg;
+  operand->vector = (NULL != vector);
+  return CHIDB_OK;
+}
+
+
+
+/* Set up a scan loop to be run a batch of rows at a time
+ *
+ * The loop runs from the instruction after the Rewind up to the Next of
+ * its cursor, which jumps back to its start. Its body may only load the
+ * cursor's columns and key (Column, Key), compare registers (Eq, Ne, Lt,
+ * Le, Gt, Ge) and skip to the Next when a comparison holds, and end with
+ * a ResultRow: as a row only ever skips ahead to the end of the loop,
+ * running each instruction over all the rows of a batch, one instruction
+ * after the other, leaves every row with the values it would have had
+ * one row at a time. Each register the body writes gets a column vector,
+ * the other registers keep the same value throughout the loop.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor the loop goes through
+ * - batch: Out parameter; the batch, or NULL if the loop cannot be run
+ *   a batch at a time
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
  */
-int chidb_DBM_execute_Ne(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint32_t instruction_id) {
-  if (reg1.type != reg2.type) return CHIDB_EMISMATCH;
+int chidb_DBM_batch_plan(DBM *machine, DBMCursor *cursor, DBMBatch **batch) {
+  int rc;
+  DBMRegister *reg;
+  uint32_t body = machine->pc + 1;
+  uint32_t next = body;
+
+  *batch = NULL;
+  while (next < machine->ninstructions &&
+         !(_Next_ == machine->instructions[next].op && cursor->id == (uint32_t) machine->instructions[next].p1))
+    next++;
+  if (next >= machine->ninstructions || body == next) return CHIDB_OK;
+  if (body != (uint32_t) machine->instructions[next].p2 || _ResultRow_ != machine->instructions[next - 1].op) return CHIDB_OK;
+
+  // Check the body, and create the registers it writes
+  for (uint32_t i = body; i < next; ++i) {
+    DBMInstruction *inst = &machine->instructions[i];
+    switch (inst->op) {
+      case _Column_:
+      case _Key_:
+        if (cursor->id != (uint32_t) inst->p1) return CHIDB_OK;
+        rc = chidb_DBM_find_or_create_register(machine, (_Column_ == inst->op) ? inst->p3 : inst->p2, &reg);
+        if (CHIDB_OK != rc) return rc;
+        break;
+      case _Eq_: case _Ne_: case _Lt_: case _Le_: case _Gt_: case _Ge_:
+        if (next != (uint32_t) inst->p2) return CHIDB_OK;
+        break;
+      case _ResultRow_:
+        if (i != next - 1) return CHIDB_OK;
+        break;
+      default:
+        return CHIDB_OK;
+    }
+  }
 
-  switch (reg1.type) {
-    case DBM_STRING_REGISTER_TYPE:
-      if (reg1.fields.string.len == reg2.fields.string.len) {
-        if (0 == strncmp((char *) reg1.fields.string.data, (char *) reg2.fields.string.data, reg1.fields.string.len)) {
-          break;
+  DBMBatch *b             = chidb_Arena_alloc(&machine->arena, sizeof(DBMBatch));
+  DBMRegister **vectors   = chidb_Arena_alloc(&machine->arena, machine->nregisters * sizeof(DBMRegister *));
+  DBMInstruction *result  = &machine->instructions[next - 1];
+  uint32_t nresult        = (result->p2 > 0) ? result->p2 : 0;
+  if (NULL == b || NULL == vectors) return CHIDB_ENOMEM;
+  memset(vectors, 0, machine->nregisters * sizeof(DBMRegister *));
+
+  b->cursor  = cursor;
+  b->next    = next;
+  b->nops    = next - body;
+  b->nresult = nresult;
+  b->ops     = chidb_Arena_alloc(&machine->arena, b->nops * sizeof(DBMBatchOp));
+  b->result  = chidb_Arena_alloc(&machine->arena, (nresult + 1) * sizeof(DBMBatchOperand));
+  b->sel     = chidb_Arena_alloc(&machine->arena, machine->batch_size * sizeof(uint32_t));
+  b->values  = chidb_Arena_alloc(&machine->arena, machine->batch_size * sizeof(int32_t));
+  b->mask    = chidb_Arena_alloc(&machine->arena, FILTER_WORDS(machine->batch_size) * sizeof(uint32_t));
+  if (NULL == b->ops || NULL == b->result || NULL == b->sel || NULL == b->values || NULL == b->mask) return CHIDB_ENOMEM;
+
+  // Registers the loop reads before it writes them (if at all) have to
+  // exist already, as one row at a time; they would be an error then
+  for (uint32_t i = 0; i < b->nops; ++i) {
+    DBMInstruction *inst = &machine->instructions[body + i];
+    DBMBatchOp *op = &b->ops[i];
+    op->op       = inst->op;
+    op->col      = inst->p2;
+    op->filtered = false;
+
+    if (_Column_ == inst->op || _Key_ == inst->op) {
+      rc = chidb_DBM_find_register(machine, (_Column_ == inst->op) ? inst->p3 : inst->p2, &reg);
+      if (CHIDB_OK != rc) return rc;
+      uint32_t r = reg - machine->registers;
+      if (NULL == vectors[r]) {
+        vectors[r] = chidb_Arena_alloc(&machine->arena, machine->batch_size * sizeof(DBMRegister));
+        if (NULL == vectors[r]) return CHIDB_ENOMEM;
+        for (uint32_t j = 0; j < machine->batch_size; ++j) {
+          vectors[r][j]      = *reg;
+          vectors[r][j].type = DBM_NULL_REGISTER_TYPE;
         }
       }
-      chidb_DBM_jump(machine, instruction_id);
-      break;
-    case DBM_INTEGER_REGISTER_TYPE:
-      if (reg1.fields.integer != reg2.fields.integer) {
-        chidb_DBM_jump(machine, instruction_id);
+      op->out.reg    = vectors[r];
+      op->out.vector = true;
+    } else if (_ResultRow_ != inst->op) {
+      if (CHIDB_OK != chidb_DBM_batch_operand(machine, vectors, inst->p1, &op->in1)) return CHIDB_OK;
+      if (CHIDB_OK != chidb_DBM_batch_operand(machine, vectors, inst->p3, &op->in2)) return CHIDB_OK;
+
+      // A column compared with a constant is filtered, the constant on the right
+      op->filtered = (op->in1.vector != op->in2.vector);
+      switch (inst->op) {
+        case _Eq_: op->filter = FILTER_EQ; break;
+        case _Ne_: op->filter = FILTER_NE; break;
+        case _Lt_: op->filter = op->in1.vector ? FILTER_LT : FILTER_GT; break;
+        case _Le_: op->filter = op->in1.vector ? FILTER_LE : FILTER_GE; break;
+        case _Gt_: op->filter = op->in1.vector ? FILTER_GT : FILTER_LT; break;
+        default:   op->filter = op->in1.vector ? FILTER_GE : FILTER_LE; break;
       }
-      break;
-    case DBM_SMALLINT_REGISTER_TYPE:
-      if (reg1.fields.smallint != reg2.fields.smallint) {
-        chidb_DBM_jump(machine, instruction_id);
+    }
+  }
+
+  for (uint32_t i = 0; i < nresult; ++i) {
+    if (CHIDB_OK != chidb_DBM_batch_operand(machine, vectors, result->p1 + i, &b->result[i])) return CHIDB_OK;
+  }
+
+  b->cell  = cursor->start;
+  b->first = cursor->start;
+  b->nsel  = 0;
+  b->row   = 0;
+  b->rc    = CHIDB_OK;
+  *batch   = b;
+  return CHIDB_OK;
+}
+
+
+
+/* Run the body of a batch loop over its next batch of rows
+ *
+ * Up to machine->batch_size consecutive cells of the cursor are loaded
+ * into the column vectors. Each comparison then drops the rows it holds
+ * for (the ones that would skip to the Next) from the selection vector,
+ * so later instructions only run over the rows still selected, and the
+ * ResultRow at the end emits the rows left, as a batch. The row memory
+ * of the previous batch, whose rows have all been handed out, is
+ * released first. Comparisons of an integer column with a constant are
+ * run over the whole selection at once (see chidb_DBM_batch_filter).
+ *
+ * An error on some row leaves the rows before it, which are handed out
+ * before the error is, as it would have happened one row at a time.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - batch: Batch loop
+ */
+void chidb_DBM_batch_fill(DBM *machine, DBMBatch *batch) {
+  int rc;
+  DBMCursor *cursor = batch->cursor;
+  uint32_t n = cursor->end - batch->cell;
+  if (n > machine->batch_size) n = machine->batch_size;
+
+  chidb_DBM_release_row(machine);
+  batch->first = batch->cell;
+  batch->cell += n;
+  batch->row   = 0;
+  batch->nsel  = n;
+  for (uint32_t i = 0; i < n; ++i) {
+    batch->sel[i] = i;
+  }
+
+  for (uint32_t i = 0; i < batch->nops && batch->nsel > 0; ++i) {
+    DBMBatchOp *op = &batch->ops[i];
+    uint32_t nsel  = 0;
+
+    if (op->filtered && chidb_DBM_batch_filter(batch, op)) continue;
+
+    for (uint32_t k = 0; k < batch->nsel; ++k) {
+      uint32_t row = batch->sel[k];
+      bool holds   = false;
+
+      if (_Column_ == op->op) {
+        cursor->cell_id = batch->first + row;
+        rc = chidb_DBM_execute_Column(machine, cursor, op->col, &op->out.reg[row]);
+      } else if (_Key_ == op->op) {
+        cursor->cell_id = batch->first + row;
+        rc = chidb_DBM_execute_Key(machine, *cursor, &op->out.reg[row]);
+      } else if (_ResultRow_ == op->op) {
+        rc = CHIDB_OK;
+      } else {
+        rc = chidb_DBM_compare(op->op, op->in1.vector ? &op->in1.reg[row] : op->in1.reg,
+                                       op->in2.vector ? &op->in2.reg[row] : op->in2.reg, &holds);
       }
-      break;
-    case DBM_BYTE_REGISTER_TYPE:
-      if (reg1.fields.byte != reg2.fields.byte) {
-        chidb_DBM_jump(machine, instruction_id);
+
+      if (CHIDB_OK != rc) {
+        batch->rc = rc;
+        break;
       }
-      break;
+      if (!holds) batch->sel[nsel++] = row;
+    }
+    batch->nsel = nsel;
+  }
+
+  cursor->cell_id = batch->first + n - 1;
+}
+
+
+
+/* Run a comparison of an integer column with a constant over a batch
+ *
+ * The column's values for the rows still selected are gathered into a
+ * contiguous buffer, and compared with the constant all at once (see
+ * chidb_Filter_int32). BYTE, SMALLINT and INTEGER values are all widened
+ * to 32 bits, as chidb_DBM_compare compares integers by value. This only
+ * works if every value is an integer, so the comparison cannot fail;
+ * otherwise nothing is done and the rows are compared one by one.
+ *
+ * Parameters
+ * - batch: Batch loop
+ * - op: Comparison of a column vector with a single register
+ *
+ * Return
+ * - true if the comparison was run (and the selection narrowed down)
+ */
+bool chidb_DBM_batch_filter(DBMBatch *batch, DBMBatchOp *op) {
+  DBMRegister *column   = op->in1.vector ? op->in1.reg : op->in2.reg;
+  DBMRegister *constant = op->in1.vector ? op->in2.reg : op->in1.reg;
+  int64_t value, wide;
+
+  if (CHIDB_OK != chidb_DBM_register_integer(constant, &value)) return false;
+  for (uint32_t k = 0; k < batch->nsel; ++k) {
+    if (CHIDB_OK != chidb_DBM_register_integer(&column[batch->sel[k]], &wide)) return false;
+    batch->values[k] = (int32_t) wide;
+  }
+
+  // Rows the comparison holds for skip to the Next
+  chidb_Filter_int32(op->filter, batch->values, batch->nsel, (int32_t) value, batch->mask);
+  uint32_t nsel = 0;
+  for (uint32_t k = 0; k < batch->nsel; ++k) {
+    if (0 == (batch->mask[k / 32] & (1u << (k % 32)))) batch->sel[nsel++] = batch->sel[k];
+  }
+  batch->nsel = nsel;
+  return true;
+}
+
+
+
+/* Hand out the next row of a batch scan
+ *
+ * A new batch is run whenever the rows of the previous one are all out
+ * (a result row only lasts until the next step, like its row memory).
+ * After the last row, the machine goes on with the instruction after
+ * the loop's Next.
+ *
+ * Parameters
+ * - machine: DBM with a batch scan
+ *
+ * Return
+ * - CHIDB_OK: Operation successful (machine->returned is set if a row
+ *   was handed out)
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - Any error the loop ran into, once the rows before it are out
+ */
+int chidb_DBM_batch_row(DBM *machine) {
+  DBMBatch *batch = machine->batch;
+
+  while (batch->row >= batch->nsel) {
+    if (CHIDB_OK != batch->rc || batch->cell >= batch->cursor->end) {
+      int rc = batch->rc;
+      chidb_DBM_release_row(machine);
+      machine->batch = NULL;
+      if (CHIDB_OK != rc) return rc;
+      machine->pc = batch->next + 1;
+      return CHIDB_OK;
+    }
+    chidb_DBM_batch_fill(machine, batch);
+  }
+
+  if (batch->nresult > machine->result_size) {
+    DBMRegister **result = chidb_Arena_alloc(&machine->arena, batch->nresult * sizeof(DBMRegister *));
+    if (NULL == result) return CHIDB_ENOMEM;
+    machine->result      = result;
+    machine->result_size = batch->nresult;
+  }
+
+  uint32_t row = batch->sel[batch->row++];
+  for (uint32_t i = 0; i < batch->nresult; ++i) {
+    DBMBatchOperand *col = &batch->result[i];
+    machine->result[i] = col->vector ? &col->reg[row] : col->reg;
+  }
+  machine->nresult  = batch->nresult;
+  machine->returned = true;
+  return CHIDB_OK;
+}
+
+
+
+/* Open a B-Tree
+ * 
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to store B-Tree information within
+ * - reg: Register with page number in integer field
+ * - ncols: Number of columns in table
+ * - mode: File access mode
+ * 
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EPAGENO: The provided page number is not valid
+ */
+int chidb_DBM_execute_Open(DBM *machine, DBMCursor *cursor, DBMRegister *reg, uint32_t ncols, uint8_t mode) {
+  int rc;
+
+  // Must have an integer register where we store the page number
+  if (DBM_INTEGER_REGISTER_TYPE != reg->type) return CHIDB_EPAGENO;
+  npage_t page  = reg->fields.integer;
+  cursor->mode  = mode;
+  cursor->ncols = ncols;
+  chidb_DBM_close_sorter(cursor);
+
+  // Writes go straight to the B-Tree through cursor->root_page,
+  // so only read cursors need the nodes and cells loaded
+  cursor->root_page = page;
+  cursor->start     = 0;
+  cursor->end       = 0;
+  cursor->cell_id   = 0;
+  if (DBM_READWRITE == mode) return CHIDB_OK;
+
+  rc = chidb_DBM_load_nodes(machine);
+  if (CHIDB_OK != rc) return rc;
+
+  // Cursors on the same table share its cells
+  for (uint32_t i = 0; i < machine->ncursors; ++i) {
+    DBMCursor *other = &machine->cursors[i];
+    if (other != cursor && DBM_READONLY == other->mode && page == other->root_page) {
+      cursor->start   = other->start;
+      cursor->end     = other->end;
+      cursor->cell_id = cursor->start;
+      return CHIDB_OK;
+    }
   }
 
+  cursor->start = machine->ncells;
+  rc = chidb_DBM_grab_cells(machine, page);
+  cursor->end     = machine->ncells;
+  cursor->cell_id = cursor->start;
+  return rc;
+}
+
+/* Open a B-Tree for reading */
+int chidb_DBM_execute_OpenRead(DBM *machine, DBMCursor *cursor, DBMRegister *reg, uint32_t ncols) {
+  return chidb_DBM_execute_Open(machine, cursor, reg, ncols, DBM_READONLY);
+}
+
+/* Open a B-Tree for reading and writing */
+int chidb_DBM_execute_OpenWrite(DBM *machine, DBMCursor *cursor, DBMRegister *reg, uint32_t ncols) {
+  return chidb_DBM_execute_Open(machine, cursor, reg, ncols, DBM_READWRITE);
+}
+
+
+
+/* Close a cursor
+ * 
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to close
+ * 
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_DBM_execute_Close(DBM *machine, DBMCursor *cursor) {
+  chidb_DBM_close_sorter(cursor);
+  size_t len = (machine->cursors + machine->ncursors) - (cursor + 1);
+  if (len > 0) memmove(cursor, cursor + 1, len * sizeof(DBMCursor));
+  machine->ncursors--;
   return CHIDB_OK;
 }
 
 
 
-/* Compare two integer registers with "less than"
+/* Point a cursor to the first entry in the B-tree
  *
  * Parameters
  * - machine: DBM to act upon
- * - reg1: First register
- * - reg2: Second register
- * - instruction_id: Instruction identifier for success jump
+ * - cursor: Cursor to rewind
+ * - instruction_id: Instruction identifier for failure jump
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EMISMATCH: Registers have different types
+ * - CHIDB_ENOTFOUND: Could not find instruction
  */
-int chidb_DBM_execute_Lt(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint32_t instruction_id) {
-  if (reg1.type != reg2.type) return CHIDB_EMISMATCH;
+int chidb_DBM_execute_Rewind(DBM *machine, DBMCursor *cursor, uint32_t instruction_id) {
+  // Row memory is released back to here every time a cursor moves on
+  chidb_DBM_mark_row(machine);
 
-  if (DBM_BYTE_REGISTER_TYPE == reg1.type) {
-    if (reg1.fields.byte < reg2.fields.byte) {
-      chidb_DBM_jump(machine, instruction_id);
-    }
+  if (cursor->start == cursor->end) {
+    // B-tree is empty, jump
+    return chidb_DBM_jump(machine, instruction_id);
   }
-  
-  if (DBM_SMALLINT_REGISTER_TYPE == reg1.type) {
-    if (reg1.fields.smallint < reg2.fields.smallint) {
-      chidb_DBM_jump(machine, instruction_id);
+
+  cursor->cell_id = cursor->start;
+  return CHIDB_OK;
+}
+
+
+
+/* Point a cursor to the first entry in the B-tree, and split the scan
+ * loop that follows across threads if the B-Tree is large enough
+ *
+ * The cursor's cells are split in partitions (see chidb_DBM_scan_bounds),
+ * up to one per thread and with at least machine->scan_min_cells cells
+ * each. A worker machine runs the scan loop over each partition: the
+ * first one on the calling thread, the others on threads of their own (or
+ * on the calling thread too, if a thread cannot be started), which queue
+ * their result rows, DBM_SCAN_QUEUE at most, and wait when their queue is
+ * full. The machine jumps past the loop at once, as for an empty B-Tree,
+ * and hands out the rows of the workers in partition order as they come,
+ * so in the same order as if the loop had not been split (see
+ * chidb_DBM_scan_row). Memory for the rows stays bounded however large
+ * the B-Tree is.
+ *
+ * Only a loop that does nothing but read its B-Tree and return rows can
+ * be split; the generator marks their Rewind with a non-zero p3. If the
+ * B-Tree is too small to be worth splitting (or cannot be cut, as it
+ * refers to a page that was not loaded), the loop is run a batch at a
+ * time instead (see chidb_DBM_execute_BatchScan), and so are the
+ * partitions by their workers.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to rewind
+ * - instruction_id: Instruction identifier past the loop (the jump for
+ *   an empty B-Tree)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_ENOTFOUND: Could not find instruction, or the tree refers to a
+ *   page that was not loaded
+ */
+int chidb_DBM_execute_ParallelScan(DBM *machine, DBMCursor *cursor, uint32_t instruction_id) {
+  int rc;
+  uint32_t nparts = machine->nthreads;
+
+  uint32_t *bounds = chidb_Arena_alloc(&machine->arena, (nparts + 1) * sizeof(uint32_t));
+  if (NULL == bounds) return CHIDB_ENOMEM;
+  rc = chidb_DBM_scan_bounds(machine, cursor, &nparts, bounds);
+  if (CHIDB_OK != rc && CHIDB_ENOTFOUND != rc) return rc;
+
+  // A B-Tree that could not be cut is scanned on this thread only
+  if (CHIDB_OK != rc || nparts < 2) return chidb_DBM_execute_BatchScan(machine, cursor, instruction_id);
+
+  DBMScan *scan       = chidb_Arena_alloc(&machine->arena, sizeof(DBMScan));
+  DBMPartition *parts = chidb_Arena_alloc(&machine->arena, nparts * sizeof(DBMPartition));
+  if (NULL == scan || NULL == parts) return CHIDB_ENOMEM;
+  memset(parts, 0, nparts * sizeof(DBMPartition));
+  for (uint32_t i = 0; i < nparts; ++i) {
+    pthread_mutex_init(&parts[i].lock, NULL);
+    pthread_cond_init(&parts[i].ready, NULL);
+    pthread_cond_init(&parts[i].room, NULL);
+  }
+  scan->parts   = parts;
+  scan->nparts  = nparts;
+  scan->part    = 0;
+  scan->held    = false;
+  machine->scan = scan;
+
+  for (uint32_t i = 0; i < nparts; ++i) {
+    rc = chidb_DBM_scan_worker(machine, cursor, bounds[i], bounds[i + 1], &parts[i].worker);
+    if (CHIDB_OK != rc) {
+      chidb_DBM_end_scan(machine);
+      return rc;
     }
   }
 
-  if (DBM_INTEGER_REGISTER_TYPE == reg1.type) {
-    if (reg1.fields.integer < reg2.fields.integer) {
-      chidb_DBM_jump(machine, instruction_id);
-    }
+  // The first partition's rows are handed out first, so its worker is
+  // simply stepped as they are needed
+  for (uint32_t i = 1; i < nparts; ++i) {
+    parts[i].threaded = 0 == pthread_create(&parts[i].thread, NULL, chidb_DBM_run_partition, &parts[i]);
+  }
+
+  return chidb_DBM_jump(machine, instruction_id);
+}
+
+
+
+/* Point a cursor to the first entry in the B-tree, and run the scan
+ * loop that follows a batch of rows at a time
+ *
+ * Rather than going through the loop once per row, interpreting every
+ * instruction of it each time, each instruction is run over a batch of
+ * up to machine->batch_size rows at once: the cursor's columns are
+ * loaded into column vectors, comparisons narrow down a selection
+ * vector, and the ResultRow emits the rows left in it (see
+ * chidb_DBM_batch_plan and chidb_DBM_batch_fill). The machine then jumps
+ * past the loop, as for an empty B-Tree, and hands out the rows of each
+ * batch in turn, in the order the loop would have returned them (see
+ * chidb_DBM_batch_row).
+ *
+ * Like ParallelScan, this is only for loops marked by the generator
+ * (Rewind with a non-zero p3). If batches are turned off
+ * (machine->batch_size is 1) or the loop does anything else, this is
+ * just a Rewind.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to rewind
+ * - instruction_id: Instruction identifier past the loop (the jump for
+ *   an empty B-Tree)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_ENOTFOUND: Could not find instruction
+ */
+int chidb_DBM_execute_BatchScan(DBM *machine, DBMCursor *cursor, uint32_t instruction_id) {
+  int rc;
+  DBMBatch *batch = NULL;
+
+  rc = chidb_DBM_execute_Rewind(machine, cursor, instruction_id);
+  if (CHIDB_OK != rc || machine->jumped || machine->batch_size < 2) return rc;
+
+  rc = chidb_DBM_batch_plan(machine, cursor, &batch);
+  if (CHIDB_OK != rc || NULL == batch) return rc;
+
+  machine->batch = batch;
+  return chidb_DBM_jump(machine, instruction_id);
+}
+
+
+
+/* Advance a cursor to the next entry in the B-tree (if any)
+ *
+ * The previous row is done with, so the row arena is released (the
+ * program reloads every column it needs after moving a cursor).
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to advance
+ * - instruction_id: Instruction identifier for jump
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: Could not find instruction
+ */
+int chidb_DBM_execute_Next(DBM *machine, DBMCursor *cursor, uint32_t instruction_id) {
+  chidb_DBM_release_row(machine);
+
+  if (cursor->cell_id + 1 < cursor->end) {
+    ++cursor->cell_id;
+    return chidb_DBM_jump(machine, instruction_id);
+  }
+
+  return CHIDB_OK;
+}
+
+
+
+/* Move a cursor to the previous entry in the B-tree (if any)
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to move
+ * - instruction_id: Instruction identifier for jump
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: Could not find instruction
+ */
+int chidb_DBM_execute_Prev(DBM *machine, DBMCursor *cursor, uint32_t instruction_id) {
+  if (cursor->cell_id > cursor->start) {
+    --cursor->cell_id;
+    return chidb_DBM_jump(machine, instruction_id);
+  }
+
+  return CHIDB_OK;
+}
+
+
+
+/* Move a cursor to the entry with a given key (if any)
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to move
+ * - key: Key of B-Tree entry
+ * - instruction_id: Instruction identifier for failure jump
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: Could not find instruction
+ */
+int chidb_DBM_execute_Seek(DBM *machine, DBMCursor *cursor, key_t key, uint32_t instruction_id) {
+  for (uint32_t i = cursor->start; i < cursor->end; ++i) {
+    if (key == machine->cells[i].entry.key) {
+      cursor->cell_id = i;
+      return CHIDB_OK;
+    }
+  }
+
+  return chidb_DBM_jump(machine, instruction_id);
+}
+
+
+
+/* Move a cursor to the entry key greater than a given key (if any)
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to move
+ * - key: Key of B-Tree entry
+ * - instruction_id: Instruction identifier for failure jump
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: Could not find instruction
+ */
+int chidb_DBM_execute_SeekGt(DBM *machine, DBMCursor *cursor, key_t key, uint32_t instruction_id) {
+  for (uint32_t i = cursor->start; i < cursor->end; ++i) {
+    if (key < machine->cells[i].entry.key) {
+      cursor->cell_id = i;
+      return CHIDB_OK;
+    }
+  }
+
+  return chidb_DBM_jump(machine, instruction_id);
+}
+
+
+
+/* Move a cursor to the entry key greater than a given key (if any)
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to move
+ * - key: Key of B-Tree entry
+ * - instruction_id: Instruction identifier for failure jump
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: Could not find instruction
+ */
+int chidb_DBM_execute_SeekGe(DBM *machine, DBMCursor *cursor, key_t key, uint32_t instruction_id) {
+  for (uint32_t i = cursor->start; i < cursor->end; ++i) {
+    if (key <= machine->cells[i].entry.key) {
+      cursor->cell_id = i;
+      return CHIDB_OK;
+    }
+  }
+
+  return chidb_DBM_jump(machine, instruction_id);
+}
+
+
+
+/* Read the whole record of a cell with overflow pages
+ *
+ * The record is read into the row arena, and kept until the row is
+ * released, so a row's columns are read from the same copy.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cell: Table leaf cell
+ * - record: Out parameter for the record
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_ECORRUPT, CHIDB_EIO: Could not read the overflow pages
+ */
+int chidb_DBM_cell_record(DBM *machine, DBMCell *cell, uint8_t **record) {
+  if (machine->record_cell != cell) {
+    uint8_t *data = chidb_Arena_alloc(&machine->row_arena, cell->entry.fields.tableLeaf.data_size);
+    if (NULL == data) return CHIDB_ENOMEM;
+
+    // The workers of a split scan may read pages at the same time
+    int rc = chidb_Btree_getCellDataAt(machine->db->bt, &cell->entry, machine->snapshot, data);
+    if (CHIDB_OK != rc) return rc;
+    machine->record_cell = cell;
+    machine->record      = data;
+  }
+
+  *record = machine->record;
+  return CHIDB_OK;
+}
+
+
+
+/* Store a column's value into a register
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to inspect
+ * - col_num: Column id to inspect
+ * - reg: Register to modify
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_DBM_execute_Column(DBM *machine, DBMCursor *cursor, int32_t col_num, DBMRegister *reg) {
+  if (NULL == machine->maps) return CHIDB_EIO;
+
+  // If I'm getting this right, the B-Tree cell should be, in the case of table cells, table leaf cells
+  // (a cursor on an index goes through the entries of every node)
+  BTreeCell btc = machine->cells[cursor->cell_id].entry;
+  if (PGTYPE_TABLE_INTERNAL == btc.type) return CHIDB_EMISMATCH;
+
+  Schema_ColumnMap *map = &machine->maps[cursor->id].colMap;
+  if (col_num < 0 || col_num >= map->ncols) return CHIDB_EMISUSE;
+  ColumnSchema schema = map->cols[col_num];
+
+  // Primary key values aren't actually stored in the DB record, but rather in the B-tree cell itself
+  if (map->primary_col >= 0 && map->primary_col == col_num) {
+    reg->type = DBM_INTEGER_REGISTER_TYPE;
+    if (PGTYPE_TABLE_LEAF == btc.type)
+      reg->fields.integer = btc.key;
+    else
+      reg->fields.integer = (PGTYPE_INDEX_LEAF == btc.type) ? btc.fields.indexLeaf.keyPk : btc.fields.indexInternal.keyPk;
+    return CHIDB_OK;
+  }
+
+  // Read the record in place, the header is only parsed up to the column
+  // (unless part of it is in overflow pages, then it is read whole first).
+  // Entries of a covering index have a record of their own, with all the
+  // columns of the index but the first one (their key) and the primary key
+  uint8_t *record = NULL;
+  int32_t field   = col_num;
+  if (PGTYPE_TABLE_LEAF == btc.type) {
+    record = btc.fields.tableLeaf.data;
+    if (0 != btc.fields.tableLeaf.overflow_page) {
+      int rc = chidb_DBM_cell_record(machine, &machine->cells[cursor->cell_id], &record);
+      if (CHIDB_OK != rc) return rc;
+    }
+  } else if (col_num > 0) {
+    record = (PGTYPE_INDEX_LEAF == btc.type) ? btc.fields.indexLeaf.extra : btc.fields.indexInternal.extra;
+    field  = col_num - 1 - ((map->primary_col > 0 && map->primary_col < col_num) ? 1 : 0);
+  }
+
+  DBRecordView view;
+  int data_type;
+  int32_t integer = 0;
+  if (NULL != record) {
+    chidb_DBRecordView_init(&view, record);
+    data_type = chidb_DBRecordView_getType(&view, field);
+  } else {
+    // The first column of an index (plain index entries have nothing else)
+    data_type = (0 == col_num) ? SQL_INTEGER_4BYTE : SQL_NULL;
+    integer   = btc.key;
+  }
+
+  // NULL value in database (or no value at all), just skip it
+  if (SQL_NULL == data_type || SQL_NOTVALID == data_type) {
+    reg->type = DBM_NULL_REGISTER_TYPE;
+    return CHIDB_OK;
+  }
+
+  // Value was returned, let's grab it. Integers are read at the width they
+  // were stored with (INSERT stores 4 bytes, .import the column's width)
+  int8_t int8;
+  int16_t int16;
+  const char *text;
+  int text_length;
+  if (NULL != record) {
+    switch (data_type) {
+      case SQL_INTEGER_1BYTE:
+        chidb_DBRecordView_getInt8(&view, field, &int8);
+        integer = int8;
+        break;
+
+      case SQL_INTEGER_2BYTE:
+        chidb_DBRecordView_getInt16(&view, field, &int16);
+        integer = int16;
+        break;
+
+      case SQL_INTEGER_4BYTE:
+        chidb_DBRecordView_getInt32(&view, field, &integer);
+        break;
+    }
+  }
+
+  switch (schema.type) {
+    case SQL_INTEGER_1BYTE:
+      reg->type        = DBM_BYTE_REGISTER_TYPE;
+      reg->fields.byte = (uint8_t) integer;
+      break;
+
+    case SQL_INTEGER_2BYTE:
+      reg->type            = DBM_SMALLINT_REGISTER_TYPE;
+      reg->fields.smallint = (int16_t) integer;
+      break;
+
+    case SQL_INTEGER_4BYTE:
+      reg->type           = DBM_INTEGER_REGISTER_TYPE;
+      reg->fields.integer = integer;
+      break;
+
+    case SQL_TEXT:
+      // The only copy, into the row arena, to add a terminating NUL so the data is a C string
+      if (NULL == record) return CHIDB_EMISMATCH;
+      chidb_DBRecordView_getString(&view, field, &text, &text_length);
+      reg->type = DBM_STRING_REGISTER_TYPE;
+      reg->fields.string.len  = text_length;
+      reg->fields.string.data = chidb_Arena_alloc(&machine->row_arena, (reg->fields.string.len + 1) * sizeof(uint8_t));
+      if (NULL == reg->fields.string.data) return CHIDB_ENOMEM;
+      memcpy((char *) reg->fields.string.data, text, reg->fields.string.len * sizeof(uint8_t));
+      reg->fields.string.data[reg->fields.string.len] = '\0';
+      break;
+  }
+
+  return CHIDB_OK;
+}
+
+
+
+/* Store a cursor's key into a register
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to inspect
+ * - reg: Register to update
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_DBM_execute_Key(DBM *machine, DBMCursor cursor, DBMRegister *reg) {
+  reg->type = DBM_INTEGER_REGISTER_TYPE;
+  reg->fields.integer = machine->cells[cursor.cell_id].entry.key;
+  return CHIDB_OK;
+}
+
+
+
+/* Store an integer in a register
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - integer: Integer to store
+ * - reg: Register for storage
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_DBM_execute_Integer(DBM *machine, DBMRegister *reg, int32_t integer) {
+  reg->type = DBM_INTEGER_REGISTER_TYPE;
+  reg->fields.integer = integer;
+  return CHIDB_OK;
+}
+
+
+
+/* Store a string in a register
+ *
+ * The string is not copied: the register points at the instruction's
+ * operand, which lives as long as the program.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - len: Length of string data
+ * - reg: Register for storage
+ * - data: Pointer to start of datastore (null-terminated)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_DBM_execute_String(DBM *machine, DBMRegister *reg, void *data, size_t len) {
+  reg->type = DBM_STRING_REGISTER_TYPE;
+  reg->fields.string.len  = len;
+  reg->fields.string.data = data;
+  return CHIDB_OK;
+}
+
+
+
+/* Store a NULL value in a register
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - reg: Register for storage
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_DBM_execute_Null(DBM *machine, DBMRegister *reg) {
+  reg->type = DBM_NULL_REGISTER_TYPE;
+  return CHIDB_OK;
+}
+
+
+
+/* Return result row (registers) to database user
+ *
+ * The row is not copied: the result just points at the registers, which
+ * the program leaves alone until the machine is stepped again.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - reg_id: Identifier for first register
+ * - ncols: Number of columns to return (total r+n-1)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_ENOTFOUND: Could not find register
+ */
+int chidb_DBM_execute_ResultRow(DBM *machine, uint32_t reg_id, int32_t ncols) {
+  int rc;
+
+  if ((uint32_t) ncols > machine->result_size) {
+    DBMRegister **result = chidb_Arena_alloc(&machine->arena, ncols * sizeof(DBMRegister *));
+    if (NULL == result) return CHIDB_ENOMEM;
+    machine->result      = result;
+    machine->result_size = ncols;
+  }
+
+  for (int32_t i = 0; i < ncols; ++i) {
+    rc = chidb_DBM_find_register(machine, reg_id + i, &machine->result[i]);
+    if (CHIDB_OK != rc) return rc;
+  }
+
+  machine->nresult  = ncols;
+  machine->returned = true;
+  return CHIDB_OK;
+}
+
+
+
+/* Print the current result row
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_DBM_print_result(DBM *machine) {
+  for (uint32_t i = 0; i < machine->nresult; ++i) {
+    DBMRegister *reg = machine->result[i];
+    switch (reg->type) {
+      case DBM_NULL_REGISTER_TYPE:
+        printf("|");
+        break;
+      case DBM_STRING_REGISTER_TYPE:
+        printf("| %s ", (char *) reg->fields.string.data);
+        break;
+      default: {
+        int64_t value;
+        chidb_DBM_register_integer(reg, &value);
+        printf("| %i ", (int) value);
+        break;
+      }
+    }
+  }
+  printf("|");
+  return CHIDB_OK;
+}
+
+
+
+/* Store a result row (registers) into another register
+ *
+ * The registers are encoded straight into a buffer from the row arena,
+ * which goes away with the row (at Next, or once Insert has written it).
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - reg_id: Identifier for first register
+ * - ncols: Number of columns to return (total r+n-1)
+ * - result_reg: Register for storage
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_ENOTFOUND: Could not find register
+ * - CHIDB_ECONSTRAINT: Too many columns to fit in a record
+ */
+int chidb_DBM_execute_MakeRecord(DBM *machine, uint32_t reg_id, int32_t ncols, DBMRegister *result_reg) {
+  int rc;
+
+  if ((uint32_t) ncols > machine->record_size) {
+    DBRecordField *fields = chidb_Arena_alloc(&machine->arena, ncols * sizeof(DBRecordField));
+    if (NULL == fields) return CHIDB_ENOMEM;
+    machine->record_fields = fields;
+    machine->record_size   = ncols;
+  }
+
+  DBMRegister *reg;
+  DBRecordField *fields = machine->record_fields;
+  for (int32_t i = 0; i < ncols; ++i) {
+    rc = chidb_DBM_find_register(machine, reg_id + i, &reg);
+    if (CHIDB_OK != rc) return rc;
+
+    switch (reg->type) {
+      case DBM_NULL_REGISTER_TYPE:
+        fields[i].type = SQL_NULL;
+        break;
+      case DBM_INTEGER_REGISTER_TYPE:
+        fields[i].type    = SQL_INTEGER_4BYTE;
+        fields[i].integer = reg->fields.integer;
+        break;
+      case DBM_SMALLINT_REGISTER_TYPE:
+        fields[i].type    = SQL_INTEGER_2BYTE;
+        fields[i].integer = reg->fields.smallint;
+        break;
+      case DBM_BYTE_REGISTER_TYPE:
+        fields[i].type    = SQL_INTEGER_1BYTE;
+        fields[i].integer = reg->fields.byte;
+        break;
+      case DBM_STRING_REGISTER_TYPE:
+        fields[i].type     = SQL_TEXT;
+        fields[i].text     = reg->fields.string.data;
+        fields[i].text_len = reg->fields.string.len;
+        break;
+    }
+  }
+
+  uint32_t size;
+  rc = chidb_DBRecord_encodedSize(fields, ncols, &size);
+  if (CHIDB_OK != rc) return rc;
+
+  chidb_DBM_mark_row(machine);
+  uint8_t *data = chidb_Arena_alloc(&machine->row_arena, size);
+  if (NULL == data) return CHIDB_ENOMEM;
+
+  result_reg->type               = DBM_STRING_REGISTER_TYPE;
+  result_reg->fields.string.len  = size;
+  result_reg->fields.string.data = data;
+  return chidb_DBRecord_encode(fields, ncols, data);
+}
+
+
+
+/* Insert a DB record into the B-tree entry pointed by a cursor
+ *
+ * The record is already in its on-disk format (see MakeRecord), so it
+ * is handed to the B-Tree as is.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to act upon
+ * - key: Key of database record
+ * - record: Register holding the raw database record
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: Cursor is not open for writing
+ * - Any error returned by chidb_Btree_insert
+ */
+int chidb_DBM_execute_Insert(DBM *machine, DBMCursor *cursor, key_t key, DBMRegister *record) {
+  int rc;
+  if (cursor->mode != DBM_READWRITE) return CHIDB_EMISUSE;
+
+  BTreeCell rcell;
+  rcell.type = PGTYPE_TABLE_LEAF;
+  rcell.key  = key;
+  rcell.fields.tableLeaf.data      = record->fields.string.data;
+  rcell.fields.tableLeaf.data_size = record->fields.string.len;
+  rc = chidb_Btree_insert(machine->db->bt, cursor->root_page, &rcell);
+
+  // The record is in the file now, a multi-row INSERT moves on to the next row
+  record->type = DBM_NULL_REGISTER_TYPE;
+  chidb_DBM_release_row(machine);
+  return rc;
+}
+
+
+
+/* Compare two registers, as a comparison instruction does
+ *
+ * Integers compare with Eq, Ne, Lt, Le, Gt and Ge, by value whatever
+ * their width (a BYTE column with an INTEGER constant, say); strings only
+ * with Eq and Ne. NULL is equal to NULL (and not less or greater than it).
+ * NULL and a value are not equal, and every ordering of them holds: the
+ * generator jumps past a row when the negation of a WHERE condition
+ * holds, so a row whose column is NULL fails =, <, <=, > and >=.
+ *
+ * Parameters
+ * - op: Comparison (_Eq_, _Ne_, _Lt_, _Le_, _Gt_ or _Ge_)
+ * - reg1: First register
+ * - reg2: Second register
+ * - holds: Out parameter; true if reg1 op reg2 holds (the instruction jumps)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: Registers have different types (other than two
+ *   integers, or NULL and a value)
+ */
+int chidb_DBM_compare(instruction_code op, DBMRegister *reg1, DBMRegister *reg2, bool *holds) {
+  int64_t value1, value2;
+  int cmp;
+
+  if (CHIDB_OK != chidb_DBM_register_integer(reg1, &value1) || CHIDB_OK != chidb_DBM_register_integer(reg2, &value2)) {
+    if (reg1->type != reg2->type) {
+      if (DBM_NULL_REGISTER_TYPE != reg1->type && DBM_NULL_REGISTER_TYPE != reg2->type) return CHIDB_EMISMATCH;
+      *holds = (_Eq_ != op);
+      return CHIDB_OK;
+    }
+
+    switch (reg1->type) {
+      case DBM_STRING_REGISTER_TYPE:
+        cmp = (reg1->fields.string.len == reg2->fields.string.len &&
+               0 == strncmp((char *) reg1->fields.string.data, (char *) reg2->fields.string.data, reg1->fields.string.len)) ? 0 : 1;
+        *holds = (_Eq_ == op) ? (0 == cmp) : (_Ne_ == op) ? (0 != cmp) : false;
+        return CHIDB_OK;
+      case DBM_NULL_REGISTER_TYPE:
+        *holds = (_Eq_ == op);
+        return CHIDB_OK;
+      default:
+        *holds = false;
+        return CHIDB_OK;
+    }
+  }
+
+  cmp = (value1 > value2) - (value1 < value2);
+  switch (op) {
+    case _Eq_: *holds = (cmp == 0); break;
+    case _Ne_: *holds = (cmp != 0); break;
+    case _Lt_: *holds = (cmp <  0); break;
+    case _Le_: *holds = (cmp <= 0); break;
+    case _Gt_: *holds = (cmp >  0); break;
+    case _Ge_: *holds = (cmp >= 0); break;
+    default:   *holds = false;      break;
+  }
+  return CHIDB_OK;
+}
+
+
+
+/* Jump if a comparison of two registers holds
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - op: Comparison (see chidb_DBM_compare)
+ * - reg1: First register
+ * - reg2: Second register
+ * - instruction_id: Instruction identifier for success jump
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: Registers have different types
+ */
+int chidb_DBM_execute_compare(DBM *machine, instruction_code op, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id) {
+  bool holds;
+  int rc = chidb_DBM_compare(op, reg1, reg2, &holds);
+  if (CHIDB_OK != rc) return rc;
+  if (holds) chidb_DBM_jump(machine, instruction_id);
+  return CHIDB_OK;
+}
+
+/* Compare two registers for equality (NULL equals NULL) */
+int chidb_DBM_execute_Eq(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id) {
+  return chidb_DBM_execute_compare(machine, _Eq_, reg1, reg2, instruction_id);
+}
+
+/* Compare two registers for inequality */
+int chidb_DBM_execute_Ne(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id) {
+  return chidb_DBM_execute_compare(machine, _Ne_, reg1, reg2, instruction_id);
+}
+
+/* Compare two integer registers with "less than" */
+int chidb_DBM_execute_Lt(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id) {
+  return chidb_DBM_execute_compare(machine, _Lt_, reg1, reg2, instruction_id);
+}
+
+/* Compare two integer registers with "less than or equal" */
+int chidb_DBM_execute_Le(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id) {
+  return chidb_DBM_execute_compare(machine, _Le_, reg1, reg2, instruction_id);
+}
+
+/* Compare two integer registers with "greater than" */
+int chidb_DBM_execute_Gt(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id) {
+  return chidb_DBM_execute_compare(machine, _Gt_, reg1, reg2, instruction_id);
+}
+
+/* Compare two integer registers with "greater than or equal" */
+int chidb_DBM_execute_Ge(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id) {
+  return chidb_DBM_execute_compare(machine, _Ge_, reg1, reg2, instruction_id);
+}
+
+
+
+/* Compare key of cursor to key in register. 
+ * If greater or equal, jump to instruction_id.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - reg: Register - must contain a key
+ * - cursor: cursor pointing to an index entry
+ * - instruction_id:  Instruction identifier for success jump
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: Registers have different types
+ */
+int chidb_DBM_execute_IdxGe(DBM *machine, DBMRegister reg, DBMCursor cursor, uint32_t instruction_id) {
+  if (reg.type != DBM_INTEGER_REGISTER_TYPE) return CHIDB_EMISMATCH;
+  DBMCell cell = machine->cells[cursor.cell_id];
+  BTreeCell btc = cell.entry; 
+  switch(btc.type){
+	case PGTYPE_INDEX_INTERNAL:
+	  if(reg.fields.integer < 0) return CHIDB_OK;
+	  if(btc.fields.indexInternal.keyPk >= (uint32_t)reg.fields.integer)
+	    chidb_DBM_jump(machine, instruction_id);
+	  break;
+
+	case PGTYPE_INDEX_LEAF:
+	  if(reg.fields.integer < 0) return CHIDB_OK;
+	  if(btc.fields.indexLeaf.keyPk >= (uint32_t)reg.fields.integer)
+	    chidb_DBM_jump(machine, instruction_id);
+	  break;
+
+	default:
+	  return CHIDB_EMISMATCH;
+  }
+
+  return CHIDB_OK;
+}
+
+
+
+/* Compare key of cursor to key in register. 
+ * If greater, jump to instruction_id.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - reg: Register - must contain a key
+ * - cursor: cursor pointing to an index entry
+ * - instruction_id:  Instruction identifier for success jump
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: Registers have different types
+ */
+int chidb_DBM_execute_IdxGt(DBM *machine, DBMRegister reg, DBMCursor cursor, uint32_t instruction_id) {
+  if (reg.type != DBM_INTEGER_REGISTER_TYPE) return CHIDB_EMISMATCH;
+  DBMCell cell = machine->cells[cursor.cell_id];
+  BTreeCell btc = cell.entry; 
+  switch(btc.type){
+	case PGTYPE_INDEX_INTERNAL:
+	  if(reg.fields.integer < 0) return CHIDB_OK;
+	  if(btc.fields.indexInternal.keyPk > (uint32_t)reg.fields.integer)
+	    chidb_DBM_jump(machine, instruction_id);
+	  break;
+
+	case PGTYPE_INDEX_LEAF:
+	  if(reg.fields.integer < 0) return CHIDB_OK;
+	  if(btc.fields.indexLeaf.keyPk > (uint32_t)reg.fields.integer)
+	    chidb_DBM_jump(machine, instruction_id);
+	  break;
+
+	default:
+	  return CHIDB_EMISMATCH;
+  }
+
+  return CHIDB_OK;
+}
+
+
+
+/* Compare key of cursor to key in register. 
+ * If less, jump to instruction_id.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - reg: Register - must contain a key
+ * - cursor: cursor pointing to an index entry
+ * - instruction_id:  Instruction identifier for success jump
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: Registers have different types
+ */
+int chidb_DBM_execute_IdxLt(DBM *machine, DBMRegister reg, DBMCursor cursor, uint32_t instruction_id) {
+  if (reg.type != DBM_INTEGER_REGISTER_TYPE) return CHIDB_EMISMATCH;
+  DBMCell cell = machine->cells[cursor.cell_id];
+  BTreeCell btc = cell.entry; 
+  switch(btc.type){
+	case PGTYPE_INDEX_INTERNAL:
+	  if(reg.fields.integer < 0) chidb_DBM_jump(machine,instruction_id);
+	  if(btc.fields.indexInternal.keyPk < (uint32_t)reg.fields.integer)
+	    chidb_DBM_jump(machine, instruction_id);
+	  break;
+
+	case PGTYPE_INDEX_LEAF:
+	  if(reg.fields.integer < 0) chidb_DBM_jump(machine,instruction_id);
+	  if(btc.fields.indexLeaf.keyPk < (uint32_t)reg.fields.integer)
+	    chidb_DBM_jump(machine, instruction_id);
+	  break;
+
+	default:
+	  return CHIDB_EMISMATCH;
+  }
+
+  return CHIDB_OK;
+}
+
+
+
+/* Compare key of cursor to key in register. 
+ * If less or equal, jump to instruction_id.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - reg: Register - must contain a key
+ * - cursor: cursor pointing to an index entry
+ * - instruction_id:  Instruction identifier for success jump
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: Cursor points to wrong type or register is 
+ *   holding wrong type
+ */
+int chidb_DBM_execute_IdxLe(DBM *machine, DBMRegister reg, DBMCursor cursor, uint32_t instruction_id) {
+  if (reg.type != DBM_INTEGER_REGISTER_TYPE) return CHIDB_EMISMATCH;
+  DBMCell cell = machine->cells[cursor.cell_id];
+  BTreeCell btc = cell.entry; 
+  switch(btc.type){
+	case PGTYPE_INDEX_INTERNAL:
+	  if(reg.fields.integer < 0) chidb_DBM_jump(machine,instruction_id);
+	  if(btc.fields.indexInternal.keyPk <= (uint32_t)reg.fields.integer)
+	    chidb_DBM_jump(machine, instruction_id);
+	  break;
+
+	case PGTYPE_INDEX_LEAF:
+	  if(reg.fields.integer < 0) chidb_DBM_jump(machine,instruction_id);
+	  if(btc.fields.indexLeaf.keyPk <= (uint32_t)reg.fields.integer)
+	    chidb_DBM_jump(machine, instruction_id);
+	  break;
+
+	default:
+	  return CHIDB_EMISMATCH;
+  }
+
+  return CHIDB_OK;
+}
+
+
+
+/* Store PKey of index pointed to by cursor in register 
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: cursor pointing to index entry
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: Cursor points to wrong type
+ */
+int chidb_DBM_execute_IdxKey(DBM *machine, DBMCursor cursor, DBMRegister *reg) {
+  reg->type = DBM_INTEGER_REGISTER_TYPE;
+  BTreeCell btc = machine->cells[cursor.cell_id].entry;
+  switch(btc.type){
+  	case PGTYPE_INDEX_INTERNAL:
+	  reg->fields.integer = btc.fields.indexInternal.keyPk;
+	  break;
+	case PGTYPE_INDEX_LEAF:
+	  reg->fields.integer = btc.fields.indexLeaf.keyPk;
+	  break;
+	default:
+	  return CHIDB_EMISMATCH;
+  }
+  return CHIDB_OK;
+}
+
+
+
+/* Store a new index entry in the index Btree pointed to by cursor
+ *
+ * If the cursor was opened with SorterOpen, the entry is added to its
+ * sorter instead, to be put in the index by BulkLoad.
+ *
+ * Parameters
+ * - machine: DBM to act on
+ * - reg1: register where idxKey is stored
+ * - reg2: register where pKey is stored
+ * - record: register with the record of a covering index entry (see
+ *   MakeRecord), or NULL for a plain index
+ * - cursor: cursor opened for writing on the index
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: The keys are not integers, or there is no record
+ * - CHIDB_EMISUSE: Cursor is not open for writing
+ * - CHIDB_ECONSTRAINT: The entry is already in the index (or, for a plain
+ *   index, another entry has the same idxKey), or the record is too large
+ * - Any error returned by chidb_Btree_insert or chidb_Sorter_add
+ */
+int chidb_DBM_execute_IdxInsert(DBM *machine, DBMRegister reg1, DBMRegister reg2, DBMRegister *record, DBMCursor *cursor) {
+  int rc;
+  int64_t keyIdx, keyPk;
+
+  // Keys read from a table (by CREATE INDEX) may be narrower integers
+  if (CHIDB_OK != chidb_DBM_register_integer(&reg1, &keyIdx) ||
+      CHIDB_OK != chidb_DBM_register_integer(&reg2, &keyPk))
+    return CHIDB_EMISMATCH;
+  if (cursor->mode != DBM_READWRITE) return CHIDB_EMISUSE;
+  if (NULL != record && DBM_STRING_REGISTER_TYPE != record->type) return CHIDB_EMISMATCH;
+
+  if (NULL != cursor->sorter) {
+    if (NULL == record) {
+      rc = chidb_Sorter_add(cursor->sorter, keyIdx, keyPk, 0, NULL, 0);
+    } else if (record->fields.string.len > INDEXCELL_MAX_EXTRA(machine->db->bt->pager->page_size)) {
+      rc = CHIDB_ECONSTRAINT;
+    } else {
+      rc = chidb_Sorter_add(cursor->sorter, keyIdx, keyPk, 0,
+                            record->fields.string.data, record->fields.string.len);
+    }
+  } else if (NULL == record) {
+    rc = chidb_Btree_insertInIndex(machine->db->bt, cursor->root_page, keyIdx, keyPk);
+  } else {
+    rc = chidb_Btree_insertInCoveringIndex(machine->db->bt, cursor->root_page, keyIdx, keyPk,
+                                           record->fields.string.data, record->fields.string.len);
+  }
+
+  /* The record is not needed anymore, but the row is left to the next
+   * Insert or Next to release: the entries of the row's other indexes
+   * (see UPDATE) may still be made from columns read into it */
+  if (NULL != record)
+    record->type = DBM_NULL_REGISTER_TYPE;
+  return (CHIDB_EDUPLICATE == rc) ? CHIDB_ECONSTRAINT : rc;
+}
+
+
+
+/* Create an empty table B-Tree
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - reg: Register for the page number of its root
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_DBM_execute_CreateTable(DBM *machine, DBMRegister *reg) {
+  npage_t npage;
+  int rc = chidb_Btree_newNode(machine->db->bt, &npage, PGTYPE_TABLE_LEAF);
+  if (CHIDB_OK != rc) return rc;
+
+  reg->type           = DBM_INTEGER_REGISTER_TYPE;
+  reg->fields.integer = npage;
+  return CHIDB_OK;
+}
+
+
+
+/* Create an empty index B-Tree
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - reg: Register for the page number of its root
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_DBM_execute_CreateIndex(DBM *machine, DBMRegister *reg) {
+  npage_t npage;
+  int rc = chidb_Btree_newNode(machine->db->bt, &npage, PGTYPE_INDEX_LEAF);
+  if (CHIDB_OK != rc) return rc;
+
+  reg->type           = DBM_INTEGER_REGISTER_TYPE;
+  reg->fields.integer = npage;
+  return CHIDB_OK;
+}
+
+
+
+/* Open a cursor on a sorter, for the entries of a new index
+ *
+ * The sorter keeps its entries in its own memory (and temporary files),
+ * not in the machine's arenas, until the cursor is closed.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - cursor: Cursor to open
+ * - ncols: Number of columns of the index (0 for a plain index)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_DBM_execute_SorterOpen(DBM *machine, DBMCursor *cursor, uint32_t ncols) {
+  chidb_DBM_close_sorter(cursor);
+  cursor->mode      = DBM_READWRITE;
+  cursor->ncols     = ncols;
+  cursor->root_page = 0;
+  cursor->start     = 0;
+  cursor->end       = 0;
+  cursor->cell_id   = 0;
+
+  cursor->sorter = malloc(sizeof(Sorter));
+  if (NULL == cursor->sorter) return CHIDB_ENOMEM;
+  return chidb_Sorter_init(cursor->sorter, 0, 0);
+}
+
+
+
+/* Build an index from the entries of a sorter
+ *
+ * The entries are sorted and the index B-Tree is built bottom-up (see
+ * chidb_Btree_bulkLoadIndex). If that fails, the (still empty) root of
+ * the index is released.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - sorter: Cursor opened with SorterOpen
+ * - cursor: Cursor opened for writing on the new, empty, index
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The cursors were not opened that way
+ * - CHIDB_ECONSTRAINT: Two entries of a plain index have the same idxKey,
+ *   or a record is too large
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the files
+ */
+int chidb_DBM_execute_BulkLoad(DBM *machine, DBMCursor *sorter, DBMCursor *cursor) {
+  int rc;
+  if (NULL == sorter->sorter || NULL != cursor->sorter || DBM_READWRITE != cursor->mode)
+    return CHIDB_EMISUSE;
+
+  rc = chidb_Sorter_sort(sorter->sorter);
+  if (CHIDB_OK == rc)
+    rc = chidb_Btree_bulkLoadIndex(machine->db->bt, cursor->root_page, sorter->sorter);
+  if (CHIDB_OK != rc)
+    chidb_Btree_freeTree(machine->db->bt, cursor->root_page);
+
+  return (CHIDB_EDUPLICATE == rc) ? CHIDB_ECONSTRAINT : rc;
+}
+
+
+
+/* Make a shallow copy of one register
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - reg1: Register to copy
+ * - reg2: Register for storage
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_DBM_execute_SCopy(DBM *machine, DBMRegister *reg1, DBMRegister *reg2) {
+  reg2->type   = reg1->type;
+  reg2->fields = reg1->fields;
+  return CHIDB_OK;
+}
+
+
+
+/* Halt execution of the DBM
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - err: Error code to return
+ * - err_msg: If err > 0, then string description
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_DBM_execute_Halt(DBM *machine, uint32_t err, const char *err_msg) {
+  machine->err        = err;
+  machine->halted     = true;
+
+  if (NULL != err_msg) {
+    size_t err_msg_len  = strlen(err_msg);
+    machine->err_msg    = malloc(err_msg_len * sizeof(char));
+    if (NULL == machine->err_msg) return CHIDB_ENOMEM;
+    machine->err_msg = strncpy(machine->err_msg, err_msg, err_msg_len);
+    if (NULL == machine->err_msg) return CHIDB_ENOMEM;
   }
 
   return CHIDB_OK;
@@ -1506,75 +3518,112 @@ int chidb_DBM_execute_Lt(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint3
 
 
 
-/* Compare two integer registers with "less than or equal"
+/* Make the group for the current row's key the target of AggStep
+ *
+ * By default groups are kept in a hash table, so rows may arrive in any
+ * order. If instruction_id is non-zero the input is known to arrive
+ * sorted by the key (e.g. grouping on the primary key of a table scan),
+ * and groups are streamed instead: no hashing is done, and when the key
+ * changes the machine jumps to instruction_id so the finished group can
+ * be emitted before the new one is accumulated.
  *
  * Parameters
  * - machine: DBM to act upon
- * - reg1: First register
- * - reg2: Second register
- * - instruction_id: Instruction identifier for success jump
+ * - reg_id: First key register
+ * - nkeys: Number of key registers (0 for a single, global group)
+ * - instruction_id: Streaming mode jump when a group is finished, or 0
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EMISMATCH: Registers have different types
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_ENOTFOUND: Could not find register
  */
-int chidb_DBM_execute_Le(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint32_t instruction_id) {
-  if (reg1.type != reg2.type) return CHIDB_EMISMATCH;
+int chidb_DBM_execute_GroupSelect(DBM *machine, uint32_t reg_id, uint32_t nkeys, uint32_t instruction_id) {
+  int rc;
 
-  if (DBM_BYTE_REGISTER_TYPE == reg1.type) {
-    if (reg1.fields.byte <= reg2.fields.byte) {
-      chidb_DBM_jump(machine, instruction_id);
-    }
+  // Key registers are allocated consecutively by the code generator, but
+  // the register file may not be, so gather them first (into a buffer
+  // kept for the whole run, as this is done for every row)
+  if (nkeys > machine->group_keys_size) {
+    DBMRegister *grown = chidb_Arena_alloc(&machine->arena, nkeys * sizeof(DBMRegister));
+    if (NULL == grown) return CHIDB_ENOMEM;
+    machine->group_keys      = grown;
+    machine->group_keys_size = nkeys;
   }
 
-  if (DBM_SMALLINT_REGISTER_TYPE == reg1.type) {
-    if (reg1.fields.smallint <= reg2.fields.smallint) {
-      chidb_DBM_jump(machine, instruction_id);
-    }
+  DBMRegister *keys = machine->group_keys;
+  for (uint32_t i = 0; i < nkeys; ++i) {
+    DBMRegister *reg;
+    rc = chidb_DBM_find_register(machine, reg_id + i, &reg);
+    if (CHIDB_OK != rc) return rc;
+    keys[i] = *reg;
   }
-  
-  if (DBM_INTEGER_REGISTER_TYPE == reg1.type) {
-    if (reg1.fields.integer <= reg2.fields.integer) {
-      chidb_DBM_jump(machine, instruction_id);
+  machine->group_nkeys = nkeys;
+
+  if (0 != instruction_id) {
+    // Streaming: same key as the last group, keep accumulating
+    if (machine->ngroups > 0 && chidb_DBM_registers_equal(machine->groups[machine->ngroups - 1].keys, keys, nkeys)) {
+      machine->group_current = machine->ngroups - 1;
+      return CHIDB_OK;
     }
-  }
-  
-  return CHIDB_OK;
-}
 
+    // Drop groups that were already emitted, at most one is kept alive
+    if (machine->group_emitted > 0) {
+      for (uint32_t i = 0; i < machine->group_emitted; ++i) {
+        for (uint32_t k = 0; k < nkeys; ++k) {
+          chidb_DBM_free_register(&machine->groups[i].keys[k]);
+        }
+        free(machine->groups[i].keys);
+        free(machine->groups[i].aggs);
+      }
+      machine->ngroups -= machine->group_emitted;
+      memmove(machine->groups, machine->groups + machine->group_emitted, machine->ngroups * sizeof(DBMGroup));
+      machine->group_emitted = 0;
+    }
 
+    rc = chidb_DBM_new_group(machine, keys, 0);
+    if (CHIDB_OK != rc) return rc;
 
-/* Compare two integer registers with "greater than"
- *
- * Parameters
- * - machine: DBM to act upon
- * - reg1: First register
- * - reg2: Second register
- * - instruction_id: Instruction identifier for success jump
- *
- * Return
- * - CHIDB_OK: Operation successful
- * - CHIDB_EMISMATCH: Registers have different types
- */
-int chidb_DBM_execute_Gt(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint32_t instruction_id) {
-  if (reg1.type != reg2.type) return CHIDB_EMISMATCH;
+    if (machine->ngroups > 1) return chidb_DBM_jump(machine, instruction_id);
+    return CHIDB_OK;
+  }
 
-  if (DBM_BYTE_REGISTER_TYPE == reg1.type) {
-    if (reg1.fields.byte > reg2.fields.byte) {
-      chidb_DBM_jump(machine, instruction_id);
-    }
+  // Hashing: look the key up, creating the group if it is new
+  if (0 == machine->group_nbuckets) {
+    machine->group_buckets = malloc(DBM_GROUP_BUCKETS * sizeof(int32_t));
+    if (NULL == machine->group_buckets) return CHIDB_ENOMEM;
+    machine->group_nbuckets = DBM_GROUP_BUCKETS;
+    memset(machine->group_buckets, 0xFF, DBM_GROUP_BUCKETS * sizeof(int32_t));
   }
 
-  if (DBM_SMALLINT_REGISTER_TYPE == reg1.type) {
-    if (reg1.fields.smallint > reg2.fields.smallint) {
-      chidb_DBM_jump(machine, instruction_id);
+  uint32_t hash = chidb_DBM_hash_registers(keys, nkeys);
+  for (int32_t i = machine->group_buckets[hash % machine->group_nbuckets]; i >= 0; i = machine->groups[i].next) {
+    if (hash == machine->groups[i].hash && chidb_DBM_registers_equal(machine->groups[i].keys, keys, nkeys)) {
+      machine->group_current = i;
+      return CHIDB_OK;
     }
   }
 
-  if (DBM_INTEGER_REGISTER_TYPE == reg1.type) {
-    if (reg1.fields.integer > reg2.fields.integer) {
-      chidb_DBM_jump(machine, instruction_id);
+  rc = chidb_DBM_new_group(machine, keys, hash);
+  if (CHIDB_OK != rc) return rc;
+
+  // Keep chains short: double the buckets when the load factor reaches one
+  if (machine->ngroups > machine->group_nbuckets) {
+    uint32_t nbuckets = 2 * machine->group_nbuckets;
+    int32_t *buckets  = realloc(machine->group_buckets, nbuckets * sizeof(int32_t));
+    if (NULL == buckets) return CHIDB_ENOMEM;
+    memset(buckets, 0xFF, nbuckets * sizeof(int32_t));
+    machine->group_buckets  = buckets;
+    machine->group_nbuckets = nbuckets;
+    for (uint32_t i = 0; i < machine->ngroups; ++i) {
+      uint32_t b = machine->groups[i].hash % nbuckets;
+      machine->groups[i].next = buckets[b];
+      buckets[b] = i;
     }
+  } else {
+    uint32_t b = hash % machine->group_nbuckets;
+    machine->groups[machine->group_current].next = machine->group_buckets[b];
+    machine->group_buckets[b] = machine->group_current;
   }
 
   return CHIDB_OK;
@@ -1582,288 +3631,286 @@ int chidb_DBM_execute_Gt(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint3
 
 
 
-/* Compare two integer registers with "greater than or equal"
+/* Accumulate a value into an aggregate of the current group
  *
  * Parameters
  * - machine: DBM to act upon
- * - reg1: First register
- * - reg2: Second register
- * - instruction_id: Instruction identifier for success jump
+ * - agg: Aggregate number within the group
+ * - reg: Input register, or NULL for COUNT(*)
+ * - func: Aggregate function (AGG_COUNT, AGG_SUM, ...)
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EMISMATCH: Registers have different types
+ * - CHIDB_EMISUSE: No group selected or aggregate out of range
+ * - CHIDB_EMISMATCH: SUM, MIN, MAX or AVG of a non-integer value
  */
-int chidb_DBM_execute_Ge(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint32_t instruction_id) {
-  if (reg1.type != reg2.type) return CHIDB_EMISMATCH;
+int chidb_DBM_execute_AggStep(DBM *machine, uint32_t agg, DBMRegister *reg, uint8_t func) {
+  if (0 == machine->ngroups || agg >= machine->group_naggs) return CHIDB_EMISUSE;
+  DBMAggregate *acc = &machine->groups[machine->group_current].aggs[agg];
 
-  if (DBM_BYTE_REGISTER_TYPE == reg1.type) {
-    if (reg1.fields.byte >= reg2.fields.byte) {
-      chidb_DBM_jump(machine, instruction_id);
-    }
+  // COUNT(*) counts rows; everything else skips NULLs
+  if (NULL == reg) {
+    acc->count++;
+    return CHIDB_OK;
   }
-
-  if (DBM_SMALLINT_REGISTER_TYPE == reg1.type) {
-    if (reg1.fields.smallint >= reg2.fields.smallint) {
-      chidb_DBM_jump(machine, instruction_id);
-    }
+  if (DBM_NULL_REGISTER_TYPE == reg->type) return CHIDB_OK;
+  if (AGG_COUNT == func) {
+    acc->count++;
+    return CHIDB_OK;
   }
 
-  if (DBM_INTEGER_REGISTER_TYPE == reg1.type) {
-    if (reg1.fields.integer >= reg2.fields.integer) {
-      chidb_DBM_jump(machine, instruction_id);
-    }
+  int64_t value;
+  int rc = chidb_DBM_register_integer(reg, &value);
+  if (CHIDB_OK != rc) return rc;
+
+  switch (func) {
+    case AGG_SUM:
+    case AGG_AVG:
+      acc->value += value;
+      break;
+    case AGG_MIN:
+      if (0 == acc->count || value < acc->value) acc->value = value;
+      break;
+    case AGG_MAX:
+      if (0 == acc->count || value > acc->value) acc->value = value;
+      break;
   }
+  acc->count++;
 
   return CHIDB_OK;
 }
 
 
 
-/* Compare key of cursor to key in register. 
- * If greater or equal, jump to instruction_id.
+/* Select the next finished group for output (GroupKey/AggFinal)
  *
  * Parameters
  * - machine: DBM to act upon
- * - reg: Register - must contain a key
- * - cursor: cursor pointing to an index entry
- * - instruction_id:  Instruction identifier for success jump
+ * - instruction_id: Instruction identifier for jump when no group is left
+ * - final: If true every group is finished (the scan is over); otherwise
+ *          only the groups before the current one are
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EMISMATCH: Registers have different types
+ * - CHIDB_ENOTFOUND: Could not find instruction
  */
-int chidb_DBM_execute_IdxGe(DBM *machine, DBMRegister reg, DBMCursor cursor, uint32_t instruction_id) {
-  if (reg.type != DBM_INTEGER_REGISTER_TYPE) return CHIDB_EMISMATCH;
-  DBMCell cell = machine->cells[cursor.cell_id];
-  BTreeCell btc = cell.entry; 
-  switch(btc.type){
-	case PGTYPE_INDEX_INTERNAL:
-	  if(reg.fields.integer < 0) return CHIDB_OK;
-	  if(btc.fields.indexInternal.keyPk >= (uint32_t)reg.fields.integer)
-	    chidb_DBM_jump(machine, instruction_id);
-	  break;
-
-	case PGTYPE_INDEX_LEAF:
-	  if(reg.fields.integer < 0) return CHIDB_OK;
-	  if(btc.fields.indexLeaf.keyPk >= (uint32_t)reg.fields.integer)
-	    chidb_DBM_jump(machine, instruction_id);
-	  break;
+int chidb_DBM_execute_GroupEmit(DBM *machine, uint32_t instruction_id, bool final) {
+  uint32_t limit = final ? machine->ngroups : machine->group_current;
 
-	default:
-	  return CHIDB_EMISMATCH;
+  if (machine->group_emitted >= limit) {
+    return chidb_DBM_jump(machine, instruction_id);
   }
 
+  machine->group_output = machine->group_emitted++;
   return CHIDB_OK;
 }
 
 
 
-/* Compare key of cursor to key in register. 
- * If greater, jump to instruction_id.
+/* Store one key of the output group into a register
+ *
+ * The key is not copied: groups keep their keys until the machine is reset.
  *
  * Parameters
  * - machine: DBM to act upon
- * - reg: Register - must contain a key
- * - cursor: cursor pointing to an index entry
- * - instruction_id:  Instruction identifier for success jump
+ * - key: Key number within the group
+ * - reg: Register for storage
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EMISMATCH: Registers have different types
+ * - CHIDB_EMISUSE: No group emitted or key out of range
  */
-int chidb_DBM_execute_IdxGt(DBM *machine, DBMRegister reg, DBMCursor cursor, uint32_t instruction_id) {
-  if (reg.type != DBM_INTEGER_REGISTER_TYPE) return CHIDB_EMISMATCH;
-  DBMCell cell = machine->cells[cursor.cell_id];
-  BTreeCell btc = cell.entry; 
-  switch(btc.type){
-	case PGTYPE_INDEX_INTERNAL:
-	  if(reg.fields.integer < 0) return CHIDB_OK;
-	  if(btc.fields.indexInternal.keyPk > (uint32_t)reg.fields.integer)
-	    chidb_DBM_jump(machine, instruction_id);
-	  break;
-
-	case PGTYPE_INDEX_LEAF:
-	  if(reg.fields.integer < 0) return CHIDB_OK;
-	  if(btc.fields.indexLeaf.keyPk > (uint32_t)reg.fields.integer)
-	    chidb_DBM_jump(machine, instruction_id);
-	  break;
-
-	default:
-	  return CHIDB_EMISMATCH;
-  }
-
+int chidb_DBM_execute_GroupKey(DBM *machine, uint32_t key, DBMRegister *reg) {
+  if (machine->group_output >= machine->ngroups || key >= machine->group_nkeys) return CHIDB_EMISUSE;
+  reg->type   = machine->groups[machine->group_output].keys[key].type;
+  reg->fields = machine->groups[machine->group_output].keys[key].fields;
   return CHIDB_OK;
 }
 
 
 
-/* Compare key of cursor to key in register. 
- * If less, jump to instruction_id.
+/* Store the final value of an aggregate of the output group into a register
+ *
+ * SUM, MIN, MAX and AVG of no values are NULL; AVG is an integer average.
  *
  * Parameters
  * - machine: DBM to act upon
- * - reg: Register - must contain a key
- * - cursor: cursor pointing to an index entry
- * - instruction_id:  Instruction identifier for success jump
+ * - agg: Aggregate number within the group
+ * - reg: Register for storage
+ * - func: Aggregate function (AGG_COUNT, AGG_SUM, ...)
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EMISMATCH: Registers have different types
+ * - CHIDB_EMISUSE: No group emitted or aggregate out of range
  */
-int chidb_DBM_execute_IdxLt(DBM *machine, DBMRegister reg, DBMCursor cursor, uint32_t instruction_id) {
-  if (reg.type != DBM_INTEGER_REGISTER_TYPE) return CHIDB_EMISMATCH;
-  DBMCell cell = machine->cells[cursor.cell_id];
-  BTreeCell btc = cell.entry; 
-  switch(btc.type){
-	case PGTYPE_INDEX_INTERNAL:
-	  if(reg.fields.integer < 0) chidb_DBM_jump(machine,instruction_id);
-	  if(btc.fields.indexInternal.keyPk < (uint32_t)reg.fields.integer)
-	    chidb_DBM_jump(machine, instruction_id);
-	  break;
+int chidb_DBM_execute_AggFinal(DBM *machine, uint32_t agg, DBMRegister *reg, uint8_t func) {
+  if (machine->group_output >= machine->ngroups || agg >= machine->group_naggs) return CHIDB_EMISUSE;
+  DBMAggregate *acc = &machine->groups[machine->group_output].aggs[agg];
 
-	case PGTYPE_INDEX_LEAF:
-	  if(reg.fields.integer < 0) chidb_DBM_jump(machine,instruction_id);
-	  if(btc.fields.indexLeaf.keyPk < (uint32_t)reg.fields.integer)
-	    chidb_DBM_jump(machine, instruction_id);
-	  break;
+  reg->type = DBM_NULL_REGISTER_TYPE;
 
-	default:
-	  return CHIDB_EMISMATCH;
+  if (AGG_COUNT == func) {
+    reg->type           = DBM_INTEGER_REGISTER_TYPE;
+    reg->fields.integer = acc->count;
+    return CHIDB_OK;
   }
 
+  if (0 == acc->count) {
+    reg->type = DBM_NULL_REGISTER_TYPE;
+    return CHIDB_OK;
+  }
+
+  reg->type           = DBM_INTEGER_REGISTER_TYPE;
+  reg->fields.integer = (AGG_AVG == func) ? acc->value / acc->count : acc->value;
   return CHIDB_OK;
 }
 
 
 
-/* Compare key of cursor to key in register. 
- * If less or equal, jump to instruction_id.
+/* Jump unconditionally
  *
  * Parameters
  * - machine: DBM to act upon
- * - reg: Register - must contain a key
- * - cursor: cursor pointing to an index entry
- * - instruction_id:  Instruction identifier for success jump
+ * - instruction_id: Instruction identifier to jump to
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EMISMATCH: Cursor points to wrong type or register is 
- *   holding wrong type
+ * - CHIDB_ENOTFOUND: Could not find instruction
  */
-int chidb_DBM_execute_IdxLe(DBM *machine, DBMRegister reg, DBMCursor cursor, uint32_t instruction_id) {
-  if (reg.type != DBM_INTEGER_REGISTER_TYPE) return CHIDB_EMISMATCH;
-  DBMCell cell = machine->cells[cursor.cell_id];
-  BTreeCell btc = cell.entry; 
-  switch(btc.type){
-	case PGTYPE_INDEX_INTERNAL:
-	  if(reg.fields.integer < 0) chidb_DBM_jump(machine,instruction_id);
-	  if(btc.fields.indexInternal.keyPk <= (uint32_t)reg.fields.integer)
-	    chidb_DBM_jump(machine, instruction_id);
-	  break;
+int chidb_DBM_execute_Goto(DBM *machine, uint32_t instruction_id) {
+  return chidb_DBM_jump(machine, instruction_id);
+}
 
-	case PGTYPE_INDEX_LEAF:
-	  if(reg.fields.integer < 0) chidb_DBM_jump(machine,instruction_id);
-	  if(btc.fields.indexLeaf.keyPk <= (uint32_t)reg.fields.integer)
-	    chidb_DBM_jump(machine, instruction_id);
-	  break;
 
-	default:
-	  return CHIDB_EMISMATCH;
-  }
 
+/* Store the number of entries in a table B-Tree into a register
+ *
+ * Only the page headers of the B-Tree are read; no cursor is needed.
+ *
+ * Parameters
+ * - machine: DBM to act upon
+ * - root_page: Root page of the table B-Tree
+ * - reg: Register for storage
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ECORRUPT: The B-Tree is not a table B-Tree
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int chidb_DBM_execute_Count(DBM *machine, npage_t root_page, DBMRegister *reg) {
+  uint32_t count;
+  int rc = chidb_Btree_countEntriesAt(machine->db->bt, root_page, machine->snapshot, &count);
+  if (CHIDB_OK != rc) return rc;
+
+  reg->type           = DBM_INTEGER_REGISTER_TYPE;
+  reg->fields.integer = count;
   return CHIDB_OK;
 }
 
 
 
-/* Store PKey of index pointed to by cursor in register 
+/* Copy the value bound to a ? placeholder into a register
+ *
+ * Placeholders that were never bound read as NULL. Strings are not
+ * copied, bindings can't change while the program runs.
  *
  * Parameters
  * - machine: DBM to act upon
- * - cursor: cursor pointing to index entry
+ * - param: Placeholder number (numbered from 1)
+ * - reg: Register for storage
  *
  * Return
  * - CHIDB_OK: Operation successful
- * - CHIDB_EMISMATCH: Cursor points to wrong type
+ * - CHIDB_EMISUSE: No such placeholder
  */
-int chidb_DBM_execute_IdxKey(DBM *machine, DBMCursor cursor, DBMRegister *reg) {
-  chidb_DBM_free_register(reg);
-  reg->type = DBM_INTEGER_REGISTER_TYPE;
-  BTreeCell btc = machine->cells[cursor.cell_id].entry;
-  switch(btc.type){
-  	case PGTYPE_INDEX_INTERNAL:
-	  reg->fields.integer = btc.fields.indexInternal.keyPk;
-	  break;
-	case PGTYPE_INDEX_LEAF:
-	  reg->fields.integer = btc.fields.indexLeaf.keyPk;
-	  break;
-	default:
-	  return CHIDB_EMISMATCH;
-  }
+int chidb_DBM_execute_Variable(DBM *machine, uint32_t param, DBMRegister *reg) {
+  int rc;
+  DBMRegister *value;
+
+  rc = chidb_DBM_find_param(machine, param, &value);
+  if (CHIDB_OK != rc) return rc;
+  reg->type   = value->type;
+  reg->fields = value->fields;
   return CHIDB_OK;
 }
 
 
 
-/* Store a new index entry in the index Btree pointed to by cursor
+/* Delete an entry from a table B-Tree
+ *
+ * Read cursors work on the cells loaded when they were opened, so a scan
+ * can go on deleting the rows it visits.
  *
  * Parameters
- * - machine: DBM to act on
- * - reg1: register where idxKey is stored
- * - reg2: register where pKey is stored
- * - cursor: cursor pointing to btree to insert in
+ * - machine: DBM to act upon
+ * - cursor: Cursor opened for writing on the table
+ * - key: Key of the entry
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: No entry with the given key was found
+ * - CHIDB_EMISUSE: The cursor is read-only
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_DBM_execute_IdxInsert(DBM *machine, DBMRegister reg1, DBMRegister reg2, DBMCursor cursor) {
-  if(reg1.type != DBM_INTEGER_REGISTER_TYPE || reg2.type != DBM_INTEGER_REGISTER_TYPE) 
-  return CHIDB_EMISMATCH;
-  npage_t index_root = 2;
-  chidb_Btree_insertInIndex(machine->db->bt,index_root,reg1.fields.integer,reg2.fields.integer);
-  return CHIDB_OK;
+int chidb_DBM_execute_Delete(DBM *machine, DBMCursor *cursor, key_t key) {
+  if (cursor->mode != DBM_READWRITE) return CHIDB_EMISUSE;
+
+  return chidb_Btree_delete(machine->db->bt, cursor->root_page, key);
 }
 
 
 
-/* Make a shallow copy of one register
+/* Delete an entry from an index B-Tree
  *
  * Parameters
  * - machine: DBM to act upon
- * - reg1: Register to copy
- * - reg2: Register for storage
+ * - reg1: Register where idxKey is stored
+ * - reg2: Register where pKey is stored
+ * - cursor: Cursor opened for writing on the index
  *
  * Return
  * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISMATCH: The keys are not integers
+ * - CHIDB_ENOTFOUND: The entry is not in the index
+ * - CHIDB_EMISUSE: The cursor is read-only
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_DBM_execute_SCopy(DBM *machine, DBMRegister *reg1, DBMRegister *reg2) {
-  reg2->type   = reg1->type;
-  reg2->fields = reg1->fields;
-  return CHIDB_OK;
+int chidb_DBM_execute_IdxDelete(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, DBMCursor *cursor) {
+  int64_t keyIdx, keyPk;
+
+  // Same keys as IdxInsert
+  if (CHIDB_OK != chidb_DBM_register_integer(reg1, &keyIdx) ||
+      CHIDB_OK != chidb_DBM_register_integer(reg2, &keyPk))
+    return CHIDB_EMISMATCH;
+  if (cursor->mode != DBM_READWRITE) return CHIDB_EMISUSE;
+
+  return chidb_Btree_deleteFromIndex(machine->db->bt, cursor->root_page, keyIdx, keyPk);
 }
 
 
 
-/* Halt execution of the DBM
+/* Replace the record of an entry in a table B-Tree
+ *
+ * A record of the same size is written over the old one, in place.
  *
  * Parameters
  * - machine: DBM to act upon
- * - err: Error code to return
- * - err_msg: If err > 0, then string description
+ * - cursor: Cursor opened for writing on the table
+ * - key: Key of the entry
+ * - record: Register with the new record
  *
  * Return
  * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOTFOUND: No entry with the given key was found
+ * - CHIDB_EMISUSE: The cursor is read-only
  * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
-int chidb_DBM_execute_Halt(DBM *machine, uint32_t err, const char *err_msg) {
-  machine->err        = err;
-  machine->halted     = true;
-
-  if (NULL != err_msg) {
-    size_t err_msg_len  = strlen(err_msg);
-    machine->err_msg    = malloc(err_msg_len * sizeof(char));
-    if (NULL == machine->err_msg) return CHIDB_ENOMEM;
-    machine->err_msg = strncpy(machine->err_msg, err_msg, err_msg_len);
-    if (NULL == machine->err_msg) return CHIDB_ENOMEM;
-  }
+int chidb_DBM_execute_Update(DBM *machine, DBMCursor *cursor, key_t key, DBMRegister *record) {
+  if (cursor->mode != DBM_READWRITE) return CHIDB_EMISUSE;
 
-  return CHIDB_OK;
-}
\ No newline at end of file
+  return chidb_Btree_update(machine->db->bt, cursor->root_page, key,
+                            record->fields.string.data, record->fields.string.len);
+}
@@ -2,10 +2,14 @@
 #define DBM_H_
 
 //#include "chidb.h"
+#include <pthread.h>
 #include "chidbInt.h"
 #include "record.h"
 #include "util.h"
 #include "schemaloader.h"
+#include "arena.h"
+#include "sorter.h"
+#include "filter.h"
 
 
 
@@ -50,7 +54,20 @@ typedef enum {
   _CreateTable_, // 29
   _CreateIndex_, // 20
   _SCopy_,       // 31
-  _Halt_         // 32
+  _Halt_,        // 32
+  _GroupSelect_, // 33
+  _AggStep_,     // 34
+  _GroupEmit_,   // 35
+  _GroupKey_,    // 36
+  _AggFinal_,    // 37
+  _Goto_,        // 38
+  _Count_,       // 39
+  _Variable_,    // 40
+  _Delete_,      // 41
+  _Update_,      // 42
+  _SorterOpen_,  // 43
+  _BulkLoad_,    // 44
+  _IdxDelete_    // 45
 } instruction_code;
 
 
@@ -85,7 +102,7 @@ struct DBMRegister {
     int8_t byte;      // Signed 8-bit integer
     struct {          // String or binary data
       size_t len;     // Length of data
-      uint8_t *data;  // Data stored on heap
+      uint8_t *data;  // Data (owned by an arena, a group or a parameter)
     } string;
   } fields;
 };
@@ -100,7 +117,11 @@ struct DBMCursor {
   uint32_t id;      // Cursor identifier
   uint8_t mode;     // Read-only or read-write access
   uint32_t ncols;   // Number of columns in table
+  npage_t root_page; // Root page of the B-Tree
+  uint32_t start;   // First cell of the B-Tree in the DBM cell array (read cursors)
+  uint32_t end;     // One past its last cell
   uint32_t cell_id; // Index in DBM cell array
+  Sorter *sorter;   // Entries added by IdxInsert, for a cursor opened with SorterOpen
 };
 
 
@@ -109,39 +130,180 @@ struct DBMCursor {
 typedef struct {
   BTreeCell entry;
   BTreeNode *node;
-  uint32_t node_offset;
 } DBMCell;
 
+// Running state of one aggregate function (COUNT, SUM, MIN, MAX, AVG)
+typedef struct {
+  int64_t value;  // Running sum, minimum or maximum
+  uint32_t count; // Number of rows (non-NULL values) accumulated
+} DBMAggregate;
+
+// Rows sharing the same GROUP BY key
+// A statement without GROUP BY uses a single group with no keys
+typedef struct {
+  uint32_t hash;      // Hash of the key registers
+  int32_t next;       // Next group in the same hash bucket (-1 if none)
+  DBMRegister *keys;  // Private copies of the key registers
+  DBMAggregate *aggs; // One accumulator per aggregate in the statement
+} DBMGroup;
+
+#define DBM_GROUP_BUCKETS 64
+
+// A scan is split across at most this many threads, and only if every
+// thread gets at least DBM_SCAN_MIN_CELLS cells (see ParallelScan)
+#define DBM_SCAN_MAX_THREADS 32
+#define DBM_SCAN_MIN_CELLS   4096
+#define DBM_SCAN_UNITS       4    // Subtrees per partition the B-Tree is cut into, at least
+#define DBM_SCAN_QUEUE       64   // Result rows a worker gets ahead of the rows handed out, at most
+
+// String storage of a slot of a partition's queue, reused by every row
+// that goes through the slot
+typedef struct {
+  uint8_t *data;    // Strings of the row in the slot (malloc'd)
+  size_t data_size; // Allocated length of data
+} DBMScanSlot;
+
+// One partition of a parallel scan: consecutive cells of the scanned
+// B-Tree, run through the scan loop by a worker machine of its own. A
+// worker on a thread of its own passes its result rows on through a
+// bounded queue; one run inline is stepped as its rows are needed.
+typedef struct {
+  DBM *worker;          // Machine running the loop (shares the program, nodes and cells)
+  pthread_t thread;     // Thread the worker runs on
+  bool threaded;        // True if a thread was started for it (or else it is run inline)
+  pthread_mutex_t lock; // Guards the queue and the flags below
+  pthread_cond_t ready; // Signalled when a row is queued, or the worker is done
+  pthread_cond_t room;  // Signalled when a slot is freed, or the scan is cancelled
+  DBMRegister *rows;    // Queue of result rows, DBM_SCAN_QUEUE slots of nresult registers (malloc'd)
+  DBMScanSlot slots[DBM_SCAN_QUEUE]; // String storage of each slot
+  uint32_t head;        // Slot of the oldest row in the queue
+  uint32_t count;       // Number of rows in the queue (the one handed out included)
+  uint32_t nresult;     // Number of columns in a result row
+  bool done;            // True once the worker is done; rc tells how its run ended
+  bool cancelled;       // True once the scan is over; the worker stops at its next row
+  int rc;               // How the worker's run ended (CHIDB_DONE or an error)
+} DBMPartition;
+
+// Scan split across threads, whose rows are handed out partition by partition
+typedef struct {
+  DBMPartition *parts; // Partitions, in key order
+  uint32_t nparts;     // Number of partitions
+  uint32_t part;       // Partition whose rows are being handed out
+  bool held;           // True if a row of that partition's queue is handed out
+} DBMScan;
+
+// A scan loop is run over at most this many rows at a time (see BatchScan)
+#define DBM_BATCH_SIZE 256
+
+// Where a batch instruction finds a value for each row of the batch
+typedef struct {
+  DBMRegister *reg; // Column vector (one value per row), or a single register
+  bool vector;      // True for a column vector; a single register is the same for every row
+} DBMBatchOperand;
+
+// An instruction of a batch loop's body, with its registers resolved
+typedef struct {
+  instruction_code op;  // Column, Key, a comparison or ResultRow
+  int32_t col;          // Column number (Column)
+  DBMBatchOperand out;  // Column vector written (Column, Key)
+  DBMBatchOperand in1;  // Operands of a comparison
+  DBMBatchOperand in2;
+  bool filtered;        // True for a comparison of a column vector with a single register
+  FilterOp filter;      // ...as a comparison of the column's values with the register's
+} DBMBatchOp;
+
+// Scan loop run over a batch of rows at a time: each instruction of its
+// body is run for every row of the batch still in the loop (the
+// selection) before the next instruction is, and the rows left once the
+// body is done are handed out one by one
+typedef struct {
+  DBMCursor *cursor;        // Cursor the loop goes through
+  uint32_t next;            // The loop's Next (the machine goes on after it once the scan is done)
+  DBMBatchOp *ops;          // Body of the loop, up to its ResultRow
+  uint32_t nops;            // Number of instructions in the body
+  DBMBatchOperand *result;  // Registers of a result row
+  uint32_t nresult;         // Number of columns in a result row
+  uint32_t cell;            // First cell of the next batch
+  uint32_t first;           // First cell of the current batch
+  uint32_t *sel;            // Selection vector: rows of the batch still in the loop, in order
+  uint32_t nsel;            // Number of rows in sel
+  uint32_t row;             // Next row of sel to hand out
+  int32_t *values;          // Integer column values of the selected rows, gathered for a filter
+  uint32_t *mask;           // Rows of values for which the filter holds
+  int rc;                   // Error the batch ran into, handed out after the rows before it
+} DBMBatch;
+
 // Instantaneous configuration of the machine itself
-// Instructions and registers are stored on the heap
+// Instructions, registers and everything else a run needs come from the arenas
 struct DBM {
+  Arena arena;                  // Memory for the statement (program) and each run of it
+  ArenaMark run_mark;           // Where the current run's memory starts
+  bool running;                 // True if run_mark is set (stepped since the last reset)
+  Arena row_arena;              // Memory for the current row (strings, records)
+  ArenaMark row_mark;           // Where row memory starts (set by the first Rewind or MakeRecord)
+  bool row_marked;              // True if row_mark is set
+
   uint32_t pc;                  // Program counter (id of current instruction)
   DBMInstruction *instructions; // Program is a list of instructions
   uint32_t ninstructions;       // Number of instructions
+  uint32_t instructions_size;   // Allocated length of the instructions array
 
   DBMRegister *registers;       // Registers and their values
   uint32_t nregisters;          // Number of registers
+  uint32_t registers_size;      // Allocated length of the registers array
 
   DBMCursor *cursors;           // Cursors and their nodes
   uint32_t ncursors;            // Number of cursors
+  uint32_t cursors_size;        // Allocated length of the cursors array
 
   chidb *db;                    // Database - should point to B-Tree file and contain schema
-  BTreeNode **nodes;            // B-Tree nodes
+  uint64_t snapshot;            // Snapshot the file is read at (PAGER_LATEST: as it is)
+  npage_t snapshot_npages;      // Pages in the file as of the snapshot
+  BTreeNode **nodes;            // B-Tree nodes (loaded by the first Open)
   uint32_t nnodes;              // Number of B-Tree nodes
 
-  DBMCell *cells;               // B-Tree cell wrappers (sorted)
+  DBMCell *cells;               // B-Tree cell wrappers, each open table in key order
   uint32_t ncells;              // Number of B-Tree cells
+  uint32_t cells_size;          // Allocated length of the cells array
+  DBMCell *record_cell;         // Cell whose whole record (with its overflow pages) is in record
+  uint8_t *record;              // From the row arena, so it only lasts as long as the row
 
   bool jumped;                  // True if execution resulted in a jump
   bool returned;                // True if ResultRow returns
   bool halted;                  // True if machine not halted
 
   npage_t root_page;            // Root page in B-Tree file
-  DBRecord *result;             // ResultRow result
+  DBMRegister **result;         // ResultRow result (the registers themselves, valid until the next step)
+  uint32_t nresult;             // Number of columns in the result row
+  uint32_t result_size;         // Allocated length of the result array
+
+  DBRecordField *record_fields; // Scratch values for MakeRecord
+  uint32_t record_size;         // Allocated length of the record_fields array
 
   Schema_Table *maps;
   uint32_t nmaps;
 
+  DBMGroup *groups;             // Groups built by GroupSelect
+  uint32_t ngroups;             // Number of groups
+  uint32_t group_nkeys;         // Number of key registers per group
+  DBMRegister *group_keys;      // Scratch copies of the key registers for GroupSelect
+  uint32_t group_keys_size;     // Allocated length of the group_keys array
+  uint32_t group_naggs;         // Number of aggregates per group (set by the generator)
+  int32_t *group_buckets;       // Hash buckets, first group in each chain (-1 if empty)
+  uint32_t group_nbuckets;      // Number of hash buckets
+  uint32_t group_current;       // Group updated by AggStep
+  uint32_t group_emitted;       // Groups already handed out by GroupEmit
+  uint32_t group_output;        // Group read by GroupKey and AggFinal
+
+  DBMRegister *params;          // Values bound to the ? placeholders (1-based)
+  uint32_t nparams;             // Number of placeholders (set by the generator)
+
+  uint32_t nthreads;            // Threads a scan may be split across (1: scans are never split)
+  uint32_t scan_min_cells;      // Fewest cells a thread of a split scan gets
+  DBMScan *scan;                // Split scan whose rows are being handed out (NULL if none)
+  uint32_t batch_size;          // Rows a scan loop is run over at a time (1: one row at a time)
+  DBMBatch *batch;              // Batch scan whose rows are being handed out (NULL if none)
+
   uint32_t err;                 // Error code
   char *err_msg;                // Error message
 };
@@ -151,5 +313,10 @@ int chidb_DBM_create(chidb *db, DBM **machine);
 int chidb_DBM_destroy(DBM *machine);
 int chidb_DBM_add_instruction(DBM *machine, DBMInstruction *instruction);
 int chidb_DBM_step(DBM *machine);
+int chidb_DBM_reset(DBM *machine);
+int chidb_DBM_bind_int(DBM *machine, uint32_t param, int32_t value);
+int chidb_DBM_bind_text(DBM *machine, uint32_t param, const char *value);
+int chidb_DBM_clear_bindings(DBM *machine);
+int chidb_DBM_print_result(DBM *machine);
 
 #endif
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <chidbInt.h>
 #include <chidb.h>
 #include "btree.h"
@@ -13,7 +14,14 @@
 
 // Machine state and utilities
 int chidb_DBM_execute(DBM *machine);
-int chidb_DBM_grab_cells(DBM *machine);
+void chidb_DBM_mark_row(DBM *machine);
+void chidb_DBM_release_row(DBM *machine);
+void *chidb_DBM_grow_array(DBM *machine, void *array, uint32_t *size, size_t elem_size);
+int chidb_DBM_load_nodes(DBM *machine);
+int chidb_DBM_free_nodes(DBM *machine);
+int chidb_DBM_find_param(DBM *machine, uint32_t param, DBMRegister **reg);
+int chidb_DBM_grab_cells(DBM *machine, npage_t npage);
+int chidb_DBM_cell_record(DBM *machine, DBMCell *cell, uint8_t **record);
 int chidb_DBM_jump(DBM *machine, uint32_t instruction_id);
 int chidb_DBM_find_instruction(DBM *machine, uint32_t instruction_id, DBMInstruction **instruction);
 int chidb_DBM_find_register(DBM *machine, uint32_t reg_id, DBMRegister **reg);
@@ -24,6 +32,26 @@ int chidb_DBM_find_cursor(DBM *machine, uint32_t cursor_id, DBMCursor **cursor);
 int chidb_DBM_create_cursor(DBM *machine, uint32_t cursor_id, DBMCursor **cursor);
 int chidb_DBM_find_or_create_cursor(DBM *machine, uint32_t cursor_id, DBMCursor **cursor);
 int chidb_DBM_find_node(DBM *machine, npage_t page_num, BTreeNode **node);
+int chidb_DBM_copy_register(DBMRegister *dst, DBMRegister *src);
+int chidb_DBM_register_integer(DBMRegister *reg, int64_t *value);
+uint32_t chidb_DBM_hash_registers(DBMRegister *regs, uint32_t nregs);
+bool chidb_DBM_registers_equal(DBMRegister *regs1, DBMRegister *regs2, uint32_t nregs);
+int chidb_DBM_new_group(DBM *machine, DBMRegister *keys, uint32_t hash);
+int chidb_DBM_free_groups(DBM *machine);
+void chidb_DBM_close_sorter(DBMCursor *cursor);
+int chidb_DBM_count_cells(DBM *machine, npage_t npage, uint32_t *ncells);
+int chidb_DBM_scan_bounds(DBM *machine, DBMCursor *cursor, uint32_t *nparts, uint32_t *bounds);
+int chidb_DBM_scan_worker(DBM *machine, DBMCursor *cursor, uint32_t start, uint32_t end, DBM **worker);
+void chidb_DBM_free_worker(DBM *worker);
+int chidb_DBM_queue_row(DBMPartition *part);
+int chidb_DBM_scan_row(DBM *machine);
+void chidb_DBM_end_scan(DBM *machine);
+int chidb_DBM_batch_operand(DBM *machine, DBMRegister **vectors, uint32_t reg_id, DBMBatchOperand *operand);
+int chidb_DBM_batch_plan(DBM *machine, DBMCursor *cursor, DBMBatch **batch);
+void chidb_DBM_batch_fill(DBM *machine, DBMBatch *batch);
+bool chidb_DBM_batch_filter(DBMBatch *batch, DBMBatchOp *op);
+int chidb_DBM_batch_row(DBM *machine);
+int chidb_DBM_compare(instruction_code op, DBMRegister *reg1, DBMRegister *reg2, bool *holds);
 
 // Instructions
 int chidb_DBM_execute_Open(DBM *machine, DBMCursor *cursor, DBMRegister *reg, uint32_t ncols, uint8_t mode);
@@ -31,6 +59,8 @@ int chidb_DBM_execute_OpenRead(DBM *machine, DBMCursor *cursor, DBMRegister *reg
 int chidb_DBM_execute_OpenWrite(DBM *machine, DBMCursor *cursor, DBMRegister *reg, uint32_t ncols);
 int chidb_DBM_execute_Close(DBM *machine, DBMCursor *cursor);
 int chidb_DBM_execute_Rewind(DBM *machine, DBMCursor *cursor, uint32_t instruction_id);
+int chidb_DBM_execute_ParallelScan(DBM *machine, DBMCursor *cursor, uint32_t instruction_id);
+int chidb_DBM_execute_BatchScan(DBM *machine, DBMCursor *cursor, uint32_t instruction_id);
 int chidb_DBM_execute_Next(DBM *machine, DBMCursor *cursor, uint32_t instruction_id);
 int chidb_DBM_execute_Prev(DBM *machine, DBMCursor *cursor, uint32_t instruction_id);
 int chidb_DBM_execute_Seek(DBM *machine, DBMCursor *cursor, key_t key, uint32_t instruction_id);
@@ -43,22 +73,37 @@ int chidb_DBM_execute_String(DBM *machine, DBMRegister *reg, void *data, size_t
 int chidb_DBM_execute_Null(DBM *machine, DBMRegister *reg);
 int chidb_DBM_execute_ResultRow(DBM *machine, uint32_t reg_id, int32_t ncols);
 int chidb_DBM_execute_MakeRecord(DBM *machine, uint32_t reg_id, int32_t ncols, DBMRegister *result_reg);
-int chidb_DBM_execute_Insert(DBM *machine, DBMCursor *cursor, key_t key, DBRecord *record);
-int chidb_DBM_execute_Eq(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint32_t instruction_id);
-int chidb_DBM_execute_Ne(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint32_t instruction_id);
-int chidb_DBM_execute_Lt(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint32_t instruction_id);
-int chidb_DBM_execute_Le(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint32_t instruction_id);
-int chidb_DBM_execute_Gt(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint32_t instruction_id);
-int chidb_DBM_execute_Ge(DBM *machine, DBMRegister reg1, DBMRegister reg2, uint32_t instruction_id);
+int chidb_DBM_execute_Insert(DBM *machine, DBMCursor *cursor, key_t key, DBMRegister *record);
+int chidb_DBM_execute_compare(DBM *machine, instruction_code op, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id);
+int chidb_DBM_execute_Eq(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id);
+int chidb_DBM_execute_Ne(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id);
+int chidb_DBM_execute_Lt(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id);
+int chidb_DBM_execute_Le(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id);
+int chidb_DBM_execute_Gt(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id);
+int chidb_DBM_execute_Ge(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, uint32_t instruction_id);
 int chidb_DBM_execute_IdxGe(DBM *machine, DBMRegister reg, DBMCursor cursor, uint32_t instruction_id);
 int chidb_DBM_execute_IdxGt(DBM *machine, DBMRegister reg, DBMCursor cursor, uint32_t instruction_id);
 int chidb_DBM_execute_IdxLt(DBM *machine, DBMRegister reg, DBMCursor cursor, uint32_t instruction_id);
 int chidb_DBM_execute_IdxLe(DBM *machine, DBMRegister reg, DBMCursor cursor, uint32_t instruction_id);
 int chidb_DBM_execute_IdxKey(DBM *machine, DBMCursor cursor, DBMRegister *reg);
-int chidb_DBM_execute_IdxInsert(DBM *machine, DBMRegister reg1, DBMRegister reg2, DBMCursor cursor);
+int chidb_DBM_execute_IdxInsert(DBM *machine, DBMRegister reg1, DBMRegister reg2, DBMRegister *record, DBMCursor *cursor);
 // int chidb_DBM_execute_CreateTable(DBM *machine, ...);
-// int chidb_DBM_execute_CreateIndex(DBM *machine, ...);
+int chidb_DBM_execute_CreateTable(DBM *machine, DBMRegister *reg);
+int chidb_DBM_execute_CreateIndex(DBM *machine, DBMRegister *reg);
 int chidb_DBM_execute_SCopy(DBM *machine, DBMRegister *reg1, DBMRegister *reg2);
 int chidb_DBM_execute_Halt(DBM *machine, uint32_t err, const char *err_msg);
+int chidb_DBM_execute_GroupSelect(DBM *machine, uint32_t reg_id, uint32_t nkeys, uint32_t instruction_id);
+int chidb_DBM_execute_AggStep(DBM *machine, uint32_t agg, DBMRegister *reg, uint8_t func);
+int chidb_DBM_execute_GroupEmit(DBM *machine, uint32_t instruction_id, bool final);
+int chidb_DBM_execute_GroupKey(DBM *machine, uint32_t key, DBMRegister *reg);
+int chidb_DBM_execute_AggFinal(DBM *machine, uint32_t agg, DBMRegister *reg, uint8_t func);
+int chidb_DBM_execute_Goto(DBM *machine, uint32_t instruction_id);
+int chidb_DBM_execute_Count(DBM *machine, npage_t root_page, DBMRegister *reg);
+int chidb_DBM_execute_Variable(DBM *machine, uint32_t param, DBMRegister *reg);
+int chidb_DBM_execute_Delete(DBM *machine, DBMCursor *cursor, key_t key);
+int chidb_DBM_execute_Update(DBM *machine, DBMCursor *cursor, key_t key, DBMRegister *record);
+int chidb_DBM_execute_SorterOpen(DBM *machine, DBMCursor *cursor, uint32_t ncols);
+int chidb_DBM_execute_BulkLoad(DBM *machine, DBMCursor *sorter, DBMCursor *cursor);
+int chidb_DBM_execute_IdxDelete(DBM *machine, DBMRegister *reg1, DBMRegister *reg2, DBMCursor *cursor);
 
 #endif
\ No newline at end of file
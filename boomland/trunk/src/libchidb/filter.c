@@ -0,0 +1,248 @@
+/*****************************************************************************
+ *
+ *																 chidb
+ *
+ * Integer filters.
+ *
+ * A filter compares n integers with a constant and returns a bit mask of
+ * the values for which the comparison holds:
+ *
+ *   uint32_t mask[FILTER_WORDS(n)];
+ *   chidb_Filter_int32(FILTER_LT, values, n, 5000, mask);
+ *   if (mask[i / 32] & (1u << (i % 32)))
+ *       ...values[i] < 5000...
+ *
+ * On x86 processors, four (SSE2) or eight (AVX2) values are compared at
+ * once, and the comparison results are packed into the mask with a
+ * movemask. The kernel is picked when the filter runs, from what the
+ * processor supports, so the library itself is built for any x86
+ * processor; elsewhere (or for the values left over at the end), the
+ * values are compared one by one.
+ *
+ * Ranking a key among sorted unsigned keys compares it with all of them
+ * the same way, and counts the comparisons that hold (the bits of the
+ * movemasks), rather than branching on each one as a search would.
+ *
+\*****************************************************************************/
+
+#include <string.h>
+
+#include "filter.h"
+
+#ifdef FILTER_X86
+#include <immintrin.h>
+#endif
+
+
+/* Compare values with a constant, one by one */
+void chidb_Filter_int32_scalar(FilterOp op, const int32_t *values, uint32_t n, int32_t constant, uint32_t *mask)
+{
+	memset(mask, 0, FILTER_WORDS(n) * sizeof(uint32_t));
+	for (uint32_t i = 0; i < n; i++)
+	{
+		bool holds;
+		switch (op)
+		{
+		case FILTER_EQ: holds = values[i] == constant; break;
+		case FILTER_NE: holds = values[i] != constant; break;
+		case FILTER_LT: holds = values[i] <  constant; break;
+		case FILTER_LE: holds = values[i] <= constant; break;
+		case FILTER_GT: holds = values[i] >  constant; break;
+		default:        holds = values[i] >= constant; break;
+		}
+		if (holds)
+			mask[i / 32] |= 1u << (i % 32);
+	}
+}
+
+
+/* Count the keys less than key, one by one */
+uint32_t chidb_Filter_rank_scalar(const uint32_t *keys, uint32_t n, uint32_t key)
+{
+	uint32_t rank = 0;
+
+	for (uint32_t i = 0; i < n; i++)
+		rank += keys[i] < key;
+	return rank;
+}
+
+
+#ifdef FILTER_X86
+
+/* Values the vector kernels left over (fewer than a whole mask word),
+ * from value start on */
+static void chidb_Filter_int32_tail(FilterOp op, const int32_t *values, uint32_t start, uint32_t n, int32_t constant, uint32_t *mask)
+{
+	uint32_t tail[1];
+
+	if (start == n)
+		return;
+	chidb_Filter_int32_scalar(op, values + start, n - start, constant, tail);
+	mask[start / 32] = tail[0];
+}
+
+
+/* Compare values with a constant, four at a time. Only equal, less than
+ * and greater than are compared for: the other comparisons are the
+ * opposite of one of these, so their bits are flipped */
+__attribute__((target("sse2")))
+void chidb_Filter_int32_sse2(FilterOp op, const int32_t *values, uint32_t n, int32_t constant, uint32_t *mask)
+{
+	__m128i c = _mm_set1_epi32(constant);
+	uint32_t flip = (FILTER_NE == op || FILTER_LE == op || FILTER_GE == op) ? 0xFFFFFFFFu : 0;
+	uint32_t i = 0;
+
+	for (; i + 32 <= n; i += 32)
+	{
+		uint32_t word = 0;
+		for (uint32_t j = 0; j < 32; j += 4)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *) (values + i + j));
+			__m128i m;
+			if (FILTER_EQ == op || FILTER_NE == op)
+				m = _mm_cmpeq_epi32(v, c);
+			else if (FILTER_LT == op || FILTER_GE == op)
+				m = _mm_cmplt_epi32(v, c);
+			else
+				m = _mm_cmpgt_epi32(v, c);
+			word |= (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(m)) << j;
+		}
+		mask[i / 32] = word ^ flip;
+	}
+	chidb_Filter_int32_tail(op, values, i, n, constant, mask);
+}
+
+
+/* Compare values with a constant, eight at a time (see the SSE2 kernel) */
+__attribute__((target("avx2")))
+void chidb_Filter_int32_avx2(FilterOp op, const int32_t *values, uint32_t n, int32_t constant, uint32_t *mask)
+{
+	__m256i c = _mm256_set1_epi32(constant);
+	uint32_t flip = (FILTER_NE == op || FILTER_LE == op || FILTER_GE == op) ? 0xFFFFFFFFu : 0;
+	uint32_t i = 0;
+
+	for (; i + 32 <= n; i += 32)
+	{
+		uint32_t word = 0;
+		for (uint32_t j = 0; j < 32; j += 8)
+		{
+			__m256i v = _mm256_loadu_si256((const __m256i *) (values + i + j));
+			__m256i m;
+			if (FILTER_EQ == op || FILTER_NE == op)
+				m = _mm256_cmpeq_epi32(v, c);
+			else if (FILTER_LT == op || FILTER_GE == op)
+				m = _mm256_cmpgt_epi32(c, v);
+			else
+				m = _mm256_cmpgt_epi32(v, c);
+			word |= (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(m)) << j;
+		}
+		mask[i / 32] = word ^ flip;
+	}
+	chidb_Filter_int32_tail(op, values, i, n, constant, mask);
+}
+
+
+/* Count the keys less than key, four at a time. SSE2 only compares
+ * signed integers, so the sign bit of both sides is flipped first */
+__attribute__((target("sse2")))
+uint32_t chidb_Filter_rank_sse2(const uint32_t *keys, uint32_t n, uint32_t key)
+{
+	__m128i bias = _mm_set1_epi32((int32_t) 0x80000000u);
+	__m128i k = _mm_xor_si128(_mm_set1_epi32((int32_t) key), bias);
+	uint32_t rank = 0;
+	uint32_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (keys + i)), bias);
+		rank += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, k))));
+	}
+	return rank + chidb_Filter_rank_scalar(keys + i, n - i, key);
+}
+
+
+/* Count the keys less than key, eight at a time (see the SSE2 kernel) */
+__attribute__((target("avx2")))
+uint32_t chidb_Filter_rank_avx2(const uint32_t *keys, uint32_t n, uint32_t key)
+{
+	__m256i bias = _mm256_set1_epi32((int32_t) 0x80000000u);
+	__m256i k = _mm256_xor_si256(_mm256_set1_epi32((int32_t) key), bias);
+	uint32_t rank = 0;
+	uint32_t i = 0;
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (keys + i)), bias);
+		rank += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v))));
+	}
+	return rank + chidb_Filter_rank_scalar(keys + i, n - i, key);
+}
+
+
+/* True if the processor (and the operating system) can run the AVX2 kernel */
+bool chidb_Filter_has_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+
+/* The fastest kernel this processor can run */
+FilterKernel chidb_Filter_kernel(void)
+{
+#ifdef FILTER_X86
+	if (chidb_Filter_has_avx2())
+		return chidb_Filter_int32_avx2;
+	if (__builtin_cpu_supports("sse2"))
+		return chidb_Filter_int32_sse2;
+#endif
+	return chidb_Filter_int32_scalar;
+}
+
+
+/* Compare n values with a constant, setting the bit of mask of each value
+ * for which the comparison holds (and clearing the others). The kernel is
+ * picked by the first call; threads racing on it pick the same one. */
+void chidb_Filter_int32(FilterOp op, const int32_t *values, uint32_t n, int32_t constant, uint32_t *mask)
+{
+	static FilterKernel filter;
+	FilterKernel kernel = __atomic_load_n(&filter, __ATOMIC_RELAXED);
+
+	if (kernel == NULL) {
+		kernel = chidb_Filter_kernel();
+		__atomic_store_n(&filter, kernel, __ATOMIC_RELAXED);
+	}
+	kernel(op, values, n, constant, mask);
+}
+
+
+/* The fastest ranking kernel this processor can run */
+FilterRank chidb_Filter_rankKernel(void)
+{
+#ifdef FILTER_X86
+	if (chidb_Filter_has_avx2())
+		return chidb_Filter_rank_avx2;
+	if (__builtin_cpu_supports("sse2"))
+		return chidb_Filter_rank_sse2;
+#endif
+	return chidb_Filter_rank_scalar;
+}
+
+
+/* Number of keys less than key. If the keys are in ascending order, this
+ * is the position of the first one that is not less than key (n if there
+ * is none). The kernel is picked by the first call; threads racing on it
+ * pick the same one. */
+uint32_t chidb_Filter_rank(const uint32_t *keys, uint32_t n, uint32_t key)
+{
+	static FilterRank rank;
+	FilterRank kernel = __atomic_load_n(&rank, __ATOMIC_RELAXED);
+
+	if (kernel == NULL) {
+		kernel = chidb_Filter_rankKernel();
+		__atomic_store_n(&rank, kernel, __ATOMIC_RELAXED);
+	}
+	return kernel(keys, n, key);
+}
@@ -0,0 +1,51 @@
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* A filter compares a vector of integers with a constant, several values
+ * at once where the processor can (SSE2, AVX2), and sets one bit per
+ * value for which the comparison holds. The DBM uses it for the
+ * comparisons of a scan run a batch of rows at a time, once the values
+ * of an integer column have been gathered into a contiguous buffer.
+ *
+ * The rank of a key among sorted keys (how many of them are less than
+ * it) is found the same way, without a branch per key: the B-Tree uses
+ * it to find a key's cell in a node (see chidb_Btree_findSlot). */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FILTER_X86
+#endif
+
+typedef enum
+{
+	FILTER_EQ,
+	FILTER_NE,
+	FILTER_LT,
+	FILTER_LE,
+	FILTER_GT,
+	FILTER_GE
+} FilterOp;
+
+/* Words of a mask for n values: bit i % 32 of word i / 32 is value i's */
+#define FILTER_WORDS(n) (((n) + 31) / 32)
+
+typedef void (*FilterKernel)(FilterOp op, const int32_t *values, uint32_t n, int32_t constant, uint32_t *mask);
+typedef uint32_t (*FilterRank)(const uint32_t *keys, uint32_t n, uint32_t key);
+
+void chidb_Filter_int32(FilterOp op, const int32_t *values, uint32_t n, int32_t constant, uint32_t *mask);
+FilterKernel chidb_Filter_kernel(void);
+void chidb_Filter_int32_scalar(FilterOp op, const int32_t *values, uint32_t n, int32_t constant, uint32_t *mask);
+uint32_t chidb_Filter_rank(const uint32_t *keys, uint32_t n, uint32_t key);
+FilterRank chidb_Filter_rankKernel(void);
+uint32_t chidb_Filter_rank_scalar(const uint32_t *keys, uint32_t n, uint32_t key);
+#ifdef FILTER_X86
+void chidb_Filter_int32_sse2(FilterOp op, const int32_t *values, uint32_t n, int32_t constant, uint32_t *mask);
+void chidb_Filter_int32_avx2(FilterOp op, const int32_t *values, uint32_t n, int32_t constant, uint32_t *mask);
+uint32_t chidb_Filter_rank_sse2(const uint32_t *keys, uint32_t n, uint32_t key);
+uint32_t chidb_Filter_rank_avx2(const uint32_t *keys, uint32_t n, uint32_t key);
+bool chidb_Filter_has_avx2(void);
+#endif
+
+#endif /*FILTER_H_*/
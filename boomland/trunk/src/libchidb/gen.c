@@ -20,22 +20,86 @@
  */
 int chidb_Gen(SQLStatement *stmt, DBM *dbm, Schema *schema)
 {
+    int rc = CHIDB_OK;
+
+    // One register per ? placeholder, filled in by chidb_bind_*
+    if (stmt->nparams > 0) {
+        dbm->params = chidb_Arena_alloc(&dbm->arena, stmt->nparams * sizeof(DBMRegister));
+        if (dbm->params == NULL) return CHIDB_ENOMEM;
+        memset(dbm->params, 0, stmt->nparams * sizeof(DBMRegister));
+        dbm->nparams = stmt->nparams;
+    }
+
     switch(stmt->type)
     {
         case STMT_SELECT:
-            chidb_Gen_SelectStmt(&(stmt->query.select), dbm, schema);
+            rc = chidb_Gen_SelectStmt(&(stmt->query.select), dbm, schema);
             break;
         case STMT_INSERT:
-            chidb_Gen_InsertStmt(&(stmt->query.insert), dbm, schema);
+            rc = chidb_Gen_InsertStmt(&(stmt->query.insert), dbm, schema);
+            break;
+        case STMT_DELETE:
+            rc = chidb_Gen_DeleteStmt(&(stmt->query.delete), dbm, schema);
+            break;
+        case STMT_UPDATE:
+            rc = chidb_Gen_UpdateStmt(&(stmt->query.update), dbm, schema);
             break;
         case STMT_CREATETABLE:
-            chidb_Gen_CreateTableStmt(&(stmt->query.createTable), dbm, schema);
+            rc = chidb_Gen_CreateTableStmt(&(stmt->query.createTable), dbm, schema);
             break;
         case STMT_CREATEINDEX:
-            chidb_Gen_CreateIndexStmt(&(stmt->query.createIndex), dbm, schema);
+            rc = chidb_Gen_CreateIndexStmt(&(stmt->query.createIndex), dbm, schema);
             break;
     }
-    return CHIDB_OK;
+    return rc;
+}
+
+
+/* Scans a covering index instead of the table of a single-table query
+ *
+ * If an index on the table has every column the query refers to (in its
+ * select list, WHERE clause and GROUP BY clause), the table's map is
+ * replaced with the index's (see Schema_Index). The index entries are
+ * smaller than the table rows, and every column is read from them, so
+ * the table B-Tree is not touched at all. The map keeps the name of the
+ * table, so columns are resolved as usual. INSERT, DELETE and UPDATE
+ * keep every index of a table in step with its rows, so the index holds
+ * the same rows as the table.
+ *
+ * Parameters:
+ * - stmt: the select statement
+ * - cols, ncols: the select list (with SELECT * already expanded)
+ * - dbm: the DBM being generated, with the table's map in maps[0]
+ * - schema: the loaded schema
+ *
+ * Returns:
+ * - true if maps[0] is now an index, which is scanned in the order of
+ *   its first column rather than of the primary key
+ */
+static bool chidb_Gen_covering_index(SelectStatement *stmt, Column *cols, int ncols, DBM *dbm, Schema *schema)
+{
+    int nnames  = 0;
+    char **names = chidb_Arena_alloc(&dbm->arena,
+        (ncols + 2 * stmt->where_nconds + stmt->group_ncols + 1) * sizeof(char *));
+    if (NULL == names) return false;
+
+    for (int i = 0; i < ncols; i++) {
+        if (NULL != cols[i].name) // COUNT(*)
+            names[nnames++] = cols[i].name;
+    }
+    for (int i = 0; i < stmt->where_nconds; i++) {
+        names[nnames++] = stmt->where_conds[i].op1.name;
+        if (OP2_COL == stmt->where_conds[i].op2Type)
+            names[nnames++] = stmt->where_conds[i].op2.col.name;
+    }
+    for (int i = 0; i < stmt->group_ncols; i++)
+        names[nnames++] = stmt->group_cols[i].name;
+
+    Schema_Table *index = chidb_getCoveringIndex(schema, dbm->maps[0].name, names, nnames);
+    if (NULL == index) return false;
+
+    dbm->maps[0] = *index;
+    return true;
 }
 
 
@@ -51,6 +115,10 @@ int chidb_Gen(SQLStatement *stmt, DBM *dbm, Schema *schema)
  */
 int chidb_Gen_SelectStmt(SelectStatement *stmt, DBM *dbm, Schema *schema)
 {
+    // Aggregates and GROUP BY get their own program shape
+    if (chidb_parser_hasAggregates(stmt))
+        return chidb_Gen_AggregateStmt(stmt, dbm, schema);
+
     // Tables
     int8_t ntables = stmt->from_ntables;
     char **tables  = stmt->from_tables;
@@ -62,19 +130,19 @@ int chidb_Gen_SelectStmt(SelectStatement *stmt, DBM *dbm, Schema *schema)
 
     // Schema loading. Gets a schema table for each involved table
     uint8_t nncols = 0;
-    dbm->maps      = malloc(sizeof(Schema_Table) * ntables);
+    dbm->maps      = chidb_Arena_alloc(&dbm->arena, sizeof(Schema_Table) * ntables);
     dbm->nmaps     = ntables;
-    dbm->root_page = schema->table_root->info.table.rootPage;
     for (int i = 0; i < ntables; i++) {
       dbm->maps[i] = *chidb_getTable(schema, tables[i]);
       nncols      += dbm->maps[i].colMap.ncols;
     }
+    dbm->root_page = dbm->maps[0].rootPage;
 
     // Columns
     Column *cols;
     if (ncols < 0) { // Deals with SELECT *
         ncols = nncols;
-        cols  = (Column *) malloc(sizeof(Column) * ncols);
+        cols  = (Column *) chidb_Arena_alloc(&dbm->arena, sizeof(Column) * ncols);
 
         int k = 0;
         for (int i = 0; i<ntables; i++) {
@@ -88,6 +156,10 @@ int chidb_Gen_SelectStmt(SelectStatement *stmt, DBM *dbm, Schema *schema)
         cols = stmt->select_cols;
     }
 
+    // Answer the query from an index alone, if one has all its columns
+    if (1 == ntables)
+        chidb_Gen_covering_index(stmt, cols, ncols, dbm, schema);
+
     // Current register and cursor
     uint32_t reg = 0;
     uint32_t cur = 0;
@@ -123,6 +195,12 @@ int chidb_Gen_SelectStmt(SelectStatement *stmt, DBM *dbm, Schema *schema)
             chidb_Gen_Rewind(dbm, i, rewind_jump);
         }
 
+        // A single-table loop only reads the table and returns rows, so
+        // it may be split across threads or run a batch of rows at a time
+        // (see chidb_DBM_execute_ParallelScan and chidb_DBM_execute_BatchScan)
+        if (1 == ntables)
+            dbm->instructions[dbm->ninstructions - 1].p3 = 1;
+
         uint32_t first_col = dbm->ninstructions;
 
         // Find the appropriate columns for the conditions being tested,
@@ -156,7 +234,7 @@ int chidb_Gen_SelectStmt(SelectStatement *stmt, DBM *dbm, Schema *schema)
             } else {
                 chidb_Gen_Column(dbm, cur, c, reg);
                 reg++;
-                chidb_Gen_cond_op_register(&conds[i], dbm, op_jump, reg-1, i);
+                chidb_Gen_cond_op_register(&conds[i], dbm, op_jump, i, reg-1);
                 reg++;
             }
         }
@@ -183,76 +261,700 @@ int chidb_Gen_SelectStmt(SelectStatement *stmt, DBM *dbm, Schema *schema)
 
 
 
+/* generates machine code for a SELECT statement with aggregates and/or GROUP BY
+ *
+ * The table is scanned once. Each row that passes the WHERE clause selects
+ * its group (GroupSelect) and feeds every aggregate (AggStep); the groups
+ * are then emitted one result row each (GroupEmit, GroupKey, AggFinal).
+ *
+ * Groups are kept in a hash table, except when the statement groups by
+ * the primary key alone: table scans return rows in key order, so each
+ * group is finished as soon as the key changes and is emitted right away
+ * (streaming aggregation, with at most two groups alive). The same holds
+ * when a covering index is scanned instead of the table and the statement
+ * groups by the first column of the index.
+ *
+ * A lone COUNT(*) without WHERE or GROUP BY skips the scan altogether and
+ * counts the cells of the table's leaf pages (Count).
+ *
+ * Only single-table queries are supported. Every selected column that is
+ * not an aggregate must appear in the GROUP BY clause.
+ *
+ * Parameters:
+ * - stmt: the select statement, already parsed
+ * - dbm: the DBM being used
+ * - schema: the loaded schema, used for reference
+ *
+ * Returns:
+ * - CHIDB_OK
+ * - CHIDB_EINVALIDSQL: unsupported or ill-formed aggregate query
+ */
+int chidb_Gen_AggregateStmt(SelectStatement *stmt, DBM *dbm, Schema *schema)
+{
+    int8_t nconds    = stmt->where_nconds;
+    Condition *conds = stmt->where_conds;
+    int8_t ncols     = stmt->select_ncols;
+    Column *cols     = stmt->select_cols;
+    uint8_t nkeys    = stmt->group_ncols;
+    Column *keys     = stmt->group_cols;
+
+    if (stmt->from_ntables != 1 || ncols <= 0) return CHIDB_EINVALIDSQL;
+
+    Schema_Table *st = chidb_getTable(schema, stmt->from_tables[0]);
+    if (NULL == st) return CHIDB_EINVALIDSQL;
+
+    dbm->maps      = chidb_Arena_alloc(&dbm->arena, sizeof(Schema_Table));
+    dbm->nmaps     = 1;
+    dbm->maps[0]   = *st;
+    dbm->root_page = st->rootPage;
+    char *table    = dbm->maps[0].name;
+
+    // A bare COUNT(*) is answered from the leaf page headers alone
+    if (1 == ncols && AGG_COUNT == cols[0].agg && NULL == cols[0].name && 0 == nconds && 0 == nkeys) {
+        chidb_Gen_Count(dbm, dbm->maps[0].rootPage, 0);
+        chidb_Gen_ResultRow(dbm, 0, 1);
+        chidb_Gen_Halt(dbm, 0, NULL);
+        return CHIDB_OK;
+    }
+
+    // Scan a covering index instead of the table, if there is one; its
+    // entries come in the order of its first column
+    int order_col = dbm->maps[0].colMap.primary_col;
+    if (chidb_Gen_covering_index(stmt, cols, ncols, dbm, schema))
+        order_col = 0;
+
+    // Resolve the GROUP BY columns and decide between hashing and streaming
+    int *key_cols = chidb_Arena_alloc(&dbm->arena, (nkeys + 1) * sizeof(int));
+    for (int i = 0; i < nkeys; i++) {
+        key_cols[i] = chidb_Gen_get_column_no(dbm->maps, table, keys[i].name, 1);
+        if (key_cols[i] < 0) {
+            return CHIDB_EINVALIDSQL;
+        }
+    }
+    bool streaming = (1 == nkeys && key_cols[0] == order_col);
+
+    // Every aggregate gets its own accumulator; plain columns must be keys
+    int rc = CHIDB_OK;
+    int *sources = chidb_Arena_alloc(&dbm->arena, ncols * sizeof(int));
+    uint32_t naggs = 0;
+    for (int i = 0; i < ncols && CHIDB_OK == rc; i++) {
+        sources[i] = -1;
+        if (cols[i].agg != AGG_NONE) {
+            naggs++;
+            if (NULL == cols[i].name) continue; // COUNT(*)
+            sources[i] = chidb_Gen_get_column_no(dbm->maps, table, cols[i].name, 1);
+        } else {
+            for (int k = 0; k < nkeys; k++) {
+                if (!strcmp(keys[k].name, cols[i].name)) sources[i] = k;
+            }
+        }
+        if (sources[i] < 0) rc = CHIDB_EINVALIDSQL;
+    }
+    if (CHIDB_OK != rc) {
+        return rc;
+    }
+    dbm->group_naggs = naggs;
+
+    uint32_t reg = 0;
+    uint32_t cur = 0;
+
+    // Constants used by the WHERE clause
+    for (int i = 0; i < nconds; i++) {
+        chidb_Gen_condition_register(&conds[i], dbm, reg);
+        reg++;
+    }
+
+    chidb_Gen_Integer(dbm, dbm->maps[0].rootPage, reg);
+    chidb_Gen_OpenRead(dbm, cur, reg, dbm->maps[0].colMap.ncols);
+    reg++;
+
+    // Without GROUP BY there is exactly one group, even for an empty table
+    if (0 == nkeys)
+        chidb_Gen_GroupSelect(dbm, reg, 0, 0);
+
+    uint32_t rewind = dbm->ninstructions;
+    chidb_Gen_Rewind(dbm, cur, 0);
+    uint32_t top = dbm->ninstructions;
+
+    // WHERE: jump to the Next instruction when a condition fails
+    uint32_t *cond_jumps = chidb_Arena_alloc(&dbm->arena, (nconds + 1) * sizeof(uint32_t));
+    for (int i = 0; i < nconds; i++) {
+        int c = chidb_Gen_get_column_no(dbm->maps, table, conds[i].op1.name, 1);
+        if (c < 0) {
+            return CHIDB_EINVALIDSQL;
+        }
+        chidb_Gen_Column(dbm, cur, c, reg);
+        if (conds[i].op2Type == OP2_COL) {
+            int c2 = chidb_Gen_get_column_no(dbm->maps, table, conds[i].op2.col.name, 1);
+            chidb_Gen_Column(dbm, cur, c2, reg + 1);
+            cond_jumps[i] = dbm->ninstructions;
+            chidb_Gen_cond_op_register(&conds[i], dbm, 1, reg + 1, reg);
+            reg += 2;
+        } else {
+            cond_jumps[i] = dbm->ninstructions;
+            chidb_Gen_cond_op_register(&conds[i], dbm, 1, i, reg);
+            reg++;
+        }
+    }
+
+    // Group selection
+    uint32_t group_select = 0;
+    uint32_t key_reg = reg;
+    if (nkeys > 0) {
+        for (int k = 0; k < nkeys; k++) {
+            chidb_Gen_Column(dbm, cur, key_cols[k], reg);
+            reg++;
+        }
+        group_select = dbm->ninstructions;
+        chidb_Gen_GroupSelect(dbm, key_reg, nkeys, 0);
+    }
+
+    // Accumulate
+    uint32_t step = dbm->ninstructions;
+    uint32_t agg = 0;
+    for (int i = 0; i < ncols; i++) {
+        if (cols[i].agg == AGG_NONE) continue;
+        if (sources[i] < 0) {
+            chidb_Gen_AggStep(dbm, agg, -1, cols[i].agg);
+        } else {
+            chidb_Gen_Column(dbm, cur, sources[i], reg);
+            chidb_Gen_AggStep(dbm, agg, reg, cols[i].agg);
+            reg++;
+        }
+        agg++;
+    }
+
+    uint32_t next = dbm->ninstructions;
+    chidb_Gen_Next(dbm, cur, top);
+    for (int i = 0; i < nconds; i++)
+        dbm->instructions[cond_jumps[i]].p2 = next;
+
+    // Streaming: emit each group as soon as the next one starts
+    uint32_t out_reg = reg;
+    uint32_t goto_final = 0;
+    if (streaming) {
+        goto_final = dbm->ninstructions;
+        chidb_Gen_Goto(dbm, 0);
+
+        dbm->instructions[group_select].p3 = dbm->ninstructions;
+        chidb_Gen_GroupEmit(dbm, step, false);
+        chidb_Gen_agg_result_row(dbm, ncols, cols, sources, out_reg);
+        chidb_Gen_Goto(dbm, step);
+    }
+
+    // End of input: every remaining group is finished
+    uint32_t final = dbm->ninstructions;
+    if (streaming)
+        dbm->instructions[goto_final].p2 = final;
+    dbm->instructions[rewind].p2 = final;
+    chidb_Gen_GroupEmit(dbm, 0, true);
+    chidb_Gen_agg_result_row(dbm, ncols, cols, sources, out_reg);
+    chidb_Gen_Goto(dbm, final);
+
+    dbm->instructions[final].p2 = dbm->ninstructions;
+    chidb_Gen_Close(dbm, cur);
+    chidb_Gen_Halt(dbm, 0, NULL);
+
+    return CHIDB_OK;
+}
+
+
+/* Here is a routine for generating the result row of an emitted group
+ *
+ * sources[i] is the GROUP BY key number for plain columns; aggregates are
+ * numbered in the order they appear in the select list.
+ */
+int chidb_Gen_agg_result_row(DBM *dbm, int8_t ncols, Column *cols, int *sources, uint32_t start_reg)
+{
+    uint32_t agg = 0;
+    for (int i = 0; i < ncols; i++) {
+        if (cols[i].agg == AGG_NONE) {
+            chidb_Gen_GroupKey(dbm, sources[i], start_reg + i);
+        } else {
+            chidb_Gen_AggFinal(dbm, agg, start_reg + i, cols[i].agg);
+            agg++;
+        }
+    }
+
+    return chidb_Gen_ResultRow(dbm, start_reg, ncols);
+}
+
+
+
+/* Load an INSERT value into a register
+ *
+ * Parameters
+ * - dbm: the DBM being generated
+ * - value: the value to load
+ * - reg: the register to load it into
+ */
+int chidb_Gen_Value(DBM *dbm, Value *value, uint32_t reg)
+{
+    switch(value->type) {
+        case INS_INT:
+            return chidb_Gen_Integer(dbm, value->val.integer, reg);
+        case INS_STR:
+            return chidb_Gen_String(dbm, value->val.string, reg);
+        case INS_NULL:
+            return chidb_Gen_Null(dbm, reg);
+        case INS_PARAM:
+            return chidb_Gen_Variable(dbm, value->val.integer, reg);
+    }
+    return CHIDB_EINVALIDSQL;
+}
+
+
+/* Order of the rows of a multi-row INSERT: by primary key when it is
+ * known at compile time, in the order given otherwise
+ */
+typedef struct {
+    bool literal;  // Key is an integer literal
+    int32_t key;
+    uint32_t row;
+} InsertRow;
+
+static int chidb_Gen_compare_rows(const void *a, const void *b)
+{
+    const InsertRow *r1 = a, *r2 = b;
+
+    if (r1->literal != r2->literal) return r1->literal ? -1 : 1;
+    if (r1->literal && r1->key != r2->key) return (r1->key < r2->key) ? -1 : 1;
+    return (r1->row < r2->row) ? -1 : (r1->row > r2->row);
+}
+
+
+/* Opens a write cursor on every index of a table
+ *
+ * Plain indexes are opened with no columns, so IdxInsert knows they have
+ * no record.
+ *
+ * Parameters:
+ * - dbm: the DBM being generated
+ * - schema, table: the table
+ * - cur: cursor of the first index; the others follow it
+ * - reg: first free register, updated
+ * - indexes, nindexes: out parameters, the indexes of the table
+ *
+ * Returns:
+ * - CHIDB_OK
+ * - CHIDB_ENOMEM: could not allocate memory
+ */
+static int chidb_Gen_open_indexes(DBM *dbm, Schema *schema, char *table, uint32_t cur, uint32_t *reg,
+                                  Schema_Index ***indexes, int *nindexes)
+{
+    *nindexes = chidb_getIndexes(schema, table, NULL);
+    *indexes  = chidb_Arena_alloc(&dbm->arena, (*nindexes + 1) * sizeof(Schema_Index *));
+    if (*indexes == NULL) return CHIDB_ENOMEM;
+    chidb_getIndexes(schema, table, *indexes);
+
+    for (int k = 0; k < *nindexes; k++) {
+        int ncols = (*indexes)[k]->covering ? (*indexes)[k]->map.colMap.ncols : 0;
+
+        chidb_Gen_Integer(dbm, (*indexes)[k]->rootPage, *reg);
+        chidb_Gen_OpenWrite(dbm, cur + k, *reg, ncols);
+        (*reg)++;
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Generates the entry of a row in an index (IdxInsert)
+ *
+ * The row's columns are in registers start_reg onwards, with its primary
+ * key in key_reg rather than in its column. The other columns of a
+ * covering index are copied to a block of scratch registers (fields_reg
+ * onwards) and packed into a record in key_reg + 1, where IdxInsert
+ * looks for it.
+ */
+static void chidb_Gen_index_entry(DBM *dbm, Schema_Index *index, uint32_t cur, int key_col,
+                                  uint32_t start_reg, uint32_t key_reg, uint32_t fields_reg)
+{
+    int *table_cols  = index->tableCols;
+    uint32_t idx_reg = (table_cols[0] == key_col) ? key_reg : start_reg + table_cols[0];
+
+    if (index->covering) {
+        int nfields = 0;
+        for (int i = 1; i < index->map.colMap.ncols; i++) {
+            if (i == index->map.colMap.primary_col) continue;
+            chidb_Gen_SCopy(dbm, start_reg + table_cols[i], fields_reg + nfields);
+            nfields++;
+        }
+        chidb_Gen_MakeRecord(dbm, fields_reg, nfields, key_reg + 1);
+    }
+    chidb_Gen_IdxInsert(dbm, cur, idx_reg, key_reg);
+}
+
 
 /* Generates machine code for an insert statement
+ *
+ * Every row of the VALUES list is inserted by the same program, through a
+ * single cursor. Rows are sorted by primary key first, so that consecutive
+ * inserts go to the same (or the next) leaf.
+ *
+ * Every index on the table gets its own cursor, and each row is added to
+ * all of them right after the table (IdxInsert), so that the indexes stay
+ * up to date. The other columns of a covering index are copied to a block
+ * of scratch registers and packed into a record for its entry.
  */
 int chidb_Gen_InsertStmt(InsertStatement *stmt, DBM *dbm, Schema *schema)
 {
     char *table     = stmt->table;
     uint8_t nvalues = stmt->nvalues;
+    uint32_t nrows  = stmt->nrows;
     Value *values   = stmt->values;
 
     uint32_t reg  = 0;
     uint32_t cur  = 0;
 
     // Schema loading. Gets a schema table for each involved table
-    dbm->maps          = malloc(sizeof(Schema_Table));
+    dbm->maps          = chidb_Arena_alloc(&dbm->arena, sizeof(Schema_Table));
     dbm->maps[0]       = *chidb_getTable(schema, table);
     dbm->nmaps         = 1;
     int schema_columns = dbm->maps[0].colMap.ncols;
     int schema_key_col = dbm->maps[0].colMap.primary_col;
-    dbm->root_page     = schema->table_root->info.table.rootPage;
+    dbm->root_page     = dbm->maps[0].rootPage;
 
     /* GENERAL FLOW:
      *
      * Integer for the right page
      * OpenWrite to correctly insert
      *
-     * Use Integer/String/etc. to load in values being inserted
-     *
-     * MakeRecord to create a record with these values
-     *
-     * Insert the records appropriately
+     * For each row:
+     *   Use Integer/String/etc. to load in values being inserted
+     *   MakeRecord to create a record with these values
+     *   Insert the records appropriately
      *
      */
-    chidb_Gen_Integer(dbm, 2, reg); // the Table root page
+    chidb_Gen_Integer(dbm, dbm->maps[0].rootPage, reg); // the Table root page
 
     chidb_Gen_OpenWrite(dbm, cur, reg, schema_columns);
     reg++;
 
-    /* Store all of the values being inserted
+    // The indexes, on cursors 1 to nindexes
+    Schema_Index **indexes;
+    int nindexes;
+    int rc = chidb_Gen_open_indexes(dbm, schema, table, cur + 1, &reg, &indexes, &nindexes);
+    if (rc != CHIDB_OK) return rc;
+
+    InsertRow *rows = chidb_Arena_alloc(&dbm->arena, nrows * sizeof(InsertRow));
+    if (rows == NULL) return CHIDB_ENOMEM;
+    for (uint32_t r = 0; r < nrows; r++) {
+        Value *key = (schema_key_col >= 0 && schema_key_col < nvalues) ? &values[r * nvalues + schema_key_col] : NULL;
+        rows[r].literal = (key != NULL && key->type == INS_INT);
+        rows[r].key     = rows[r].literal ? key->val.integer : 0;
+        rows[r].row     = r;
+    }
+    if (nrows > 1) qsort(rows, nrows, sizeof(InsertRow), chidb_Gen_compare_rows);
+
+    /* Store all of the values being inserted. The primary key lives in
+     * the B-Tree cell rather than in the record, so its value goes to a
+     * separate key register and the record gets a NULL in its place.
+     * Every row reuses the same registers.
      */
-    uint32_t start_reg = reg;
-    for (int i = 0; i < nvalues; i++) {
-        switch(values[i].type) {
-            case INS_INT:
-                chidb_Gen_Integer(dbm, values[i].val.integer, reg);
-                break;
-            case INS_STR:
-                chidb_Gen_String(dbm, values[i].val.string, reg);
-                break;
-            case INS_NULL:
+    uint32_t start_reg  = reg;
+    uint32_t key_reg    = start_reg + nvalues;
+    uint32_t record_reg = key_reg + 1; // also the record of index entries
+    uint32_t fields_reg = record_reg + 1;
+    for (uint32_t r = 0; r < nrows; r++) {
+        Value *row = &values[rows[r].row * nvalues];
+
+        reg = start_reg;
+        for (int i = 0; i < nvalues; i++) {
+            if (i == schema_key_col) {
+                chidb_Gen_Value(dbm, &row[i], key_reg);
                 chidb_Gen_Null(dbm, reg);
-                break;
+            } else {
+                chidb_Gen_Value(dbm, &row[i], reg);
+            }
+            reg++;
+        }
+
+        /* now, create a new record for these values
+         */
+        chidb_Gen_MakeRecord(dbm, start_reg, nvalues, record_reg);
+
+        /* at this point, we are ready with our database record
+         * we now need to ready an index record
+         */
+        chidb_Gen_InsertEntry(dbm, cur, record_reg, key_reg);
+
+        // Then the entry of each index
+        for (int k = 0; k < nindexes; k++)
+            chidb_Gen_index_entry(dbm, indexes[k], cur + 1 + k, schema_key_col, start_reg, key_reg, fields_reg);
+    }
+
+    for (int k = 0; k < nindexes; k++)
+        chidb_Gen_Close(dbm, cur + 1 + k);
+    chidb_Gen_Close(dbm, cur);
+
+    chidb_Gen_Halt(dbm, 0, NULL);
+
+    return CHIDB_OK;
+}
+
+
+/* Generates the WHERE clause of a single-table scan
+ *
+ * The constants of the conditions must already be in registers 0 to
+ * nconds - 1. Every condition jumps away when it fails; the addresses of
+ * those jumps are stored in cond_jumps, for the caller to point them to
+ * its Next instruction.
+ *
+ * Parameters:
+ * - dbm: the DBM being generated
+ * - table: the table being scanned, through cursor cur
+ * - nconds, conds: the conditions
+ * - reg: first free register, updated
+ * - cond_jumps: out parameter, one instruction address per condition
+ *
+ * Returns:
+ * - CHIDB_OK
+ * - CHIDB_EINVALIDSQL: a condition refers to an unknown column
+ */
+static int chidb_Gen_where(DBM *dbm, char *table, uint32_t cur, int8_t nconds, Condition *conds, uint32_t *reg, uint32_t *cond_jumps)
+{
+    for (int i = 0; i < nconds; i++) {
+        int c = chidb_Gen_get_column_no(dbm->maps, table, conds[i].op1.name, 1);
+        if (c < 0) return CHIDB_EINVALIDSQL;
+        chidb_Gen_Column(dbm, cur, c, *reg);
+        if (conds[i].op2Type == OP2_COL) {
+            int c2 = chidb_Gen_get_column_no(dbm->maps, table, conds[i].op2.col.name, 1);
+            if (c2 < 0) return CHIDB_EINVALIDSQL;
+            chidb_Gen_Column(dbm, cur, c2, *reg + 1);
+            cond_jumps[i] = dbm->ninstructions;
+            chidb_Gen_cond_op_register(&conds[i], dbm, 1, *reg + 1, *reg);
+            *reg += 2;
+        } else {
+            cond_jumps[i] = dbm->ninstructions;
+            chidb_Gen_cond_op_register(&conds[i], dbm, 1, i, *reg);
+            (*reg)++;
         }
+    }
+
+    return CHIDB_OK;
+}
+
+
+/* Generates machine code for a delete statement
+ *
+ * The table is scanned through a read cursor (0), and every row that
+ * passes the WHERE clause is deleted through a write cursor (1) on the
+ * same table. The scan reads the cells loaded when it started, so
+ * deleting the rows it has visited does not disturb it.
+ *
+ * Every index on the table gets a write cursor (2 onwards), and the
+ * row's entry is deleted from each of them (IdxDelete) before the row
+ * itself, so that no index is left with entries of deleted rows.
+ */
+int chidb_Gen_DeleteStmt(DeleteStatement *stmt, DBM *dbm, Schema *schema)
+{
+    int8_t nconds    = stmt->where_nconds;
+    Condition *conds = stmt->where_conds;
+
+    Schema_Table *st = chidb_getTable(schema, stmt->table);
+    if (NULL == st) return CHIDB_EINVALIDSQL;
+
+    dbm->maps      = chidb_Arena_alloc(&dbm->arena, sizeof(Schema_Table));
+    dbm->nmaps     = 1;
+    dbm->maps[0]   = *st;
+    dbm->root_page = st->rootPage;
+    char *table    = dbm->maps[0].name;
+
+    uint32_t reg = 0;
+    uint32_t cur = 0;
+    uint32_t wcur = 1;
+
+    // Constants used by the WHERE clause
+    for (int i = 0; i < nconds; i++) {
+        chidb_Gen_condition_register(&conds[i], dbm, reg);
         reg++;
     }
 
-    /* now, determine the column of the key
-     */
-    uint32_t key_reg = start_reg + schema_key_col;
+    chidb_Gen_Integer(dbm, dbm->maps[0].rootPage, reg);
+    chidb_Gen_OpenRead(dbm, cur, reg, dbm->maps[0].colMap.ncols);
+    chidb_Gen_OpenWrite(dbm, wcur, reg, dbm->maps[0].colMap.ncols);
+    reg++;
 
-    /* now, create a new record for these values
-     */
-    chidb_Gen_MakeRecord(dbm, start_reg, nvalues, reg);
+    Schema_Index **indexes;
+    int nindexes;
+    int rc = chidb_Gen_open_indexes(dbm, schema, table, wcur + 1, &reg, &indexes, &nindexes);
+    if (CHIDB_OK != rc) return rc;
+    int key_col = dbm->maps[0].colMap.primary_col;
 
-    /* at this point, we are ready with our database record
-     * we now need to ready an index record
-     */
-    chidb_Gen_InsertEntry(dbm, cur, reg, key_reg);
+    uint32_t rewind = dbm->ninstructions;
+    chidb_Gen_Rewind(dbm, cur, 0);
+    uint32_t top = dbm->ninstructions;
+
+    // WHERE: jump to the Next instruction when a condition fails
+    uint32_t *cond_jumps = chidb_Arena_alloc(&dbm->arena, (nconds + 1) * sizeof(uint32_t));
+    rc = chidb_Gen_where(dbm, table, cur, nconds, conds, &reg, cond_jumps);
+    if (CHIDB_OK != rc) return rc;
+
+    // The entries of the row go first, found by their keys
+    uint32_t key_reg = reg;
+    chidb_Gen_Key(dbm, cur, key_reg);
+    for (int k = 0; k < nindexes; k++) {
+        int col = indexes[k]->tableCols[0];
+        uint32_t idx_reg = key_reg;
+        if (col != key_col) {
+            idx_reg = key_reg + 1;
+            chidb_Gen_Column(dbm, cur, col, idx_reg);
+        }
+        chidb_Gen_IdxDelete(dbm, wcur + 1 + k, idx_reg, key_reg);
+    }
+    chidb_Gen_Delete(dbm, wcur, key_reg);
+
+    uint32_t next = dbm->ninstructions;
+    chidb_Gen_Next(dbm, cur, top);
+    for (int i = 0; i < nconds; i++)
+        dbm->instructions[cond_jumps[i]].p2 = next;
+    dbm->instructions[rewind].p2 = dbm->ninstructions;
 
+    for (int k = 0; k < nindexes; k++)
+        chidb_Gen_Close(dbm, wcur + 1 + k);
+    chidb_Gen_Close(dbm, wcur);
     chidb_Gen_Close(dbm, cur);
+    chidb_Gen_Halt(dbm, 0, NULL);
+
+    return CHIDB_OK;
+}
+
+
+/* Generates machine code for an update statement
+ *
+ * Like a delete, the table is scanned through a read cursor (0) and
+ * written through a write cursor (1). For every row that passes the WHERE
+ * clause, a new record is made from the row's columns, with the SET
+ * values in place of the updated ones, and replaces the old record (in
+ * place, when its size has not changed).
+ *
+ * Every index with a column in the SET clause gets a write cursor (2
+ * onwards). The row's old entry is deleted from it (IdxDelete, with the
+ * old value of the indexed column), and its new entry inserted as in an
+ * INSERT. Indexes whose columns are all left alone keep their entries.
+ *
+ * The primary key can't be updated, it is the key of the row's B-Tree
+ * entry.
+ */
+int chidb_Gen_UpdateStmt(UpdateStatement *stmt, DBM *dbm, Schema *schema)
+{
+    int8_t nconds    = stmt->where_nconds;
+    Condition *conds = stmt->where_conds;
+
+    Schema_Table *st = chidb_getTable(schema, stmt->table);
+    if (NULL == st) return CHIDB_EINVALIDSQL;
+
+    dbm->maps      = chidb_Arena_alloc(&dbm->arena, sizeof(Schema_Table));
+    dbm->nmaps     = 1;
+    dbm->maps[0]   = *st;
+    dbm->root_page = st->rootPage;
+    char *table    = dbm->maps[0].name;
+    int ncols      = dbm->maps[0].colMap.ncols;
+    int key_col    = dbm->maps[0].colMap.primary_col;
+
+    // The value each column is set to (NULL if it keeps its own)
+    Value **values = chidb_Arena_alloc(&dbm->arena, ncols * sizeof(Value *));
+    if (NULL == values) return CHIDB_ENOMEM;
+    memset(values, 0, ncols * sizeof(Value *));
+    for (int i = 0; i < stmt->set_ncols; i++) {
+        int c = chidb_Gen_get_column_no(dbm->maps, table, stmt->set_cols[i].name, 1);
+        if (c < 0 || c == key_col) return CHIDB_EINVALIDSQL;
+        values[c] = &stmt->set_values[i];
+    }
+
+    uint32_t reg = 0;
+    uint32_t cur = 0;
+    uint32_t wcur = 1;
+
+    // Constants used by the WHERE clause
+    for (int i = 0; i < nconds; i++) {
+        chidb_Gen_condition_register(&conds[i], dbm, reg);
+        reg++;
+    }
+
+    chidb_Gen_Integer(dbm, dbm->maps[0].rootPage, reg);
+    chidb_Gen_OpenRead(dbm, cur, reg, ncols);
+    chidb_Gen_OpenWrite(dbm, wcur, reg, ncols);
+    reg++;
+
+    // Only the indexes on updated columns are opened, on cursors wcur + 1
+    // onwards
+    Schema_Index **indexes;
+    int nindexes = chidb_getIndexes(schema, table, NULL);
+    indexes = chidb_Arena_alloc(&dbm->arena, (nindexes + 1) * sizeof(Schema_Index *));
+    if (NULL == indexes) return CHIDB_ENOMEM;
+    chidb_getIndexes(schema, table, indexes);
+
+    int nupdated = 0;
+    for (int k = 0; k < nindexes; k++) {
+        Schema_Index *index = indexes[k];
+        bool updated = false;
+        for (int i = 0; i < index->map.colMap.ncols; i++)
+            if (values[index->tableCols[i]] != NULL) updated = true;
+        if (!updated) continue;
+
+        int idx_ncols = index->covering ? index->map.colMap.ncols : 0;
+        chidb_Gen_Integer(dbm, index->rootPage, reg);
+        chidb_Gen_OpenWrite(dbm, wcur + 1 + nupdated, reg, idx_ncols);
+        reg++;
+        indexes[nupdated++] = index;
+    }
+
+    uint32_t rewind = dbm->ninstructions;
+    chidb_Gen_Rewind(dbm, cur, 0);
+    uint32_t top = dbm->ninstructions;
+
+    // WHERE: jump to the Next instruction when a condition fails
+    uint32_t *cond_jumps = chidb_Arena_alloc(&dbm->arena, (nconds + 1) * sizeof(uint32_t));
+    int rc = chidb_Gen_where(dbm, table, cur, nconds, conds, &reg, cond_jumps);
+    if (CHIDB_OK != rc) return rc;
+
+    /* The new record, with a NULL in place of the primary key (as in an
+     * INSERT), and the key of the entry to update. The old value of each
+     * updated index's column is kept after the scratch registers of the
+     * index records
+     */
+    uint32_t start_reg  = reg;
+    uint32_t key_reg    = start_reg + ncols;
+    uint32_t record_reg = key_reg + 1;
+    uint32_t fields_reg = record_reg + 1;
+    uint32_t old_reg    = fields_reg + ncols;
+    for (int i = 0; i < ncols; i++) {
+        if (i == key_col)
+            chidb_Gen_Null(dbm, start_reg + i);
+        else if (values[i] != NULL)
+            chidb_Gen_Value(dbm, values[i], start_reg + i);
+        else
+            chidb_Gen_Column(dbm, cur, i, start_reg + i);
+    }
+    chidb_Gen_Key(dbm, cur, key_reg);
+    for (int k = 0; k < nupdated; k++) {
+        int col = indexes[k]->tableCols[0];
+        if (col != key_col && values[col] != NULL)
+            chidb_Gen_Column(dbm, cur, col, old_reg + k);
+    }
+    chidb_Gen_MakeRecord(dbm, start_reg, ncols, record_reg);
+    chidb_Gen_Update(dbm, wcur, record_reg, key_reg);
+
+    for (int k = 0; k < nupdated; k++) {
+        int col = indexes[k]->tableCols[0];
+        uint32_t idx_reg = (col == key_col) ? key_reg :
+                           (values[col] != NULL) ? old_reg + k : start_reg + col;
+        chidb_Gen_IdxDelete(dbm, wcur + 1 + k, idx_reg, key_reg);
+        chidb_Gen_index_entry(dbm, indexes[k], wcur + 1 + k, key_col, start_reg, key_reg, fields_reg);
+    }
+
+    uint32_t next = dbm->ninstructions;
+    chidb_Gen_Next(dbm, cur, top);
+    for (int i = 0; i < nconds; i++)
+        dbm->instructions[cond_jumps[i]].p2 = next;
+    dbm->instructions[rewind].p2 = dbm->ninstructions;
 
+    for (int k = 0; k < nupdated; k++)
+        chidb_Gen_Close(dbm, wcur + 1 + k);
+    chidb_Gen_Close(dbm, wcur);
+    chidb_Gen_Close(dbm, cur);
     chidb_Gen_Halt(dbm, 0, NULL);
 
     return CHIDB_OK;
@@ -260,72 +962,154 @@ int chidb_Gen_InsertStmt(InsertStatement *stmt, DBM *dbm, Schema *schema)
 
 
 /* Generates machine code for a create table statement
+ *
+ * CreateTable allocates the (empty) table, which is then added to the
+ * schema table, as for CREATE INDEX.
  */
 int chidb_Gen_CreateTableStmt(CreateTableStatement *stmt, DBM *dbm, Schema *schema)
 {
-    
+    if (chidb_getTable(schema, stmt->table) != NULL) return CHIDB_EINVALIDSQL;
+
+    /* The schema table entry: type, name, table, root page and the
+     * statement itself
+     */
+    SQLStatement sql;
+    sql.type = STMT_CREATETABLE;
+    sql.query.createTable = *stmt;
+    char *text = chidb_parser_CreateTableToString(&sql);
+    if (text == NULL) return CHIDB_ENOMEM;
+
+    uint32_t schema_cur = 0;
+    uint32_t root_reg = 0, reg = 1;
+    chidb_Gen_CreateTable(dbm, root_reg);
+    chidb_Gen_Integer(dbm, 1, reg);
+    chidb_Gen_OpenWrite(dbm, schema_cur, reg, 5);
+    chidb_Gen_String(dbm, "table", reg + 1);
+    chidb_Gen_String(dbm, stmt->table, reg + 2);
+    chidb_Gen_String(dbm, stmt->table, reg + 3);
+    chidb_Gen_SCopy(dbm, root_reg, reg + 4);
+    int rc = chidb_Gen_String(dbm, text, reg + 5);
+    free(text);
+    if (rc != CHIDB_OK) return rc;
+    chidb_Gen_MakeRecord(dbm, reg + 1, 5, reg + 6);
+    chidb_Gen_Integer(dbm, schema->max_key + 1, reg + 7);
+    chidb_Gen_InsertEntry(dbm, schema_cur, reg + 6, reg + 7);
+    chidb_Gen_Close(dbm, schema_cur);
+
+    chidb_Gen_Halt(dbm, 0, NULL);
+
     return CHIDB_OK;
 }
 
 
 /* Generates machine code for a create index statement
+ *
+ * The index is built bottom-up rather than with one IdxInsert per row
+ * into the B-Tree (each from its root to a leaf, with pages written all
+ * over the file and left half full by splits): the table is scanned into
+ * a sorter (IdxInsert on a cursor opened with SorterOpen), and BulkLoad
+ * sorts the entries and packs them into the new index, which CreateIndex
+ * allocated. The entries are made as in an INSERT. The index is then
+ * added to the schema table.
  */
 int chidb_Gen_CreateIndexStmt(CreateIndexStatement *stmt, DBM *dbm, Schema *schema)
 {
-    // // Index
-    // char *index = stmt->index;
-    
-    // Column
     char *table = stmt->on.table;
-    char *name  = stmt->on.name;
-    
+    Schema_Table *st = chidb_getTable(schema, table);
+    if (st == NULL || chidb_getIndex(schema, stmt->index) != NULL) return CHIDB_EINVALIDSQL;
+
     // Schema Loading
-    dbm->maps      = malloc(sizeof(Schema_Table));
+    dbm->maps      = chidb_Arena_alloc(&dbm->arena, sizeof(Schema_Table));
+    if (dbm->maps == NULL) return CHIDB_ENOMEM;
     dbm->nmaps     = 1;
-    dbm->root_page = schema->table_root->info.table.rootPage;
-    dbm->maps[0]   = *chidb_getTable(schema, table);
-    
-    // Current register and cursor
-    uint32_t reg = 0;
-    uint32_t cur = 0;
-    
+    dbm->maps[0]   = *st;
+    dbm->root_page = st->rootPage;
+    int key_col    = st->colMap.primary_col;
+
+    // Position of each column of the index in the table
+    int *table_cols = chidb_Arena_alloc(&dbm->arena, stmt->ncols * sizeof(int));
+    if (table_cols == NULL) return CHIDB_ENOMEM;
+    for (int i = 0; i < stmt->ncols; i++) {
+        table_cols[i] = chidb_Gen_get_column_no(dbm->maps, table, stmt->cols[i], 1);
+        if (table_cols[i] < 0) return CHIDB_EINVALIDSQL;
+    }
+    int ncols = (stmt->ncols > 1) ? stmt->ncols : 0; // covering indexes have a record
+
+    // Cursors: the table (whose map is maps[0]), the index, its sorter and
+    // the schema table
+    uint32_t table_cur = 0, idx_cur = 1, sorter_cur = 2, schema_cur = 3;
+    uint32_t root_reg = 0, reg = 1;
+
     // Create the index, and open it for write access
-    chidb_Gen_CreateIndex(dbm, reg);
-    chidb_Gen_OpenWrite(dbm, cur, reg, 0);
-    reg++; cur++;
-    
+    chidb_Gen_CreateIndex(dbm, root_reg);
+    chidb_Gen_OpenWrite(dbm, idx_cur, root_reg, ncols);
+    chidb_Gen_SorterOpen(dbm, sorter_cur, ncols);
+
     // Open the table to index for read access
-    chidb_Gen_Integer(dbm, dbm->maps[0].rootPage, reg);
-    chidb_Gen_OpenRead(dbm, cur, reg, dbm->maps[0].colMap.ncols);
-    reg++;
-    
-    // Begin the loop to index the table entries
-    uint32_t rewind_jump = dbm->ninstructions + 4;
-    uint32_t next_jump = dbm->ninstructions + 1;
-    chidb_Gen_Rewind(dbm, cur, rewind_jump);
-    
-    // Get the value in the column of interest
-    uint32_t n = chidb_Gen_get_column_no(dbm->maps, table, name, 1);
-    chidb_Gen_Column(dbm, cur, n, reg);
+    chidb_Gen_Integer(dbm, st->rootPage, reg);
+    chidb_Gen_OpenRead(dbm, table_cur, reg, st->colMap.ncols);
     reg++;
-    // Get the value of the key in the current row
-    chidb_Gen_Key(dbm, cur, reg);
-    
-    // Insert the index entry
-    cur--;
-    chidb_Gen_IdxInsert(dbm, cur, reg-1, reg);
-    cur++;
-    
-    // Conclusion of the loop
-    chidb_Gen_Next(dbm, cur, next_jump);
-    
-    // Close the B-Trees and halt
-    chidb_Gen_Close(dbm, cur);
-    cur--;
-    chidb_Gen_Close(dbm, cur);
-    
+
+    // One entry per row, as in an INSERT
+    uint32_t idx_reg    = reg;
+    uint32_t key_reg    = idx_reg + 1;
+    uint32_t record_reg = key_reg + 1;
+    uint32_t fields_reg = record_reg + 1;
+    uint32_t rewind = dbm->ninstructions;
+    chidb_Gen_Rewind(dbm, table_cur, 0);
+    uint32_t top = dbm->ninstructions;
+
+    // The primary key is in the B-Tree cell, not in the record
+    if (table_cols[0] == key_col)
+        chidb_Gen_Key(dbm, table_cur, idx_reg);
+    else
+        chidb_Gen_Column(dbm, table_cur, table_cols[0], idx_reg);
+    chidb_Gen_Key(dbm, table_cur, key_reg);
+    if (ncols > 0) {
+        int nfields = 0;
+        for (int i = 1; i < stmt->ncols; i++) {
+            if (table_cols[i] == key_col) continue;
+            chidb_Gen_Column(dbm, table_cur, table_cols[i], fields_reg + nfields);
+            nfields++;
+        }
+        chidb_Gen_MakeRecord(dbm, fields_reg, nfields, record_reg);
+    }
+    chidb_Gen_IdxInsert(dbm, sorter_cur, idx_reg, key_reg);
+    chidb_Gen_Next(dbm, table_cur, top);
+    dbm->instructions[rewind].p2 = dbm->ninstructions;
+
+    // Build the index from the sorted entries
+    chidb_Gen_BulkLoad(dbm, sorter_cur, idx_cur);
+    chidb_Gen_Close(dbm, table_cur);
+    chidb_Gen_Close(dbm, sorter_cur);
+    chidb_Gen_Close(dbm, idx_cur);
+
+    /* The schema table entry: type, name, table, root page and the
+     * statement itself (without the semicolon)
+     */
+    SQLStatement sql;
+    sql.type = STMT_CREATEINDEX;
+    sql.query.createIndex = *stmt;
+    char *text = chidb_parser_CreateIndexToString(&sql);
+    if (text == NULL) return CHIDB_ENOMEM;
+
+    reg = fields_reg + stmt->ncols;
+    chidb_Gen_Integer(dbm, 1, reg);
+    chidb_Gen_OpenWrite(dbm, schema_cur, reg, 5);
+    chidb_Gen_String(dbm, "index", reg + 1);
+    chidb_Gen_String(dbm, stmt->index, reg + 2);
+    chidb_Gen_String(dbm, table, reg + 3);
+    chidb_Gen_SCopy(dbm, root_reg, reg + 4);
+    int rc = chidb_Gen_String(dbm, text, reg + 5);
+    free(text);
+    if (rc != CHIDB_OK) return rc;
+    chidb_Gen_MakeRecord(dbm, reg + 1, 5, reg + 6);
+    chidb_Gen_Integer(dbm, schema->max_key + 1, reg + 7);
+    chidb_Gen_InsertEntry(dbm, schema_cur, reg + 6, reg + 7);
+    chidb_Gen_Close(dbm, schema_cur);
+
     chidb_Gen_Halt(dbm, 0, NULL);
-    
+
     return CHIDB_OK;
 }
 
@@ -397,6 +1181,9 @@ int chidb_Gen_condition_register(Condition *cond, DBM *dbm, uint32_t reg)
         case OP2_STR:
             chidb_Gen_String(dbm, cond->op2.string, reg);
             break;
+        case OP2_PARAM:
+            chidb_Gen_Variable(dbm, cond->op2.integer, reg);
+            break;
         case OP2_COL: // We store a NULL value, as this register is never actually used
         default:      // Occurs is a case of NULL/NOT NULL
             chidb_Gen_Null(dbm, reg);
@@ -312,14 +312,20 @@ int chidb_Gen_Integer(DBM *dbm, int n, uint32_t r)
  */
 int chidb_Gen_String(DBM *dbm, char *string, uint32_t r)
 {
+    // The program keeps its own copy, String hands it out without copying
+    size_t len = strlen(string);
+    char *copy = chidb_Arena_alloc(&dbm->arena, len + 1);
+    if (copy == NULL) return CHIDB_ENOMEM;
+    memcpy(copy, string, len + 1);
+
     DBMInstruction dbmi;
     dbmi.machine = dbm;
     dbmi.id = dbm->ninstructions;
     dbmi.op = _String_;
-    dbmi.p1 = strlen(string);
+    dbmi.p1 = len;
     dbmi.p2 = r;
     dbmi.p3 = 0;
-    dbmi.p4 = string;
+    dbmi.p4 = copy;
     return chidb_DBM_add_instruction(dbm, &dbmi);
 }
 
@@ -696,6 +702,10 @@ int chidb_Gen_IdxKey(DBM *dbm, uint32_t c, uint32_t r)
 
 /* Add a new key pair to a B-Tree
 *
+* If the cursor was opened on a covering index (with the number of its
+* columns rather than 0), register r2 + 1 must contain the record of the
+* entry, built with MakeRecord.
+*
 * Parameters:
 * - dbm: the DBM machine being used
 * - c: a cursor pointing to an index B-Tree
@@ -810,4 +820,326 @@ int chidb_Gen_Halt(DBM *dbm, int n, char *msg)
     dbmi.p3 = 0;
     dbmi.p4 = msg;
     return chidb_DBM_add_instruction(dbm, &dbmi);
-}
\ No newline at end of file
+}
+
+
+/* Select the aggregation group for the key held in registers r..r+n-1
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - r: the first key register
+ * - n: the number of key registers (0 for one global group)
+ * - j: 0 to hash the groups, or a jump address taken when a group is finished
+ * -    (streaming mode, for input sorted by the key)
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_GroupSelect(DBM *dbm, uint32_t r, uint32_t n, uint32_t j)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _GroupSelect_;
+    dbmi.p1 = r;
+    dbmi.p2 = n;
+    dbmi.p3 = j;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
+
+
+/* Accumulate a value into an aggregate of the selected group
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - a: the aggregate number
+ * - r: the register holding the value, or -1 for COUNT(*)
+ * - f: the aggregate function (AGG_COUNT, AGG_SUM, ...)
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_AggStep(DBM *dbm, uint32_t a, int32_t r, uint8_t f)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _AggStep_;
+    dbmi.p1 = a;
+    dbmi.p2 = r;
+    dbmi.p3 = f;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
+
+
+/* Pick the next finished group for GroupKey and AggFinal
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - j: a jump address if no finished group is left
+ * - final: true once the input is exhausted (every group is finished)
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_GroupEmit(DBM *dbm, uint32_t j, bool final)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _GroupEmit_;
+    dbmi.p1 = 0;
+    dbmi.p2 = j;
+    dbmi.p3 = final;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
+
+
+/* Copy a key of the emitted group into a register
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - k: the key number
+ * - r: the register to store the key in
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_GroupKey(DBM *dbm, uint32_t k, uint32_t r)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _GroupKey_;
+    dbmi.p1 = k;
+    dbmi.p2 = r;
+    dbmi.p3 = 0;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
+
+
+/* Store the final value of an aggregate of the emitted group
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - a: the aggregate number
+ * - r: the register to store the value in
+ * - f: the aggregate function (AGG_COUNT, AGG_SUM, ...)
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_AggFinal(DBM *dbm, uint32_t a, uint32_t r, uint8_t f)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _AggFinal_;
+    dbmi.p1 = a;
+    dbmi.p2 = r;
+    dbmi.p3 = f;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
+
+
+/* Jump unconditionally
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - j: the jump address
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_Goto(DBM *dbm, uint32_t j)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _Goto_;
+    dbmi.p1 = 0;
+    dbmi.p2 = j;
+    dbmi.p3 = 0;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
+
+
+/* Count the entries of a table B-Tree without opening a cursor
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - n: the root page of the table
+ * - r: the register to store the count in
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_Count(DBM *dbm, uint32_t n, uint32_t r)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _Count_;
+    dbmi.p1 = n;
+    dbmi.p2 = r;
+    dbmi.p3 = 0;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
+
+
+/* Copy the value bound to a ? placeholder into a register
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - p: the placeholder number (numbered from 1)
+ * - r: the register to store the value in
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_Variable(DBM *dbm, uint32_t p, uint32_t r)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _Variable_;
+    dbmi.p1 = p;
+    dbmi.p2 = r;
+    dbmi.p3 = 0;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
+
+
+/* Delete an entry from a table B-Tree
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - c: a cursor opened for writing on the table
+ * - r: register contains the key of the entry
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_Delete(DBM *dbm, uint32_t c, uint32_t r)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _Delete_;
+    dbmi.p1 = c;
+    dbmi.p2 = r;
+    dbmi.p3 = 0;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
+
+
+/* Replace the record of an entry in a table B-Tree
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - c: a cursor opened for writing on the table
+ * - r1: register contains the new database record
+ * - r2: register contains the key of the entry
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_Update(DBM *dbm, uint32_t c, uint32_t r1, uint32_t r2)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _Update_;
+    dbmi.p1 = c;
+    dbmi.p2 = r1;
+    dbmi.p3 = r2;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
+
+
+/* Open a sorter for the entries of a new index
+ *
+ * IdxInsert on the cursor adds the entry to the sorter rather than to a
+ * B-Tree (see BulkLoad). As with OpenWrite, the cursor of a covering
+ * index is opened with its number of columns, and that of a plain index
+ * with 0.
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - c: the cursor to open
+ * - n: the number of columns of the index
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_SorterOpen(DBM *dbm, uint32_t c, uint32_t n)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _SorterOpen_;
+    dbmi.p1 = c;
+    dbmi.p2 = n;
+    dbmi.p3 = 0;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
+
+
+/* Sort the entries of a sorter and build an index B-Tree from them
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - c1: a cursor opened with SorterOpen
+ * - c2: a cursor opened for writing on an empty index (see CreateIndex)
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_BulkLoad(DBM *dbm, uint32_t c1, uint32_t c2)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _BulkLoad_;
+    dbmi.p1 = c1;
+    dbmi.p2 = c2;
+    dbmi.p3 = 0;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
+
+
+/* Delete an entry from an index B-Tree
+ *
+ * Parameters:
+ * - dbm: the DBM machine being used
+ * - c: a cursor opened for writing on the index
+ * - r1: a register containing the index key of the entry
+ * - r2: a register containing its pkey
+ *
+ * Returns:
+ * - CHIDB_OK
+ */
+int chidb_Gen_IdxDelete(DBM *dbm, uint32_t c, uint32_t r1, uint32_t r2)
+{
+    DBMInstruction dbmi;
+    dbmi.machine = dbm;
+    dbmi.id = dbm->ninstructions;
+    dbmi.op = _IdxDelete_;
+    dbmi.p1 = c;
+    dbmi.p2 = r1;
+    dbmi.p3 = r2;
+    dbmi.p4 = NULL;
+    return chidb_DBM_add_instruction(dbm, &dbmi);
+}
@@ -43,5 +43,19 @@ int chidb_Gen_CreateIndex(DBM *dbm, uint32_t r);
 int chidb_Gen_SCopy(DBM *dbm, uint32_t r1, uint32_t r2);
 int chidb_Gen_Halt(DBM *dbm, int n, char* msg);
 
+int chidb_Gen_GroupSelect(DBM *dbm, uint32_t r, uint32_t n, uint32_t j);
+int chidb_Gen_AggStep(DBM *dbm, uint32_t a, int32_t r, uint8_t f);
+int chidb_Gen_GroupEmit(DBM *dbm, uint32_t j, bool final);
+int chidb_Gen_GroupKey(DBM *dbm, uint32_t k, uint32_t r);
+int chidb_Gen_AggFinal(DBM *dbm, uint32_t a, uint32_t r, uint8_t f);
+int chidb_Gen_Goto(DBM *dbm, uint32_t j);
+int chidb_Gen_Count(DBM *dbm, uint32_t n, uint32_t r);
+int chidb_Gen_Variable(DBM *dbm, uint32_t p, uint32_t r);
+int chidb_Gen_Delete(DBM *dbm, uint32_t c, uint32_t r);
+int chidb_Gen_Update(DBM *dbm, uint32_t c, uint32_t r1, uint32_t r2);
+int chidb_Gen_SorterOpen(DBM *dbm, uint32_t c, uint32_t n);
+int chidb_Gen_BulkLoad(DBM *dbm, uint32_t c1, uint32_t c2);
+int chidb_Gen_IdxDelete(DBM *dbm, uint32_t c, uint32_t r1, uint32_t r2);
+
 
 #endif
\ No newline at end of file
@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <chidb.h>
 #include <string.h>
+#include <ctype.h>
 #include "btree.h"
 #include "gen.h"
 #include "parser.h"
@@ -21,20 +22,256 @@
 #include "dbm.h"
 #include "record.h"
 #include "pager.h"
+#include "csv.h"
+
+
+
+/* Build the statement cache key for a SQL string
+ *
+ * Runs of whitespace outside string literals are collapsed into a single
+ * space (and leading/trailing whitespace dropped), so statements that
+ * only differ in layout share a cache entry.
+ *
+ * Return
+ * - The key (to be freed by the caller), or NULL if out of memory
+ */
+static char *chidb_stmtcache_key(const char *sql) {
+  char *key = malloc(strlen(sql) + 1);
+  if (key == NULL) return NULL;
+
+  char *k = key;
+  bool in_string = false, space = false;
+  for (const char *c = sql; *c != '\0'; ++c) {
+    if (!in_string && isspace((unsigned char) *c)) {
+      space = (k != key);
+      continue;
+    }
+    if (space) *k++ = ' ';
+    space = false;
+    if (*c == '"') in_string = !in_string;
+    *k++ = *c;
+  }
+  *k = '\0';
+  return key;
+}
+
+
+/* Have a statement read the file at a snapshot
+ *
+ * Only statements that just read (SELECT) keep the snapshot; the others
+ * read the file as it is, while they hold the connection's lock, so the
+ * snapshot is closed right away.
+ */
+static void chidb_stmt_pin(chidb_stmt *stmt, uint64_t snapshot, npage_t npages) {
+  if (STMT_SELECT != stmt->type) {
+    chidb_Pager_closeSnapshot(stmt->db->bt->pager, snapshot);
+    return;
+  }
+  stmt->dbm->snapshot        = snapshot;
+  stmt->dbm->snapshot_npages = npages;
+}
+
+
+/* Close the snapshot a statement reads the file at, if any */
+static void chidb_stmt_unpin(chidb_stmt *stmt) {
+  if (stmt->dbm != NULL && PAGER_LATEST != stmt->dbm->snapshot) {
+    chidb_Pager_closeSnapshot(stmt->db->bt->pager, stmt->dbm->snapshot);
+    stmt->dbm->snapshot = PAGER_LATEST;
+  }
+}
+
+
+/* Free a statement and everything it owns */
+static int chidb_stmt_destroy(chidb_stmt *stmt) {
+  int rc = CHIDB_OK;
+
+  chidb_stmt_unpin(stmt);
+  if (stmt->dbm != NULL) rc = chidb_DBM_destroy(stmt->dbm);
+  free(stmt->sql);
+  if (stmt->schema != NULL) chidb_destroySchema(stmt->schema);
+  free(stmt->cache_key);
+  free(stmt);
+  return rc;
+}
+
+
+/* Take a statement compiled from the same SQL out of the cache
+ *
+ * Statements compiled against an older schema (i.e. a different schema
+ * cookie) are dropped along the way.
+ *
+ * Return
+ * - The statement, or NULL if there is none
+ */
+static chidb_stmt *chidb_stmtcache_take(chidb *db, const char *key, uint32_t cookie) {
+  StmtCache *cache = &db->cache;
+  chidb_stmt *found = NULL;
+  uint32_t kept = 0;
+
+  for (uint32_t i = 0; i < cache->nstmts; ++i) {
+    chidb_stmt *st = cache->stmts[i];
+    if (st->schema_cookie != cookie) {
+      chidb_stmt_destroy(st);
+    } else if (found == NULL && 0 == strcmp(st->cache_key, key)) {
+      found = st;
+    } else {
+      cache->stmts[kept++] = st;
+    }
+  }
+  cache->nstmts = kept;
+  return found;
+}
+
+
+/* Park a finalized statement in the cache as the most recently used one
+ *
+ * If the cache is full, the least recently used statement is freed. If
+ * the same SQL is already cached (it was prepared twice before either
+ * was finalized), the statement is simply freed.
+ */
+static int chidb_stmtcache_put(chidb *db, chidb_stmt *stmt) {
+  StmtCache *cache = &db->cache;
+  int rc;
+
+  for (uint32_t i = 0; i < cache->nstmts; ++i) {
+    if (0 == strcmp(cache->stmts[i]->cache_key, stmt->cache_key)) {
+      return chidb_stmt_destroy(stmt);
+    }
+  }
+
+  rc = chidb_DBM_reset(stmt->dbm);
+  if (CHIDB_OK != rc) return chidb_stmt_destroy(stmt);
+  chidb_DBM_clear_bindings(stmt->dbm);
+
+  if (cache->nstmts == CHIDB_STMTCACHE_SIZE) {
+    chidb_stmt_destroy(cache->stmts[0]);
+    memmove(cache->stmts, cache->stmts + 1, (cache->nstmts - 1) * sizeof(chidb_stmt *));
+    --cache->nstmts;
+  }
+  cache->stmts[cache->nstmts++] = stmt;
+  return CHIDB_OK;
+}
+
+
+/* Take the connection's lock in a given mode (see ChidbLock) */
+static void chidb_lock(chidb *db, ChidbLockMode mode) {
+  ChidbLock *lock = &db->lock;
+
+  pthread_mutex_lock(&lock->mutex);
+  uint64_t ticket = lock->next_ticket++;
+  while (ticket != lock->serving ||
+         (lock->holders > 0 && (lock->mode != mode || CHIDB_LOCK_WRITE == mode))) {
+    pthread_cond_wait(&lock->cond, &lock->mutex);
+  }
+  lock->serving++;
+  lock->holders++;
+  lock->mode = mode;
+
+  // The next thread in line may be able to share it
+  pthread_cond_broadcast(&lock->cond);
+  pthread_mutex_unlock(&lock->mutex);
+}
+
+
+/* Let go of the connection's lock */
+static void chidb_unlock(chidb *db) {
+  ChidbLock *lock = &db->lock;
+
+  pthread_mutex_lock(&lock->mutex);
+  if (--lock->holders == 0) pthread_cond_broadcast(&lock->cond);
+  pthread_mutex_unlock(&lock->mutex);
+}
+
+
+/* Get the schema as a snapshot sees it
+ *
+ * The caller must hold db->mutex. The connection keeps the newest schema
+ * it has loaded, and only loads one when the snapshot's schema cookie is
+ * a different one. The caller gets its own reference to the schema, to
+ * be dropped with chidb_destroySchema.
+ */
+static int chidb_schema_get(chidb *db, uint64_t snapshot, uint32_t *cookie, Schema **schema) {
+  int rc;
+
+  rc = chidb_Btree_getSchemaCookieAt(db->bt, snapshot, cookie);
+  if (CHIDB_OK != rc) return rc;
+  if (db->schema != NULL && db->schema_cookie == *cookie) {
+    *schema = chidb_retainSchema(db->schema);
+    return CHIDB_OK;
+  }
+
+  rc = chidb_loadSchemaAt(db, snapshot, schema);
+  if (CHIDB_OK != rc) return rc;
+
+  // The cookie only goes up: an older snapshot's schema is not kept.
+  // Statements still using the old schema keep their own reference.
+  if (db->schema == NULL || db->schema_cookie < *cookie) {
+    chidb_destroySchema(db->schema);
+    db->schema        = chidb_retainSchema(*schema);
+    db->schema_cookie = *cookie;
+  }
+  return CHIDB_OK;
+}
+
+
+/* Start keeping stats on the tables a SELECT statement reads from
+ *
+ * The caller must hold db->mutex.
+ */
+static int chidb_stats_addTables(chidb *db, SelectStatement *select) {
+  for (int i = 0; i < select->from_ntables; ++i) {
+    bool found_table = false;
+    char *table_name = select->from_tables[i];
+
+    for (uint32_t j = 0; j < db->stats.ntables; ++j) {
+      if (0 == strcmp(table_name, db->stats.table_names[j])) {
+        found_table = true;
+      }
+    }
+
+    if (found_table) continue;
+    db->stats.table_names = realloc(db->stats.table_names, (db->stats.ntables + 1) * sizeof(char *));
+    db->stats.table_sizes = realloc(db->stats.table_sizes, (db->stats.ntables + 1) * sizeof(uint32_t));
+    if (db->stats.table_names == NULL || db->stats.table_sizes == NULL) return CHIDB_ENOMEM;
+    db->stats.table_names[db->stats.ntables] = strdup(table_name);
+    db->stats.table_sizes[db->stats.ntables] = 0;
+    ++db->stats.ntables;
+  }
+  return CHIDB_OK;
+}
 
 
 
 int chidb_open(const char *file, chidb **db) {
+  return chidb_open_pagesize(file, db, DEFAULT_PAGE_SIZE);
+}
+
+
+int chidb_open_pagesize(const char *file, chidb **db, uint32_t page_size) {
   *db = malloc(sizeof(chidb));
   if (*db == NULL) return CHIDB_ENOMEM;
 
-  int rc = chidb_Btree_open(file, *db, &(*db)->bt);
-  if (rc == CHIDB_ECORRUPTHEADER) return CHIDB_ECORRUPT;
+  int rc = chidb_Btree_openPageSize(file, *db, &(*db)->bt, page_size);
+  if (rc != CHIDB_OK) {
+    free(*db);
+    *db = NULL;
+    return (rc == CHIDB_ECORRUPTHEADER) ? CHIDB_ECORRUPT : rc;
+  }
 
   (*db)->stats.ntables     = 0;
   (*db)->stats.table_names = NULL;
   (*db)->stats.table_sizes = NULL;
 
+  (*db)->cache.nstmts = 0;
+  (*db)->schema       = NULL;
+
+  pthread_mutex_init(&(*db)->mutex, NULL);
+  pthread_mutex_init(&(*db)->lock.mutex, NULL);
+  pthread_cond_init(&(*db)->lock.cond, NULL);
+  (*db)->lock.next_ticket = 0;
+  (*db)->lock.serving     = 0;
+  (*db)->lock.holders     = 0;
+  (*db)->lock.mode        = CHIDB_LOCK_INSERT;
 
   return CHIDB_OK;
 }
@@ -42,7 +279,22 @@ int chidb_open(const char *file, chidb **db) {
 
 int chidb_close(chidb *db) {
   if (db == NULL) return CHIDB_EMISUSE;
+
+  for (uint32_t i = 0; i < db->cache.nstmts; ++i) {
+    chidb_stmt_destroy(db->cache.stmts[i]);
+  }
+
+  for (uint32_t i = 0; i < db->stats.ntables; ++i) {
+    free(db->stats.table_names[i]);
+  }
+  free(db->stats.table_names);
+  free(db->stats.table_sizes);
+
+  chidb_destroySchema(db->schema);
   chidb_Btree_close(db->bt);
+  pthread_mutex_destroy(&db->mutex);
+  pthread_mutex_destroy(&db->lock.mutex);
+  pthread_cond_destroy(&db->lock.cond);
   free(db);
   db = NULL;
   return CHIDB_OK;
@@ -51,81 +303,157 @@ int chidb_close(chidb *db) {
 
 int chidb_prepare(chidb *db, const char *sql, chidb_stmt **stmt) {
   int rc;
+  uint32_t cookie;
+  Schema *schema;
+  uint64_t snapshot;
+  npage_t npages;
 
-  chidb_stmt *st = (chidb_stmt *) malloc(sizeof(chidb_stmt));
   if (sql == NULL) return CHIDB_EINVALIDSQL;
 
+  char *key = chidb_stmtcache_key(sql);
+  if (key == NULL) return CHIDB_ENOMEM;
+
+  // The statement is compiled against, and reads, the file as of now
+  rc = chidb_Pager_openSnapshot(db->bt->pager, &snapshot, &npages);
+  if (CHIDB_OK != rc) {
+    free(key);
+    return rc;
+  }
+
+  pthread_mutex_lock(&db->mutex);
+  rc = chidb_schema_get(db, snapshot, &cookie, &schema);
+  if (CHIDB_OK != rc) {
+    pthread_mutex_unlock(&db->mutex);
+    chidb_Pager_closeSnapshot(db->bt->pager, snapshot);
+    free(key);
+    return rc;
+  }
+
+  // Same SQL, same schema: reuse the compiled program
+  chidb_stmt *st = chidb_stmtcache_take(db, key, cookie);
+  pthread_mutex_unlock(&db->mutex);
+  if (st != NULL) {
+    chidb_destroySchema(schema);
+    free(key);
+    chidb_stmt_pin(st, snapshot, npages);
+    *stmt = st;
+    return CHIDB_OK;
+  }
+
+  st = (chidb_stmt *) malloc(sizeof(chidb_stmt));
+  if (st == NULL) {
+    chidb_Pager_closeSnapshot(db->bt->pager, snapshot);
+    chidb_destroySchema(schema);
+    free(key);
+    return CHIDB_ENOMEM;
+  }
+  st->db            = db;
+  st->cache_key     = key;
+  st->schema_cookie = cookie;
+  st->sql           = NULL;
+  st->schema        = schema;
+
   //create dbm
-  chidb_DBM_create(db, &st->dbm);
-  if (st->dbm == NULL) return CHIDB_ENOMEM;
+  rc = chidb_DBM_create(db, &st->dbm);
+  if (CHIDB_OK != rc) {
+    st->dbm = NULL;
+    chidb_Pager_closeSnapshot(db->bt->pager, snapshot);
+    chidb_stmt_destroy(st);
+    return rc;
+  }
+  st->dbm->snapshot        = snapshot;
+  st->dbm->snapshot_npages = npages;
 
   //create sql stmt
-  chidb_parser(sql, &st->sql);
-  if (st->sql == NULL) return CHIDB_ENOMEM;
-
-  //set the schema
-  rc = chidb_loadSchema(db, &st->schema);
+  rc = chidb_parser(sql, &st->sql);
   if (CHIDB_OK != rc) {
-    free(st);
+    st->sql = NULL;
+    chidb_stmt_destroy(st);
     return rc;
   }
 
   //generate the code
   rc = chidb_Gen(st->sql, st->dbm, st->schema);
   if (CHIDB_OK != rc) {
-    free(st);
+    chidb_stmt_destroy(st);
     return rc;
   }
 
   // Look up or start keeping stats on this table
   if (st->sql->type == STMT_SELECT) {
-    for (int i = 0; i < st->sql->query.select.from_ntables; ++i) {
-      bool found_table = false;
-      char *table_name = st->sql->query.select.from_tables[i];
-
-      for (uint32_t j = 0; j < db->stats.ntables; ++j) {
-        if (0 == strcmp(table_name, db->stats.table_names[j])) {
-          found_table = true;
-        }
-      }
-
-      if (found_table) continue;
-      db->stats.table_names = malloc(sizeof(db->stats.table_names) + sizeof(char *));
-      db->stats.table_sizes = malloc(sizeof(db->stats.table_sizes) + sizeof(uint32_t));
-      db->stats.table_names[db->stats.ntables] = table_name;
-      db->stats.table_sizes[db->stats.ntables] = 0;
-      ++db->stats.ntables;
+    pthread_mutex_lock(&db->mutex);
+    rc = chidb_stats_addTables(db, &st->sql->query.select);
+    pthread_mutex_unlock(&db->mutex);
+    if (CHIDB_OK != rc) {
+      chidb_stmt_destroy(st);
+      return rc;
     }
   }
 
   //set the stmt characteristics to hold these elements
   st->type = st->sql->type;
   *stmt    = st;
+  if (STMT_SELECT != st->type) chidb_stmt_unpin(st);
 
   return CHIDB_OK;
 }
 
 
 int chidb_step(chidb_stmt *stmt) {  
+  int rc;
   if (stmt == NULL) return CHIDB_EMISUSE;
-  return chidb_DBM_step(stmt->dbm);
+
+  // Reads see their snapshot whatever is written meanwhile, so they
+  // need no lock at all
+  if (STMT_SELECT == stmt->type) return chidb_DBM_step(stmt->dbm);
+
+  // Inserts run alongside each other, and commit together when the last
+  // of them is done; the step returns once its writes are committed
+  chidb_lock(stmt->db, STMT_INSERT == stmt->type ? CHIDB_LOCK_INSERT : CHIDB_LOCK_WRITE);
+  chidb_Pager_beginWrite(stmt->db->bt->pager);
+
+  rc = chidb_DBM_step(stmt->dbm);
+
+  // Statements compiled against the old schema must not be reused
+  if (CHIDB_DONE == rc && (STMT_CREATETABLE == stmt->type || STMT_CREATEINDEX == stmt->type)) {
+    int crc = chidb_Btree_incrSchemaCookie(stmt->db->bt);
+    if (CHIDB_OK != crc) rc = crc;
+  }
+
+  chidb_Pager_endWrite(stmt->db->bt->pager);
+  chidb_unlock(stmt->db);
+  return rc;
 }
 
 
-int chidb_finalize(chidb_stmt *stmt) {
-  int rc;
-  if (stmt == NULL) return CHIDB_EMISUSE;
+int chidb_bind_int(chidb_stmt *stmt, int param, int value) {
+  if (stmt == NULL || param < 1) return CHIDB_EMISUSE;
+  return chidb_DBM_bind_int(stmt->dbm, param, value);
+}
 
-  rc = chidb_DBM_destroy(stmt->dbm);
-  if (CHIDB_OK != rc) return rc;
 
-  free(stmt->sql);
+int chidb_bind_text(chidb_stmt *stmt, int param, const char *value) {
+  if (stmt == NULL || param < 1 || value == NULL) return CHIDB_EMISUSE;
+  return chidb_DBM_bind_text(stmt->dbm, param, value);
+}
 
-  chidb_destroySchema(stmt->schema);
 
-  free(stmt);
-  stmt = NULL;
-  return CHIDB_OK;
+int chidb_reset(chidb_stmt *stmt) {
+  if (stmt == NULL) return CHIDB_EMISUSE;
+  return chidb_DBM_reset(stmt->dbm);
+}
+
+
+int chidb_finalize(chidb_stmt *stmt) {
+  if (stmt == NULL) return CHIDB_EMISUSE;
+
+  // Keep the compiled program around in case the same SQL is prepared again
+  chidb *db = stmt->db;
+  chidb_stmt_unpin(stmt);
+  pthread_mutex_lock(&db->mutex);
+  int rc = chidb_stmtcache_put(db, stmt);
+  pthread_mutex_unlock(&db->mutex);
+  return rc;
 }
 
 
@@ -145,13 +473,10 @@ int chidb_column_count(chidb_stmt *stmt) {
 
 
 int chidb_column_type(chidb_stmt *stmt, int col) {
-  if (stmt->sql->type == STMT_SELECT) {
-	  int ty = stmt->dbm->result->types[col];
-    if (ty > SQL_TEXT) return SQL_TEXT;
-    return ty;
-	}
+  if (col < 0 || (uint32_t) col >= stmt->dbm->nresult) return SQL_NOTVALID;
 
-  return SQL_NOTVALID;
+  // Register types use the same codes as the SQL types
+  return stmt->dbm->result[col]->type;
 }
 
 const char *chidb_column_name(chidb_stmt* stmt, int col) {
@@ -171,31 +496,24 @@ const char *chidb_column_name(chidb_stmt* stmt, int col) {
       }
 
     } else {
-      name = stmt->sql->query.select.select_cols[col].name;
+      Column *c = &stmt->sql->query.select.select_cols[col];
+      name = (c->agg != AGG_NONE) ? (char *) chidb_parser_aggregateName(c->agg) : c->name;
     }
   } return name;
 }
 
 
 int chidb_column_int(chidb_stmt *stmt, int col) {
-  int ty = stmt->dbm->result->types[col];
-  
-  if (ty == SQL_INTEGER_1BYTE) {
-    int8_t val;
-    chidb_DBRecord_getInt8(stmt->dbm->result, col, &val);
-    return val;
-  }
-
-   if (ty == SQL_INTEGER_2BYTE) {
-    int16_t val;
-    chidb_DBRecord_getInt16(stmt->dbm->result, col, &val);
-    return val;
-  }
-
-  if (ty == SQL_INTEGER_4BYTE) {
-    int32_t val;
-    chidb_DBRecord_getInt32(stmt->dbm->result, col, &val);
-    return val;
+  if (col < 0 || (uint32_t) col >= stmt->dbm->nresult) return 0;
+
+  DBMRegister *reg = stmt->dbm->result[col];
+  switch (reg->type) {
+    case DBM_BYTE_REGISTER_TYPE:
+      return reg->fields.byte;
+    case DBM_SMALLINT_REGISTER_TYPE:
+      return reg->fields.smallint;
+    case DBM_INTEGER_REGISTER_TYPE:
+      return reg->fields.integer;
   }
 
   // SQL_NULL...
@@ -205,16 +523,202 @@ int chidb_column_int(chidb_stmt *stmt, int col) {
 
 
 const char *chidb_column_text(chidb_stmt *stmt, int col) {
-  int ty = chidb_DBRecord_getType(stmt->dbm->result, col);
-  
-  if (ty == SQL_TEXT) {
-    int length;
-    chidb_DBRecord_getStringLength(stmt->dbm->result, col, &length);
+  if (col < 0 || (uint32_t) col >= stmt->dbm->nresult) return NULL;
 
-    char *str;
-    chidb_DBRecord_getString(stmt->dbm->result, col, &str);
-    return str;
+  // String registers are NUL-terminated, and stay put until the next step
+  DBMRegister *reg = stmt->dbm->result[col];
+  if (reg->type == DBM_STRING_REGISTER_TYPE) {
+    return (const char *) reg->fields.string.data;
   }
 
   return NULL;
 }
+
+
+
+/* Convert one CSV row into the fields of a record and its key
+ *
+ * The primary key lives in the B-Tree cell, so it gets a NULL in the
+ * record (just like INSERT). Text fields point into the CSV row.
+ */
+static int chidb_import_row(CSVReader *csv, Schema_Table *st, DBRecordField *fields, key_t *key) {
+  if (csv->nfields != (uint32_t) st->colMap.ncols) return CHIDB_EMISMATCH;
+
+  for (uint32_t i = 0; i < csv->nfields; ++i) {
+    const char *value = csv->row + csv->fields[i];
+    uint8_t type      = st->colMap.cols[i].type;
+
+    fields[i].type = SQL_NULL;
+    if (csv->lengths[i] == 0 && (int) i != st->colMap.primary_col) continue;
+
+    if (SQL_TEXT == type) {
+      fields[i].type     = SQL_TEXT;
+      fields[i].text     = (const uint8_t *) value;
+      fields[i].text_len = csv->lengths[i];
+      continue;
+    }
+
+    char *end;
+    long integer = strtol(value, &end, 10);
+    if (csv->lengths[i] == 0 || *end != '\0') return CHIDB_EMISMATCH;
+
+    if ((int) i == st->colMap.primary_col) {
+      if (integer < 0 || integer > UINT32_MAX) return CHIDB_EMISMATCH;
+      *key = integer;
+      continue;
+    }
+
+    // Integers are stored as wide as the column
+    if ((SQL_INTEGER_1BYTE == type && (integer < INT8_MIN || integer > INT8_MAX)) ||
+        (SQL_INTEGER_2BYTE == type && (integer < INT16_MIN || integer > INT16_MAX)) ||
+        integer < INT32_MIN || integer > INT32_MAX) {
+      return CHIDB_EMISMATCH;
+    }
+    fields[i].type    = type;
+    fields[i].integer = integer;
+  }
+
+  return CHIDB_OK;
+}
+
+
+/* Make sure a reusable buffer has room for size bytes */
+static int chidb_import_reserve(uint8_t **buf, uint32_t *buf_size, uint32_t size) {
+  if (size <= *buf_size) return CHIDB_OK;
+
+  uint8_t *grown = realloc(*buf, size);
+  if (grown == NULL) return CHIDB_ENOMEM;
+  *buf      = grown;
+  *buf_size = size;
+  return CHIDB_OK;
+}
+
+
+/* Add the entries of an imported row to the indexes of its table
+ *
+ * Entries are built the same way as by INSERT: the first column of the
+ * index is the key, and covering indexes get a record with their other
+ * columns (except the primary key, which is the entry's Key-Pk).
+ */
+static int chidb_import_indexes(chidb *db, Schema_Table *st, Schema_Index **indexes, int nindexes,
+                                DBRecordField *fields, key_t key, DBRecordField *idx_fields,
+                                uint8_t **buf, uint32_t *buf_size) {
+  int rc = CHIDB_OK;
+
+  for (int k = 0; k < nindexes && CHIDB_OK == rc; k++) {
+    Schema_Index *index = indexes[k];
+    int *table_cols     = index->tableCols;
+    key_t idx_key;
+
+    if (table_cols[0] == st->colMap.primary_col) {
+      idx_key = key;
+    } else {
+      uint8_t type = fields[table_cols[0]].type;
+      if (SQL_INTEGER_1BYTE != type && SQL_INTEGER_2BYTE != type && SQL_INTEGER_4BYTE != type)
+        return CHIDB_EMISMATCH;
+      idx_key = fields[table_cols[0]].integer;
+    }
+
+    if (!index->covering) {
+      rc = chidb_Btree_insertInIndex(db->bt, index->rootPage, idx_key, key);
+    } else {
+      uint8_t nfields = 0;
+      uint32_t size;
+      for (int i = 1; i < index->map.colMap.ncols; i++) {
+        if (i != index->map.colMap.primary_col)
+          idx_fields[nfields++] = fields[table_cols[i]];
+      }
+      rc = chidb_DBRecord_encodedSize(idx_fields, nfields, &size);
+      if (CHIDB_OK == rc) rc = chidb_import_reserve(buf, buf_size, size);
+      if (CHIDB_OK != rc) return rc;
+      chidb_DBRecord_encode(idx_fields, nfields, *buf);
+      rc = chidb_Btree_insertInCoveringIndex(db->bt, index->rootPage, idx_key, key, *buf, size);
+    }
+  }
+
+  return (CHIDB_EDUPLICATE == rc) ? CHIDB_ECONSTRAINT : rc;
+}
+
+
+int chidb_import(chidb *db, const char *file, const char *table, uint32_t *nrows) {
+  int rc;
+  uint32_t cookie;
+  Schema *schema;
+  uint64_t snapshot;
+  npage_t npages;
+
+  *nrows = 0;
+  rc = chidb_Pager_openSnapshot(db->bt->pager, &snapshot, &npages);
+  if (CHIDB_OK != rc) return rc;
+  pthread_mutex_lock(&db->mutex);
+  rc = chidb_schema_get(db, snapshot, &cookie, &schema);
+  pthread_mutex_unlock(&db->mutex);
+  chidb_Pager_closeSnapshot(db->bt->pager, snapshot);
+  if (CHIDB_OK != rc) return rc;
+
+  Schema_Table *st = chidb_getTable(schema, table);
+  if (st == NULL || st->colMap.primary_col < 0) {
+    chidb_destroySchema(schema);
+    return (st == NULL) ? CHIDB_EINVALIDSQL : CHIDB_EMISUSE;
+  }
+
+  FILE *f = fopen(file, "r");
+  if (f == NULL) {
+    chidb_destroySchema(schema);
+    return CHIDB_ECANTOPEN;
+  }
+
+  CSVReader csv;
+  rc = chidb_CSV_open(&csv, f);
+
+  // Rows go to every index of the table as well
+  int nindexes = chidb_getIndexes(schema, table, NULL);
+  Schema_Index **indexes = malloc((nindexes + 1) * sizeof(Schema_Index *));
+  if (indexes != NULL) chidb_getIndexes(schema, table, indexes);
+
+  // One set of fields and one record buffer, reused for every row
+  DBRecordField *fields     = malloc(st->colMap.ncols * sizeof(DBRecordField));
+  DBRecordField *idx_fields = malloc(st->colMap.ncols * sizeof(DBRecordField));
+  uint8_t *record           = NULL;
+  uint32_t record_size      = 0;
+  if (fields == NULL || idx_fields == NULL || indexes == NULL) rc = CHIDB_ENOMEM;
+
+  // Other imports and INSERTs may add rows at the same time. Readers
+  // see all of the rows imported, or none of them.
+  chidb_lock(db, CHIDB_LOCK_INSERT);
+  chidb_Pager_beginWrite(db->bt->pager);
+  while (CHIDB_OK == rc && CHIDB_ROW == (rc = chidb_CSV_next(&csv))) {
+    BTreeCell btc;
+    uint32_t size;
+
+    rc = chidb_import_row(&csv, st, fields, &btc.key);
+    if (CHIDB_OK == rc) rc = chidb_DBRecord_encodedSize(fields, st->colMap.ncols, &size);
+    if (CHIDB_OK == rc) rc = chidb_import_reserve(&record, &record_size, size);
+    if (CHIDB_OK != rc) break;
+    chidb_DBRecord_encode(fields, st->colMap.ncols, record);
+
+    btc.type = PGTYPE_TABLE_LEAF;
+    btc.fields.tableLeaf.data      = record;
+    btc.fields.tableLeaf.data_size = size;
+    rc = chidb_Btree_insert(db->bt, st->rootPage, &btc);
+    if (CHIDB_EDUPLICATE == rc) rc = CHIDB_ECONSTRAINT;
+
+    // The record has been written, its buffer is free for index entries
+    if (CHIDB_OK == rc)
+      rc = chidb_import_indexes(db, st, indexes, nindexes, fields, btc.key,
+                                idx_fields, &record, &record_size);
+    if (CHIDB_OK == rc) (*nrows)++;
+  }
+  chidb_Pager_endWrite(db->bt->pager);
+  chidb_unlock(db);
+  if (CHIDB_DONE == rc) rc = CHIDB_OK;
+
+  free(record);
+  free(fields);
+  free(idx_fields);
+  free(indexes);
+  chidb_CSV_close(&csv);
+  fclose(f);
+  chidb_destroySchema(schema);
+  return rc;
+}
@@ -10,12 +10,18 @@
  * modify the page returned by the pager and instruct the pager to
  * write it back to disk.
  *
- * The default pager is very simple and always creates an in-memory copy
- * of any page that is read (even if that page has already been read before).
+ * The pager always creates an in-memory copy of any page that is read.
  * More specifically, pages are read into a MemPage structure, which must
  * be freed (using the releaseMemPage function) once they are not needed.
- * In a real database, the pager component typically does some caching
- * of pages to reduce the number of disk accesses.
+ * To avoid going to the file for every read, pages are also kept in a
+ * cache (see pager.h) which several threads may read from at once. The
+ * file itself is only accessed with pread/pwrite, which do not share a
+ * file position between threads.
+ *
+ * So that a reader can see the file as it was when it started, while
+ * writers carry on, the pager keeps the old images of the pages that
+ * writers overwrite for as long as an open snapshot needs them (see
+ * pager.h and chidb_Pager_openSnapshot).
  *
  *
  * 2009, 2010 Borja Sotomayor - http://people.cs.uchicago.edu/~borja/
@@ -28,11 +34,15 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <sched.h>
 
 #include <chidbInt.h>
 
 #include "pager.h"
 
+static void chidb_Pager_flushCache(Pager *pager);
+static void chidb_Pager_collectVersions(Pager *pager);
+
 /* Open a file
  *
  * This function opens a file for paged access.
@@ -52,6 +62,18 @@ int chidb_Pager_open(Pager **pager, const char *filename)
 	*pager = malloc(sizeof(Pager));
 	if (pager == NULL)
 		return CHIDB_ENOMEM;
+	memset((*pager)->stripes, 0, sizeof((*pager)->stripes));
+	for (int i = 0; i < PAGER_CACHE_STRIPES; i++)
+		pthread_mutex_init(&(*pager)->stripes[i].lock, NULL);
+	pthread_mutex_init(&(*pager)->txn_lock, NULL);
+	(*pager)->commit_seq = 0;
+	(*pager)->commit_npages = 0;
+	(*pager)->writers = 0;
+	(*pager)->closing = false;
+	pthread_cond_init(&(*pager)->committed, NULL);
+	(*pager)->snapshots = NULL;
+	(*pager)->nsnapshots = 0;
+	(*pager)->snapshots_size = 0;
 	(*pager)->f = fopen(filename, "r+");
 	
 	if ((*pager)->f == NULL)
@@ -70,6 +92,7 @@ int chidb_Pager_open(Pager **pager, const char *filename)
  * This function must be called before operating on pages.
  * It will not verify if the page size makes sense. If an incorrect
  * page size is provided, this will result in unexpected behaviour.
+ * Any pages cached with the previous page size are dropped.
  *
  * Parameters
  * - pager: A Pager.
@@ -78,8 +101,9 @@ int chidb_Pager_open(Pager **pager, const char *filename)
  * Return
  * - CHIDB_OK: Operation successful
  */
-int chidb_Pager_setPageSize(Pager *pager, uint16_t pagesize)
+int chidb_Pager_setPageSize(Pager *pager, uint32_t pagesize)
 {
+	chidb_Pager_flushCache(pager);
 	pager->page_size = pagesize;
 	chidb_Pager_getRealDBSize(pager, &pager->n_pages);
 	
@@ -104,9 +128,8 @@ int chidb_Pager_setPageSize(Pager *pager, uint16_t pagesize)
  */
 int chidb_Pager_readHeader(Pager *pager, uint8_t *header)
 {
-	int count;
-	count = fseek(pager->f, 0, SEEK_SET);
-	count = fread(header, 1, 100, pager->f);
+	ssize_t count;
+	count = pread(fileno(pager->f), header, 100, 0);
 	if (count != 100)
 		return CHIDB_NOHEADER;
 	else
@@ -127,17 +150,242 @@ int chidb_Pager_readHeader(Pager *pager, uint8_t *header)
 int chidb_Pager_allocatePage(Pager *pager, npage_t *npage)
 {
 	/* We simply increment the page number counter. readPage
-	 * and writePage take care of the rest. */
-	*npage = ++pager->n_pages;
+	 * and writePage take care of the rest. Other threads may be
+	 * reading pages in the meantime. */
+	*npage = __atomic_add_fetch(&pager->n_pages, 1, __ATOMIC_RELEASE);
 	
 	return CHIDB_OK;	
 }
 
 
+/* Pin a cached page
+ *
+ * The caller must hold the stripe's lock. The page is moved to the
+ * front of the stripe's LRU list.
+ *
+ * Return
+ * - The pinned page, or NULL if the page is not in the cache.
+ */
+static CachedPage *chidb_Pager_pinCached(PagerStripe *stripe, npage_t npage)
+{
+	CachedPage *cp;
+
+	for (cp = stripe->buckets[(npage / PAGER_CACHE_STRIPES) % PAGER_CACHE_BUCKETS]; cp != NULL; cp = cp->next)
+		if (cp->npage == npage)
+			break;
+	if (cp == NULL)
+		return NULL;
+
+	if (cp != stripe->lru_head) {
+		cp->lru_prev->lru_next = cp->lru_next;
+		if (cp->lru_next != NULL)
+			cp->lru_next->lru_prev = cp->lru_prev;
+		else
+			stripe->lru_tail = cp->lru_prev;
+		cp->lru_prev = NULL;
+		cp->lru_next = stripe->lru_head;
+		stripe->lru_head->lru_prev = cp;
+		stripe->lru_head = cp;
+	}
+	__atomic_add_fetch(&cp->pins, 1, __ATOMIC_RELAXED);
+	stripe->hits++;
+
+	return cp;
+}
+
+
+/* Remove a page from the cache and free it
+ *
+ * The caller must hold the stripe's lock, and the page must not be pinned.
+ */
+static void chidb_Pager_evictCached(PagerStripe *stripe, CachedPage *cp)
+{
+	CachedPage **link = &stripe->buckets[(cp->npage / PAGER_CACHE_STRIPES) % PAGER_CACHE_BUCKETS];
+
+	while (*link != cp)
+		link = &(*link)->next;
+	*link = cp->next;
+
+	if (cp->lru_prev != NULL)
+		cp->lru_prev->lru_next = cp->lru_next;
+	else
+		stripe->lru_head = cp->lru_next;
+	if (cp->lru_next != NULL)
+		cp->lru_next->lru_prev = cp->lru_prev;
+	else
+		stripe->lru_tail = cp->lru_prev;
+
+	stripe->npages--;
+	chidb_Pager_releaseKeys(cp->keys);
+	free(cp->data);
+	free(cp);
+}
+
+
+/* Add a page just read from the file to the cache
+ *
+ * The caller must hold the stripe's lock. If another thread has cached
+ * the page in the meantime, nothing is done. When the stripe is full,
+ * the least recently used page that is not pinned makes room for it; if
+ * every page is pinned, the page is simply not cached.
+ *
+ * Return
+ * - The cached page, or NULL if the page could not be cached.
+ */
+static CachedPage *chidb_Pager_cachePage(Pager *pager, PagerStripe *stripe, npage_t npage, const uint8_t *data)
+{
+	uint32_t limit = PAGER_CACHE_SIZE / pager->page_size / PAGER_CACHE_STRIPES;
+	CachedPage **bucket = &stripe->buckets[(npage / PAGER_CACHE_STRIPES) % PAGER_CACHE_BUCKETS];
+	CachedPage *cp;
+
+	for (cp = *bucket; cp != NULL; cp = cp->next)
+		if (cp->npage == npage)
+			return cp;
+
+	if (limit == 0)
+		limit = 1;
+	for (cp = stripe->lru_tail; cp != NULL && stripe->npages >= limit; ) {
+		CachedPage *prev = cp->lru_prev;
+		if (__atomic_load_n(&cp->pins, __ATOMIC_ACQUIRE) == 0)
+			chidb_Pager_evictCached(stripe, cp);
+		cp = prev;
+	}
+	if (stripe->npages >= limit)
+		return NULL;
+
+	cp = malloc(sizeof(CachedPage));
+	if (cp == NULL)
+		return NULL;
+	cp->data = malloc(pager->page_size);
+	if (cp->data == NULL) {
+		free(cp);
+		return NULL;
+	}
+	memcpy(cp->data, data, pager->page_size);
+	cp->npage = npage;
+	cp->image = ++stripe->images;
+	cp->keys = NULL;
+	cp->pins = 0;
+	cp->next = *bucket;
+	*bucket = cp;
+	cp->lru_prev = NULL;
+	cp->lru_next = stripe->lru_head;
+	if (stripe->lru_head != NULL)
+		stripe->lru_head->lru_prev = cp;
+	else
+		stripe->lru_tail = cp;
+	stripe->lru_head = cp;
+	stripe->npages++;
+
+	return cp;
+}
+
+
+/* Drop every cached page and every page version
+ *
+ * No other thread may be using the pager while this is done.
+ */
+static void chidb_Pager_flushCache(Pager *pager)
+{
+	for (int i = 0; i < PAGER_CACHE_STRIPES; i++) {
+		PagerStripe *stripe = &pager->stripes[i];
+
+		while (stripe->lru_head != NULL)
+			chidb_Pager_evictCached(stripe, stripe->lru_head);
+		for (int b = 0; b < PAGER_CACHE_BUCKETS; b++)
+			while (stripe->versions[b] != NULL) {
+				PageVersion *pv = stripe->versions[b];
+				stripe->versions[b] = pv->next;
+				free(pv->data);
+				free(pv);
+			}
+		stripe->nversions = 0;
+	}
+}
+
+
+/* Find the image of a page that a snapshot should read
+ *
+ * The caller must hold the stripe's lock.
+ *
+ * Return
+ * - The version valid for the snapshot, or NULL if the snapshot should
+ *   read the page itself.
+ */
+static PageVersion *chidb_Pager_findVersion(PagerStripe *stripe, npage_t npage, uint64_t snapshot)
+{
+	PageVersion *pv;
+
+	if (snapshot == PAGER_LATEST)
+		return NULL;
+	for (pv = stripe->versions[(npage / PAGER_CACHE_STRIPES) % PAGER_CACHE_BUCKETS]; pv != NULL; pv = pv->next)
+		if (pv->npage == npage && pv->from <= snapshot && snapshot < pv->until)
+			return pv;
+	return NULL;
+}
+
+
+/* Keep the current image of a page before a transaction overwrites it
+ *
+ * Nothing is done if the transaction already kept it. The caller must
+ * hold the stripe's lock, so the page cannot change in the meantime.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+static int chidb_Pager_keepVersion(Pager *pager, PagerStripe *stripe, npage_t npage, uint64_t txn)
+{
+	PageVersion **bucket = &stripe->versions[(npage / PAGER_CACHE_STRIPES) % PAGER_CACHE_BUCKETS];
+	PageVersion *pv, *newest;
+	CachedPage *cp;
+
+	/* Versions are added at the head of the bucket, newest first */
+	for (newest = *bucket; newest != NULL; newest = newest->next)
+		if (newest->npage == npage)
+			break;
+	if (newest != NULL && newest->until == txn)
+		return CHIDB_OK;
+
+	pv = malloc(sizeof(PageVersion));
+	if (pv == NULL)
+		return CHIDB_ENOMEM;
+	pv->data = calloc(pager->page_size, 1);
+	if (pv->data == NULL) {
+		free(pv);
+		return CHIDB_ENOMEM;
+	}
+
+	for (cp = stripe->buckets[(npage / PAGER_CACHE_STRIPES) % PAGER_CACHE_BUCKETS]; cp != NULL; cp = cp->next)
+		if (cp->npage == npage)
+			break;
+	if (cp != NULL)
+		memcpy(pv->data, cp->data, pager->page_size);
+	else if (pread(fileno(pager->f), pv->data, pager->page_size, (off_t) (npage - 1) * pager->page_size) < 0) {
+		free(pv->data);
+		free(pv);
+		return CHIDB_EIO;
+	}
+
+	/* If the older versions of the page have been dropped, no open
+	 * snapshot needs to tell them apart from this one */
+	pv->npage = npage;
+	pv->from = newest != NULL ? newest->until : 0;
+	pv->until = txn;
+	pv->next = *bucket;
+	*bucket = pv;
+	stripe->nversions++;
+
+	return CHIDB_OK;
+}
+
+
 /* Read a page from file
  *
- * This page reads a page from the file, and creates an in-memory copy
- * in a MemPage struct (see header file for more details on this struct).
+ * This page reads a page from the file (or from the cache), and creates
+ * an in-memory copy in a MemPage struct (see header file for more details
+ * on this struct). Several threads may read pages at the same time.
  * Always use chidb_Pager_releaseMemPage to free the memory allocated for
  * a MemPage created by this function.
  * Any changes done to a MemPage will not be effective until you call
@@ -155,20 +403,100 @@ int chidb_Pager_allocatePage(Pager *pager, npage_t *npage)
  */
 int	chidb_Pager_readPage(Pager *pager, npage_t npage, MemPage **page)
 {
-	if (npage > pager->n_pages)
+	return chidb_Pager_readPageAt(pager, npage, PAGER_LATEST, page);
+}
+
+
+/* Read a page as a snapshot sees it
+ *
+ * Like chidb_Pager_readPage, but the page is read as it was when the
+ * snapshot was opened (see chidb_Pager_openSnapshot), whatever has been
+ * written to it since.
+ *
+ * Parameters
+ * - pager: A Pager.
+ * - npage: Page number of page to read.
+ * - snapshot: An open snapshot, or PAGER_LATEST to read the page as it is.
+ * - page: Out parameter. Used to return a pointer to newly created MemPage
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: An I/O error has occurred when accessing the file
+ */
+int	chidb_Pager_readPageAt(Pager *pager, npage_t npage, uint64_t snapshot, MemPage **page)
+{
+	if (npage > __atomic_load_n(&pager->n_pages, __ATOMIC_ACQUIRE))
 		return CHIDB_EPAGENO;
-	int n;
+	PagerStripe *stripe = &pager->stripes[npage % PAGER_CACHE_STRIPES];
+	PageVersion *pv;
+	CachedPage *cp;
+	uint64_t writes;
+	ssize_t n;
 	
 	*page = malloc(sizeof(MemPage));
-	if (page == NULL)
+	if (*page == NULL)
 		return CHIDB_ENOMEM;
 	(*page)->npage = npage;
+	(*page)->keys = NULL;
+	(*page)->image = 0;
 	(*page)->data = calloc(pager->page_size, 1);
-	if ((*page)->data == NULL)
+	if ((*page)->data == NULL) {
+		free(*page);
 		return CHIDB_ENOMEM;
-	fseek(pager->f, (npage - 1) * pager->page_size, SEEK_SET);
-	n = fread((*page)->data, 1, pager->page_size, pager->f);
-	VTRACEF("Read %i bytes from page %i into memory [%x data: %x]", n, npage, *page, (*page)->data);
+	}
+
+	pthread_mutex_lock(&stripe->lock);
+	for (;;) {
+		pv = chidb_Pager_findVersion(stripe, npage, snapshot);
+		if (pv != NULL) {
+			memcpy((*page)->data, pv->data, pager->page_size);
+			pthread_mutex_unlock(&stripe->lock);
+			VTRACEF("Read page %i as of %lu [%x data: %x]", npage, snapshot, *page, (*page)->data);
+			return CHIDB_OK;
+		}
+
+		cp = chidb_Pager_pinCached(stripe, npage);
+		if (cp != NULL) {
+			(*page)->image = cp->image;
+			(*page)->keys = cp->keys;
+			if (cp->keys != NULL)
+				__atomic_add_fetch(&cp->keys->refs, 1, __ATOMIC_RELAXED);
+			pthread_mutex_unlock(&stripe->lock);
+			memcpy((*page)->data, cp->data, pager->page_size);
+			__atomic_sub_fetch(&cp->pins, 1, __ATOMIC_RELEASE);
+			VTRACEF("Read page %i from the cache [%x data: %x]", npage, *page, (*page)->data);
+			return CHIDB_OK;
+		}
+		writes = stripe->writes;
+		pthread_mutex_unlock(&stripe->lock);
+
+		n = pread(fileno(pager->f), (*page)->data, pager->page_size, (off_t) (npage - 1) * pager->page_size);
+		if (n < 0) {
+			free((*page)->data);
+			free(*page);
+			return CHIDB_EIO;
+		}
+		VTRACEF("Read %i bytes from page %i into memory [%x data: %x]", n, npage, *page, (*page)->data);
+
+		/* If a page of the stripe was written while we read, we may
+		 * have read this one half-written, or the snapshot may now
+		 * have to read a version of it */
+		pthread_mutex_lock(&stripe->lock);
+		if (stripe->writes == writes)
+			break;
+		memset((*page)->data, 0, pager->page_size);
+	}
+
+	/* A page past the end of the file (allocated, but not written yet)
+	 * is read as zeroes, and is not cached */
+	stripe->misses++;
+	if (n == pager->page_size) {
+		cp = chidb_Pager_cachePage(pager, stripe, npage, (*page)->data);
+		if (cp != NULL)
+			(*page)->image = cp->image;
+	}
+	pthread_mutex_unlock(&stripe->lock);
 	
 	return CHIDB_OK;
 }
@@ -177,7 +505,12 @@ int	chidb_Pager_readPage(Pager *pager, npage_t npage, MemPage **page)
 /* Write a page to file
  *
  * This page writes the in-memory copy of a page (stored in a MemPage
- * struct) back to disk.
+ * struct) back to disk, and updates the page's cached copy (if any),
+ * waiting for threads copying it out to be done. The key directories of
+ * the cached copy and of the MemPage are dropped, since they were built
+ * for the previous image.
+ * Within a transaction, the page's previous image is first kept for the
+ * open snapshots.
  *
  * Parameters
  * - pager: A Pager.
@@ -186,21 +519,73 @@ int	chidb_Pager_readPage(Pager *pager, npage_t npage, MemPage **page)
  * Return
  * - CHIDB_OK: Operation successful
  * - CHIDB_EPAGENO: The page has an incorrect page number
+ * - CHIDB_ENOMEM: Could not allocate memory
  * - CHIDB_EIO: An I/O error has occurred when accessing the file
  */
 int	chidb_Pager_writePage(Pager *pager, MemPage *page)
 {
-	if (page->npage > pager->n_pages)
+	if (page->npage > __atomic_load_n(&pager->n_pages, __ATOMIC_ACQUIRE))
 		return CHIDB_EPAGENO;
-	int n;
-	fseek(pager->f, (page->npage - 1) * pager->page_size, SEEK_SET);
-	n = fwrite(page->data, 1, pager->page_size, pager->f);
+	PagerStripe *stripe = &pager->stripes[page->npage % PAGER_CACHE_STRIPES];
+	CachedPage *cp;
+	bool versioned;
+	uint64_t txn, image;
+	ssize_t n;
+	int error;
+
+	/* Pages added since the last commit cannot be seen by any snapshot */
+	pthread_mutex_lock(&pager->txn_lock);
+	versioned = pager->writers > 0 && page->npage <= pager->commit_npages;
+	txn = pager->commit_seq + 1;
+	pthread_mutex_unlock(&pager->txn_lock);
+
+	pthread_mutex_lock(&stripe->lock);
+	if (versioned) {
+		error = chidb_Pager_keepVersion(pager, stripe, page->npage, txn);
+		if (error != CHIDB_OK) {
+			pthread_mutex_unlock(&stripe->lock);
+			return error;
+		}
+	}
+
+	stripe->writes++;
+	n = pwrite(fileno(pager->f), page->data, pager->page_size, (off_t) (page->npage - 1) * pager->page_size);
 	VTRACEF("Wrote %i bytes to page %i", n, page->npage);
+	if (n != pager->page_size) {
+		pthread_mutex_unlock(&stripe->lock);
+		return CHIDB_EIO;
+	}
+
+	for (cp = stripe->buckets[(page->npage / PAGER_CACHE_STRIPES) % PAGER_CACHE_BUCKETS]; cp != NULL; cp = cp->next)
+		if (cp->npage == page->npage)
+			break;
+	if (cp != NULL) {
+		/* Nobody can pin the page while we hold the lock */
+		while (__atomic_load_n(&cp->pins, __ATOMIC_ACQUIRE) > 0)
+			sched_yield();
+		memcpy(cp->data, page->data, pager->page_size);
+		cp->image = ++stripe->images;
+		chidb_Pager_releaseKeys(cp->keys);
+		cp->keys = NULL;
+	}
+	image = cp != NULL ? cp->image : 0;
+	pthread_mutex_unlock(&stripe->lock);
+
+	/* Whoever wrote the page may have changed it without telling its
+	 * directory; it is rebuilt from what was written if it is needed */
+	chidb_Pager_releaseKeys(page->keys);
+	page->keys = NULL;
+	page->image = image;
+
 	return CHIDB_OK;
 }
 
 
 /* Release an in-memory copy of a page
+ *
+ * If a key directory was built for the page while it was still a copy
+ * of the cached image, and the cached page has none, the cached page
+ * keeps it for the next readers.
  *
  * Parameters
  * - pager: A Pager.
@@ -212,10 +597,25 @@ int	chidb_Pager_writePage(Pager *pager, MemPage *page)
  */
 int	chidb_Pager_releaseMemPage(Pager *pager, MemPage *page)
 {
-	if (page->npage > pager->n_pages)
+	if (page->npage > __atomic_load_n(&pager->n_pages, __ATOMIC_ACQUIRE))
 		return CHIDB_EPAGENO;
 
 	VTRACEF("Releasing page %i from memory [%x data: %x]", page->npage, page, page->data);
+	if (page->keys != NULL && page->image != 0) {
+		PagerStripe *stripe = &pager->stripes[page->npage % PAGER_CACHE_STRIPES];
+		CachedPage *cp;
+
+		pthread_mutex_lock(&stripe->lock);
+		for (cp = stripe->buckets[(page->npage / PAGER_CACHE_STRIPES) % PAGER_CACHE_BUCKETS]; cp != NULL; cp = cp->next)
+			if (cp->npage == page->npage)
+				break;
+		if (cp != NULL && cp->image == page->image && cp->keys == NULL) {
+			cp->keys = page->keys;
+			page->keys = NULL;
+		}
+		pthread_mutex_unlock(&stripe->lock);
+	}
+	chidb_Pager_releaseKeys(page->keys);
 	free(page->data);
 	free(page);
 	
@@ -223,6 +623,18 @@ int	chidb_Pager_releaseMemPage(Pager *pager, MemPage *page)
 }
 
 
+/* Drop a reference to a key directory, freeing it with the last one
+ *
+ * Parameters
+ * - keys: A key directory, or NULL.
+ */
+void chidb_Pager_releaseKeys(PageKeys *keys)
+{
+	if (keys != NULL && __atomic_sub_fetch(&keys->refs, 1, __ATOMIC_ACQ_REL) == 0)
+		free(keys);
+}
+
+
 /* Computes the number of pages in a file.
  *
  * Parameters
@@ -242,6 +654,209 @@ int chidb_Pager_getRealDBSize(Pager *pager, npage_t *npages)
 }
 
 
+/* Counts the reads served from the cache, and those that went to the file.
+ *
+ * Parameters
+ * - pager: A Pager.
+ * - hits: Out parameter. Reads served from the cache.
+ * - misses: Out parameter. Reads that went to the file.
+ */
+void chidb_Pager_cacheStats(Pager *pager, uint64_t *hits, uint64_t *misses)
+{
+	*hits = *misses = 0;
+	for (int i = 0; i < PAGER_CACHE_STRIPES; i++) {
+		pthread_mutex_lock(&pager->stripes[i].lock);
+		*hits += pager->stripes[i].hits;
+		*misses += pager->stripes[i].misses;
+		pthread_mutex_unlock(&pager->stripes[i].lock);
+	}
+}
+
+
+/* Start writing as part of the current transaction
+ *
+ * Threads writing at the same time share a transaction, which commits
+ * when the last of them calls chidb_Pager_endWrite. Snapshots opened
+ * until then do not see any of its writes. Once one of its writers has
+ * called chidb_Pager_endWrite, the transaction takes no new writers: they
+ * wait here until it commits, and start the next one. Writes made outside
+ * a transaction are seen by every snapshot.
+ *
+ * Parameters
+ * - pager: A Pager.
+ */
+void chidb_Pager_beginWrite(Pager *pager)
+{
+	pthread_mutex_lock(&pager->txn_lock);
+	while (pager->closing)
+		pthread_cond_wait(&pager->committed, &pager->txn_lock);
+	if (pager->writers++ == 0)
+		pager->commit_npages = __atomic_load_n(&pager->n_pages, __ATOMIC_ACQUIRE);
+	pthread_mutex_unlock(&pager->txn_lock);
+}
+
+
+/* Stop writing, committing the transaction if nobody else is writing
+ *
+ * If other writers are still in the transaction, this waits until the
+ * last of them is done and the transaction commits, so that snapshots
+ * opened by the caller afterwards see its writes.
+ *
+ * Parameters
+ * - pager: A Pager.
+ */
+void chidb_Pager_endWrite(Pager *pager)
+{
+	bool committed;
+	uint64_t txn;
+
+	pthread_mutex_lock(&pager->txn_lock);
+	txn = pager->commit_seq + 1;
+	committed = --pager->writers == 0;
+	if (committed) {
+		pager->commit_seq = txn;
+		pager->closing = false;
+		pthread_cond_broadcast(&pager->committed);
+	} else {
+		pager->closing = true;
+		while (pager->commit_seq < txn)
+			pthread_cond_wait(&pager->committed, &pager->txn_lock);
+	}
+	pthread_mutex_unlock(&pager->txn_lock);
+
+	if (committed)
+		chidb_Pager_collectVersions(pager);
+}
+
+
+/* Open a snapshot of the file as of the last commit
+ *
+ * Reading pages at the snapshot (see chidb_Pager_readPageAt) shows them
+ * as they were at that commit until the snapshot is closed.
+ *
+ * Parameters
+ * - pager: A Pager.
+ * - snapshot: Out parameter. The snapshot.
+ * - npages: Out parameter. Number of pages in the file as of the snapshot.
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+int chidb_Pager_openSnapshot(Pager *pager, uint64_t *snapshot, npage_t *npages)
+{
+	pthread_mutex_lock(&pager->txn_lock);
+	if (pager->nsnapshots == pager->snapshots_size) {
+		uint32_t size = pager->snapshots_size == 0 ? 8 : 2 * pager->snapshots_size;
+		uint64_t *grown = realloc(pager->snapshots, size * sizeof(uint64_t));
+		if (grown == NULL) {
+			pthread_mutex_unlock(&pager->txn_lock);
+			return CHIDB_ENOMEM;
+		}
+		pager->snapshots = grown;
+		pager->snapshots_size = size;
+	}
+	*snapshot = pager->commit_seq;
+	*npages = pager->writers > 0 ? pager->commit_npages : __atomic_load_n(&pager->n_pages, __ATOMIC_ACQUIRE);
+	pager->snapshots[pager->nsnapshots++] = *snapshot;
+	pthread_mutex_unlock(&pager->txn_lock);
+
+	return CHIDB_OK;
+}
+
+
+/* Close a snapshot
+ *
+ * Parameters
+ * - pager: A Pager.
+ * - snapshot: A snapshot opened by chidb_Pager_openSnapshot.
+ */
+void chidb_Pager_closeSnapshot(Pager *pager, uint64_t snapshot)
+{
+	pthread_mutex_lock(&pager->txn_lock);
+	for (uint32_t i = 0; i < pager->nsnapshots; i++)
+		if (pager->snapshots[i] == snapshot) {
+			pager->snapshots[i] = pager->snapshots[--pager->nsnapshots];
+			break;
+		}
+	pthread_mutex_unlock(&pager->txn_lock);
+
+	chidb_Pager_collectVersions(pager);
+}
+
+
+/* Drop the page versions that no open snapshot can read
+ *
+ * A version kept by a transaction that has not committed yet is never
+ * dropped: snapshots opened before it commits will need it. Snapshots
+ * opened while this runs are as of the last commit, so none of them can
+ * read a version that is dropped.
+ */
+static void chidb_Pager_collectVersions(Pager *pager)
+{
+	uint64_t *snapshots, commit_seq;
+	uint32_t nsnapshots;
+
+	pthread_mutex_lock(&pager->txn_lock);
+	commit_seq = pager->commit_seq;
+	nsnapshots = pager->nsnapshots;
+	snapshots = malloc((nsnapshots + 1) * sizeof(uint64_t));
+	if (snapshots != NULL)
+		memcpy(snapshots, pager->snapshots, nsnapshots * sizeof(uint64_t));
+	pthread_mutex_unlock(&pager->txn_lock);
+	if (snapshots == NULL)
+		return;
+
+	for (int i = 0; i < PAGER_CACHE_STRIPES; i++) {
+		PagerStripe *stripe = &pager->stripes[i];
+
+		pthread_mutex_lock(&stripe->lock);
+		for (int b = 0; b < PAGER_CACHE_BUCKETS; b++) {
+			PageVersion **link = &stripe->versions[b];
+
+			while (*link != NULL) {
+				PageVersion *pv = *link;
+				bool needed = pv->until > commit_seq;
+
+				for (uint32_t s = 0; s < nsnapshots && !needed; s++)
+					needed = pv->from <= snapshots[s] && snapshots[s] < pv->until;
+				if (needed) {
+					link = &pv->next;
+					continue;
+				}
+				*link = pv->next;
+				stripe->nversions--;
+				free(pv->data);
+				free(pv);
+			}
+		}
+		pthread_mutex_unlock(&stripe->lock);
+	}
+	free(snapshots);
+}
+
+
+/* Counts the page versions kept for open snapshots.
+ *
+ * Parameters
+ * - pager: A Pager.
+ *
+ * Return
+ * - Number of versions
+ */
+uint32_t chidb_Pager_countVersions(Pager *pager)
+{
+	uint32_t nversions = 0;
+
+	for (int i = 0; i < PAGER_CACHE_STRIPES; i++) {
+		pthread_mutex_lock(&pager->stripes[i].lock);
+		nversions += pager->stripes[i].nversions;
+		pthread_mutex_unlock(&pager->stripes[i].lock);
+	}
+	return nversions;
+}
+
+
 /* Closes a pager and frees up all resources used by the pager.
  *
  * Parameters
@@ -253,6 +868,12 @@ int chidb_Pager_getRealDBSize(Pager *pager, npage_t *npages)
  */
 int chidb_Pager_close(Pager *pager)
 {
+	chidb_Pager_flushCache(pager);
+	for (int i = 0; i < PAGER_CACHE_STRIPES; i++)
+		pthread_mutex_destroy(&pager->stripes[i].lock);
+	pthread_mutex_destroy(&pager->txn_lock);
+	pthread_cond_destroy(&pager->committed);
+	free(pager->snapshots);
 	fclose(pager->f);
 	free(pager);
 	
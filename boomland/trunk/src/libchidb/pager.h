@@ -2,31 +2,133 @@
 #define PAGER_H_
 
 #include <stdio.h>
+#include <pthread.h>
 #include <chidbInt.h>
 
+/* Pages that have been read are kept in a cache shared by every thread
+ * using the pager. The cache is split into stripes (a page goes to the
+ * stripe picked by its number), each with its own lock, so that threads
+ * reading different pages seldom wait on each other. A thread copies a
+ * cached page out without holding the stripe's lock; while it does, the
+ * page is pinned, and a pinned page is neither evicted nor overwritten. */
+
+#define PAGER_CACHE_STRIPES (16)
+#define PAGER_CACHE_BUCKETS (256)	/* Hash buckets per stripe */
+#define PAGER_CACHE_SIZE (8 << 20)	/* Bytes of pages kept in the cache */
+
+/* Writes happen in transactions (see chidb_Pager_beginWrite), numbered
+ * one past the last committed one. Writers that overlap share a
+ * transaction, which commits when the last of them is done; once one of
+ * them is done, new writers wait for that commit before they start, so a
+ * transaction cannot be kept open by writers that keep arriving. A writer
+ * is only done once its transaction has committed, so the thread that
+ * wrote sees its writes from then on. A reader may open a snapshot of the
+ * file as of the last commit (see chidb_Pager_openSnapshot); before a
+ * transaction first overwrites a page that a snapshot could see, the
+ * page's previous image is kept as a PageVersion, valid for snapshots
+ * from the transaction that wrote it up to the one that overwrote it.
+ * A reader with a snapshot reads the image that is valid for it, or the
+ * page itself if there is none. Images that no open snapshot can read
+ * are dropped when a transaction commits or a snapshot is closed. */
+
+#define PAGER_LATEST (UINT64_MAX)	/* Not a snapshot: reads see every write */
+
+/* The key of every cell of a B-Tree node, decoded by the B-Tree module
+ * (see chidb_Btree_findSlot). A directory built for a page read from the
+ * cache is handed to the cached page when the MemPage is released, and
+ * shared (never copied) with the MemPages read from it afterwards, until
+ * the page is written or evicted. A directory never changes once built. */
+struct PageKeys
+{
+	uint32_t refs;		/* Cached page and MemPages holding it (changed atomically) */
+	uint32_t n;		/* Number of keys */
+	uint32_t keys[];
+};
+typedef struct PageKeys PageKeys;
+
 struct MemPage
 {
 	npage_t npage;
 	uint8_t *data;
+	PageKeys *keys;		/* Key directory of data, or NULL */
+	uint64_t image;		/* Cached image data is a copy of (0 if none, or if data changed) */
 };
 typedef struct MemPage MemPage;
 
+struct CachedPage
+{
+	npage_t npage;
+	uint8_t *data;
+	uint64_t image;		/* Stamp of data, changed whenever the page is written */
+	PageKeys *keys;		/* Key directory of data, or NULL */
+	uint32_t pins;		/* Threads copying data (changed atomically) */
+	struct CachedPage *next;	/* Next page in the same bucket */
+	struct CachedPage *lru_prev;	/* More recently used page */
+	struct CachedPage *lru_next;	/* Less recently used page */
+};
+typedef struct CachedPage CachedPage;
+
+struct PageVersion
+{
+	npage_t npage;
+	uint64_t from;		/* Oldest snapshot that may read this image */
+	uint64_t until;		/* Transaction that overwrote it */
+	uint8_t *data;
+	struct PageVersion *next;	/* Next (older) version in the same bucket */
+};
+typedef struct PageVersion PageVersion;
+
+struct PagerStripe
+{
+	pthread_mutex_t lock;	/* Guards everything below (but not pins) */
+	CachedPage *buckets[PAGER_CACHE_BUCKETS];
+	CachedPage *lru_head;	/* Most recently used page */
+	CachedPage *lru_tail;	/* Least recently used page */
+	uint32_t npages;	/* Pages in the stripe */
+	uint64_t images;	/* Page images cached so far (stamps them) */
+	PageVersion *versions[PAGER_CACHE_BUCKETS];
+	uint32_t nversions;	/* Versions in the stripe */
+	uint64_t writes;	/* Pages of the stripe written so far */
+	uint64_t hits;		/* Reads served from the stripe */
+	uint64_t misses;	/* Reads that went to the file */
+};
+typedef struct PagerStripe PagerStripe;
+
 struct Pager
 {
 	FILE *f;
 	npage_t n_pages;
-	uint16_t page_size;
+	uint32_t page_size;
+	PagerStripe stripes[PAGER_CACHE_STRIPES];
+
+	pthread_mutex_t txn_lock;	/* Guards everything below */
+	uint64_t commit_seq;	/* Last committed transaction */
+	npage_t commit_npages;	/* Pages in the file when the current transaction began */
+	uint32_t writers;	/* Threads in the current transaction */
+	bool closing;		/* A writer is done: the transaction takes no more */
+	pthread_cond_t committed;	/* Signalled when a transaction commits */
+	uint64_t *snapshots;	/* Open snapshots (a snapshot may be open twice) */
+	uint32_t nsnapshots;	/* Number of open snapshots */
+	uint32_t snapshots_size;	/* Allocated length of snapshots */
 };
 typedef struct Pager Pager;
 
 int chidb_Pager_open(Pager **pager, const char *filename);
-int chidb_Pager_setPageSize(Pager *pager, uint16_t pagesize);
+int chidb_Pager_setPageSize(Pager *pager, uint32_t pagesize);
 int chidb_Pager_readHeader(Pager *pager, uint8_t *header);
 int chidb_Pager_allocatePage(Pager *pager, npage_t *npage);
 int chidb_Pager_releaseMemPage(Pager *pager, MemPage *page);
 int	chidb_Pager_readPage(Pager *pager, npage_t page_num, MemPage **page);
+int	chidb_Pager_readPageAt(Pager *pager, npage_t page_num, uint64_t snapshot, MemPage **page);
 int chidb_Pager_writePage(Pager *pager, MemPage *page);
+void chidb_Pager_releaseKeys(PageKeys *keys);
 int chidb_Pager_getRealDBSize(Pager *pager, npage_t *npages);
+void chidb_Pager_cacheStats(Pager *pager, uint64_t *hits, uint64_t *misses);
+void chidb_Pager_beginWrite(Pager *pager);
+void chidb_Pager_endWrite(Pager *pager);
+int chidb_Pager_openSnapshot(Pager *pager, uint64_t *snapshot, npage_t *npages);
+void chidb_Pager_closeSnapshot(Pager *pager, uint64_t snapshot);
+uint32_t chidb_Pager_countVersions(Pager *pager);
 int chidb_Pager_close(Pager *pager);
 
 #endif /*PAGER_H_*/
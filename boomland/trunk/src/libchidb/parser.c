@@ -11,6 +11,8 @@ int chidb_parser_initSelectStmt(SQLStatement *stmt)
 	stmt->query.select.from_tables = NULL;
 	stmt->query.select.where_nconds = 0;
 	stmt->query.select.where_conds = NULL;
+	stmt->query.select.group_ncols = 0;
+	stmt->query.select.group_cols = NULL;
 	
 	return CHIDB_OK;
 }
@@ -21,10 +23,55 @@ int chidb_parser_addSelectColumn(SQLStatement *stmt, char *table, char *col)
 	stmt->query.select.select_cols = realloc(stmt->query.select.select_cols, stmt->query.select.select_ncols * sizeof(Column));
 	stmt->query.select.select_cols[stmt->query.select.select_ncols-1].table = table;
 	stmt->query.select.select_cols[stmt->query.select.select_ncols-1].name = col;
+	stmt->query.select.select_cols[stmt->query.select.select_ncols-1].agg = AGG_NONE;
 	
 	return CHIDB_OK;
 }
 
+int chidb_parser_addSelectAggregate(SQLStatement *stmt, uint8_t agg, char *table, char *col)
+{
+	chidb_parser_addSelectColumn(stmt, table, col);
+	stmt->query.select.select_cols[stmt->query.select.select_ncols-1].agg = agg;
+	
+	return CHIDB_OK;
+}
+
+int chidb_parser_addGroupByColumn(SQLStatement *stmt, char *table, char *col)
+{
+	stmt->query.select.group_ncols++;
+	stmt->query.select.group_cols = realloc(stmt->query.select.group_cols, stmt->query.select.group_ncols * sizeof(Column));
+	stmt->query.select.group_cols[stmt->query.select.group_ncols-1].table = table;
+	stmt->query.select.group_cols[stmt->query.select.group_ncols-1].name = col;
+	stmt->query.select.group_cols[stmt->query.select.group_ncols-1].agg = AGG_NONE;
+	
+	return CHIDB_OK;
+}
+
+bool chidb_parser_hasAggregates(SelectStatement *select)
+{
+	if (select->group_ncols > 0)
+		return true;
+	
+	for(int i = 0; i < select->select_ncols; i++)
+		if (select->select_cols[i].agg != AGG_NONE)
+			return true;
+	
+	return false;
+}
+
+const char* chidb_parser_aggregateName(uint8_t agg)
+{
+	switch(agg)
+	{
+		case AGG_COUNT: return "COUNT";
+		case AGG_SUM: return "SUM";
+		case AGG_MIN: return "MIN";
+		case AGG_MAX: return "MAX";
+		case AGG_AVG: return "AVG";
+	}
+	return NULL;
+}
+
 int chidb_parser_addFromTable(SQLStatement *stmt, char *table)
 {
 	stmt->query.select.from_ntables++;
@@ -34,29 +81,63 @@ int chidb_parser_addFromTable(SQLStatement *stmt, char *table)
 	return CHIDB_OK;
 }
 
+/* SELECT, DELETE and UPDATE all have a WHERE clause */
+static void chidb_parser_whereClause(SQLStatement *stmt, uint8_t **nconds, Condition ***conds)
+{
+	switch(stmt->type)
+	{
+		case STMT_DELETE:
+			*nconds = &stmt->query.delete.where_nconds;
+			*conds = &stmt->query.delete.where_conds;
+			break;
+		case STMT_UPDATE:
+			*nconds = &stmt->query.update.where_nconds;
+			*conds = &stmt->query.update.where_conds;
+			break;
+		default:
+			*nconds = &stmt->query.select.where_nconds;
+			*conds = &stmt->query.select.where_conds;
+	}
+}
+
+/* The condition being parsed */
+static Condition *chidb_parser_lastCondition(SQLStatement *stmt)
+{
+	uint8_t *nconds;
+	Condition **conds;
+	
+	chidb_parser_whereClause(stmt, &nconds, &conds);
+	return &(*conds)[*nconds - 1];
+}
+
 int chidb_parser_newCondition(SQLStatement *stmt)
 {
-	stmt->query.select.where_nconds++;
-	stmt->query.select.where_conds = realloc(stmt->query.select.where_conds, stmt->query.select.where_nconds * sizeof(Condition));
+	uint8_t *nconds;
+	Condition **conds;
+	
+	chidb_parser_whereClause(stmt, &nconds, &conds);
+	(*nconds)++;
+	*conds = realloc(*conds, *nconds * sizeof(Condition));
 	
 	return CHIDB_OK;
 }
 
 int chidb_parser_setConditionOperand1(SQLStatement *stmt, char *table, char *col)
 {
-	int ncond = stmt->query.select.where_nconds - 1;
+	Condition *cond = chidb_parser_lastCondition(stmt);
 	
-	stmt->query.select.where_conds[ncond].op1.table = table;
-	stmt->query.select.where_conds[ncond].op1.name = col;
+	cond->op1.table = table;
+	cond->op1.name = col;
+	cond->op1.agg = AGG_NONE;
 	
 	return CHIDB_OK;
 }
 
 int chidb_parser_setConditionOperator(SQLStatement *stmt, uint8_t op)
 {
-	int ncond = stmt->query.select.where_nconds - 1;
+	Condition *cond = chidb_parser_lastCondition(stmt);
 	
-	stmt->query.select.where_conds[ncond].op = op;
+	cond->op = op;
 	
 	return CHIDB_OK;
 }
@@ -64,31 +145,42 @@ int chidb_parser_setConditionOperator(SQLStatement *stmt, uint8_t op)
 
 int chidb_parser_setConditionOperand2Integer(SQLStatement *stmt, int v)
 {
-	int ncond = stmt->query.select.where_nconds - 1;
+	Condition *cond = chidb_parser_lastCondition(stmt);
 	
-	stmt->query.select.where_conds[ncond].op2Type = OP2_INT;
-	stmt->query.select.where_conds[ncond].op2.integer = v;
+	cond->op2Type = OP2_INT;
+	cond->op2.integer = v;
+	
+	return CHIDB_OK;
+}
+
+int chidb_parser_setConditionOperand2Param(SQLStatement *stmt)
+{
+	Condition *cond = chidb_parser_lastCondition(stmt);
+	
+	cond->op2Type = OP2_PARAM;
+	cond->op2.integer = ++stmt->nparams;
 	
 	return CHIDB_OK;
 }
 
 int chidb_parser_setConditionOperand2String(SQLStatement *stmt, char *v)
 {
-	int ncond = stmt->query.select.where_nconds - 1;
+	Condition *cond = chidb_parser_lastCondition(stmt);
 	
-	stmt->query.select.where_conds[ncond].op2Type = OP2_STR;
-	stmt->query.select.where_conds[ncond].op2.string = v;
+	cond->op2Type = OP2_STR;
+	cond->op2.string = v;
 	
 	return CHIDB_OK;
 }
 
 int chidb_parser_setConditionOperand2Column(SQLStatement *stmt, char *table, char *col)
 {
-	int ncond = stmt->query.select.where_nconds - 1;
+	Condition *cond = chidb_parser_lastCondition(stmt);
 	
-	stmt->query.select.where_conds[ncond].op2Type = OP2_COL;
-	stmt->query.select.where_conds[ncond].op2.col.table = table;
-	stmt->query.select.where_conds[ncond].op2.col.name = col;
+	cond->op2Type = OP2_COL;
+	cond->op2.col.table = table;
+	cond->op2.col.name = col;
+	cond->op2.col.agg = AGG_NONE;
 	
 	return CHIDB_OK;
 }
@@ -97,6 +189,9 @@ int chidb_parser_initInsertStmt(SQLStatement *stmt)
 {
 	stmt->type = STMT_INSERT;
 	stmt->query.insert.nvalues = 0;
+	stmt->query.insert.nrows = 0;
+	stmt->query.insert.ntotal = 0;
+	stmt->query.insert.size = 0;
 	stmt->query.insert.values = NULL;
 	
 	return CHIDB_OK;
@@ -109,35 +204,163 @@ int chidb_parser_setInsertTable(SQLStatement *stmt, char *table)
 	return CHIDB_OK;
 }
 
+/* Values of large multi-row INSERTs add up, so the array grows geometrically */
+static Value *chidb_parser_newInsertValue(SQLStatement *stmt)
+{
+	InsertStatement *insert = &stmt->query.insert;
+	
+	if (insert->ntotal == insert->size)
+	{
+		uint32_t size = insert->size ? 2 * insert->size : 8;
+		Value *values = realloc(insert->values, size * sizeof(Value));
+		if (values == NULL)
+			return NULL;
+		insert->values = values;
+		insert->size = size;
+	}
+	
+	return &insert->values[insert->ntotal++];
+}
+
 int chidb_parser_addInsertIntValue(SQLStatement *stmt, int v)
 {
-	stmt->query.insert.nvalues++;
-	stmt->query.insert.values = realloc(stmt->query.insert.values, stmt->query.insert.nvalues * sizeof(Value));
-	stmt->query.insert.values[stmt->query.insert.nvalues-1].type = INS_INT;
-	stmt->query.insert.values[stmt->query.insert.nvalues-1].val.integer = v;
+	Value *value = chidb_parser_newInsertValue(stmt);
+	if (value == NULL)
+		return CHIDB_ENOMEM;
+	value->type = INS_INT;
+	value->val.integer = v;
 	
 	return CHIDB_OK;
 }
 
 int chidb_parser_addInsertStrValue(SQLStatement *stmt, char *v)
 {
-	stmt->query.insert.nvalues++;
-	stmt->query.insert.values = realloc(stmt->query.insert.values, stmt->query.insert.nvalues * sizeof(Value));
-	stmt->query.insert.values[stmt->query.insert.nvalues-1].type = INS_STR;
-	stmt->query.insert.values[stmt->query.insert.nvalues-1].val.string = v;
+	Value *value = chidb_parser_newInsertValue(stmt);
+	if (value == NULL)
+		return CHIDB_ENOMEM;
+	value->type = INS_STR;
+	value->val.string = v;
 	
 	return CHIDB_OK;	
 }
 
 int chidb_parser_addInsertNullValue(SQLStatement *stmt)
 {
-	stmt->query.insert.nvalues++;
-	stmt->query.insert.values = realloc(stmt->query.insert.values, stmt->query.insert.nvalues * sizeof(Value));
-	stmt->query.insert.values[stmt->query.insert.nvalues-1].type = INS_NULL;
+	Value *value = chidb_parser_newInsertValue(stmt);
+	if (value == NULL)
+		return CHIDB_ENOMEM;
+	value->type = INS_NULL;
+	
+	return CHIDB_OK;	
+}
+
+int chidb_parser_addInsertParamValue(SQLStatement *stmt)
+{
+	Value *value = chidb_parser_newInsertValue(stmt);
+	if (value == NULL)
+		return CHIDB_ENOMEM;
+	value->type = INS_PARAM;
+	value->val.integer = ++stmt->nparams;
 	
 	return CHIDB_OK;	
 }
 
+/* Closes a row of the VALUES list; every row must have as many values
+ * as the first one */
+int chidb_parser_endInsertRow(SQLStatement *stmt)
+{
+	InsertStatement *insert = &stmt->query.insert;
+	uint32_t nvalues = insert->ntotal - insert->nrows * insert->nvalues;
+	
+	if (insert->nrows == 0 && nvalues <= 0xFF)
+		insert->nvalues = nvalues;
+	else if (insert->nrows == 0 || nvalues != insert->nvalues)
+		return CHIDB_EINVALIDSQL;
+	insert->nrows++;
+	
+	return CHIDB_OK;
+}
+
+
+int chidb_parser_initDeleteStmt(SQLStatement *stmt, char *table)
+{
+	stmt->type = STMT_DELETE;
+	stmt->query.delete.table = table;
+	stmt->query.delete.where_nconds = 0;
+	stmt->query.delete.where_conds = NULL;
+	
+	return CHIDB_OK;
+}
+
+int chidb_parser_initUpdateStmt(SQLStatement *stmt, char *table)
+{
+	stmt->type = STMT_UPDATE;
+	stmt->query.update.table = table;
+	stmt->query.update.set_ncols = 0;
+	stmt->query.update.set_cols = NULL;
+	stmt->query.update.set_values = NULL;
+	stmt->query.update.where_nconds = 0;
+	stmt->query.update.where_conds = NULL;
+	
+	return CHIDB_OK;
+}
+
+int chidb_parser_addUpdateColumn(SQLStatement *stmt, char *col)
+{
+	UpdateStatement *update = &stmt->query.update;
+	
+	update->set_ncols++;
+	update->set_cols = realloc(update->set_cols, update->set_ncols * sizeof(Column));
+	update->set_values = realloc(update->set_values, update->set_ncols * sizeof(Value));
+	update->set_cols[update->set_ncols-1].table = NULL;
+	update->set_cols[update->set_ncols-1].name = col;
+	update->set_cols[update->set_ncols-1].agg = AGG_NONE;
+	update->set_values[update->set_ncols-1].type = INS_NULL;
+	
+	return CHIDB_OK;
+}
+
+/* The value of the column added last to the SET clause */
+static Value *chidb_parser_lastUpdateValue(SQLStatement *stmt)
+{
+	return &stmt->query.update.set_values[stmt->query.update.set_ncols-1];
+}
+
+int chidb_parser_setUpdateIntValue(SQLStatement *stmt, int v)
+{
+	Value *value = chidb_parser_lastUpdateValue(stmt);
+	value->type = INS_INT;
+	value->val.integer = v;
+	
+	return CHIDB_OK;
+}
+
+int chidb_parser_setUpdateStrValue(SQLStatement *stmt, char *v)
+{
+	Value *value = chidb_parser_lastUpdateValue(stmt);
+	value->type = INS_STR;
+	value->val.string = v;
+	
+	return CHIDB_OK;
+}
+
+int chidb_parser_setUpdateNullValue(SQLStatement *stmt)
+{
+	Value *value = chidb_parser_lastUpdateValue(stmt);
+	value->type = INS_NULL;
+	
+	return CHIDB_OK;
+}
+
+int chidb_parser_setUpdateParamValue(SQLStatement *stmt)
+{
+	Value *value = chidb_parser_lastUpdateValue(stmt);
+	value->type = INS_PARAM;
+	value->val.integer = ++stmt->nparams;
+	
+	return CHIDB_OK;
+}
+
 
 int chidb_parser_initCreateTableStmt(SQLStatement *stmt)
 {
@@ -175,6 +398,23 @@ int chidb_parser_initCreateIndexStmt(SQLStatement *stmt, char* index, char *tabl
 	stmt->query.createIndex.index = index;
 	stmt->query.createIndex.on.table = table;
 	stmt->query.createIndex.on.name = col;
+	stmt->query.createIndex.on.agg = AGG_NONE;
+	stmt->query.createIndex.nkeys = 1;
+	stmt->query.createIndex.ncols = 1;
+	stmt->query.createIndex.cols = malloc(sizeof(char *));
+	stmt->query.createIndex.cols[0] = col;
+	
+	return CHIDB_OK;
+}
+
+int chidb_parser_addCreateIndexColumn(SQLStatement *stmt, char *col, bool include)
+{
+	stmt->query.createIndex.ncols++;
+	stmt->query.createIndex.cols = realloc(stmt->query.createIndex.cols, stmt->query.createIndex.ncols * sizeof(char *));
+	stmt->query.createIndex.cols[stmt->query.createIndex.ncols-1] = col;
+	
+	if(!include)
+		stmt->query.createIndex.nkeys++;
 	
 	return CHIDB_OK;
 }
@@ -193,6 +433,12 @@ int chidb_parser_SQLStatement_destroyInternal(SQLStatement stmt) {
   case STMT_INSERT:
     chidb_parser_InsertStatement_destroyInternal(stmt.query.insert);
     break;
+  case STMT_DELETE:
+    chidb_parser_DeleteStatement_destroyInternal(stmt.query.delete);
+    break;
+  case STMT_UPDATE:
+    chidb_parser_UpdateStatement_destroyInternal(stmt.query.update);
+    break;
   case STMT_CREATETABLE:
     chidb_parser_CreateTableStatement_destroyInternal(stmt.query.createTable);
     break;
@@ -212,17 +458,42 @@ int chidb_parser_SelectStatement_destroyInternal(SelectStatement select) {
   for(int i = 0; i < select.where_nconds; i++)
     chidb_parser_Condition_destroyInternal(select.where_conds[i]);
   free(select.where_conds);
+  for(int i = 0; i < select.group_ncols; i++)
+    chidb_parser_Column_destroyInternal(select.group_cols[i]);
+  free(select.group_cols);
   return CHIDB_OK;
 }
 
 int chidb_parser_InsertStatement_destroyInternal(InsertStatement insert) {
   free(insert.table);
-  for(int i = 0; i < insert.nvalues; i++)
+  for(uint32_t i = 0; i < insert.ntotal; i++)
     chidb_parser_Value_destroyInternal(insert.values[i]);
   free(insert.values);
   return CHIDB_OK;
 }
 
+int chidb_parser_DeleteStatement_destroyInternal(DeleteStatement delete) {
+  free(delete.table);
+  for(int i = 0; i < delete.where_nconds; i++)
+    chidb_parser_Condition_destroyInternal(delete.where_conds[i]);
+  free(delete.where_conds);
+  return CHIDB_OK;
+}
+
+int chidb_parser_UpdateStatement_destroyInternal(UpdateStatement update) {
+  free(update.table);
+  for(int i = 0; i < update.set_ncols; i++) {
+    chidb_parser_Column_destroyInternal(update.set_cols[i]);
+    chidb_parser_Value_destroyInternal(update.set_values[i]);
+  }
+  free(update.set_cols);
+  free(update.set_values);
+  for(int i = 0; i < update.where_nconds; i++)
+    chidb_parser_Condition_destroyInternal(update.where_conds[i]);
+  free(update.where_conds);
+  return CHIDB_OK;
+}
+
 int chidb_parser_CreateTableStatement_destroyInternal(CreateTableStatement createTable) {
   free(createTable.table);
   for(int i = 0; i < createTable.ncols; i++)
@@ -234,6 +505,10 @@ int chidb_parser_CreateTableStatement_destroyInternal(CreateTableStatement creat
 int chidb_parser_CreateIndexStatement_destroyInternal(CreateIndexStatement createIndex) {
   free(createIndex.index);
   chidb_parser_Column_destroyInternal(createIndex.on);
+  // cols[0] is on.name
+  for(int i = 1; i < createIndex.ncols; i++)
+    free(createIndex.cols[i]);
+  free(createIndex.cols);
   return CHIDB_OK;
 }
 
@@ -270,13 +545,22 @@ int chidb_parser_ColumnSchema_destroyInternal(ColumnSchema cs) {
 
 int chidb_parser_appendColumn(char **s, Column *c)
 {
+	if (c->agg != AGG_NONE)
+	{
+		chidb_astrcat(s, (char *) chidb_parser_aggregateName(c->agg));
+		chidb_astrcat(s, "(");
+	}
+
 	if (c->table) 
 	{
 		chidb_astrcat(s, c->table);
 		chidb_astrcat(s, ".");
 	}
 	
-	chidb_astrcat(s, c->name);
+	chidb_astrcat(s, c->name? c->name : "*");
+
+	if (c->agg != AGG_NONE)
+		chidb_astrcat(s, ")");
 
 	return CHIDB_OK;
 }
@@ -309,12 +593,30 @@ int chidb_parser_appendCondition(char **s, Condition *c)
 			chidb_astrcat(s, c->op2.string);
 			chidb_astrcat(s, "\"");
 		}
+		else if (c->op2Type == OP2_PARAM)
+			chidb_astrcat(s, "?");
 		chidb_astrcat(s, " ");
 	}
 		
 	return CHIDB_OK;
 }
 
+int chidb_parser_appendWhere(char **s, uint8_t nconds, Condition *conds)
+{
+	if (nconds > 0)
+	{
+		chidb_astrcat(s, "WHERE ");
+		chidb_parser_appendCondition(s, &conds[0]);
+		for(int i=1; i<nconds; i++)
+		{
+			chidb_astrcat(s, "AND ");			
+			chidb_parser_appendCondition(s, &conds[i]);
+		}
+	}
+	
+	return CHIDB_OK;
+}
+
 int chidb_parser_appendInsertValue(char **s, Value *v)
 {
 	if (v->type == INS_INT)
@@ -334,6 +636,10 @@ int chidb_parser_appendInsertValue(char **s, Value *v)
 	{
 		chidb_astrcat(s, "NULL"); 
 	}
+	else if	(v->type == INS_PARAM)
+	{
+		chidb_astrcat(s, "?"); 
+	}
 		
 	return CHIDB_OK;
 }
@@ -385,15 +691,18 @@ char* chidb_parser_SelectToString(SQLStatement *stmt)
 	}
 	chidb_astrcat(&s,  " ");
 
-	if (stmt->query.select.where_nconds > 0)
+	chidb_parser_appendWhere(&s, stmt->query.select.where_nconds, stmt->query.select.where_conds);
+
+	if (stmt->query.select.group_ncols > 0)
 	{
-		chidb_astrcat(&s, "WHERE ");
-		chidb_parser_appendCondition(&s, &stmt->query.select.where_conds[0]);
-		for(int i=1; i<stmt->query.select.where_nconds; i++)
+		chidb_astrcat(&s, "GROUP BY ");
+		chidb_parser_appendColumn(&s, &stmt->query.select.group_cols[0]);
+		for(int i=1; i<stmt->query.select.group_ncols; i++)
 		{
-			chidb_astrcat(&s, "AND ");			
-			chidb_parser_appendCondition(&s, &stmt->query.select.where_conds[i]);
+			chidb_astrcat(&s, ", ");
+			chidb_parser_appendColumn(&s, &stmt->query.select.group_cols[i]);
 		}
+		chidb_astrcat(&s,  " ");
 	}
 	
 	return s;
@@ -406,14 +715,55 @@ char* chidb_parser_InsertToString(SQLStatement *stmt)
 	
 	chidb_astrcat(&s, "INSERT INTO ");
 	chidb_astrcat(&s, stmt->query.insert.table);
-	chidb_astrcat(&s, " VALUES(");
-	chidb_parser_appendInsertValue(&s, &stmt->query.insert.values[0]);
-	for(int i=1; i<stmt->query.insert.nvalues; i++)
+	chidb_astrcat(&s, " VALUES");
+	for(uint32_t r=0; r<stmt->query.insert.nrows; r++)
 	{
-		chidb_astrcat(&s, ", ");
-		chidb_parser_appendInsertValue(&s, &stmt->query.insert.values[i]);
+		Value *row = &stmt->query.insert.values[r * stmt->query.insert.nvalues];
+		chidb_astrcat(&s, r == 0 ? "(" : ",\n       (");
+		chidb_parser_appendInsertValue(&s, &row[0]);
+		for(int i=1; i<stmt->query.insert.nvalues; i++)
+		{
+			chidb_astrcat(&s, ", ");
+			chidb_parser_appendInsertValue(&s, &row[i]);
+		}
+		chidb_astrcat(&s, ")");
+	}
+	chidb_astrcat(&s,  "\n");
+	
+	return s;
+}
+
+char* chidb_parser_DeleteToString(SQLStatement *stmt)
+{
+	char *s = malloc(1);
+	*s = '\0';
+	
+	chidb_astrcat(&s, "DELETE FROM ");
+	chidb_astrcat(&s, stmt->query.delete.table);
+	chidb_astrcat(&s, " ");
+	chidb_parser_appendWhere(&s, stmt->query.delete.where_nconds, stmt->query.delete.where_conds);
+	
+	return s;
+}
+
+char* chidb_parser_UpdateToString(SQLStatement *stmt)
+{
+	char *s = malloc(1);
+	*s = '\0';
+	
+	chidb_astrcat(&s, "UPDATE ");
+	chidb_astrcat(&s, stmt->query.update.table);
+	chidb_astrcat(&s, " SET ");
+	for(int i=0; i<stmt->query.update.set_ncols; i++)
+	{
+		if (i > 0)
+			chidb_astrcat(&s, ", ");
+		chidb_parser_appendColumn(&s, &stmt->query.update.set_cols[i]);
+		chidb_astrcat(&s, " = ");
+		chidb_parser_appendInsertValue(&s, &stmt->query.update.set_values[i]);
 	}
-	chidb_astrcat(&s,  ")\n");
+	chidb_astrcat(&s, " ");
+	chidb_parser_appendWhere(&s, stmt->query.update.where_nconds, stmt->query.update.where_conds);
 	
 	return s;
 }
@@ -441,9 +791,16 @@ char* chidb_parser_CreateTableToString(SQLStatement *stmt)
 char* chidb_parser_CreateIndexToString(SQLStatement *stmt)
 {
 	char *s;
-	asprintf(&s, "CREATE INDEX %s ON %s(%s)", stmt->query.createIndex.index, 
-	                                               stmt->query.createIndex.on.table,
-	                                               stmt->query.createIndex.on.name);
+	CreateIndexStatement *createIndex = &stmt->query.createIndex;
+	asprintf(&s, "CREATE INDEX %s ON %s(%s", createIndex->index, 
+	                                               createIndex->on.table,
+	                                               createIndex->on.name);
+	for(int i=1; i<createIndex->ncols; i++)
+	{
+		chidb_astrcat(&s, (i == createIndex->nkeys) ? ") INCLUDE (" : ", ");
+		chidb_astrcat(&s, createIndex->cols[i]);
+	}
+	chidb_astrcat(&s, ")");
 	return s;
 }
 
@@ -453,6 +810,8 @@ char* chidb_parser_StatementToString(SQLStatement *stmt)
 	{
 		case STMT_SELECT:      return chidb_parser_SelectToString(stmt);
 		case STMT_INSERT:      return chidb_parser_InsertToString(stmt);
+		case STMT_DELETE:      return chidb_parser_DeleteToString(stmt);
+		case STMT_UPDATE:      return chidb_parser_UpdateToString(stmt);
 		case STMT_CREATETABLE: return chidb_parser_CreateTableToString(stmt);
 		case STMT_CREATEINDEX: return chidb_parser_CreateIndexToString(stmt);
 	}
@@ -480,6 +839,28 @@ int chidb_parser_printInsert(SQLStatement *stmt)
 	return CHIDB_OK;
 }
 
+int chidb_parser_printDelete(SQLStatement *stmt)
+{
+	char *s = chidb_parser_DeleteToString(stmt);
+	
+	fprintf(stderr, "%s\n", s);
+	
+	free(s); 
+
+	return CHIDB_OK;
+}
+
+int chidb_parser_printUpdate(SQLStatement *stmt)
+{
+	char *s = chidb_parser_UpdateToString(stmt);
+	
+	fprintf(stderr, "%s\n", s);
+	
+	free(s); 
+
+	return CHIDB_OK;
+}
+
 int chidb_parser_printCreateTable(SQLStatement *stmt)
 {
 	char *s = chidb_parser_CreateTableToString(stmt);
@@ -7,6 +7,8 @@
 #define STMT_INSERT (1)
 #define STMT_CREATETABLE  (2)
 #define STMT_CREATEINDEX  (3)
+#define STMT_DELETE (4)
+#define STMT_UPDATE (5)
 
 #define SELECT_ALL (-1)
 
@@ -22,18 +24,28 @@
 #define OP2_COL (0)
 #define OP2_INT (1)
 #define OP2_STR (2)
+#define OP2_PARAM (3)
 
 #define INS_INT (0)
 #define INS_STR (1)
 #define INS_NULL (2)
+#define INS_PARAM (3)
 
 #define CREATETABLE_NOPK (-1)
 
+#define AGG_NONE (0)
+#define AGG_COUNT (1)
+#define AGG_SUM (2)
+#define AGG_MIN (3)
+#define AGG_MAX (4)
+#define AGG_AVG (5)
+
 
 struct Column
 {
 	char *table;
-	char *name;
+	char *name;	/* NULL in COUNT(*) */
+	uint8_t agg;	/* AGG_NONE unless the column is an aggregate */
 };
 typedef struct Column Column;
 
@@ -52,7 +64,7 @@ struct Condition
 	union
 	{
 		Column col;
-		int integer;
+		int integer;	/* Also the parameter number with OP2_PARAM */
 		char *string;
 	} op2;
 };
@@ -63,7 +75,7 @@ struct Value
 	uint8_t type;
 	union
 	{
-		int integer;
+		int integer;	/* Also the parameter number with INS_PARAM */
 		char *string;
 	} val;
 };
@@ -77,17 +89,41 @@ struct SelectStatement
 	char **from_tables;
 	uint8_t where_nconds;
 	Condition *where_conds;	
+	uint8_t group_ncols;
+	Column *group_cols;
 };
 typedef struct SelectStatement SelectStatement;
 
 struct InsertStatement
 {
 	char *table;
-	uint8_t nvalues;
-	Value *values;	
+	uint8_t nvalues;	/* Number of values in each row */
+	uint32_t nrows;		/* Number of rows in the VALUES list */
+	uint32_t ntotal;	/* Number of values parsed so far */
+	uint32_t size;		/* Allocated length of the values array */
+	Value *values;		/* One row after the other (nrows * nvalues) */
 };
 typedef struct InsertStatement InsertStatement;
 
+struct DeleteStatement
+{
+	char *table;
+	uint8_t where_nconds;
+	Condition *where_conds;
+};
+typedef struct DeleteStatement DeleteStatement;
+
+struct UpdateStatement
+{
+	char *table;
+	uint8_t set_ncols;
+	Column *set_cols;
+	Value *set_values;	/* One for each column in set_cols */
+	uint8_t where_nconds;
+	Condition *where_conds;
+};
+typedef struct UpdateStatement UpdateStatement;
+
 struct CreateTableStatement
 {
 	char *table;
@@ -100,16 +136,22 @@ typedef struct CreateTableStatement CreateTableStatement;
 struct CreateIndexStatement
 {
 	char *index;
-	Column on;
+	Column on;		/* Table, and first key column */
+	uint8_t nkeys;		/* Number of key columns */
+	uint8_t ncols;		/* Number of key and included columns */
+	char **cols;		/* Key columns (cols[0] is on.name), then included columns */
 };
 typedef struct CreateIndexStatement CreateIndexStatement;
 
 struct SQLStatement
 {
 	uint8_t type;
+	uint8_t nparams;	/* Number of ? placeholders, numbered from 1 */
         union {
 	  SelectStatement select;
 	  InsertStatement insert;
+	  DeleteStatement delete;
+	  UpdateStatement update;
 	  CreateTableStatement createTable;
 	  CreateIndexStatement createIndex;
 	} query;
@@ -122,6 +164,10 @@ int chidb_parser(const char *sql, SQLStatement **stmt);
 /* SELECT */
 int chidb_parser_initSelectStmt(SQLStatement *stmt);
 int chidb_parser_addSelectColumn(SQLStatement *stmt, char *table, char *col);
+int chidb_parser_addSelectAggregate(SQLStatement *stmt, uint8_t agg, char *table, char *col);
+int chidb_parser_addGroupByColumn(SQLStatement *stmt, char *table, char *col);
+bool chidb_parser_hasAggregates(SelectStatement *select);
+const char* chidb_parser_aggregateName(uint8_t agg);
 int chidb_parser_addFromTable(SQLStatement *stmt, char *table);
 int chidb_parser_newCondition(SQLStatement *stmt);
 int chidb_parser_setConditionOperand1(SQLStatement *stmt, char *table, char *col);
@@ -129,6 +175,7 @@ int chidb_parser_setConditionOperator(SQLStatement *stmt, uint8_t op);
 int chidb_parser_setConditionOperand2Integer(SQLStatement *stmt, int v);
 int chidb_parser_setConditionOperand2String(SQLStatement *stmt, char *v);
 int chidb_parser_setConditionOperand2Column(SQLStatement *stmt, char *table, char *col);
+int chidb_parser_setConditionOperand2Param(SQLStatement *stmt);
 
 /* INSERT */
 int chidb_parser_initInsertStmt(SQLStatement *stmt);
@@ -136,6 +183,19 @@ int chidb_parser_setInsertTable(SQLStatement *stmt, char *table);
 int chidb_parser_addInsertIntValue(SQLStatement *stmt, int v);
 int chidb_parser_addInsertStrValue(SQLStatement *stmt, char *v);
 int chidb_parser_addInsertNullValue(SQLStatement *stmt);
+int chidb_parser_addInsertParamValue(SQLStatement *stmt);
+int chidb_parser_endInsertRow(SQLStatement *stmt);
+
+/* DELETE */
+int chidb_parser_initDeleteStmt(SQLStatement *stmt, char *table);
+
+/* UPDATE */
+int chidb_parser_initUpdateStmt(SQLStatement *stmt, char *table);
+int chidb_parser_addUpdateColumn(SQLStatement *stmt, char *col);
+int chidb_parser_setUpdateIntValue(SQLStatement *stmt, int v);
+int chidb_parser_setUpdateStrValue(SQLStatement *stmt, char *v);
+int chidb_parser_setUpdateNullValue(SQLStatement *stmt);
+int chidb_parser_setUpdateParamValue(SQLStatement *stmt);
 
 /* CREATE TABLE */
 int chidb_parser_initCreateTableStmt(SQLStatement *stmt);
@@ -144,12 +204,15 @@ int chidb_parser_addCreateTableColumn(SQLStatement *stmt, char* name, uint8_t ty
 
 /* CREATE INDEX */
 int chidb_parser_initCreateIndexStmt(SQLStatement *stmt, char* index, char *table, char *col);
+int chidb_parser_addCreateIndexColumn(SQLStatement *stmt, char *col, bool include);
 
 /* CLEANUP */
 int chidb_parser_SQLStatement_destroy(SQLStatement *stmt);
 int chidb_parser_SQLStatement_destroyInternal(SQLStatement stmt);
 int chidb_parser_SelectStatement_destroyInternal(SelectStatement select);
 int chidb_parser_InsertStatement_destroyInternal(InsertStatement insert);
+int chidb_parser_DeleteStatement_destroyInternal(DeleteStatement delete);
+int chidb_parser_UpdateStatement_destroyInternal(UpdateStatement update);
 int chidb_parser_CreateTableStatement_destroyInternal(CreateTableStatement createTable);
 int chidb_parser_CreateIndexStatement_destroyInternal(CreateIndexStatement createIndex);
 int chidb_parser_Condition_destroyInternal(Condition cond);
@@ -162,10 +225,14 @@ char* chidb_parser_StatementToString(SQLStatement *stmt);
 
 char* chidb_parser_SelectToString(SQLStatement *stmt);
 char* chidb_parser_InsertToString(SQLStatement *stmt);
+char* chidb_parser_DeleteToString(SQLStatement *stmt);
+char* chidb_parser_UpdateToString(SQLStatement *stmt);
 char* chidb_parser_CreateTableToString(SQLStatement *stmt);
 char* chidb_parser_CreateIndexToString(SQLStatement *stmt);
 int chidb_parser_printSelect(SQLStatement *stmt);
 int chidb_parser_printInsert(SQLStatement *stmt);
+int chidb_parser_printDelete(SQLStatement *stmt);
+int chidb_parser_printUpdate(SQLStatement *stmt);
 int chidb_parser_printCreateTable(SQLStatement *stmt);
 int chidb_parser_printCreateIndex(SQLStatement *stmt);
 
@@ -30,6 +30,15 @@
  *   chidb_DBRecord_appendNull(&dbrb);
  *   chidb_DBRecord_finalize(&dbrb, &dbr);
  *
+ * Records that only need to be read (e.g. straight out of a B-Tree cell)
+ * don't have to be unpacked: a DBRecordView reads the fields in place,
+ * without allocating or copying anything:
+ *
+ *   DBRecordView view;
+ *   chidb_DBRecordView_init(&view, btc.fields.tableLeaf.data);
+ *   chidb_DBRecordView_getInt32(&view, 2, &i32);
+ *   chidb_DBRecordView_getString(&view, 3, &str, &len); // not NUL-terminated
+ *
  * 2009, 2010 Borja Sotomayor - http://people.cs.uchicago.edu/~borja/
 \*****************************************************************************/
 
@@ -334,6 +343,110 @@ int chidb_DBRecord_pack(DBRecord *dbr, uint8_t **p)
 }
 
 
+/* Compute the size of the raw binary record for a list of values
+ *
+ * Together with chidb_DBRecord_encode, this builds a raw record in a
+ * single pass, straight into a buffer the caller has already sized,
+ * without going through a DBRecord.
+ *
+ * Parameters
+ * - fields: Values to encode
+ * - nfields: Number of values
+ * - size: Out parameter used to return the size (header and data)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ECONSTRAINT: The header would not fit in the header size byte
+ */
+int chidb_DBRecord_encodedSize(DBRecordField *fields, uint8_t nfields, uint32_t *size)
+{
+	uint32_t header_size = 1, data_len = 0;
+
+	for(int i=0; i < nfields; i++)
+	{
+		switch(fields[i].type)
+		{
+			case SQL_NULL:
+				header_size += 1;
+				break;
+			case SQL_INTEGER_1BYTE:
+			case SQL_INTEGER_2BYTE:
+			case SQL_INTEGER_4BYTE:
+				header_size += 1;
+				data_len += fields[i].type;
+				break;
+			case SQL_TEXT:
+				header_size += 4;
+				data_len += fields[i].text_len;
+				break;
+		}
+	}
+
+	if (header_size > 0xFF)
+		return CHIDB_ECONSTRAINT;
+
+	*size = header_size + data_len;
+	return CHIDB_OK;
+}
+
+
+/* Encode a list of values as a raw binary database record
+ *
+ * Parameters
+ * - fields: Values to encode
+ * - nfields: Number of values
+ * - raw: Buffer of (at least) the size given by chidb_DBRecord_encodedSize
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ECONSTRAINT: The header would not fit in the header size byte
+ */
+int chidb_DBRecord_encode(DBRecordField *fields, uint8_t nfields, uint8_t *raw)
+{
+	uint32_t header_size = 1;
+
+	for(int i=0; i < nfields; i++)
+		header_size += (fields[i].type == SQL_TEXT) ? 4 : 1;
+	if (header_size > 0xFF)
+		return CHIDB_ECONSTRAINT;
+	raw[0] = header_size;
+
+	uint8_t *header = raw + 1;
+	uint8_t *data = raw + header_size;
+	for(int i=0; i < nfields; i++)
+	{
+		switch(fields[i].type)
+		{
+			case SQL_NULL:
+				*header++ = SQL_NULL;
+				break;
+			case SQL_INTEGER_1BYTE:
+				*header++ = SQL_INTEGER_1BYTE;
+				*data++ = (uint8_t) fields[i].integer;
+				break;
+			case SQL_INTEGER_2BYTE:
+				*header++ = SQL_INTEGER_2BYTE;
+				put2byte(data, fields[i].integer);
+				data += 2;
+				break;
+			case SQL_INTEGER_4BYTE:
+				*header++ = SQL_INTEGER_4BYTE;
+				put4byte(data, fields[i].integer);
+				data += 4;
+				break;
+			case SQL_TEXT:
+				putVarint32(header, 2 * fields[i].text_len + SQL_TEXT);
+				header += 4;
+				memcpy(data, fields[i].text, fields[i].text_len);
+				data += fields[i].text_len;
+				break;
+		}
+	}
+
+	return CHIDB_OK;
+}
+
+
 /* Returns the type of a field
  *
  * Parameters
@@ -603,3 +716,319 @@ int chidb_DBRecord_destroy(DBRecord *dbr)
 	
 	return CHIDB_OK;
 }
+
+
+/* Returns the size of a field's value given its header type
+ *
+ * Parameters
+ * - type: Type of the field, as stored in the record header
+ *
+ * Return
+ * - Number of bytes taken by the value
+ */
+static uint32_t chidb_DBRecord_typeSize(uint32_t type)
+{
+	if (type == SQL_INTEGER_1BYTE || type == SQL_INTEGER_2BYTE || type == SQL_INTEGER_4BYTE)
+		return type;
+	else if (type >= SQL_TEXT)
+		return (type - SQL_TEXT) / 2;
+	else
+		return 0;
+}
+
+
+/* Reads the header type stored at a position of a record's header
+ *
+ * Types of text fields are 4-byte varints, all others take a single byte.
+ *
+ * Parameters
+ * - raw: Pointer to the first byte of the record
+ * - pos: Position in the header
+ * - type: Out parameter used to return the type
+ *
+ * Return
+ * - Number of header bytes taken by the type
+ */
+static uint8_t chidb_DBRecord_readType(const uint8_t *raw, uint8_t pos, uint32_t *type)
+{
+	if (raw[pos] & 0x80)
+	{
+		getVarint32(&raw[pos], type);
+		return 4;
+	}
+	*type = raw[pos];
+	return 1;
+}
+
+
+/* Create a view over a raw binary database record
+ *
+ * The view is positioned on the first field; no memory is allocated.
+ *
+ * Parameters
+ * - view: View to initialize (can be on the stack)
+ * - raw: Pointer to first byte of raw binary database record
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_DBRecordView_init(DBRecordView *view, const uint8_t *raw)
+{
+	view->raw = raw;
+	view->header_size = raw[0];
+	view->field = 0;
+	view->header_pos = 1;
+	view->offset = view->header_size;
+	view->type = SQL_NULL;
+	if (view->header_pos < view->header_size)
+		chidb_DBRecord_readType(raw, view->header_pos, &view->type);
+
+	return CHIDB_OK;
+}
+
+
+/* Position a view on a field
+ *
+ * Moving forward only parses the header entries in between; moving
+ * backwards starts over from the first field.
+ *
+ * Parameters
+ * - view: The DBRecordView
+ * - field: Index of the field
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The record has no such field
+ */
+static int chidb_DBRecordView_seek(DBRecordView *view, uint8_t field)
+{
+	if (field < view->field)
+		chidb_DBRecordView_init(view, view->raw);
+
+	while (view->field < field && view->header_pos < view->header_size)
+	{
+		view->offset += chidb_DBRecord_typeSize(view->type);
+		view->header_pos += (view->raw[view->header_pos] & 0x80) ? 4 : 1;
+		view->field++;
+		if (view->header_pos < view->header_size)
+			chidb_DBRecord_readType(view->raw, view->header_pos, &view->type);
+	}
+
+	if (view->header_pos >= view->header_size)
+		return CHIDB_EMISUSE;
+
+	return CHIDB_OK;
+}
+
+
+/* Returns the number of fields in a record
+ *
+ * Parameters
+ * - view: The DBRecordView
+ *
+ * Return
+ * - Number of fields
+ */
+int chidb_DBRecordView_nfields(DBRecordView *view)
+{
+	int nfields = 0;
+	uint32_t type;
+
+	for (uint8_t pos = 1; pos < view->header_size; nfields++)
+		pos += chidb_DBRecord_readType(view->raw, pos, &type);
+
+	return nfields;
+}
+
+
+/* Returns the type of a field
+ *
+ * Parameters
+ * - view: The DBRecordView
+ * - field: Index of the field
+ *
+ * Return
+ * - SQL_NULL, SQL_INTEGER_1BYTE, SQL_INTEGER_2BYTE, SQL_INTEGER_4BYTE,
+ *   or SQL_TEXT depending on the field type.
+ * - SQL_NOTVALID if the field has an invalid type or does not exist.
+ */
+int chidb_DBRecordView_getType(DBRecordView *view, uint8_t field)
+{
+	if (chidb_DBRecordView_seek(view, field) != CHIDB_OK)
+		return SQL_NOTVALID;
+
+	if (view->type == SQL_NULL || view->type == SQL_INTEGER_1BYTE ||
+	    view->type == SQL_INTEGER_2BYTE || view->type == SQL_INTEGER_4BYTE)
+		return view->type;
+	else if (view->type >= SQL_TEXT && (view->type - SQL_TEXT) % 2 == 0)
+		return SQL_TEXT;
+	else
+		return SQL_NOTVALID;
+}
+
+
+/* Returns the value of a 1-byte integer field
+ *
+ * Parameters
+ * - view: The DBRecordView
+ * - field: Index of the field
+ * - v: Out parameter used to return the value
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The record has no such field
+ */
+int chidb_DBRecordView_getInt8(DBRecordView *view, uint8_t field, int8_t *v)
+{
+	int rc = chidb_DBRecordView_seek(view, field);
+	if (rc != CHIDB_OK)
+		return rc;
+
+	*v = view->raw[view->offset];
+
+	return CHIDB_OK;
+}
+
+
+/* Returns the value of a 2-byte integer field
+ *
+ * Parameters
+ * - view: The DBRecordView
+ * - field: Index of the field
+ * - v: Out parameter used to return the value
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The record has no such field
+ */
+int chidb_DBRecordView_getInt16(DBRecordView *view, uint8_t field, int16_t *v)
+{
+	int rc = chidb_DBRecordView_seek(view, field);
+	if (rc != CHIDB_OK)
+		return rc;
+
+	*v = get2byte(&view->raw[view->offset]);
+
+	return CHIDB_OK;
+}
+
+
+/* Returns the value of a 4-byte integer field
+ *
+ * Parameters
+ * - view: The DBRecordView
+ * - field: Index of the field
+ * - v: Out parameter used to return the value
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The record has no such field
+ */
+int chidb_DBRecordView_getInt32(DBRecordView *view, uint8_t field, int32_t *v)
+{
+	int rc = chidb_DBRecordView_seek(view, field);
+	if (rc != CHIDB_OK)
+		return rc;
+
+	*v = get4byte(&view->raw[view->offset]);
+
+	return CHIDB_OK;
+}
+
+
+/* Returns the value of a string field, without copying it
+ *
+ * Parameters
+ * - view: The DBRecordView
+ * - field: Index of the field
+ * - v: Out parameter used to return a pointer to the string, inside the
+ *      record (it is NOT null-terminated)
+ * - len: Out parameter used to return the length of the string
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The record has no such field
+ */
+int chidb_DBRecordView_getString(DBRecordView *view, uint8_t field, const char **v, int *len)
+{
+	int rc = chidb_DBRecordView_seek(view, field);
+	if (rc != CHIDB_OK)
+		return rc;
+
+	*v = (const char *) &view->raw[view->offset];
+	*len = chidb_DBRecord_typeSize(view->type);
+
+	return CHIDB_OK;
+}
+
+
+/* Returns the length of a string field
+ *
+ * Parameters
+ * - view: The DBRecordView
+ * - field: Index of the field
+ * - len: Out parameter used to return the length
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The record has no such field
+ */
+int chidb_DBRecordView_getStringLength(DBRecordView *view, uint8_t field, int *len)
+{
+	int rc = chidb_DBRecordView_seek(view, field);
+	if (rc != CHIDB_OK)
+		return rc;
+
+	*len = chidb_DBRecord_typeSize(view->type);
+
+	return CHIDB_OK;
+}
+
+
+/* Prints a string representation of a raw database record to stdout
+ *
+ * Parameters
+ * - view: The DBRecordView
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_DBRecordView_print(DBRecordView *view)
+{
+	int nfields = chidb_DBRecordView_nfields(view);
+
+	for(int i=0; i<nfields; i++)
+	{
+		int type = chidb_DBRecordView_getType(view, i);
+		if (type == SQL_NULL)
+			printf("|");
+		else if (type == SQL_INTEGER_1BYTE)
+		{
+			uint8_t i8;
+			chidb_DBRecordView_getInt8(view, i, (int8_t *) &i8);
+			printf("| %i ", i8);
+		}
+		else if (type == SQL_INTEGER_2BYTE)
+		{
+			uint16_t i16;
+			chidb_DBRecordView_getInt16(view, i, (int16_t *) &i16);
+			printf("| %i ", i16);
+		}
+		else if (type == SQL_INTEGER_4BYTE)
+		{
+			uint32_t i32;
+			chidb_DBRecordView_getInt32(view, i, (int32_t *) &i32);
+			printf("| %i ", i32);
+		}
+		else if (type == SQL_TEXT)
+		{
+			const char *s;
+			int len;
+			chidb_DBRecordView_getString(view, i, &s, &len);
+			printf("| %.*s ", len, s);
+		}
+	}
+	printf("|");
+
+	return CHIDB_OK;
+}
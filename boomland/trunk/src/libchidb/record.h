@@ -24,6 +24,33 @@ struct DBRecordBuffer
 };
 typedef struct DBRecordBuffer DBRecordBuffer;
 
+/* A single value to be encoded by chidb_DBRecord_encode. Unlike a
+ * DBRecordBuffer, nothing is copied: text just points at the caller's
+ * bytes until the record has been encoded. */
+struct DBRecordField
+{
+	uint8_t type;          /* SQL_NULL, SQL_INTEGER_1BYTE/2BYTE/4BYTE or SQL_TEXT */
+	int32_t integer;       /* Value of integer fields */
+	const uint8_t *text;   /* Bytes of text fields (not NUL-terminated) */
+	uint32_t text_len;     /* Length of text fields */
+};
+typedef struct DBRecordField DBRecordField;
+
+/* A read-only view of a raw database record. Nothing is copied: the view
+ * points straight at the record's bytes (e.g. a B-Tree cell's payload),
+ * which must outlive it. The header is parsed lazily, one field at a time,
+ * so reading fields in order never goes over the header twice. */
+struct DBRecordView
+{
+	const uint8_t *raw;    /* First byte of the record (the header size) */
+	uint8_t header_size;   /* Size of the header, in bytes */
+	uint8_t field;         /* Field the view is positioned on */
+	uint8_t header_pos;    /* Position of that field's type in the header */
+	uint32_t type;         /* Header type of that field */
+	uint32_t offset;       /* Position of that field's value in the record */
+};
+typedef struct DBRecordView DBRecordView;
+
 int chidb_DBRecord_create(DBRecord **dbr, const char *, ...);
 
 int chidb_DBRecord_create_empty(DBRecordBuffer *dbrb, uint8_t nfields);
@@ -37,6 +64,9 @@ int chidb_DBRecord_finalize(DBRecordBuffer *dbrb, DBRecord **dbr);
 int chidb_DBRecord_unpack(DBRecord **dbr, uint8_t *);
 int chidb_DBRecord_pack(DBRecord *dbr, uint8_t **);
 
+int chidb_DBRecord_encodedSize(DBRecordField *fields, uint8_t nfields, uint32_t *size);
+int chidb_DBRecord_encode(DBRecordField *fields, uint8_t nfields, uint8_t *raw);
+
 int chidb_DBRecord_getType(DBRecord *dbr, uint8_t field);
 
 int chidb_DBRecord_getInt8(DBRecord *dbr, uint8_t field, int8_t *v);
@@ -47,6 +77,16 @@ int chidb_DBRecord_getStringLength(DBRecord *dbr, uint8_t field, int *len);
 
 int chidb_DBRecord_print(DBRecord *dbr);
 
+int chidb_DBRecordView_init(DBRecordView *view, const uint8_t *raw);
+int chidb_DBRecordView_nfields(DBRecordView *view);
+int chidb_DBRecordView_getType(DBRecordView *view, uint8_t field);
+int chidb_DBRecordView_getInt8(DBRecordView *view, uint8_t field, int8_t *v);
+int chidb_DBRecordView_getInt16(DBRecordView *view, uint8_t field, int16_t *v);
+int chidb_DBRecordView_getInt32(DBRecordView *view, uint8_t field, int32_t *v);
+int chidb_DBRecordView_getString(DBRecordView *view, uint8_t field, const char **v, int *len);
+int chidb_DBRecordView_getStringLength(DBRecordView *view, uint8_t field, int *len);
+int chidb_DBRecordView_print(DBRecordView *view);
+
 
 int chidb_DBRecord_destroy(DBRecord *dbr);
 
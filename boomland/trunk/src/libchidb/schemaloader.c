@@ -7,168 +7,381 @@
 #include "record.h"
 #include "schemaloader.h"
 
+/* chidb_hashSchemaName
+ *
+ * Hashes a table or index name (FNV-1a) to pick its schema bucket.
+ *
+ */
+static uint32_t chidb_hashSchemaName(const char *name){
+  uint32_t hash = 2166136261u;
+  for(const char *c = name; *c != '\0'; c++)
+    hash = (hash ^ (uint8_t) *c) * 16777619u;
+  return hash % SCHEMA_NBUCKETS;
+}
+
 /* chidb_addSchemaNode
  *
- * Inserts a new schema node into a schema based on
- * the table name.
+ * Inserts a new schema node into a schema hash table based on
+ * its name.
  *
  * Parameters
  * - toInsert: the Schema_Node being inserted - we assume is already has
  *   a name and information
- * - root: the root of the tree to insert into
+ * - buckets: the hash table to insert into
  * - id: the id to give this node
  *
  * Note: the actual table info is inserted outside of this
  * function
  *
+ * Return
+ * - CHIDB_OK: Node was inserted
+ * - CHIDB_ECONSTRAINT: There already is a node with that name
  */
-int chidb_addSchemaNode(Schema_Node *toInsert, Schema_Node **root, int id){
-  if((*root) == NULL){
-    toInsert->id = id;
-    // printf("Inserting %d ...\n",id);
-    *root = toInsert;
-    return CHIDB_OK;
-  }
-  int rid = (*root)->id;
-  if(strcmp(toInsert->name,(*root)->name) > 0){
-    // printf("RIGHT\n");
-    chidb_addSchemaNode(toInsert,&((*root)->right),rid+rid/2);
-  }
-  else if(strcmp(toInsert->name,(*root)->name) < 0){
-    // printf("LEFT\n");
-    chidb_addSchemaNode(toInsert,&((*root)->left),rid-rid/2);
-  }
-  else{ // duplicate entry, not sure if this is correct return
-    return CHIDB_ECONSTRAINT;
+int chidb_addSchemaNode(Schema_Node *toInsert, Schema_Node **buckets, int id){
+  Schema_Node **bucket = &buckets[chidb_hashSchemaName(toInsert->name)];
+
+  for(Schema_Node *n = *bucket; n != NULL; n = n->next){
+    if(strcmp(toInsert->name,n->name) == 0)
+      return CHIDB_ECONSTRAINT;
   }
+
+  toInsert->id = id;
+  toInsert->next = *bucket;
+  *bucket = toInsert;
   return CHIDB_OK;
 }
 
+/* chidb_findSchemaNode
+ *
+ * Returns the node with the given name in a schema hash table,
+ * or NULL if there is none.
+ *
+ */
+static Schema_Node *chidb_findSchemaNode(Schema_Node **buckets, const char *name){
+  for(Schema_Node *n = buckets[chidb_hashSchemaName(name)]; n != NULL; n = n->next){
+    if(strcmp(name,n->name) == 0)
+      return n;
+  }
+  return NULL;
+}
 
-
-/* chidb_loadSchema
+/* chidb_copyRecordString
  *
- * Loads the schema of a file into a Schema struct.
+ * Copies a string field of a schema record into a new null-terminated
+ * string, leaving room for extra characters at the end.
  *
- * Parameters
- * - filename: the name of the file to read from
- * - schema: a point to an empty schema struct to write to
+ */
+static char *chidb_copyRecordString(DBRecordView *view, uint8_t field, int extra){
+  const char *str;
+  int len;
+
+  if (chidb_DBRecordView_getString(view, field, &str, &len) != CHIDB_OK)
+    return NULL;
+
+  char *copy = malloc(len + extra + 1);
+  if (copy == NULL) return NULL;
+  memcpy(copy, str, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+/* chidb_loadTableNode
+ *
+ * Builds the schema node for a table, parsing its CREATE TABLE
+ * statement (field 4 of the schema record) to get the column mapping.
  *
  */
+static int chidb_loadTableNode(char *name, int32_t root_page, DBRecordView *view, Schema_Node **node){
+  int rc;
+  SQLStatement *stmt;
 
-int chidb_loadSchema(chidb *db, Schema **schema){
+  char *sql = chidb_copyRecordString(view, 4, 1);
+  if (sql == NULL) return CHIDB_ENOMEM;
+  strcat(sql,";");
+
+  rc = chidb_parser(sql, &stmt);
+  free(sql);
+  if (rc != CHIDB_OK) return rc;
+
+  Schema_Node *new_node;
+  new_node = (Schema_Node *) malloc(sizeof(Schema_Node));
+  if (new_node == NULL) {
+    chidb_parser_SQLStatement_destroy(stmt);
+    return CHIDB_ENOMEM;
+  }
+
+  new_node->name                = name;
+  new_node->isTable             = true;
+  new_node->info.table.name     = name;
+  new_node->info.table.rootPage = root_page;
+
+  // the column mapping takes over the parsed column definitions
+  new_node->info.table.colMap.cols        = stmt->query.createTable.cols;
+  new_node->info.table.colMap.ncols       = stmt->query.createTable.ncols;
+  new_node->info.table.colMap.primary_col = stmt->query.createTable.pk;
+  new_node->next = NULL;
+
+  free(stmt->query.createTable.table);
+  free(stmt);
+
+  *node = new_node;
+  return CHIDB_OK;
+}
+
+/* chidb_loadIndexNode
+ *
+ * Builds the schema node for an index, parsing its CREATE INDEX
+ * statement (field 4 of the schema record) to get its columns. Their
+ * types are only known once the table is loaded (see
+ * chidb_resolveIndexNode).
+ *
+ */
+static int chidb_loadIndexNode(char *name, char *assoc, int32_t root_page, DBRecordView *view, Schema_Node **node){
   int rc;
-  BTree *bt = db->bt;
+  SQLStatement *stmt;
+
+  char *sql = chidb_copyRecordString(view, 4, 1);
+  if (sql == NULL) return CHIDB_ENOMEM;
+  strcat(sql,";");
+
+  rc = chidb_parser(sql, &stmt);
+  free(sql);
+  if (rc != CHIDB_OK) return rc;
+
+  CreateIndexStatement *createIndex = &stmt->query.createIndex;
+  Schema_Node *new_node;
+  new_node = (Schema_Node *) malloc(sizeof(Schema_Node));
+  // one more column, in case the primary key has to be added
+  ColumnSchema *cols = malloc((createIndex->ncols + 1) * sizeof(ColumnSchema));
+  if (new_node == NULL || cols == NULL) {
+    free(new_node);
+    free(cols);
+    chidb_parser_SQLStatement_destroy(stmt);
+    return CHIDB_ENOMEM;
+  }
 
-  BTreeNode *schemaTable;
-  rc = chidb_Btree_getNodeByPage(bt,1,&schemaTable);
-  if(rc != CHIDB_OK) return rc;
+  new_node->name                 = name;
+  new_node->isTable              = false;
+  new_node->info.index.assocName = assoc;
+  new_node->info.index.rootPage  = root_page;
+  new_node->info.index.nkeys     = createIndex->nkeys;
+  new_node->info.index.covering  = createIndex->ncols > 1;
+  new_node->info.index.tableCols = NULL;
+
+  // the column mapping takes over the parsed column names
+  for (int i = 0; i < createIndex->ncols; i++) {
+    cols[i].name = createIndex->cols[i];
+    cols[i].type = SQL_NULL;
+  }
+  new_node->info.index.map.name              = assoc;
+  new_node->info.index.map.rootPage          = root_page;
+  new_node->info.index.map.colMap.cols        = cols;
+  new_node->info.index.map.colMap.ncols       = createIndex->ncols;
+  new_node->info.index.map.colMap.primary_col = CREATETABLE_NOPK;
+  new_node->next = NULL;
+
+  free(createIndex->index);
+  free(createIndex->on.table);
+  free(createIndex->cols);
+  free(stmt);
+
+  *node = new_node;
+  return CHIDB_OK;
+}
+
+/* chidb_resolveIndexNode
+ *
+ * Copies the types of the columns of an index from its table, and adds
+ * the primary key of the table to the index columns if it is not one
+ * of them (every index entry holds it).
+ *
+ */
+static int chidb_resolveIndexNode(Schema *schema, Schema_Node *node){
+  Schema_ColumnMap *tableMap = chidb_getColumnMap(schema, node->info.index.assocName);
+  Schema_ColumnMap *colMap = &node->info.index.map.colMap;
+  if (tableMap == NULL) return CHIDB_ECORRUPT;
+
+  int *tableCols = malloc((colMap->ncols + 1) * sizeof(int));
+  if (tableCols == NULL) return CHIDB_ENOMEM;
+  node->info.index.tableCols = tableCols;
+
+  for (int i = 0; i < colMap->ncols; i++) {
+    int j = 0;
+    while (j < tableMap->ncols && strcmp(colMap->cols[i].name, tableMap->cols[j].name) != 0)
+      j++;
+    if (j == tableMap->ncols) return CHIDB_ECORRUPT;
+
+    tableCols[i] = j;
+    colMap->cols[i].type = tableMap->cols[j].type;
+    if (j == tableMap->primary_col)
+      colMap->primary_col = i;
+  }
 
-  BTreeCell *btc;
-  DBRecord *dbr;
+  if (colMap->primary_col == CREATETABLE_NOPK && tableMap->primary_col != CREATETABLE_NOPK) {
+    ColumnSchema *pk = &tableMap->cols[tableMap->primary_col];
+    colMap->cols[colMap->ncols].name = strdup(pk->name);
+    if (colMap->cols[colMap->ncols].name == NULL) return CHIDB_ENOMEM;
+    colMap->cols[colMap->ncols].type = pk->type;
+    tableCols[colMap->ncols] = tableMap->primary_col;
+    colMap->primary_col = colMap->ncols++;
+  }
+  return CHIDB_OK;
+}
 
-  btc = (BTreeCell *) malloc(sizeof(BTreeCell));
-  if (NULL == btc) return CHIDB_ENOMEM;
-  dbr = (DBRecord *) malloc(sizeof(DBRecord));
-  if (NULL == dbr) return CHIDB_ENOMEM;
+void chidb_freeSchemaNode(Schema_Node *sm);
 
-  // initialize the schema struct
-  *schema = (Schema *) malloc(sizeof(Schema));
-  if (*schema == NULL) return CHIDB_ENOMEM;
-  (*schema)->table_root = NULL;
-  (*schema)->index_root = NULL;
-
-  // I'm a bit unsure about setting id's for these - not sure how they'll
-  // be used.
-  //
-  // For now, I'll use this since it ensures we can generate a unique
-  // key for every table in the schema corresponding to its 
-  // alphabetical order while giving room for new table insertions
-  int ROOT_ID = 2 * schemaTable->n_cells;
+/* chidb_loadSchemaTree
+ *
+ * Adds the tables and indexes in a (sub)tree of the schema table to a
+ * schema. The schema table starts as a single node in page 1, but it
+ * becomes a tree like any other table once it no longer fits there.
+ *
+ */
+static int chidb_loadSchemaTree(BTree *bt, npage_t npage, uint64_t snapshot, Schema *schema, uint8_t **record){
+  int rc = CHIDB_OK;
+
+  BTreeNode *btn;
+  rc = chidb_Btree_getNodeAt(bt,npage,snapshot,&btn);
+  if(rc != CHIDB_OK) return rc;
 
   // variables for holding table info
-  char *type, *name, *assoc, *sql;
+  BTreeCell btc;
+  DBRecordView view;
+  const char *type;
+  int type_len;
+  char *name, *assoc;
   int32_t root_page;
 
-  for(int i = 0; i<schemaTable->n_cells; i++){
-    chidb_Btree_getCell(schemaTable,i,btc);
-    chidb_DBRecord_unpack(&dbr,btc->fields.tableLeaf.data);
+  for(int i = 0; i<btn->n_cells && rc == CHIDB_OK; i++){
+    chidb_Btree_getCell(btn,i,&btc);
 
-    // extract values
-    chidb_DBRecord_getString(dbr,0,&type);
-    chidb_DBRecord_getString(dbr,1,&name);
-    chidb_DBRecord_getString(dbr,2,&assoc);
-    chidb_DBRecord_getInt32(dbr,3,&root_page);
-    chidb_DBRecord_getString(dbr,4,&sql);
+    if(btn->type == PGTYPE_TABLE_INTERNAL) {
+      rc = chidb_loadSchemaTree(bt,btc.fields.tableInternal.child_page,snapshot,schema,record);
+      continue;
+    }
+    if(btc.key > schema->max_key)
+      schema->max_key = btc.key;
+
+    // read the record in place, only the strings the schema keeps are copied
+    // (the end of a long CREATE statement may be in overflow pages, though)
+    uint8_t *data = btc.fields.tableLeaf.data;
+    if(btc.fields.tableLeaf.overflow_page != 0) {
+      free(*record);
+      *record = malloc(btc.fields.tableLeaf.data_size);
+      if(*record == NULL) {
+        rc = CHIDB_ENOMEM;
+        break;
+      }
+      rc = chidb_Btree_getCellDataAt(bt,&btc,snapshot,*record);
+      if(rc != CHIDB_OK) break;
+      data = *record;
+    }
+    chidb_DBRecordView_init(&view,data);
+    rc = chidb_DBRecordView_getString(&view,0,&type,&type_len);
+    if(rc == CHIDB_OK) rc = chidb_DBRecordView_getInt32(&view,3,&root_page);
+    if(rc != CHIDB_OK) {
+      rc = CHIDB_ECORRUPT;
+      break;
+    }
+    name = chidb_copyRecordString(&view,1,0);
+    if(name == NULL) {
+      rc = CHIDB_ENOMEM;
+      break;
+    }
 
     // put values in the schema structure
-    /*if(strcmp(type,"index")==0){
-      Schema_Node *new_node;
-      new_node = (Schema_Node *)malloc(sizeof(Schema_Node));
-      if(new_node == NULL) return CHIDB_ENOMEM;
-      strcpy(new_node->name,name);
-      strcpy(new_node->info.index.assocName,assoc);
-      new_node->info.index.rootPage = root_page;
-      new_node->left = NULL;
-      new_node->right= NULL;
-      rc = chidb_addSchemaNode(new_node,&((*db)->schema->index_root),ROOT_ID);
-      if(rc != CHIDB_OK) return rc;
-    } else */
-
-
-    if (strcmp(type,"table") == 0) {
-      // TODO free these new nodes and columns created here...
-      Schema_Node *new_node;
-      new_node = (Schema_Node *) malloc(sizeof(Schema_Node));
-      if (new_node == NULL) return CHIDB_ENOMEM;
-      
-      new_node->info.table.rootPage = root_page;
-      new_node->name                = name;
-      new_node->info.table.name     = name;
-
-      ColumnSchema *cols;
-      cols = (ColumnSchema *) calloc(sizeof(ColumnSchema), dbr->nfields);
-
-      SQLStatement *stmt;
-
-      if (strcat(sql,";") == NULL) {
-        free(dbr);
-        free(btc);
-        return CHIDB_ENOMEM;
-      }
+    Schema_Node *new_node = NULL;
+    if (type_len == 5 && strncmp(type,"table",5) == 0) {
+      rc = chidb_loadTableNode(name, root_page, &view, &new_node);
+      if(rc != CHIDB_OK)
+        free(name);
+      else
+        rc = chidb_addSchemaNode(new_node,schema->tables,schema->ntables++);
+    } else if (type_len == 5 && strncmp(type,"index",5) == 0) {
+      assoc = chidb_copyRecordString(&view,2,0);
+      if (assoc == NULL)
+        rc = CHIDB_ENOMEM;
+      else
+        rc = chidb_loadIndexNode(name, assoc, root_page, &view, &new_node);
+      if(rc != CHIDB_OK) {
+        free(name);
+        free(assoc);
+      } else
+        rc = chidb_addSchemaNode(new_node,schema->indexes,schema->nindexes++);
+    } else {
+      // someone put an incorrect value in the schema table
+      free(name);
+      rc = CHIDB_ECORRUPT;
+    }
 
-      rc = chidb_parser(sql, &stmt);
-      if (rc != CHIDB_OK) {
-        free(dbr);
-        free(btc);
-        return rc;
-      }
+    if(rc != CHIDB_OK && new_node != NULL)
+      chidb_freeSchemaNode(new_node);
+  }
 
-      // transfer column mapping
-      int ncols = stmt->query.createTable.ncols;
-      for(int j = 0; j<ncols; j++){
-        cols[j] = stmt->query.createTable.cols[j];
-      }
+  if(rc == CHIDB_OK && btn->type == PGTYPE_TABLE_INTERNAL)
+    rc = chidb_loadSchemaTree(bt,btn->right_page,snapshot,schema,record);
 
-      new_node->info.table.colMap.cols        = cols;
-      new_node->info.table.colMap.ncols       = ncols;
-      new_node->info.table.colMap.primary_col = stmt->query.createTable.pk;
+  chidb_Btree_freeMemNode(bt,btn);
+  return rc;
+}
 
-      new_node->left = NULL;
-      new_node->right= NULL;
-      rc = chidb_addSchemaNode(new_node,&(*schema)->table_root,ROOT_ID);
-      if(rc != CHIDB_OK) return rc;
-    } else {
-      // someone put an incorrect value in the schema table
-      free(dbr);
-      free(btc);
-      return CHIDB_ECORRUPT;
-    }
+/* chidb_loadSchema
+ *
+ * Loads the schema of a file into a Schema struct.
+ *
+ * Parameters
+ * - db: the database to read from
+ * - schema: out parameter for the newly allocated schema
+ *
+ * Return
+ * - CHIDB_OK: Schema was loaded
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_ECORRUPT: The schema table has an unknown entry type
+ * - CHIDB_ECONSTRAINT: Two tables (or indexes) share a name
+ * - Any error returned by the B-Tree or the parser
+ */
+
+int chidb_loadSchema(chidb *db, Schema **schema){
+  return chidb_loadSchemaAt(db, PAGER_LATEST, schema);
+}
+
+/* chidb_loadSchemaAt
+ *
+ * Loads the schema of a file, as a snapshot sees it, into a Schema struct.
+ *
+ * Parameters
+ * - db: the database to read from
+ * - snapshot: an open snapshot (see chidb_Pager_openSnapshot), or PAGER_LATEST
+ * - schema: out parameter for the newly allocated schema
+ *
+ * Return
+ * - As chidb_loadSchema
+ */
+
+int chidb_loadSchemaAt(chidb *db, uint64_t snapshot, Schema **schema){
+  int rc = CHIDB_OK;
+
+  // initialize the schema struct
+  *schema = (Schema *) calloc(1, sizeof(Schema));
+  if (*schema == NULL)
+    return CHIDB_ENOMEM;
+  (*schema)->refs = 1;
+
+  uint8_t *record = NULL; // whole record of an entry with overflow pages
+  rc = chidb_loadSchemaTree(db->bt,1,snapshot,*schema,&record);
+  free(record);
+
+  // indexes may come before their tables in the schema table
+  for(int b = 0; b < SCHEMA_NBUCKETS && rc == CHIDB_OK; b++){
+    for(Schema_Node *n = (*schema)->indexes[b]; n != NULL && rc == CHIDB_OK; n = n->next)
+      rc = chidb_resolveIndexNode(*schema, n);
   }
 
-  free(dbr);
-  free(btc);
-  return CHIDB_OK;
+  if(rc != CHIDB_OK){
+    chidb_destroySchema(*schema);
+    *schema = NULL;
+  }
+  return rc;
 }
 
 /* chidb_getTable
@@ -177,19 +390,24 @@ int chidb_loadSchema(chidb *db, Schema **schema){
  *
  */
 
-Schema_Table* chidb_getTableFromRoot(Schema_Node *root, const char *tableName){
-  if(root == NULL) return NULL;
-  int cmp = strcmp(tableName,root->name);
-  if(cmp == 0)
-    return &root->info.table;
-  if(cmp < 0)
-    return chidb_getTableFromRoot(root->left,tableName);
-  
-  return chidb_getTableFromRoot(root->right,tableName);
+Schema_Table* chidb_getTable(Schema *schema, const char *tableName){
+  Schema_Node *node = chidb_findSchemaNode(schema->tables,tableName);
+  if(node == NULL)
+    return NULL;
+  return &node->info.table;
 }
 
-Schema_Table* chidb_getTable(Schema *schema, const char *tableName){
-  return chidb_getTableFromRoot(schema->table_root,tableName);
+/* chidb_getIndex
+ *
+ * Return the index with the given name, or NULL
+ *
+ */
+
+Schema_Index* chidb_getIndex(Schema *schema, const char *indexName){
+  Schema_Node *node = chidb_findSchemaNode(schema->indexes,indexName);
+  if(node == NULL)
+    return NULL;
+  return &node->info.index;
 }
 
 /* chidb_getColumnMap
@@ -205,46 +423,105 @@ Schema_Table* chidb_getTable(Schema *schema, const char *tableName){
  */
 Schema_ColumnMap* chidb_getColumnMap(Schema *schema, const char *tableName){
   // find proper table
-  Schema_Table *table = chidb_getTableFromRoot(schema->table_root,tableName);
+  Schema_Table *table = chidb_getTable(schema,tableName);
   if(table == NULL)
     return NULL;
   return &table->colMap;
 }
 
-// helper function for chidb_printSchema
-void chidb_printTableSchemaNodes(Schema_Node *sm){
-  if(sm != NULL){
-    printf("Name: %s Id: %d\nColumns       | ColType\n",sm->name,sm->id);
-    Schema_ColumnMap colMap = sm->info.table.colMap;
-    for(int i=0;i<colMap.ncols;i++){   
-      printf(" %-12s | %d\n",colMap.cols[i].name,colMap.cols[i].type);
+/* chidb_getCoveringIndex
+ *
+ * Returns the columns of an index on a table that has all the given
+ * columns (see Schema_Index), so that a query on them can scan the
+ * index instead of the table. If there are several, the one with the
+ * fewest columns is returned.
+ *
+ * PARAMETERS
+ * -schema: the schema struct
+ * -tableName: the indexed table
+ * -colNames: names of the columns the index must have
+ * -ncols: number of names in colNames
+ *
+ *  Returns NULL if there is no such index
+ */
+Schema_Table* chidb_getCoveringIndex(Schema *schema, const char *tableName, char **colNames, int ncols){
+  Schema_Table *best = NULL;
+
+  for(int b=0;b<SCHEMA_NBUCKETS;b++){
+    for(Schema_Node *sm=schema->indexes[b];sm!=NULL;sm=sm->next){
+      Schema_Table *map = &sm->info.index.map;
+      if(strcmp(sm->info.index.assocName,tableName) != 0)
+        continue;
+      if(best != NULL && best->colMap.ncols <= map->colMap.ncols)
+        continue;
+
+      bool covers = true;
+      for(int i=0;i<ncols && covers;i++){
+        covers = false;
+        for(int j=0;j<map->colMap.ncols && !covers;j++)
+          covers = (strcmp(colNames[i],map->colMap.cols[j].name) == 0);
+      }
+      if(covers)
+        best = map;
     }
-    printf("\n");
-    if(sm->right)
-      chidb_printTableSchemaNodes(sm->right);
-    if(sm->left)
-      chidb_printTableSchemaNodes(sm->left);
   }
+  return best;
 }
 
-void chidb_printIndexSchemaNodes(Schema_Node *sm){
-  if(sm != NULL){
-    printf("Name: %s Id: %d Assoc: %s\n",
-    sm->name,sm->id,sm->info.index.assocName);
-    if(sm->right)
-      chidb_printIndexSchemaNodes(sm->right);
-    if(sm->left)
-      chidb_printIndexSchemaNodes(sm->left);
+/* chidb_getIndexes
+ *
+ * Finds every index on a table, e.g. to keep them up to date when rows
+ * are added to it.
+ *
+ * PARAMETERS
+ * -schema: the schema struct
+ * -tableName: the indexed table
+ * -indexes: array filled with the indexes, or NULL to only count them
+ *
+ *  Returns the number of indexes on the table
+ */
+int chidb_getIndexes(Schema *schema, const char *tableName, Schema_Index **indexes){
+  int n = 0;
+
+  for(int b=0;b<SCHEMA_NBUCKETS;b++){
+    for(Schema_Node *sm=schema->indexes[b];sm!=NULL;sm=sm->next){
+      if(strcmp(sm->info.index.assocName,tableName) != 0)
+        continue;
+      if(indexes != NULL)
+        indexes[n] = &sm->info.index;
+      n++;
+    }
   }
+  return n;
 }
 
 // prints the information stored in a schema
 void chidb_printSchema(Schema *s){
   printf("\n== TABLES ======\n");
-  chidb_printTableSchemaNodes(s->table_root);
+  for(int b=0;b<SCHEMA_NBUCKETS;b++){
+    for(Schema_Node *sm=s->tables[b];sm!=NULL;sm=sm->next){
+      printf("Name: %s Id: %d\nColumns       | ColType\n",sm->name,sm->id);
+      Schema_ColumnMap colMap = sm->info.table.colMap;
+      for(int i=0;i<colMap.ncols;i++){   
+        printf(" %-12s | %d\n",colMap.cols[i].name,colMap.cols[i].type);
+      }
+      printf("\n");
+    }
+  }
 
   printf("== INDICES =====\n");
-  chidb_printIndexSchemaNodes(s->index_root);
+  for(int b=0;b<SCHEMA_NBUCKETS;b++){
+    for(Schema_Node *sm=s->indexes[b];sm!=NULL;sm=sm->next){
+      printf("Name: %s Id: %d Assoc: %s\nColumns       | ColType\n",
+      sm->name,sm->id,sm->info.index.assocName);
+      Schema_ColumnMap colMap = sm->info.index.map.colMap;
+      for(int i=0;i<colMap.ncols;i++){
+        printf(" %-12s | %d%s\n",colMap.cols[i].name,colMap.cols[i].type,
+               (i >= sm->info.index.nkeys && i != colMap.primary_col) ? " (included)" : "");
+      }
+      printf("\n");
+    }
+  }
 }
 
 
@@ -252,17 +529,44 @@ void chidb_printSchema(Schema *s){
 
 //helper function for below
 void chidb_freeSchemaNode(Schema_Node *sm){
-	if(sm != NULL){
-		if(sm->isTable){
-			free(sm->info.table.colMap.cols);
+	if(sm->isTable){
+		for(int i=0;i<sm->info.table.colMap.ncols;i++)
+			free(sm->info.table.colMap.cols[i].name);
+		free(sm->info.table.colMap.cols);
+	} else {
+		for(int i=0;i<sm->info.index.map.colMap.ncols;i++)
+			free(sm->info.index.map.colMap.cols[i].name);
+		free(sm->info.index.map.colMap.cols);
+		free(sm->info.index.tableCols);
+		free(sm->info.index.assocName);
+	}
+	free(sm->name);
+	free(sm);
+}
+
+void chidb_freeSchemaBuckets(Schema_Node **buckets){
+	for(int b=0;b<SCHEMA_NBUCKETS;b++){
+		Schema_Node *sm = buckets[b];
+		while(sm != NULL){
+			Schema_Node *next = sm->next;
+			chidb_freeSchemaNode(sm);
+			sm = next;
 		}
-		chidb_freeSchemaNode(sm->right);
-		chidb_freeSchemaNode(sm->left);
-		free(sm);
 	}
 }
 
+// takes another reference to a schema (statements on other threads may
+// be taking and dropping theirs at the same time)
+Schema *chidb_retainSchema(Schema *s){
+	__atomic_add_fetch(&s->refs, 1, __ATOMIC_RELAXED);
+	return s;
+}
+
+// drops a reference to a schema, freeing it with the last one
 void chidb_destroySchema(Schema *s){
-	chidb_freeSchemaNode(s->index_root);
-	chidb_freeSchemaNode(s->table_root);
+	if(s == NULL || __atomic_sub_fetch(&s->refs, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+	chidb_freeSchemaBuckets(s->indexes);
+	chidb_freeSchemaBuckets(s->tables);
+	free(s);
 }
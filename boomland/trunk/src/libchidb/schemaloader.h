@@ -28,6 +28,16 @@ typedef struct{
 typedef struct{
 	char *assocName;
 	int rootPage;
+	int nkeys; // number of key columns, the others are included columns
+	// more than one column: every entry holds a record with the columns
+	// other than the first and the primary key (see btree.h)
+	bool covering;
+	// the index entries as rows of a table, to scan the index instead of
+	// its table: named after the table, rooted at the index, with the key
+	// columns, the included columns, and the primary key (added last if
+	// it is not one of them)
+	Schema_Table map;
+	int *tableCols; // position in the table of each column of map
 }Schema_Index;
 
 typedef struct Schema_Node {
@@ -38,21 +48,37 @@ typedef struct Schema_Node {
 	Schema_Index index;
 	Schema_Table table;
    }info;
-   struct Schema_Node *right;
-   struct Schema_Node *left;
+   struct Schema_Node *next; // next node in the same hash bucket
 } Schema_Node;
 
-typedef struct{
-	struct Schema_Node *table_root;
-	struct Schema_Node *index_root;
-}Schema;
+#define SCHEMA_NBUCKETS (64)
+
+/* Tables and indexes are kept in hash tables keyed on their name.
+ *
+ * A schema may be shared (e.g. by a connection and the statements
+ * compiled against it), so it is reference counted: chidb_loadSchema
+ * hands out the first reference, chidb_retainSchema adds one, and
+ * chidb_destroySchema drops one, freeing the schema with the last. */
+typedef struct Schema {
+	Schema_Node *tables[SCHEMA_NBUCKETS];
+	Schema_Node *indexes[SCHEMA_NBUCKETS];
+	int ntables;
+	int nindexes;
+	key_t max_key; // largest key in the schema table
+	int refs;
+} Schema;
 
 int chidb_loadSchema(chidb *db, Schema **schema);
+int chidb_loadSchemaAt(chidb *db, uint64_t snapshot, Schema **schema);
 //npage_t chidb_lookupTablePage(Schema *schema,char *name);
 //npage_t chidb_lookupIndexPage(Schema *schema,char *name);
 Schema_Table *chidb_getTable(Schema *schema, const char *tableName);
+Schema_Index *chidb_getIndex(Schema *schema, const char *indexName);
 Schema_ColumnMap *chidb_getColumnMap(Schema *schema, const char *tableName);
+Schema_Table *chidb_getCoveringIndex(Schema *schema, const char *tableName, char **colNames, int ncols);
+int chidb_getIndexes(Schema *schema, const char *tableName, Schema_Index **indexes);
 void chidb_printSchema(Schema *s);
+Schema *chidb_retainSchema(Schema *s);
 void chidb_destroySchema(Schema *s);
 
 #endif
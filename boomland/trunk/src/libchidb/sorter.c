@@ -0,0 +1,477 @@
+/*****************************************************************************
+ *
+ *																 chidb
+ *
+ * External merge sort of index entries.
+ *
+ * Entries are added in any order, and read back in (KeyIdx, KeyPk) order.
+ * At most about sorter->memory bytes of them are kept in memory: past
+ * that, they are sorted and written to a temporary file as a sorted run.
+ * Sorting the entries in memory is split between several threads, each
+ * sorting a slice of them with qsort; the slices are then merged (along
+ * with any runs in temporary files) with a heap:
+ *
+ *   Sorter sorter;
+ *   SorterEntry *entry;
+ *   chidb_Sorter_init(&sorter, 0, 0);
+ *   chidb_Sorter_add(&sorter, keyIdx, keyPk, 0, NULL, 0);
+ *   ...
+ *   chidb_Sorter_sort(&sorter);
+ *   while ((rc = chidb_Sorter_next(&sorter, &entry)) == CHIDB_ROW)
+ *       printf("%u %u\n", entry->keyIdx, entry->keyPk);
+ *   chidb_Sorter_close(&sorter);
+ *
+\*****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "sorter.h"
+
+/* Bytes written to a run before the extra of each entry: KeyIdx, KeyPk,
+ * child and size */
+#define SORTER_ENTRY_HEADER (16)
+
+
+/* A slice of the entries in memory, sorted by its own thread */
+struct SorterSlice
+{
+	SorterEntry *entries;
+	uint32_t nentries;
+	pthread_t thread;
+	bool threaded;		/* True if a thread was started to sort it */
+};
+typedef struct SorterSlice SorterSlice;
+
+
+static int chidb_Sorter_compare(const SorterEntry *a, const SorterEntry *b)
+{
+	if (a->keyIdx != b->keyIdx)
+		return (a->keyIdx < b->keyIdx) ? -1 : 1;
+	if (a->keyPk != b->keyPk)
+		return (a->keyPk < b->keyPk) ? -1 : 1;
+	return 0;
+}
+
+static int chidb_Sorter_qsortCompare(const void *a, const void *b)
+{
+	return chidb_Sorter_compare(a, b);
+}
+
+static void *chidb_Sorter_sortSlice(void *arg)
+{
+	SorterSlice *slice = arg;
+	qsort(slice->entries, slice->nentries, sizeof(SorterEntry), chidb_Sorter_qsortCompare);
+	return NULL;
+}
+
+
+/* Initialize an empty sorter
+ *
+ * Parameters
+ * - sorter: Sorter to initialize
+ * - memory: Bytes of entries to keep in memory (0 for SORTER_MEMORY)
+ * - nthreads: Threads to sort with (0 for one per processor, up to
+ *             SORTER_MAX_THREADS)
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ */
+int chidb_Sorter_init(Sorter *sorter, size_t memory, int nthreads)
+{
+	memset(sorter, 0, sizeof(Sorter));
+	sorter->memory = (memory == 0) ? SORTER_MEMORY : memory;
+
+	if (nthreads <= 0)
+		nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads > SORTER_MAX_THREADS)
+		nthreads = SORTER_MAX_THREADS;
+	sorter->nthreads = (nthreads < 1) ? 1 : nthreads;
+
+	return CHIDB_OK;
+}
+
+
+/* Sort the entries in memory
+ *
+ * The entries are split in (up to) one slice per thread, and each slice
+ * is added to the runs of the sorter once sorted. If a thread cannot be
+ * started, its slice is sorted by the calling thread instead.
+ *
+ * Parameters
+ * - sorter: Sorter
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ */
+static int chidb_Sorter_sortMemory(Sorter *sorter)
+{
+	SorterSlice slices[SORTER_MAX_THREADS];
+	uint32_t nslices = sorter->nthreads;
+
+	if (sorter->nentries / SORTER_MIN_SLICE < nslices)
+		nslices = sorter->nentries / SORTER_MIN_SLICE;
+	if (nslices < 1)
+		nslices = 1;
+
+	if (sorter->nruns + nslices > sorter->runs_size)
+	{
+		uint32_t size = 2 * (sorter->nruns + nslices);
+		SorterRun *runs = realloc(sorter->runs, size * sizeof(SorterRun));
+		uint32_t *heap = realloc(sorter->heap, size * sizeof(uint32_t));
+		if (runs != NULL)
+			sorter->runs = runs;
+		if (heap != NULL)
+			sorter->heap = heap;
+		if (runs == NULL || heap == NULL)
+			return CHIDB_ENOMEM;
+		sorter->runs_size = size;
+	}
+
+	/* the data may have moved since the entries were added */
+	for (uint32_t i = 0; i < sorter->nentries; i++)
+	{
+		SorterEntry *e = &sorter->entries[i];
+		e->extra = (e->size > 0) ? sorter->data + e->offset : NULL;
+	}
+
+	uint32_t per_slice = sorter->nentries / nslices;
+	for (uint32_t i = 0; i < nslices; i++)
+	{
+		slices[i].entries = sorter->entries + i * per_slice;
+		slices[i].nentries = (i == nslices - 1) ? sorter->nentries - i * per_slice : per_slice;
+		slices[i].threaded = i > 0 && pthread_create(&slices[i].thread, NULL,
+							     chidb_Sorter_sortSlice, &slices[i]) == 0;
+	}
+	for (uint32_t i = 0; i < nslices; i++)
+	{
+		if (slices[i].threaded)
+			pthread_join(slices[i].thread, NULL);
+		else
+			chidb_Sorter_sortSlice(&slices[i]);
+	}
+
+	for (uint32_t i = 0; i < nslices; i++)
+	{
+		SorterRun *run = &sorter->runs[sorter->nruns++];
+		memset(run, 0, sizeof(SorterRun));
+		run->entries = slices[i].entries;
+		run->left = slices[i].nentries;
+	}
+
+	return CHIDB_OK;
+}
+
+
+/* Move a run on to its next entry
+ *
+ * Parameters
+ * - sorter: Sorter
+ * - run: Run to move on
+ *
+ * Return
+ * - CHIDB_ROW: run->head is the next entry
+ * - CHIDB_DONE: The run has no more entries
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: Could not read the temporary file
+ */
+static int chidb_Sorter_advance(Sorter *sorter, SorterRun *run)
+{
+	uint8_t header[SORTER_ENTRY_HEADER];
+
+	if (run->left == 0)
+		return CHIDB_DONE;
+	run->left--;
+
+	if (run->f == NULL)
+	{
+		run->head = *run->entries++;
+		return CHIDB_ROW;
+	}
+
+	if (fread(header, SORTER_ENTRY_HEADER, 1, run->f) != 1)
+		return CHIDB_EIO;
+	memcpy(&run->head.keyIdx, header, 4);
+	memcpy(&run->head.keyPk, header + 4, 4);
+	memcpy(&run->head.child, header + 8, 4);
+	memcpy(&run->head.size, header + 12, 4);
+	run->head.extra = NULL;
+
+	if (run->head.size > 0)
+	{
+		if (run->head.size > run->buf_size)
+		{
+			uint8_t *buf = realloc(run->buf, run->head.size);
+			if (buf == NULL)
+				return CHIDB_ENOMEM;
+			run->buf = buf;
+			run->buf_size = run->head.size;
+		}
+		if (fread(run->buf, run->head.size, 1, run->f) != 1)
+			return CHIDB_EIO;
+		run->head.extra = run->buf;
+	}
+
+	return CHIDB_ROW;
+}
+
+
+/* Restore the heap order below the i-th run of the heap */
+static void chidb_Sorter_siftDown(Sorter *sorter, uint32_t i)
+{
+	for (;;)
+	{
+		uint32_t smallest = i, l = 2 * i + 1, r = 2 * i + 2;
+		if (l < sorter->nheap && chidb_Sorter_compare(&sorter->runs[sorter->heap[l]].head,
+							      &sorter->runs[sorter->heap[smallest]].head) < 0)
+			smallest = l;
+		if (r < sorter->nheap && chidb_Sorter_compare(&sorter->runs[sorter->heap[r]].head,
+							      &sorter->runs[sorter->heap[smallest]].head) < 0)
+			smallest = r;
+		if (smallest == i)
+			return;
+
+		uint32_t tmp = sorter->heap[i];
+		sorter->heap[i] = sorter->heap[smallest];
+		sorter->heap[smallest] = tmp;
+		i = smallest;
+	}
+}
+
+
+/* Start merging the runs from the first-th one onwards
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - Any error returned by chidb_Sorter_advance
+ */
+static int chidb_Sorter_startMerge(Sorter *sorter, uint32_t first)
+{
+	int rc;
+
+	sorter->nheap = 0;
+	sorter->started = false;
+	for (uint32_t i = first; i < sorter->nruns; i++)
+	{
+		rc = chidb_Sorter_advance(sorter, &sorter->runs[i]);
+		if (rc == CHIDB_ROW)
+			sorter->heap[sorter->nheap++] = i;
+		else if (rc != CHIDB_DONE)
+			return rc;
+	}
+	for (uint32_t i = sorter->nheap / 2; i > 0; i--)
+		chidb_Sorter_siftDown(sorter, i - 1);
+
+	return CHIDB_OK;
+}
+
+
+/* Write the entries in memory to a temporary file, as a sorted run
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: Could not write the temporary file
+ */
+static int chidb_Sorter_spill(Sorter *sorter)
+{
+	int rc;
+	uint32_t first = sorter->nruns;
+	uint64_t written = 0;
+	uint8_t header[SORTER_ENTRY_HEADER];
+	SorterEntry *e;
+
+	rc = chidb_Sorter_sortMemory(sorter);
+	if (rc != CHIDB_OK)
+		return rc;
+
+	FILE *f = tmpfile();
+	if (f == NULL)
+		return CHIDB_EIO;
+	setvbuf(f, NULL, _IOFBF, SORTER_IO_BUFFER);
+
+	rc = chidb_Sorter_startMerge(sorter, first);
+	while (rc == CHIDB_OK && (rc = chidb_Sorter_next(sorter, &e)) == CHIDB_ROW)
+	{
+		memcpy(header, &e->keyIdx, 4);
+		memcpy(header + 4, &e->keyPk, 4);
+		memcpy(header + 8, &e->child, 4);
+		memcpy(header + 12, &e->size, 4);
+		if (fwrite(header, SORTER_ENTRY_HEADER, 1, f) != 1 ||
+		    (e->size > 0 && fwrite(e->extra, e->size, 1, f) != 1))
+			rc = CHIDB_EIO;
+		else
+		{
+			written++;
+			rc = CHIDB_OK;
+		}
+	}
+	if (rc == CHIDB_DONE && (fflush(f) != 0 || fseek(f, 0, SEEK_SET) != 0))
+		rc = CHIDB_EIO;
+	if (rc != CHIDB_DONE)
+	{
+		fclose(f);
+		return rc;
+	}
+
+	/* the slices are replaced by the run */
+	SorterRun *run = &sorter->runs[first];
+	memset(run, 0, sizeof(SorterRun));
+	run->f = f;
+	run->left = written;
+	sorter->nruns = first + 1;
+	sorter->nheap = 0;
+	sorter->nentries = 0;
+	sorter->data_len = 0;
+
+	return CHIDB_OK;
+}
+
+
+/* Add an entry to a sorter
+ *
+ * Parameters
+ * - sorter: Sorter
+ * - keyIdx, keyPk: Keys of the entry
+ * - child: Page number kept with the entry (see SorterEntry)
+ * - extra: Record of the entry (copied), or NULL
+ * - size: Bytes of extra
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_EMISUSE: The sorter has already been sorted
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: Could not write a temporary file
+ */
+int chidb_Sorter_add(Sorter *sorter, key_t keyIdx, key_t keyPk, npage_t child,
+		     const uint8_t *extra, uint32_t size)
+{
+	if (sorter->sorted)
+		return CHIDB_EMISUSE;
+
+	if (sorter->nentries == sorter->entries_size)
+	{
+		uint32_t n = sorter->entries_size ? 2 * sorter->entries_size : 1024;
+		SorterEntry *entries = realloc(sorter->entries, n * sizeof(SorterEntry));
+		if (entries == NULL)
+			return CHIDB_ENOMEM;
+		sorter->entries = entries;
+		sorter->entries_size = n;
+	}
+
+	if (sorter->data_len + size > sorter->data_size)
+	{
+		size_t n = sorter->data_size ? 2 * sorter->data_size : 4096;
+		while (n < sorter->data_len + size)
+			n *= 2;
+		uint8_t *data = realloc(sorter->data, n);
+		if (data == NULL)
+			return CHIDB_ENOMEM;
+		sorter->data = data;
+		sorter->data_size = n;
+	}
+
+	SorterEntry *e = &sorter->entries[sorter->nentries++];
+	e->keyIdx = keyIdx;
+	e->keyPk = keyPk;
+	e->child = child;
+	e->size = size;
+	e->extra = NULL;
+	e->offset = sorter->data_len;
+	if (size > 0)
+		memcpy(sorter->data + sorter->data_len, extra, size);
+	sorter->data_len += size;
+	sorter->count++;
+
+	if (sorter->nentries * sizeof(SorterEntry) + sorter->data_len >= sorter->memory)
+		return chidb_Sorter_spill(sorter);
+	return CHIDB_OK;
+}
+
+
+/* Sort the entries added to a sorter, so they can be read back
+ *
+ * No more entries can be added afterwards.
+ *
+ * Parameters
+ * - sorter: Sorter
+ *
+ * Return
+ * - CHIDB_OK: Operation successful
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: Could not read a temporary file
+ */
+int chidb_Sorter_sort(Sorter *sorter)
+{
+	int rc;
+
+	if (sorter->nentries > 0)
+	{
+		rc = chidb_Sorter_sortMemory(sorter);
+		if (rc != CHIDB_OK)
+			return rc;
+	}
+
+	sorter->sorted = true;
+	return chidb_Sorter_startMerge(sorter, 0);
+}
+
+
+/* Read the next entry of a sorted sorter
+ *
+ * Parameters
+ * - sorter: Sorter
+ * - entry: Out parameter. The entry, which is only valid until the
+ *          next call
+ *
+ * Return
+ * - CHIDB_ROW: *entry is the next entry
+ * - CHIDB_DONE: There are no more entries
+ * - CHIDB_ENOMEM: Could not allocate memory
+ * - CHIDB_EIO: Could not read a temporary file
+ */
+int chidb_Sorter_next(Sorter *sorter, SorterEntry **entry)
+{
+	int rc;
+
+	/* the entry handed out last is the head of the first run in the heap */
+	if (sorter->started && sorter->nheap > 0)
+	{
+		rc = chidb_Sorter_advance(sorter, &sorter->runs[sorter->heap[0]]);
+		if (rc == CHIDB_DONE)
+			sorter->heap[0] = sorter->heap[--sorter->nheap];
+		else if (rc != CHIDB_ROW)
+			return rc;
+		chidb_Sorter_siftDown(sorter, 0);
+	}
+	sorter->started = true;
+
+	if (sorter->nheap == 0)
+		return CHIDB_DONE;
+	*entry = &sorter->runs[sorter->heap[0]].head;
+	return CHIDB_ROW;
+}
+
+
+/* Free a sorter's memory and temporary files
+ *
+ * Parameters
+ * - sorter: Sorter
+ */
+void chidb_Sorter_close(Sorter *sorter)
+{
+	for (uint32_t i = 0; i < sorter->nruns; i++)
+	{
+		if (sorter->runs[i].f != NULL)
+			fclose(sorter->runs[i].f);
+		free(sorter->runs[i].buf);
+	}
+	free(sorter->runs);
+	free(sorter->heap);
+	free(sorter->entries);
+	free(sorter->data);
+	memset(sorter, 0, sizeof(Sorter));
+}
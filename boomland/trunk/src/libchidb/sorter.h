@@ -0,0 +1,73 @@
+#ifndef SORTER_H_
+#define SORTER_H_
+
+#include <chidbInt.h>
+
+/* A Sorter puts index entries in (KeyIdx, KeyPk) order, so that an index
+ * can be built bottom-up (see chidb_Btree_bulkLoadIndex) rather than one
+ * root-to-leaf insertion at a time. Entries are gathered in memory; when
+ * they take up more than the sorter's memory, they are sorted (by several
+ * threads, each sorting a slice) and spilled as a sorted run to a
+ * temporary file. The runs, and the entries left in memory, are then
+ * merged as the entries are read back. */
+
+#define SORTER_MEMORY (64 << 20)
+#define SORTER_MAX_THREADS (8)
+#define SORTER_MIN_SLICE (1 << 14)	/* Fewer entries are sorted by a single thread */
+#define SORTER_IO_BUFFER (1 << 16)
+
+struct SorterEntry
+{
+	key_t keyIdx;
+	key_t keyPk;
+	npage_t child;		/* Left child of an entry of an internal node (0 otherwise) */
+	uint32_t size;		/* Bytes of extra */
+	uint8_t *extra;		/* Record of an entry of a covering index (see btree.h) */
+	size_t offset;		/* Where extra is in the sorter's data, while in memory */
+};
+typedef struct SorterEntry SorterEntry;
+
+/* A sorted sequence of entries: either a run spilled to a file, or a
+ * slice of the entries in memory */
+struct SorterRun
+{
+	FILE *f;		/* Temporary file, or NULL for a slice */
+	SorterEntry *entries;	/* Entries of a slice */
+	uint64_t left;		/* Entries not read yet */
+	SorterEntry head;	/* Smallest entry not handed out yet */
+	uint8_t *buf;		/* Extra of head, for file runs */
+	uint32_t buf_size;	/* Allocated length of buf */
+};
+typedef struct SorterRun SorterRun;
+
+struct Sorter
+{
+	size_t memory;		/* Bytes of entries kept in memory before they are spilled */
+	int nthreads;		/* Threads sorting the entries in memory */
+	uint64_t count;		/* Entries added */
+
+	SorterEntry *entries;	/* Entries in memory */
+	uint32_t nentries;	/* Number of entries in memory */
+	uint32_t entries_size;	/* Allocated length of entries */
+	uint8_t *data;		/* Extras of the entries in memory, one after another */
+	size_t data_len;	/* Bytes used in data */
+	size_t data_size;	/* Allocated length of data */
+
+	SorterRun *runs;	/* Spilled runs and, once sorted, the slices in memory */
+	uint32_t nruns;		/* Number of runs */
+	uint32_t runs_size;	/* Allocated length of runs */
+	uint32_t *heap;		/* Runs being merged, the one with the smallest head first */
+	uint32_t nheap;		/* Number of runs in heap */
+	bool sorted;		/* True once chidb_Sorter_sort has been called */
+	bool started;		/* True once the first entry of a merge has been handed out */
+};
+typedef struct Sorter Sorter;
+
+int chidb_Sorter_init(Sorter *sorter, size_t memory, int nthreads);
+int chidb_Sorter_add(Sorter *sorter, key_t keyIdx, key_t keyPk, npage_t child,
+		     const uint8_t *extra, uint32_t size);
+int chidb_Sorter_sort(Sorter *sorter);
+int chidb_Sorter_next(Sorter *sorter, SorterEntry **entry);
+void chidb_Sorter_close(Sorter *sorter);
+
+#endif /*SORTER_H_*/
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "sql.yy.h"
 #include "parser.h"
 int yylex (void);
@@ -9,6 +10,10 @@ extern int yylineno;
 void yyerror (char const *msg);
 
 SQLStatement *__stmt;
+
+/* The scanner and the parser keep their state in globals, so only one
+ * statement is parsed at a time */
+static pthread_mutex_t chidb_parser_lock = PTHREAD_MUTEX_INITIALIZER;
 %}
 
 %defines
@@ -20,8 +25,9 @@ SQLStatement *__stmt;
 
 %token TK_SELECT TK_FROM TK_WHERE TK_STAR
 %token TK_INSERT TK_INTO TK_VALUES
+%token TK_DELETE TK_UPDATE TK_SET
 %token TK_CREATE TK_TABLE TK_BYTE TK_SMALLINT TK_INTEGER TK_TEXT TK_PRIMARY TK_KEY
-%token TK_INDEX TK_ON
+%token TK_INDEX TK_ON TK_INCLUDE
 %token TK_EXPLAIN
 %token TK_LPAREN TK_RPAREN TK_SEMICOLON TK_DOT TK_COMMA
 %token TK_AND
@@ -29,6 +35,11 @@ SQLStatement *__stmt;
 %token<integer> TK_INT
 %token<string> TK_ID TK_STRING
 %token TK_NULL
+%token TK_PARAM
+%token TK_GROUP TK_BY
+%token TK_COUNT TK_SUM TK_MIN TK_MAX TK_AVG
+
+%type<integer> agg_func
 
 
 %% 
@@ -71,6 +82,28 @@ sql_statement:
 	 
 	| 
 	
+	delete_statement TK_SEMICOLON
+	
+	{
+		#ifdef DEBUG
+		TRACE("The parsed DELETE statement is:");
+		chidb_parser_printDelete(__stmt);
+		#endif
+	}
+	 
+	| 
+	
+	update_statement TK_SEMICOLON
+	
+	{
+		#ifdef DEBUG
+		TRACE("The parsed UPDATE statement is:");
+		chidb_parser_printUpdate(__stmt);
+		#endif
+	}
+	 
+	| 
+	
 	createtable_statement TK_SEMICOLON
 
 	{
@@ -105,7 +138,7 @@ select_statement:
 		chidb_parser_initSelectStmt(__stmt);
 	}
 	
-	select_clause TK_FROM from_clause where_clause;
+	select_clause TK_FROM from_clause where_clause groupby_clause;
 
 select_clause: 
 	TK_STAR 
@@ -143,6 +176,45 @@ sel_col:
 		chidb_parser_addSelectColumn(__stmt, $1, $3);
 	}		
 	
+	| 
+	
+	agg_func TK_LPAREN TK_STAR TK_RPAREN
+	
+	{
+		/* Only COUNT(*) makes sense */
+		if ($1 != AGG_COUNT)
+			YYERROR;
+		chidb_parser_addSelectAggregate(__stmt, AGG_COUNT, NULL, NULL);
+	}		
+	
+	| 
+	
+	agg_func TK_LPAREN TK_ID TK_RPAREN
+	
+	{
+		chidb_parser_addSelectAggregate(__stmt, $1, NULL, $3);
+	}		
+	
+	| 
+	
+	agg_func TK_LPAREN TK_ID TK_DOT TK_ID TK_RPAREN
+	
+	{
+		chidb_parser_addSelectAggregate(__stmt, $1, $3, $5);
+	}		
+	
+	;
+
+agg_func:
+	TK_COUNT    { $$ = AGG_COUNT; }
+	| 
+	TK_SUM      { $$ = AGG_SUM; }
+	| 
+	TK_MIN      { $$ = AGG_MIN; }
+	| 
+	TK_MAX      { $$ = AGG_MAX; }
+	| 
+	TK_AVG      { $$ = AGG_AVG; }
 	;
 
 
@@ -194,6 +266,37 @@ where_clause_r:
 	/* Empty */
 	;
 
+/* GROUP BY clause */
+
+groupby_clause: 
+	TK_GROUP TK_BY group_col groupby_clause_r 
+	| 
+	/* Empty */
+	;
+
+groupby_clause_r: 
+	TK_COMMA group_col groupby_clause_r 
+	|
+	/* Empty */
+	;
+
+group_col:
+	TK_ID
+	 
+	{
+		chidb_parser_addGroupByColumn(__stmt, NULL, $1);
+	}		
+	
+	| 
+	
+	TK_ID TK_DOT TK_ID
+	
+	{
+		chidb_parser_addGroupByColumn(__stmt, $1, $3);
+	}		
+	
+	;
+
 cond: 
 
 	cond_op1_col cond_op TK_INT 
@@ -212,6 +315,14 @@ cond:
 
 	| 
 	
+	cond_op1_col cond_op TK_PARAM 
+	
+	{
+		chidb_parser_setConditionOperand2Param(__stmt);
+	}
+
+	| 
+	
 	cond_op1_col TK_IS TK_NULL
 	
 	{
@@ -329,7 +440,7 @@ insert_statement:
 		chidb_parser_initInsertStmt(__stmt);
 	} 
 	
-	TK_ID TK_VALUES TK_LPAREN insert_val_list TK_RPAREN 
+	TK_ID TK_VALUES insert_row_list 
 	
 	{
 		chidb_parser_setInsertTable(__stmt, $4);
@@ -337,6 +448,25 @@ insert_statement:
 	
 	;
 
+insert_row_list: 
+	insert_row insert_row_list_r;
+
+insert_row_list_r: 
+	TK_COMMA insert_row insert_row_list_r 
+	| 
+	/* Empty */
+	;
+
+insert_row: 
+	TK_LPAREN insert_val_list TK_RPAREN 
+	
+	{
+		/* Every row must have as many values as the first one */
+		if (chidb_parser_endInsertRow(__stmt) != CHIDB_OK)
+			YYERROR;
+	} 
+	;
+
 insert_val_list: 
 	insert_val insert_val_list_r;
 
@@ -367,6 +497,91 @@ insert_val:
 		chidb_parser_addInsertNullValue(__stmt);
 	} 
 
+	| 
+	
+	TK_PARAM
+	{
+		chidb_parser_addInsertParamValue(__stmt);
+	} 
+
+
+/********************/
+/* DELETE statement */
+/********************/
+
+delete_statement: 
+	TK_DELETE TK_FROM TK_ID 
+	
+	{
+		chidb_parser_initDeleteStmt(__stmt, $3);
+	} 
+	
+	where_clause 
+	;
+
+
+/********************/
+/* UPDATE statement */
+/********************/
+
+update_statement: 
+	TK_UPDATE TK_ID 
+	
+	{
+		chidb_parser_initUpdateStmt(__stmt, $2);
+	} 
+	
+	TK_SET set_list where_clause 
+	;
+
+set_list: 
+	set_item set_list_r;
+
+set_list_r: 
+	TK_COMMA set_item set_list_r 
+	| 
+	/* Empty */
+	;
+
+set_item: 
+	TK_ID TK_EQ 
+	
+	{
+		chidb_parser_addUpdateColumn(__stmt, $1);
+	} 
+	
+	set_val 
+	;
+
+set_val: 
+	TK_INT 
+	
+	{
+		chidb_parser_setUpdateIntValue(__stmt, $1);
+	} 
+
+	| 
+	
+	TK_STRING
+	{
+		chidb_parser_setUpdateStrValue(__stmt, $1);
+	} 
+
+	| 
+	
+	TK_NULL
+	{
+		chidb_parser_setUpdateNullValue(__stmt);
+	} 
+
+	| 
+	
+	TK_PARAM
+	{
+		chidb_parser_setUpdateParamValue(__stmt);
+	} 
+	;
+
 
 /**************************/
 /* CREATE TABLE statement */
@@ -440,12 +655,49 @@ cr_col:
 
 createindex_statement:
 
-	TK_CREATE TK_INDEX TK_ID TK_ON TK_ID TK_LPAREN TK_ID TK_RPAREN
+	TK_CREATE TK_INDEX TK_ID TK_ON TK_ID TK_LPAREN TK_ID
 	
 	{
 		chidb_parser_initCreateIndexStmt(__stmt, $3, $5, $7);
 	} 		
 	
+	idx_collist_r TK_RPAREN idx_include
+	;
+
+
+idx_collist_r: 
+	TK_COMMA idx_col idx_collist_r 
+	| 
+	/* Empty */
+	;
+
+idx_col:
+	TK_ID
+
+	{
+		chidb_parser_addCreateIndexColumn(__stmt, $1, false);
+	}
+	;
+
+idx_include:
+	TK_INCLUDE TK_LPAREN idx_include_col idx_include_r TK_RPAREN
+	| 
+	/* Empty */
+	;
+
+idx_include_r: 
+	TK_COMMA idx_include_col idx_include_r 
+	| 
+	/* Empty */
+	;
+
+idx_include_col:
+	TK_ID
+
+	{
+		chidb_parser_addCreateIndexColumn(__stmt, $1, true);
+	}
+	;
 
 
 %%
@@ -459,7 +711,9 @@ int chidb_parser(const char *sql, SQLStatement **stmt)
 {
 	int rc;
 	
+	pthread_mutex_lock(&chidb_parser_lock);
 	__stmt = malloc(sizeof(SQLStatement));
+	__stmt->nparams = 0;
 	
 	TRACEF("The SQL statement to parse is: %s", sql);
 	
@@ -470,11 +724,14 @@ int chidb_parser(const char *sql, SQLStatement **stmt)
 	if (rc == 0)
 	{
 		*stmt = __stmt;
-		return CHIDB_OK;
+		rc = CHIDB_OK;
 	}
 	else
 	{
 		free(__stmt);
-		return CHIDB_EINVALIDSQL;
+		rc = CHIDB_EINVALIDSQL;
 	}
+	pthread_mutex_unlock(&chidb_parser_lock);
+	
+	return rc;
 }
@@ -52,15 +52,13 @@ int putVarint32(uint8_t *p, uint32_t v)
 
 void chidb_BTree_recordPrinter(BTreeNode *btn, BTreeCell *btc)
 {
-	DBRecord *dbr;
+	DBRecordView view;
 	
-	chidb_DBRecord_unpack(&dbr, btc->fields.tableLeaf.data);
+	chidb_DBRecordView_init(&view, btc->fields.tableLeaf.data);
 	
 	printf("< %5i >", btc->key);
-	chidb_DBRecord_print(dbr);
+	chidb_DBRecordView_print(&view);
 	printf("\n");
-	 
-	free(dbr);
 }
 
 void chidb_BTree_stringPrinter(BTreeNode *btn, BTreeCell *btc)
@@ -92,8 +90,16 @@ int chidb_Btree_print(BTree *bt, npage_t npage, fBTreeCellPrinter printer, bool
 		{
 			BTreeCell btc;
 			
+			uint8_t *data = NULL;
+			
 			chidb_Btree_getCell(btn, i, &btc);
-			printer(btn, &btc);			
+			/* printers get the whole record, even if it overflows */
+			if (btc.fields.tableLeaf.overflow_page != 0 &&
+			    (data = malloc(btc.fields.tableLeaf.data_size)) != NULL &&
+			    chidb_Btree_getCellData(bt, &btc, data) == CHIDB_OK)
+				btc.fields.tableLeaf.data = data;
+			printer(btn, &btc);
+			free(data);
 		}
 	}
 	else if (btn->type == PGTYPE_TABLE_INTERNAL)
@@ -11,35 +11,93 @@
 \*****************************************************************************/
 
 #include <histedit.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <chidb.h>
 
 #define COL_SEPARATOR "|"
+#define IMPORT_COMMAND ".import"
 
 char * prompt(EditLine *e) 
 {
   return "chidb> ";
 }
 
+/* .import FILE TABLE: load the rows of a CSV file into a table */
+void import(chidb *db, const char *cmd)
+{
+  char file[256], table[256];
+  uint32_t nrows;
+  int rc;
+
+  if (sscanf(cmd, IMPORT_COMMAND " %255s %255s", file, table) != 2)
+  {
+    printf("Usage: " IMPORT_COMMAND " FILE TABLE\n");
+    return;
+  }
+
+  rc = chidb_import(db, file, table, &nrows);
+  switch(rc)
+  {
+    case CHIDB_OK:
+      break;
+    case CHIDB_ECANTOPEN:
+      printf("ERROR: Could not open file %s.\n", file);
+      break;
+    case CHIDB_EINVALIDSQL:
+      printf("ERROR: No such table: %s.\n", table);
+      break;
+    case CHIDB_EMISUSE:
+      printf("ERROR: Table %s has no integer primary key.\n", table);
+      break;
+    case CHIDB_ECONSTRAINT:
+      printf("ERROR: SQL statement failed because of a constraint violation.\n");
+      break;
+    case CHIDB_EMISMATCH:
+      printf("ERROR: Data type mismatch.\n");
+      break;
+    case CHIDB_ENOMEM:
+      printf("ERROR: Could not allocate memory.\n");
+      break;
+    default:
+      printf("ERROR: An I/O error has occurred when accessing the file.\n");
+      break;
+  }
+  printf("%u rows imported.\n", nrows);
+}
+
 int main(int argc, char *argv[]) 
 {
   EditLine *el;
   History *hist;
   chidb *db;
+  const char *file;
   int rc;
 
   HistEvent ev;
 
-  if (argc != 2)
+  /* chidb [-p PAGESIZE] FILE: the page size is only used for new files */
+  uint32_t page_size = DEFAULT_PAGE_SIZE;
+  if (argc == 4 && !strcmp(argv[1], "-p"))
+    page_size = strtoul(argv[2], NULL, 10);
+  else if (argc != 2)
   {
     fprintf(stderr, "ERROR: Must specify a database file.\n");
     return 1;
   }
+  file = argv[argc - 1];
 
-  rc = chidb_open(argv[1], &db); 
+  rc = chidb_open_pagesize(file, &db, page_size); 
   
-  if (rc != CHIDB_OK)
+  if (rc == CHIDB_EMISUSE)
+  {
+    fprintf(stderr, "ERROR: Page size must be a power of two between %d and %d.\n", MIN_PAGE_SIZE, MAX_PAGE_SIZE);
+    return 1;
+  }
+  else if (rc != CHIDB_OK)
   {
-    fprintf(stderr, "ERROR: Could not open file %s or file is not well formed.\n", argv[1]);
+    fprintf(stderr, "ERROR: Could not open file %s or file is not well formed.\n", file);
     return 1;
   }
 
@@ -71,6 +129,12 @@ int main(int argc, char *argv[])
       else
       {
         history(hist, &ev, H_ENTER, sql); // Add to history
+
+        if (strncmp(sql, IMPORT_COMMAND, strlen(IMPORT_COMMAND)) == 0)
+        {
+          import(db, sql);
+          continue;
+        }
         
       rc = chidb_prepare(db, sql, &stmt);
       
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <pthread.h>
 #include "CUnit/Basic.h"
 #include "libchidb/btree.h"
 #include "libchidb/util.h"
@@ -493,6 +494,31 @@ void test_3_10(void)
   free(db);
 }
 
+void test_3_11(void)
+{
+  chidb *db;
+  uint32_t cookie;
+  int rc;
+  
+  create_temp_file(TESTFILE_1);
+  
+  db = malloc(sizeof(chidb));
+  chidb_Btree_open(TEMPFILE, db, &db->bt);
+  rc = chidb_Btree_getSchemaCookie(db->bt, &cookie);
+  CU_ASSERT(rc == CHIDB_OK);
+  CU_ASSERT(cookie == 0);
+  chidb_Btree_incrSchemaCookie(db->bt);
+  chidb_Btree_incrSchemaCookie(db->bt);
+  chidb_Btree_close(db->bt);
+  
+  rc = chidb_Btree_open(TEMPFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  chidb_Btree_getSchemaCookie(db->bt, &cookie);
+  CU_ASSERT(cookie == 2);
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
 
 
 
@@ -709,7 +735,7 @@ void test_4_4(void)
 
 void test_values(BTree *bt, key_t *keys, char **values, key_t nkeys)
 {
-  uint16_t size;
+  uint32_t size;
   uint8_t *data;
   int rc;	
   
@@ -735,7 +761,7 @@ void test_5_1(void)
 void test_5_2(void)
 {
   chidb *db;
-  uint16_t size;
+  uint32_t size;
   uint8_t *data;
   key_t nokeys[] = {0,4,6,8,9,11,18,27,36,40,100,650,1500,2500,3500,4500,5500};
   int rc;
@@ -818,10 +844,15 @@ void insert_bigfile(chidb *db, int i)
 void test_bigfile(chidb *db)
 {
   int rc;
+  uint32_t count;
+  
+  rc = chidb_Btree_countEntries(db->bt, 1, &count);
+  CU_ASSERT(rc == CHIDB_OK);
+  CU_ASSERT(count == bigfile_nvalues);
   
   for (int i=0; i<bigfile_nvalues; i++) {
     uint8_t* buf;
-    uint16_t size;
+    uint32_t size;
     uint8_t data[192];
     int datalen = ((bigfile_pkeys[i] % 3) + 1) * 64;
     
@@ -873,7 +904,7 @@ void test_index_bigfile(chidb *db, npage_t index_nroot)
   int rc;
   for (int i=0; i<bigfile_nvalues; i++) {
     uint8_t* buf;
-    uint16_t size;
+    uint32_t size;
     uint8_t data[192];
     key_t pkey;
     
@@ -1028,80 +1059,1517 @@ void test_8_3(void)
   free(db);
 }
 
-int init_tests_btree()
+uint32_t free_pages(BTree *bt)
+{
+  uint8_t header[100];
+  chidb_Pager_readHeader(bt->pager, header);
+  return get4byte(header + 0x24);
+}
+
+void test_9_1(void)
 {
-  CU_pSuite openexistingTests, loadnodeTests, createwriteTests, opennewTests, cellTests, findTests, insertnosplitTests, insertTests, indexTests;
+  chidb *db;
+  int rc;
+  npage_t npage, npages;
   
-  /* add suites to the registry */
-  if (
-      NULL == (openexistingTests =  CU_add_suite("Step 1a: Opening an existing chidb file", NULL, NULL))	||
-      NULL == (loadnodeTests =      CU_add_suite("Step 2: Loading a B-Tree node from the file", NULL, NULL))	||
-      NULL == (createwriteTests =   CU_add_suite("Step 3: Creating and writing a B-Tree node to disk", NULL, NULL))	||
-      NULL == (opennewTests =       CU_add_suite("Step 1b: Opening a new chidb file", NULL, NULL))	||
-      NULL == (cellTests =          CU_add_suite("Step 4: Manipulating B-Tree cells", NULL, NULL))	||
-      NULL == (findTests =          CU_add_suite("Step 5: Finding a value in a B-Tree", NULL, NULL))	||
-      NULL == (insertnosplitTests = CU_add_suite("Step 6: Insertion into a leaf without splitting", NULL, NULL))	||
-      NULL == (insertTests =        CU_add_suite("Step 7: Insertion with splitting", NULL, NULL))	||
-      NULL == (indexTests =         CU_add_suite("Step 8: Supporting index B-Trees", NULL, NULL))
-      ) 
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  
+  for (int i=0; i<bigfile_nvalues; i++)
+    insert_bigfile(db, i);	
+  npages = db->bt->pager->n_pages;
+  
+  chidb_Btree_newNode(db->bt, &npage, PGTYPE_INDEX_LEAF);
+  for (int i=0; i<bigfile_nvalues; i++)
+    chidb_Btree_insertInIndex(db->bt, npage, bigfile_ikeys[i], bigfile_pkeys[i]);
+  npage_t index_npages = db->bt->pager->n_pages - npages;
+  
+  /* Drop the index, then build it again from the free pages (in the
+   * same order, so that it is split the same way) */
+  rc = chidb_Btree_freeTree(db->bt, npage);
+  CU_ASSERT(rc == CHIDB_OK);
+  CU_ASSERT(free_pages(db->bt) == index_npages);
+  
+  chidb_Btree_newNode(db->bt, &npage, PGTYPE_INDEX_LEAF);
+  for (int i=0; i<bigfile_nvalues; i++)
+    chidb_Btree_insertInIndex(db->bt, npage, bigfile_ikeys[i], bigfile_pkeys[i]);
+  CU_ASSERT(db->bt->pager->n_pages == npages + index_npages);
+  
+  test_bigfile(db);
+  test_index_bigfile(db, npage);
+  
+  /* The free-list must not make the header look corrupt */
+  uint8_t header[100];
+  chidb_Pager_readHeader(db->bt->pager, header);
+  CU_ASSERT(chidb_validate_file_header(header) == CHIDB_OK);
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+#define NFREE (600) // More than fit in one trunk page
+
+void test_9_2(void)
+{
+  chidb *db;
+  int rc;
+  npage_t npage;
+  bool used[NFREE + 2] = {false};
+  
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  
+  for (int i=0; i<NFREE; i++)
+    chidb_Btree_newNode(db->bt, &npage, PGTYPE_TABLE_LEAF);
+  CU_ASSERT(db->bt->pager->n_pages == NFREE + 1);
+  
+  for (npage=2; npage<=NFREE+1; npage++)
+    CU_ASSERT(chidb_Btree_freePage(db->bt, npage) == CHIDB_OK);
+  CU_ASSERT(free_pages(db->bt) == NFREE);
+  CU_ASSERT(chidb_Btree_freePage(db->bt, 1) == CHIDB_EPAGENO);
+  
+  /* Every page comes back exactly once, and the file does not grow */
+  for (int i=0; i<NFREE; i++)
+  {
+    rc = chidb_Btree_newNode(db->bt, &npage, PGTYPE_TABLE_LEAF);
+    CU_ASSERT(rc == CHIDB_OK);
+    CU_ASSERT_FATAL(npage >= 2 && npage <= NFREE + 1);
+    CU_ASSERT(!used[npage]);
+    used[npage] = true;
+  }
+  CU_ASSERT(free_pages(db->bt) == 0);
+  CU_ASSERT(db->bt->pager->n_pages == NFREE + 1);
+  
+  chidb_Btree_newNode(db->bt, &npage, PGTYPE_TABLE_LEAF);
+  CU_ASSERT(npage == NFREE + 2);
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/*
+ * Step 10: Deleting and updating entries
+ *
+ */
+
+void test_10_1(void)
+{
+  chidb *db;
+  int rc;
+  uint32_t count;
+  uint8_t *buf;
+  uint32_t size;
+  BTreeNode *btn;
+  
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  
+  for (int i=0; i<bigfile_nvalues; i++)
+    insert_bigfile(db, i);
+  
+  /* Delete every other entry, the rest must still be there */
+  for (int i=1; i<bigfile_nvalues; i+=2)
+    CU_ASSERT(chidb_Btree_delete(db->bt, 1, bigfile_pkeys[i]) == CHIDB_OK);
+  CU_ASSERT(chidb_Btree_delete(db->bt, 1, bigfile_pkeys[1]) == CHIDB_ENOTFOUND);
+  
+  rc = chidb_Btree_countEntries(db->bt, 1, &count);
+  CU_ASSERT(rc == CHIDB_OK);
+  CU_ASSERT(count == bigfile_nvalues / 2);
+  CU_ASSERT(free_pages(db->bt) > 0);
+  
+  for (int i=0; i<bigfile_nvalues; i++)
+  {
+    rc = chidb_Btree_find(db->bt, 1, bigfile_pkeys[i], &buf, &size);
+    if (i % 2)
     {
-      CU_cleanup_registry();
-      return CU_get_error();
+      CU_ASSERT(rc == CHIDB_ENOTFOUND);
+    }
+    else
+    {
+      CU_ASSERT(rc == CHIDB_OK);
+      CU_ASSERT(size == ((bigfile_pkeys[i] % 3) + 1) * 64);
+      free(buf);
     }
+  }
   
-  if (
-      /* Step 1a */
-      (NULL == CU_add_test(openexistingTests, "1a.1", test_1a_1)) ||
-      (NULL == CU_add_test(openexistingTests, "1a.2", test_1a_2)) ||
-      (NULL == CU_add_test(openexistingTests, "1a.3", test_1a_3)) ||
-      
-      /* Step 2 */
-      (NULL == CU_add_test(loadnodeTests, "2.1", test_2_1)) ||
-      (NULL == CU_add_test(loadnodeTests, "2.2", test_2_2)) ||
-      (NULL == CU_add_test(loadnodeTests, "2.3", test_2_3)) ||
-      (NULL == CU_add_test(loadnodeTests, "2.4", test_2_4)) ||
-      (NULL == CU_add_test(loadnodeTests, "2.5", test_2_5)) ||
-      (NULL == CU_add_test(loadnodeTests, "2.6", test_2_6)) ||
-		
-      /* Step 3 */
-      (NULL == CU_add_test(createwriteTests, "3.1", test_3_1)) ||
-      (NULL == CU_add_test(createwriteTests, "3.2", test_3_2)) ||
-      (NULL == CU_add_test(createwriteTests, "3.3", test_3_3)) ||
-      (NULL == CU_add_test(createwriteTests, "3.4", test_3_4)) ||
-      (NULL == CU_add_test(createwriteTests, "3.5", test_3_5)) ||
-      (NULL == CU_add_test(createwriteTests, "3.6", test_3_6)) ||
-      (NULL == CU_add_test(createwriteTests, "3.7", test_3_7)) ||
-      (NULL == CU_add_test(createwriteTests, "3.8", test_3_8)) ||
-      (NULL == CU_add_test(createwriteTests, "3.9", test_3_9)) ||
-      (NULL == CU_add_test(createwriteTests, "3.10", test_3_10)) ||
-      
-      /* Step 1b */
-      (NULL == CU_add_test(opennewTests, "1b.1", test_1b_1)) ||
-      (NULL == CU_add_test(opennewTests, "1b.2", test_1b_2)) ||
-      
-      /* Step 4 */
-      (NULL == CU_add_test(cellTests, "4.1", test_4_1)) ||
-      (NULL == CU_add_test(cellTests, "4.2", test_4_2)) ||
-      (NULL == CU_add_test(cellTests, "4.3", test_4_3)) ||
-      (NULL == CU_add_test(cellTests, "4.4", test_4_4)) ||
-      
-      /* Step 5 */
-      (NULL == CU_add_test(findTests, "5.1", test_5_1)) ||
-      (NULL == CU_add_test(findTests, "5.2", test_5_2)) ||
-      
-      /* Step 6 */
-      (NULL == CU_add_test(insertnosplitTests, "6.1", test_6_1)) ||
-      (NULL == CU_add_test(insertnosplitTests, "6.2", test_6_2)) ||
-      
-      /* Step 7 */
-      (NULL == CU_add_test(insertTests, "7.1", test_7_1)) ||
-      (NULL == CU_add_test(insertTests, "7.2", test_7_2)) ||
-      (NULL == CU_add_test(insertTests, "7.3", test_7_3)) ||
-      
-      /* Step 8 */
-      (NULL == CU_add_test(indexTests, "8.1", test_8_1)) ||
-      (NULL == CU_add_test(indexTests, "8.2", test_8_2)) ||
-      (NULL == CU_add_test(indexTests, "8.3", test_8_3)) 
+  /* Deleting the rest leaves an empty leaf, and every other page free */
+  for (int i=0; i<bigfile_nvalues; i+=2)
+    CU_ASSERT(chidb_Btree_delete(db->bt, 1, bigfile_pkeys[i]) == CHIDB_OK);
+  
+  rc = chidb_Btree_countEntries(db->bt, 1, &count);
+  CU_ASSERT(count == 0);
+  CU_ASSERT(free_pages(db->bt) == db->bt->pager->n_pages - 1);
+  chidb_Btree_getNodeByPage(db->bt, 1, &btn);
+  CU_ASSERT(btn->type == PGTYPE_TABLE_LEAF);
+  CU_ASSERT(btn->n_cells == 0);
+  chidb_Btree_freeMemNode(db->bt, btn);
+  
+  /* ... and the freed pages are used again */
+  npage_t npages = db->bt->pager->n_pages;
+  for (int i=0; i<bigfile_nvalues; i++)
+    insert_bigfile(db, i);
+  test_bigfile(db);
+  CU_ASSERT(db->bt->pager->n_pages == npages);
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+void test_10_2(void)
+{
+  chidb *db;
+  int rc;
+  uint8_t *buf;
+  uint32_t size;
+  uint8_t data[256];
+  
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  
+  for (int i=0; i<bigfile_nvalues; i++)
+    insert_bigfile(db, i);
+  npage_t npages = db->bt->pager->n_pages;
+  
+  /* Same size: the data is overwritten in place */
+  memset(data, 0xAB, sizeof(data));
+  for (int i=0; i<bigfile_nvalues; i+=3)
+  {
+    int datalen = ((bigfile_pkeys[i] % 3) + 1) * 64;
+    CU_ASSERT(chidb_Btree_update(db->bt, 1, bigfile_pkeys[i], data, datalen) == CHIDB_OK);
+  }
+  CU_ASSERT(db->bt->pager->n_pages == npages);
+  
+  /* Different size: the entry is replaced */
+  for (int i=1; i<bigfile_nvalues; i+=3)
+    CU_ASSERT(chidb_Btree_update(db->bt, 1, bigfile_pkeys[i], data, 256) == CHIDB_OK);
+  CU_ASSERT(chidb_Btree_update(db->bt, 1, 0, data, 8) == CHIDB_ENOTFOUND);
+  
+  for (int i=0; i<bigfile_nvalues; i++)
+  {
+    int datalen = ((bigfile_pkeys[i] % 3) + 1) * 64;
+    rc = chidb_Btree_find(db->bt, 1, bigfile_pkeys[i], &buf, &size);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    if (i % 3 == 0)
+    {
+      CU_ASSERT(size == datalen && !memcmp(buf, data, datalen));
+    }
+    else if (i % 3 == 1)
+    {
+      CU_ASSERT(size == 256 && !memcmp(buf, data, 256));
+    }
+    else
+    {
+      CU_ASSERT(size == datalen && get4byte(buf) == bigfile_ikeys[i]);
+    }
+    free(buf);
+  }
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/*
+ * Step 11: Overflow pages
+ *
+ */
+
+#define OVERFLOW_NVALUES (9)
+#define OVERFLOW_MAXSIZE (100000)
+#define OVERFLOW_KEY(i) (0x0FFFFF00 + (i))
+uint32_t overflow_sizes[] = {239, 240, 1000, 1100, 2032, 5000, 40000, 65535, OVERFLOW_MAXSIZE};
+
+void fill_overflow_data(uint8_t *data, uint32_t size, int seed)
+{
+  for (uint32_t j = 0; j < size; j++)
+    data[j] = (uint8_t) (seed * 7 + j * 13 + j / 251);
+}
+
+void test_overflow_values(BTree *bt, uint8_t *data)
+{
+  uint8_t *buf;
+  uint32_t size;
+  
+  for (int i = 0; i < OVERFLOW_NVALUES; i++)
+  {
+    CU_ASSERT_FATAL(chidb_Btree_find(bt, 1, OVERFLOW_KEY(i), &buf, &size) == CHIDB_OK);
+    fill_overflow_data(data, overflow_sizes[i], i);
+    CU_ASSERT(size == overflow_sizes[i]);
+    CU_ASSERT(!memcmp(buf, data, overflow_sizes[i]));
+    free(buf);
+  }
+}
+
+void test_overflow_cells(BTree *bt, npage_t npage)
+{
+  BTreeNode *btn;
+  BTreeCell btc;
+  
+  chidb_Btree_getNodeByPage(bt, npage, &btn);
+  for (ncell_t i = 0; i < btn->n_cells; i++)
+  {
+    chidb_Btree_getCell(btn, i, &btc);
+    if (btn->type == PGTYPE_TABLE_INTERNAL)
+    {
+      test_overflow_cells(bt, btc.fields.tableInternal.child_page);
+      continue;
+    }
+    CU_ASSERT(chidb_Btree_cellSize(btn, &btc) + 2 <= (bt->pager->page_size - INTPG_CELLSOFFSET_OFFSET) / 4);
+    CU_ASSERT((btc.fields.tableLeaf.overflow_page != 0) ==
+	      (btc.fields.tableLeaf.data_size > TABLELEAFCELL_MAX_LOCAL(bt->pager->page_size)));
+  }
+  if (btn->type == PGTYPE_TABLE_INTERNAL)
+    test_overflow_cells(bt, btn->right_page);
+  chidb_Btree_freeMemNode(bt, btn);
+}
+
+void test_11_1(void)
+{
+  chidb *db;
+  int rc;
+  uint8_t *data = malloc(OVERFLOW_MAXSIZE);
+  
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  
+  /* Large entries among small ones, so that they are moved by splits.
+   * Keys are larger than any key in bigfile */
+  for (int i=0; i<bigfile_nvalues; i++)
+  {
+    insert_bigfile(db, i);
+    if (i % 100 == 0 && i / 100 < OVERFLOW_NVALUES)
+    {
+      int k = i / 100;
+      fill_overflow_data(data, overflow_sizes[k], k);
+      rc = chidb_Btree_insertInTable(db->bt, 1, OVERFLOW_KEY(k), data, overflow_sizes[k]);
+      CU_ASSERT(rc == CHIDB_OK);
+    }
+  }
+  test_overflow_values(db->bt, data);
+  
+  /* No cell takes more than a quarter of a page */
+  test_overflow_cells(db->bt, 1);
+  
+  /* Deleting the entries frees their overflow pages, which are reused */
+  npage_t npages = db->bt->pager->n_pages;
+  for (int i = 0; i < OVERFLOW_NVALUES; i++)
+    CU_ASSERT(chidb_Btree_delete(db->bt, 1, OVERFLOW_KEY(i)) == CHIDB_OK);
+  CU_ASSERT(free_pages(db->bt) >= 65535 / db->bt->pager->page_size);
+  
+  for (int i = 0; i < OVERFLOW_NVALUES; i++)
+  {
+    fill_overflow_data(data, overflow_sizes[i], i);
+    rc = chidb_Btree_insertInTable(db->bt, 1, OVERFLOW_KEY(i), data, overflow_sizes[i]);
+    CU_ASSERT(rc == CHIDB_OK);
+  }
+  /* (the leaves are not split the same way, so one more may be needed) */
+  CU_ASSERT(db->bt->pager->n_pages <= npages + 1);
+  test_overflow_values(db->bt, data);
+  
+  /* A duplicate key leaves no overflow pages behind */
+  npages = db->bt->pager->n_pages;
+  uint32_t nfree = free_pages(db->bt);
+  rc = chidb_Btree_insertInTable(db->bt, 1, OVERFLOW_KEY(0), data, 40000);
+  CU_ASSERT(rc == CHIDB_EDUPLICATE);
+  CU_ASSERT(db->bt->pager->n_pages - free_pages(db->bt) == npages - nfree);
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+  free(data);
+}
+
+void test_11_2(void)
+{
+  chidb *db;
+  int rc;
+  uint8_t *buf;
+  uint32_t size;
+  uint8_t *data = malloc(65535);
+  
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  
+  for (int i=0; i<bigfile_nvalues; i++)
+    insert_bigfile(db, i);
+  
+  /* Small entries become large ones... */
+  fill_overflow_data(data, 5000, 1);
+  for (int i=0; i<bigfile_nvalues; i+=50)
+    CU_ASSERT(chidb_Btree_update(db->bt, 1, bigfile_pkeys[i], data, 5000) == CHIDB_OK);
+  for (int i=0; i<bigfile_nvalues; i+=50)
+  {
+    CU_ASSERT_FATAL(chidb_Btree_find(db->bt, 1, bigfile_pkeys[i], &buf, &size) == CHIDB_OK);
+    CU_ASSERT(size == 5000 && !memcmp(buf, data, 5000));
+    free(buf);
+  }
+  
+  /* ...and are rewritten over and over without growing the file */
+  npage_t npages = db->bt->pager->n_pages;
+  for (int round=2; round<5; round++)
+  {
+    fill_overflow_data(data, 5000, round);
+    for (int i=0; i<bigfile_nvalues; i+=50)
+      CU_ASSERT(chidb_Btree_update(db->bt, 1, bigfile_pkeys[i], data, 5000) == CHIDB_OK);
+  }
+  CU_ASSERT(db->bt->pager->n_pages == npages);
+  
+  /* Back to small entries, all the overflow pages are free */
+  uint32_t nfree = free_pages(db->bt);
+  for (int i=0; i<bigfile_nvalues; i+=50)
+    CU_ASSERT(chidb_Btree_update(db->bt, 1, bigfile_pkeys[i], data, 64) == CHIDB_OK);
+  CU_ASSERT(free_pages(db->bt) >= nfree + (bigfile_nvalues / 50) * (5000 / db->bt->pager->page_size));
+  for (int i=0; i<bigfile_nvalues; i+=50)
+  {
+    CU_ASSERT_FATAL(chidb_Btree_find(db->bt, 1, bigfile_pkeys[i], &buf, &size) == CHIDB_OK);
+    CU_ASSERT(size == 64 && !memcmp(buf, data, 64));
+    free(buf);
+  }
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+  free(data);
+}
+
+/* Large entries mixed with small ones, in random key order, at several
+ * page sizes: a split must leave room for the new entry in the half it
+ * goes to, whichever half the large entries end up in */
+#define MIXED_NVALUES (600)
+
+void test_11_3(void)
+{
+  chidb *db;
+  int rc;
+  uint8_t *buf;
+  uint32_t size;
+  uint32_t page_sizes[] = {512, 1024, 4096, 65536};
+  key_t keys[MIXED_NVALUES];
+  uint32_t sizes[MIXED_NVALUES];
+  uint32_t seed = 12345;
+
+  for (int k = 0; k < 4; k++)
+  {
+    uint32_t large = TABLELEAFCELL_MAX_LOCAL(page_sizes[k]);
+    uint8_t *data = malloc(large);
+
+    /* shuffle the keys, and make about half the entries large */
+    for (int i = 0; i < MIXED_NVALUES; i++)
+      keys[i] = i + 1;
+    for (int i = MIXED_NVALUES - 1; i >= 0; i--)
+    {
+      seed = seed * 1103515245 + 12345;
+      int j = (seed >> 8) % (i + 1);
+      key_t tmp = keys[i];
+      keys[i] = keys[j];
+      keys[j] = tmp;
+      seed = seed * 1103515245 + 12345;
+      sizes[i] = ((seed >> 10) & 1) ? large : 8;
+    }
+
+    remove(NEWFILE);
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_openPageSize(NEWFILE, db, &db->bt, page_sizes[k]);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    for (int i = 0; i < MIXED_NVALUES; i++)
+    {
+      fill_overflow_data(data, sizes[i], keys[i]);
+      rc = chidb_Btree_insertInTable(db->bt, 1, keys[i], data, sizes[i]);
+      CU_ASSERT_FATAL(rc == CHIDB_OK);
+    }
+
+    for (int i = 0; i < MIXED_NVALUES; i++)
+    {
+      CU_ASSERT_FATAL(chidb_Btree_find(db->bt, 1, keys[i], &buf, &size) == CHIDB_OK);
+      fill_overflow_data(data, sizes[i], keys[i]);
+      CU_ASSERT(size == sizes[i] && !memcmp(buf, data, sizes[i]));
+      free(buf);
+    }
+    test_overflow_cells(db->bt, 1);
+
+    chidb_Btree_close(db->bt);
+    free(db);
+    free(data);
+  }
+  remove(NEWFILE);
+}
+
+/*
+ * Step 12: Page sizes
+ *
+ */
+
+uint32_t test_page_sizes[] = {1024, 4096, 16384, 65536};
+#define TEST_NPAGE_SIZES (4)
+
+int tree_depth(BTree *bt, npage_t nroot)
+{
+  BTreeNode *btn;
+  int depth = 1;
+  
+  chidb_Btree_getNodeByPage(bt, nroot, &btn);
+  while (btn->type == PGTYPE_TABLE_INTERNAL)
+  {
+    npage_t child = btn->right_page;
+    chidb_Btree_freeMemNode(bt, btn);
+    chidb_Btree_getNodeByPage(bt, child, &btn);
+    depth++;
+  }
+  chidb_Btree_freeMemNode(bt, btn);
+  return depth;
+}
+
+void test_12_1(void)
+{
+  int rc;
+  chidb *db;
+  MemPage *page;
+  BTreeNode *btn;
+  uint32_t page_size;
+  
+  for (int k = 0; k < TEST_NPAGE_SIZES; k++)
+  {
+    page_size = test_page_sizes[k];
+    remove(NEWFILE);
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_openPageSize(NEWFILE, db, &db->bt, page_size);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    CU_ASSERT(db->bt->pager->page_size == page_size);
+    
+    /* 65536 is stored as 1 in the file header, and as 0 in the
+     * Cells-Offset of an empty page */
+    rc = chidb_Pager_readPage(db->bt->pager, 1, &page);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    CU_ASSERT(get2byte(&page->data[16]) == ((page_size == 65536) ? 1 : page_size));
+    CU_ASSERT(get2byte(&page->data[105]) == (page_size & 0xFFFF));
+    chidb_Pager_releaseMemPage(db->bt->pager, page);
+    
+    chidb_Btree_close(db->bt);
+    
+    /* The page size of an existing file is the one in its header */
+    rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    CU_ASSERT(db->bt->pager->page_size == page_size);
+    CU_ASSERT(db->bt->pager->n_pages == 1);
+    chidb_Btree_getNodeByPage(db->bt, 1, &btn);
+    CU_ASSERT(btn->cells_offset == page_size);
+    chidb_Btree_freeMemNode(db->bt, btn);
+    
+    chidb_Btree_close(db->bt);
+    free(db);
+  }
+  remove(NEWFILE);
+}
+
+void test_12_2(void)
+{
+  int rc;
+  chidb *db;
+  int depth[TEST_NPAGE_SIZES];
+  uint8_t *data = malloc(OVERFLOW_MAXSIZE);
+  
+  for (int k = 0; k < TEST_NPAGE_SIZES; k++)
+  {
+    remove(NEWFILE);
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_openPageSize(NEWFILE, db, &db->bt, test_page_sizes[k]);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    
+    for (int i=0; i<bigfile_nvalues; i++)
+      insert_bigfile(db, i);
+    for (int i = 0; i < OVERFLOW_NVALUES; i++)
+    {
+      fill_overflow_data(data, overflow_sizes[i], i);
+      rc = chidb_Btree_insertInTable(db->bt, 1, OVERFLOW_KEY(i), data, overflow_sizes[i]);
+      CU_ASSERT(rc == CHIDB_OK);
+    }
+    chidb_Btree_close(db->bt);
+    
+    rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    CU_ASSERT(db->bt->pager->page_size == test_page_sizes[k]);
+    
+    test_overflow_values(db->bt, data);
+    test_overflow_cells(db->bt, 1);
+    /* (test_bigfile expects only the bigfile entries) */
+    for (int i = 0; i < OVERFLOW_NVALUES; i++)
+      CU_ASSERT(chidb_Btree_delete(db->bt, 1, OVERFLOW_KEY(i)) == CHIDB_OK);
+    test_bigfile(db);
+    depth[k] = tree_depth(db->bt, 1);
+    
+    chidb_Btree_close(db->bt);
+    free(db);
+  }
+  
+  /* Larger pages make for shallower trees */
+  CU_ASSERT(depth[0] > depth[TEST_NPAGE_SIZES - 1]);
+  
+  remove(NEWFILE);
+  free(data);
+}
+
+void test_12_3(void)
+{
+  int rc;
+  chidb *db;
+  uint32_t bad_sizes[] = {0, 256, 1000, 3072, 131072};
+  
+  db = malloc(sizeof(chidb));
+  remove(NEWFILE);
+  for (int k = 0; k < 5; k++)
+  {
+    rc = chidb_Btree_openPageSize(NEWFILE, db, &db->bt, bad_sizes[k]);
+    CU_ASSERT(rc == CHIDB_EMISUSE);
+  }
+  
+  /* A file whose header has an invalid page size is corrupt */
+  create_temp_file(TESTFILE_1);
+  FILE *f = fopen(TEMPFILE, "r+b");
+  CU_ASSERT_FATAL(f != NULL);
+  fseek(f, 16, SEEK_SET);
+  fputc(0x03, f);
+  fclose(f);
+  rc = chidb_Btree_open(TEMPFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_ECORRUPTHEADER);
+  
+  free(db);
+}
+
+/* Entries of a covering index, in order, as (KeyIdx, KeyPk, extra size) */
+#define COVERING_NVALUES (1500)
+#define COVERING_KEYIDX(pk) ((pk) % 37)
+#define COVERING_SIZE(pk) (8 + (pk) % 97)
+
+void fill_covering_data(uint8_t *data, key_t pk)
+{
+  for (int j = 0; j < COVERING_SIZE(pk); j++)
+    data[j] = (pk + j) & 0xFF;
+}
+
+void test_covering_entries(BTree *bt, npage_t npage, key_t *last_idx, key_t *last_pk, uint32_t *count)
+{
+  BTreeNode *btn;
+  BTreeCell btc;
+  uint8_t data[256];
+  
+  chidb_Btree_getNodeByPage(bt, npage, &btn);
+  for (ncell_t i = 0; i < btn->n_cells; i++)
+  {
+    chidb_Btree_getCell(btn, i, &btc);
+    key_t pk;
+    uint8_t *extra;
+    uint32_t extra_size;
+    if (btn->type == PGTYPE_INDEX_INTERNAL)
+    {
+      test_covering_entries(bt, btc.fields.indexInternal.child_page, last_idx, last_pk, count);
+      pk = btc.fields.indexInternal.keyPk;
+      extra = btc.fields.indexInternal.extra;
+      extra_size = btc.fields.indexInternal.extra_size;
+    }
+    else
+    {
+      pk = btc.fields.indexLeaf.keyPk;
+      extra = btc.fields.indexLeaf.extra;
+      extra_size = btc.fields.indexLeaf.extra_size;
+    }
+    
+    CU_ASSERT(btc.key == COVERING_KEYIDX(pk));
+    CU_ASSERT(*count == 0 || btc.key > *last_idx || (btc.key == *last_idx && pk > *last_pk));
+    CU_ASSERT_FATAL(extra != NULL);
+    CU_ASSERT(extra_size == COVERING_SIZE(pk));
+    fill_covering_data(data, pk);
+    CU_ASSERT(!memcmp(extra, data, COVERING_SIZE(pk)));
+    
+    *last_idx = btc.key;
+    *last_pk = pk;
+    (*count)++;
+  }
+  if (btn->type == PGTYPE_INDEX_INTERNAL)
+    test_covering_entries(bt, btn->right_page, last_idx, last_pk, count);
+  chidb_Btree_freeMemNode(bt, btn);
+}
+
+/* Covering index with repeated index keys, inserted out of order */
+void test_13_1(void)
+{
+  chidb *db;
+  int rc;
+  npage_t npage;
+  uint8_t data[256];
+  
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  
+  chidb_Btree_newNode(db->bt, &npage, PGTYPE_INDEX_LEAF);
+  for (int i = 0; i < COVERING_NVALUES; i++)
+  {
+    key_t pk = (i * 7919) % COVERING_NVALUES + 1;
+    fill_covering_data(data, pk);
+    rc = chidb_Btree_insertInCoveringIndex(db->bt, npage, COVERING_KEYIDX(pk), pk, data, COVERING_SIZE(pk));
+    CU_ASSERT(rc == CHIDB_OK);
+  }
+  
+  key_t last_idx = 0, last_pk = 0;
+  uint32_t count = 0;
+  test_covering_entries(db->bt, npage, &last_idx, &last_pk, &count);
+  CU_ASSERT(count == COVERING_NVALUES);
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/* Duplicate entries and records that do not fit */
+void test_13_2(void)
+{
+  chidb *db;
+  int rc;
+  npage_t npage;
+  uint8_t data[1024];
+  
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  
+  memset(data, 0x42, sizeof(data));
+  chidb_Btree_newNode(db->bt, &npage, PGTYPE_INDEX_LEAF);
+  CU_ASSERT(chidb_Btree_insertInCoveringIndex(db->bt, npage, 10, 1, data, 16) == CHIDB_OK);
+  CU_ASSERT(chidb_Btree_insertInCoveringIndex(db->bt, npage, 10, 2, data, 16) == CHIDB_OK);
+  CU_ASSERT(chidb_Btree_insertInCoveringIndex(db->bt, npage, 10, 1, data, 16) == CHIDB_EDUPLICATE);
+  
+  uint32_t max = INDEXCELL_MAX_EXTRA(db->bt->pager->page_size);
+  CU_ASSERT(chidb_Btree_insertInCoveringIndex(db->bt, npage, 11, 3, data, max) == CHIDB_OK);
+  CU_ASSERT(chidb_Btree_insertInCoveringIndex(db->bt, npage, 11, 4, data, max + 1) == CHIDB_ECONSTRAINT);
+  
+  BTreeNode *btn;
+  chidb_Btree_getNodeByPage(db->bt, npage, &btn);
+  CU_ASSERT(btn->n_cells == 3);
+  chidb_Btree_freeMemNode(db->bt, btn);
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/*
+ * Step 14: Building indexes bottom-up
+ *
+ */
+
+#define BULK_NVALUES (100000)
+#define BULK_KEYIDX(pk) (3 * (pk))
+
+void test_bulk_entries(BTree *bt, npage_t npage, key_t *last_idx, uint32_t *count, uint32_t *nleaves)
+{
+  BTreeNode *btn;
+  BTreeCell btc;
+  
+  chidb_Btree_getNodeByPage(bt, npage, &btn);
+  CU_ASSERT(btn->n_cells > 0);
+  for (ncell_t i = 0; i < btn->n_cells; i++)
+  {
+    chidb_Btree_getCell(btn, i, &btc);
+    key_t pk;
+    if (btn->type == PGTYPE_INDEX_INTERNAL)
+    {
+      test_bulk_entries(bt, btc.fields.indexInternal.child_page, last_idx, count, nleaves);
+      pk = btc.fields.indexInternal.keyPk;
+    }
+    else
+      pk = btc.fields.indexLeaf.keyPk;
+    
+    CU_ASSERT(btc.key == BULK_KEYIDX(pk));
+    CU_ASSERT(*count == 0 || btc.key > *last_idx);
+    *last_idx = btc.key;
+    (*count)++;
+  }
+  if (btn->type == PGTYPE_INDEX_INTERNAL)
+    test_bulk_entries(bt, btn->right_page, last_idx, count, nleaves);
+  else
+    (*nleaves)++;
+  chidb_Btree_freeMemNode(bt, btn);
+}
+
+/* Plain index, sorted by several threads, with packed leaves */
+void test_14_1(void)
+{
+  chidb *db;
+  int rc;
+  npage_t npage;
+  Sorter sorter;
+  
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  
+  chidb_Sorter_init(&sorter, 0, 4);
+  for (int i = 0; i < BULK_NVALUES; i++)
+  {
+    key_t pk = (i * 7919) % BULK_NVALUES + 1;
+    CU_ASSERT(chidb_Sorter_add(&sorter, BULK_KEYIDX(pk), pk, 0, NULL, 0) == CHIDB_OK);
+  }
+  CU_ASSERT(chidb_Sorter_sort(&sorter) == CHIDB_OK);
+  chidb_Btree_newNode(db->bt, &npage, PGTYPE_INDEX_LEAF);
+  rc = chidb_Btree_bulkLoadIndex(db->bt, npage, &sorter);
+  CU_ASSERT(rc == CHIDB_OK);
+  chidb_Sorter_close(&sorter);
+  
+  // Every leaf is full, but for the last two
+  key_t last_idx = 0;
+  uint32_t count = 0, nleaves = 0;
+  uint32_t per_leaf = (db->bt->pager->page_size - LEAFPG_CELLSOFFSET_OFFSET) / (2 + INDEXLEAFCELL_SIZE);
+  test_bulk_entries(db->bt, npage, &last_idx, &count, &nleaves);
+  CU_ASSERT(count == BULK_NVALUES);
+  CU_ASSERT(nleaves <= BULK_NVALUES / per_leaf + 2);
+  
+  // The index can still be searched and inserted into
+  CU_ASSERT(chidb_Btree_insertInIndex(db->bt, npage, BULK_KEYIDX(4242), 4242) == CHIDB_EDUPLICATE);
+  for (key_t pk = BULK_NVALUES + 1; pk <= BULK_NVALUES + 500; pk++)
+    CU_ASSERT(chidb_Btree_insertInIndex(db->bt, npage, BULK_KEYIDX(pk), pk) == CHIDB_OK);
+  count = 0;
+  nleaves = 0;
+  test_bulk_entries(db->bt, npage, &last_idx, &count, &nleaves);
+  CU_ASSERT(count == BULK_NVALUES + 500);
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/* Covering index, with runs spilled to temporary files */
+void test_14_2(void)
+{
+  chidb *db;
+  int rc;
+  npage_t npage;
+  Sorter sorter;
+  uint8_t data[256];
+  
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  
+  chidb_Sorter_init(&sorter, 8192, 0);
+  for (int i = 0; i < COVERING_NVALUES; i++)
+  {
+    key_t pk = (i * 7919) % COVERING_NVALUES + 1;
+    fill_covering_data(data, pk);
+    rc = chidb_Sorter_add(&sorter, COVERING_KEYIDX(pk), pk, 0, data, COVERING_SIZE(pk));
+    CU_ASSERT(rc == CHIDB_OK);
+  }
+  CU_ASSERT(sorter.nruns > 1);
+  CU_ASSERT(chidb_Sorter_sort(&sorter) == CHIDB_OK);
+  chidb_Btree_newNode(db->bt, &npage, PGTYPE_INDEX_LEAF);
+  rc = chidb_Btree_bulkLoadIndex(db->bt, npage, &sorter);
+  CU_ASSERT(rc == CHIDB_OK);
+  chidb_Sorter_close(&sorter);
+  
+  key_t last_idx = 0, last_pk = 0;
+  uint32_t count = 0;
+  test_covering_entries(db->bt, npage, &last_idx, &last_pk, &count);
+  CU_ASSERT(count == COVERING_NVALUES);
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/* Duplicate keys in a plain index, and records that do not fit */
+void test_14_3(void)
+{
+  chidb *db;
+  int rc;
+  npage_t npage;
+  Sorter sorter;
+  uint8_t data[1024];
+  
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  
+  chidb_Sorter_init(&sorter, 0, 0);
+  chidb_Sorter_add(&sorter, 10, 1, 0, NULL, 0);
+  chidb_Sorter_add(&sorter, 20, 2, 0, NULL, 0);
+  chidb_Sorter_add(&sorter, 10, 3, 0, NULL, 0);
+  chidb_Sorter_sort(&sorter);
+  CU_ASSERT(chidb_Sorter_add(&sorter, 30, 4, 0, NULL, 0) == CHIDB_EMISUSE);
+  chidb_Btree_newNode(db->bt, &npage, PGTYPE_INDEX_LEAF);
+  CU_ASSERT(chidb_Btree_bulkLoadIndex(db->bt, npage, &sorter) == CHIDB_EDUPLICATE);
+  chidb_Sorter_close(&sorter);
+  
+  memset(data, 0x42, sizeof(data));
+  uint32_t max = INDEXCELL_MAX_EXTRA(db->bt->pager->page_size);
+  chidb_Sorter_init(&sorter, 0, 0);
+  chidb_Sorter_add(&sorter, 10, 1, 0, data, 16);
+  chidb_Sorter_add(&sorter, 10, 2, 0, data, max + 1);
+  chidb_Sorter_sort(&sorter);
+  chidb_Btree_newNode(db->bt, &npage, PGTYPE_INDEX_LEAF);
+  CU_ASSERT(chidb_Btree_bulkLoadIndex(db->bt, npage, &sorter) == CHIDB_ECONSTRAINT);
+  chidb_Sorter_close(&sorter);
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/*
+ * Step 15: Inserting from several threads
+ *
+ */
+
+#define LATCH_NTHREADS (4)
+#define LATCH_NVALUES (8000)
+#define LATCH_SIZE(key) ((key) % 50 == 0 ? 1500 : 16 + (key) % 64) // Some overflow
+
+struct LatchInserter
+{
+  BTree *bt;
+  npage_t nroot;
+  int t;
+  int nok;
+  int nduplicate;
+  int nfailed;
+};
+
+void fill_latch_data(uint8_t *data, key_t key)
+{
+  for (uint32_t i = 0; i < LATCH_SIZE(key); i++)
+    data[i] = (key + i) % 251;
+}
+
+/* Count the entries of an index, checking they are in order */
+void test_latch_entries(BTree *bt, npage_t npage, key_t *last, uint32_t *count)
+{
+  BTreeNode *btn;
+  BTreeCell btc;
+  
+  chidb_Btree_getNodeByPage(bt, npage, &btn);
+  for (ncell_t i = 0; i < btn->n_cells; i++)
+  {
+    chidb_Btree_getCell(btn, i, &btc);
+    if (btn->type == PGTYPE_INDEX_INTERNAL)
+      test_latch_entries(bt, btc.fields.indexInternal.child_page, last, count);
+    CU_ASSERT(*count == 0 || btc.key > *last);
+    *last = btc.key;
+    (*count)++;
+  }
+  if (btn->type == PGTYPE_INDEX_INTERNAL)
+    test_latch_entries(bt, btn->right_page, last, count);
+  chidb_Btree_freeMemNode(bt, btn);
+}
+
+/* Each thread inserts its own keys into a table, in scrambled order */
+void *test_latch_table(void *arg)
+{
+  struct LatchInserter *ins = arg;
+  uint8_t data[2048];
+  
+  for (int i = 0; i < LATCH_NVALUES / LATCH_NTHREADS; i++)
+  {
+    int j = (i * 7919) % (LATCH_NVALUES / LATCH_NTHREADS);
+    key_t key = j * LATCH_NTHREADS + ins->t + 1;
+    fill_latch_data(data, key);
+    if (chidb_Btree_insertInTable(ins->bt, ins->nroot, key, data, LATCH_SIZE(key)) == CHIDB_OK)
+      ins->nok++;
+    else
+      ins->nfailed++;
+  }
+  return NULL;
+}
+
+/* Every thread inserts the same keys into an index */
+void *test_latch_index(void *arg)
+{
+  struct LatchInserter *ins = arg;
+  
+  for (int i = 0; i < LATCH_NVALUES; i++)
+  {
+    key_t key = ((i + ins->t * 1000) * 7919) % LATCH_NVALUES + 1;
+    int rc = chidb_Btree_insertInIndex(ins->bt, ins->nroot, key, key + 1);
+    if (rc == CHIDB_OK)
+      ins->nok++;
+    else if (rc == CHIDB_EDUPLICATE)
+      ins->nduplicate++;
+    else
+      ins->nfailed++;
+  }
+  return NULL;
+}
+
+/* Threads inserting different keys into the same table */
+void test_15_1(void)
+{
+  chidb *db;
+  int rc;
+  npage_t nroot;
+  pthread_t threads[LATCH_NTHREADS];
+  struct LatchInserter ins[LATCH_NTHREADS];
+  uint8_t expected[2048];
+  
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  chidb_Btree_newNode(db->bt, &nroot, PGTYPE_TABLE_LEAF);
+  
+  for (int t = 0; t < LATCH_NTHREADS; t++)
+  {
+    ins[t].bt = db->bt;
+    ins[t].nroot = nroot;
+    ins[t].t = t;
+    ins[t].nok = ins[t].nduplicate = ins[t].nfailed = 0;
+    pthread_create(&threads[t], NULL, test_latch_table, &ins[t]);
+  }
+  for (int t = 0; t < LATCH_NTHREADS; t++)
+  {
+    pthread_join(threads[t], NULL);
+    CU_ASSERT(ins[t].nok == LATCH_NVALUES / LATCH_NTHREADS);
+    CU_ASSERT(ins[t].nfailed == 0);
+  }
+  
+  // Every entry made it in, whole
+  uint32_t count;
+  chidb_Btree_countEntries(db->bt, nroot, &count);
+  CU_ASSERT(count == LATCH_NVALUES);
+  for (key_t key = 1; key <= LATCH_NVALUES; key++)
+  {
+    uint8_t *data;
+    uint32_t size;
+    rc = chidb_Btree_find(db->bt, nroot, key, &data, &size);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    fill_latch_data(expected, key);
+    CU_ASSERT(size == LATCH_SIZE(key));
+    CU_ASSERT(!memcmp(data, expected, size));
+    free(data);
+  }
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/* Threads racing to insert the same keys into an index */
+void test_15_2(void)
+{
+  chidb *db;
+  int rc;
+  npage_t nroot;
+  pthread_t threads[LATCH_NTHREADS];
+  struct LatchInserter ins[LATCH_NTHREADS];
+  
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  chidb_Btree_newNode(db->bt, &nroot, PGTYPE_INDEX_LEAF);
+  
+  for (int t = 0; t < LATCH_NTHREADS; t++)
+  {
+    ins[t].bt = db->bt;
+    ins[t].nroot = nroot;
+    ins[t].t = t;
+    ins[t].nok = ins[t].nduplicate = ins[t].nfailed = 0;
+    pthread_create(&threads[t], NULL, test_latch_index, &ins[t]);
+  }
+  
+  // Each key went in exactly once
+  int nok = 0;
+  for (int t = 0; t < LATCH_NTHREADS; t++)
+  {
+    pthread_join(threads[t], NULL);
+    CU_ASSERT(ins[t].nfailed == 0);
+    CU_ASSERT(ins[t].nok + ins[t].nduplicate == LATCH_NVALUES);
+    nok += ins[t].nok;
+  }
+  CU_ASSERT(nok == LATCH_NVALUES);
+  
+  key_t last = 0;
+  uint32_t count = 0;
+  test_latch_entries(db->bt, nroot, &last, &count);
+  CU_ASSERT(count == LATCH_NVALUES);
+  for (key_t key = 1; key <= LATCH_NVALUES; key++)
+  {
+    key_t pk = 0;
+    chidb_Btree_findInIndex(db->bt, nroot, key, &pk);
+    CU_ASSERT(pk == key + 1);
+  }
+  
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/*
+ * Step 16: Searching nodes through their key directory
+ *
+ */
+
+#define KEYDIR_NVALUES (3000)
+
+/* Check that the slot of every key around those of a node's cells (and
+ * of its children's) is where a search one cell at a time finds it */
+void test_keydir_node(BTree *bt, npage_t npage, uint32_t *nnodes)
+{
+  BTreeNode *btn;
+  BTreeCell btc;
+
+  chidb_Btree_getNodeByPage(bt, npage, &btn);
+  (*nnodes)++;
+  for (ncell_t i = 0; i < btn->n_cells; i++)
+  {
+    chidb_Btree_getCell(btn, i, &btc);
+    for (key_t key = btc.key - 1; key != btc.key + 2; key++)
+    {
+      ncell_t slot;
+      BTreeCell other;
+      for (slot = 0; slot < btn->n_cells; slot++)
+      {
+        chidb_Btree_getCell(btn, slot, &other);
+        if (key <= other.key) break;
+      }
+      CU_ASSERT(chidb_Btree_findSlot(btn, key) == slot);
+    }
+    if (btn->type == PGTYPE_TABLE_INTERNAL)
+      test_keydir_node(bt, btc.fields.tableInternal.child_page, nnodes);
+  }
+  CU_ASSERT(chidb_Btree_findSlot(btn, 0) == 0);
+  CU_ASSERT(chidb_Btree_findSlot(btn, UINT32_MAX) == btn->n_cells);
+  if (btn->type == PGTYPE_TABLE_INTERNAL)
+    test_keydir_node(bt, btn->right_page, nnodes);
+  chidb_Btree_freeMemNode(bt, btn);
+}
+
+void test_16_1(void)
+{
+  chidb *db;
+  int rc;
+  npage_t nroot;
+  uint8_t data[64];
+
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  chidb_Btree_newNode(db->bt, &nroot, PGTYPE_TABLE_LEAF);
+
+  // Keys three apart, so some keys fall between those of two cells
+  memset(data, 0xAB, sizeof(data));
+  for (int i = 0; i < KEYDIR_NVALUES; i++)
+  {
+    key_t key = ((i * 7919) % KEYDIR_NVALUES) * 3 + 3;
+    rc = chidb_Btree_insertInTable(db->bt, nroot, key, data, 16 + key % 48);
+    CU_ASSERT(rc == CHIDB_OK);
+  }
+
+  uint32_t nnodes = 0;
+  test_keydir_node(db->bt, nroot, &nnodes);
+  CU_ASSERT(nnodes > 1);
+
+  for (key_t key = 1; key <= 3 * KEYDIR_NVALUES + 3; key++)
+  {
+    uint8_t *found;
+    uint32_t size;
+    rc = chidb_Btree_find(db->bt, nroot, key, &found, &size);
+    CU_ASSERT(rc == ((key % 3 == 0 && key <= 3 * KEYDIR_NVALUES) ? CHIDB_OK : CHIDB_ENOTFOUND));
+    if (rc == CHIDB_OK)
+    {
+      CU_ASSERT(size == 16 + key % 48);
+      free(found);
+    }
+  }
+
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/* A node's key directory follows the changes to its cells */
+void test_16_2(void)
+{
+  chidb *db;
+  int rc;
+  npage_t npage;
+  BTreeNode *btn;
+  BTreeCell btc;
+
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  chidb_Btree_newNode(db->bt, &npage, PGTYPE_INDEX_LEAF);
+  chidb_Btree_getNodeByPage(db->bt, npage, &btn);
+
+  CU_ASSERT(chidb_Btree_findSlot(btn, 10) == 0);
+  btc.type = PGTYPE_INDEX_LEAF;
+  btc.fields.indexLeaf.extra = NULL;
+  btc.fields.indexLeaf.extra_size = 0;
+  for (key_t key = 10; key <= 50; key += 10)
+  {
+    btc.key = key;
+    btc.fields.indexLeaf.keyPk = key + 1;
+    rc = chidb_Btree_insertCell(btn, btn->n_cells, &btc);
+    CU_ASSERT(rc == CHIDB_OK);
+    CU_ASSERT(chidb_Btree_findSlot(btn, key) == btn->n_cells - 1);
+    CU_ASSERT(chidb_Btree_findSlot(btn, key + 1) == btn->n_cells);
+  }
+
+  btc.key = 25;
+  chidb_Btree_insertCell(btn, 2, &btc);
+  CU_ASSERT(chidb_Btree_findSlot(btn, 25) == 2);
+  CU_ASSERT(chidb_Btree_findSlot(btn, 30) == 3);
+  chidb_Btree_removeCell(btn, 0);
+  CU_ASSERT(chidb_Btree_findSlot(btn, 25) == 1);
+  CU_ASSERT(chidb_Btree_findSlot(btn, 5) == 0);
+  CU_ASSERT(chidb_Btree_findSlot(btn, 51) == btn->n_cells);
+
+  chidb_Btree_freeMemNode(db->bt, btn);
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/* A node's key directory is decoded once, kept with the cached page for
+ * the next loads of the node, and dropped when the page is written */
+void test_16_3(void)
+{
+  chidb *db;
+  int rc;
+  npage_t npage;
+  BTreeNode *btn;
+  PageKeys *keys;
+  uint8_t data[16];
+
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  chidb_Btree_newNode(db->bt, &npage, PGTYPE_TABLE_LEAF);
+  memset(data, 0xAB, sizeof(data));
+  for (key_t key = 2; key <= 40; key += 2)
+    chidb_Btree_insertInTable(db->bt, npage, key, data, sizeof(data));
+
+  chidb_Btree_getNodeByPage(db->bt, npage, &btn);
+  CU_ASSERT(btn->page->keys == NULL);
+  CU_ASSERT(chidb_Btree_findSlot(btn, 7) == 3);
+  keys = btn->page->keys;
+  CU_ASSERT_FATAL(keys != NULL);
+  CU_ASSERT(keys->n == 20);
+  chidb_Btree_freeMemNode(db->bt, btn);
+
+  // The next load shares the directory instead of decoding it again
+  chidb_Btree_getNodeByPage(db->bt, npage, &btn);
+  CU_ASSERT(btn->page->keys == keys);
+  CU_ASSERT(chidb_Btree_findSlot(btn, 40) == 19);
+  CU_ASSERT(chidb_Btree_findSlot(btn, 41) == 20);
+  chidb_Btree_freeMemNode(db->bt, btn);
+
+  // Writing the page drops it
+  rc = chidb_Btree_insertInTable(db->bt, npage, 41, data, sizeof(data));
+  CU_ASSERT(rc == CHIDB_OK);
+  chidb_Btree_getNodeByPage(db->bt, npage, &btn);
+  CU_ASSERT(btn->page->keys == NULL);
+  CU_ASSERT(chidb_Btree_findSlot(btn, 41) == 20);
+  CU_ASSERT(chidb_Btree_findSlot(btn, 42) == 21);
+  chidb_Btree_freeMemNode(db->bt, btn);
+
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/*
+ * Step 17: Deleting index entries
+ *
+ */
+
+#define IDXDELETE_NVALUES (3000)
+
+/* Plain index: delete every other entry, then the rest */
+void test_17_1(void)
+{
+  chidb *db;
+  int rc;
+  npage_t nroot, ntable;
+  BTreeNode *btn;
+
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  chidb_Btree_newNode(db->bt, &nroot, PGTYPE_INDEX_LEAF);
+  for (int i = 0; i < IDXDELETE_NVALUES; i++)
+  {
+    key_t key = (i * 7919) % IDXDELETE_NVALUES + 1;
+    CU_ASSERT(chidb_Btree_insertInIndex(db->bt, nroot, key, key + 1) == CHIDB_OK);
+  }
+  npage_t npages = db->bt->pager->n_pages;
+
+  for (int i = 0; i < IDXDELETE_NVALUES; i++)
+  {
+    key_t key = (i * 7919) % IDXDELETE_NVALUES + 1;
+    if (key % 2 == 0)
+      CU_ASSERT(chidb_Btree_deleteFromIndex(db->bt, nroot, key, key + 1) == CHIDB_OK);
+  }
+  CU_ASSERT(chidb_Btree_deleteFromIndex(db->bt, nroot, 2, 3) == CHIDB_ENOTFOUND);
+  CU_ASSERT(chidb_Btree_deleteFromIndex(db->bt, nroot, 3, 5) == CHIDB_ENOTFOUND);
+
+  key_t last = 0;
+  uint32_t count = 0;
+  test_latch_entries(db->bt, nroot, &last, &count);
+  CU_ASSERT(count == IDXDELETE_NVALUES / 2);
+  for (key_t key = 1; key <= IDXDELETE_NVALUES; key++)
+  {
+    key_t pk = 0;
+    rc = chidb_Btree_findInIndex(db->bt, nroot, key, &pk);
+    CU_ASSERT(rc == ((key % 2) ? CHIDB_OK : CHIDB_ENOTFOUND));
+    CU_ASSERT(rc != CHIDB_OK || pk == key + 1);
+  }
+
+  // Once empty, the root is a leaf again, and the pages can be reused
+  for (key_t key = 1; key <= IDXDELETE_NVALUES; key += 2)
+    CU_ASSERT(chidb_Btree_deleteFromIndex(db->bt, nroot, key, key + 1) == CHIDB_OK);
+  chidb_Btree_getNodeByPage(db->bt, nroot, &btn);
+  CU_ASSERT(btn->type == PGTYPE_INDEX_LEAF);
+  CU_ASSERT(btn->n_cells == 0);
+  chidb_Btree_freeMemNode(db->bt, btn);
+
+  for (int i = 0; i < IDXDELETE_NVALUES; i++)
+  {
+    key_t key = (i * 7919) % IDXDELETE_NVALUES + 1;
+    CU_ASSERT(chidb_Btree_insertInIndex(db->bt, nroot, key, key + 1) == CHIDB_OK);
+  }
+  CU_ASSERT(db->bt->pager->n_pages == npages);
+
+  // Table B-Trees have their own delete
+  chidb_Btree_newNode(db->bt, &ntable, PGTYPE_TABLE_LEAF);
+  CU_ASSERT(chidb_Btree_deleteFromIndex(db->bt, ntable, 1, 2) == CHIDB_EMISUSE);
+
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/* Covering index: entries with the same KeyIdx and records of different
+ * sizes, deleted out of order */
+void test_17_2(void)
+{
+  chidb *db;
+  int rc;
+  npage_t nroot;
+  uint8_t data[256];
+
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  chidb_Btree_newNode(db->bt, &nroot, PGTYPE_INDEX_LEAF);
+  for (int i = 0; i < COVERING_NVALUES; i++)
+  {
+    key_t pk = (i * 7919) % COVERING_NVALUES + 1;
+    fill_covering_data(data, pk);
+    rc = chidb_Btree_insertInCoveringIndex(db->bt, nroot, COVERING_KEYIDX(pk), pk, data, COVERING_SIZE(pk));
+    CU_ASSERT(rc == CHIDB_OK);
+  }
+
+  uint32_t ndeleted = 0;
+  for (int i = 0; i < COVERING_NVALUES; i++)
+  {
+    key_t pk = (i * 4583) % COVERING_NVALUES + 1;
+    if (pk % 3 != 0)
+    {
+      rc = chidb_Btree_deleteFromIndex(db->bt, nroot, COVERING_KEYIDX(pk), pk);
+      CU_ASSERT(rc == CHIDB_OK);
+      ndeleted++;
+    }
+  }
+  CU_ASSERT(chidb_Btree_deleteFromIndex(db->bt, nroot, COVERING_KEYIDX(1), 1) == CHIDB_ENOTFOUND);
+  CU_ASSERT(chidb_Btree_deleteFromIndex(db->bt, nroot, COVERING_KEYIDX(3) + 1, 3) == CHIDB_ENOTFOUND);
+
+  // What is left is still in order, with the right records
+  key_t last_idx = 0, last_pk = 0;
+  uint32_t count = 0;
+  test_covering_entries(db->bt, nroot, &last_idx, &last_pk, &count);
+  CU_ASSERT(count == COVERING_NVALUES - ndeleted);
+
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+/* Covering index built bottom-up, so its nodes are full: the entry next
+ * to a deleted one often does not fit in its place */
+void test_17_3(void)
+{
+  chidb *db;
+  int rc;
+  npage_t nroot;
+  Sorter sorter;
+  uint8_t data[256];
+
+  remove(NEWFILE);
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(NEWFILE, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  chidb_Sorter_init(&sorter, 0, 1);
+  for (key_t pk = 1; pk <= COVERING_NVALUES; pk++)
+  {
+    fill_covering_data(data, pk);
+    chidb_Sorter_add(&sorter, COVERING_KEYIDX(pk), pk, 0, data, COVERING_SIZE(pk));
+  }
+  chidb_Sorter_sort(&sorter);
+  chidb_Btree_newNode(db->bt, &nroot, PGTYPE_INDEX_LEAF);
+  rc = chidb_Btree_bulkLoadIndex(db->bt, nroot, &sorter);
+  CU_ASSERT(rc == CHIDB_OK);
+  chidb_Sorter_close(&sorter);
+
+  for (int i = 0; i < COVERING_NVALUES; i++)
+  {
+    key_t pk = (i * 4583) % COVERING_NVALUES + 1;
+    rc = chidb_Btree_deleteFromIndex(db->bt, nroot, COVERING_KEYIDX(pk), pk);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+
+    if (i % 100 == 0)
+    {
+      key_t last_idx = 0, last_pk = 0;
+      uint32_t count = 0;
+      test_covering_entries(db->bt, nroot, &last_idx, &last_pk, &count);
+      CU_ASSERT(count == COVERING_NVALUES - i - 1);
+    }
+  }
+
+  chidb_Btree_close(db->bt);
+  free(db);
+}
+
+int init_tests_btree()
+{
+  CU_pSuite openexistingTests, loadnodeTests, createwriteTests, opennewTests, cellTests, findTests, insertnosplitTests, insertTests, indexTests, freelistTests, deleteTests, overflowTests, pagesizeTests, coveringTests, bulkTests, latchTests, keydirTests, idxdeleteTests;
+  
+  /* add suites to the registry */
+  if (
+      NULL == (openexistingTests =  CU_add_suite("Step 1a: Opening an existing chidb file", NULL, NULL))	||
+      NULL == (loadnodeTests =      CU_add_suite("Step 2: Loading a B-Tree node from the file", NULL, NULL))	||
+      NULL == (createwriteTests =   CU_add_suite("Step 3: Creating and writing a B-Tree node to disk", NULL, NULL))	||
+      NULL == (opennewTests =       CU_add_suite("Step 1b: Opening a new chidb file", NULL, NULL))	||
+      NULL == (cellTests =          CU_add_suite("Step 4: Manipulating B-Tree cells", NULL, NULL))	||
+      NULL == (findTests =          CU_add_suite("Step 5: Finding a value in a B-Tree", NULL, NULL))	||
+      NULL == (insertnosplitTests = CU_add_suite("Step 6: Insertion into a leaf without splitting", NULL, NULL))	||
+      NULL == (insertTests =        CU_add_suite("Step 7: Insertion with splitting", NULL, NULL))	||
+      NULL == (indexTests =         CU_add_suite("Step 8: Supporting index B-Trees", NULL, NULL))	||
+      NULL == (freelistTests =      CU_add_suite("Step 9: Reusing free pages", NULL, NULL))	||
+      NULL == (deleteTests =        CU_add_suite("Step 10: Deleting and updating entries", NULL, NULL))	||
+      NULL == (overflowTests =      CU_add_suite("Step 11: Overflow pages", NULL, NULL))	||
+      NULL == (pagesizeTests =      CU_add_suite("Step 12: Page sizes", NULL, NULL))	||
+      NULL == (coveringTests =      CU_add_suite("Step 13: Covering indexes", NULL, NULL))	||
+      NULL == (bulkTests =          CU_add_suite("Step 14: Building indexes bottom-up", NULL, NULL))	||
+      NULL == (latchTests =         CU_add_suite("Step 15: Inserting from several threads", NULL, NULL))	||
+      NULL == (keydirTests =        CU_add_suite("Step 16: Searching nodes through their key directory", NULL, NULL))	||
+      NULL == (idxdeleteTests =     CU_add_suite("Step 17: Deleting index entries", NULL, NULL))
+      ) 
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+  
+  if (
+      /* Step 1a */
+      (NULL == CU_add_test(openexistingTests, "1a.1", test_1a_1)) ||
+      (NULL == CU_add_test(openexistingTests, "1a.2", test_1a_2)) ||
+      (NULL == CU_add_test(openexistingTests, "1a.3", test_1a_3)) ||
+      
+      /* Step 2 */
+      (NULL == CU_add_test(loadnodeTests, "2.1", test_2_1)) ||
+      (NULL == CU_add_test(loadnodeTests, "2.2", test_2_2)) ||
+      (NULL == CU_add_test(loadnodeTests, "2.3", test_2_3)) ||
+      (NULL == CU_add_test(loadnodeTests, "2.4", test_2_4)) ||
+      (NULL == CU_add_test(loadnodeTests, "2.5", test_2_5)) ||
+      (NULL == CU_add_test(loadnodeTests, "2.6", test_2_6)) ||
+		
+      /* Step 3 */
+      (NULL == CU_add_test(createwriteTests, "3.1", test_3_1)) ||
+      (NULL == CU_add_test(createwriteTests, "3.2", test_3_2)) ||
+      (NULL == CU_add_test(createwriteTests, "3.3", test_3_3)) ||
+      (NULL == CU_add_test(createwriteTests, "3.4", test_3_4)) ||
+      (NULL == CU_add_test(createwriteTests, "3.5", test_3_5)) ||
+      (NULL == CU_add_test(createwriteTests, "3.6", test_3_6)) ||
+      (NULL == CU_add_test(createwriteTests, "3.7", test_3_7)) ||
+      (NULL == CU_add_test(createwriteTests, "3.8", test_3_8)) ||
+      (NULL == CU_add_test(createwriteTests, "3.9", test_3_9)) ||
+      (NULL == CU_add_test(createwriteTests, "3.10", test_3_10)) ||
+      (NULL == CU_add_test(createwriteTests, "3.11", test_3_11)) ||
+      
+      /* Step 1b */
+      (NULL == CU_add_test(opennewTests, "1b.1", test_1b_1)) ||
+      (NULL == CU_add_test(opennewTests, "1b.2", test_1b_2)) ||
+      
+      /* Step 4 */
+      (NULL == CU_add_test(cellTests, "4.1", test_4_1)) ||
+      (NULL == CU_add_test(cellTests, "4.2", test_4_2)) ||
+      (NULL == CU_add_test(cellTests, "4.3", test_4_3)) ||
+      (NULL == CU_add_test(cellTests, "4.4", test_4_4)) ||
+      
+      /* Step 5 */
+      (NULL == CU_add_test(findTests, "5.1", test_5_1)) ||
+      (NULL == CU_add_test(findTests, "5.2", test_5_2)) ||
+      
+      /* Step 6 */
+      (NULL == CU_add_test(insertnosplitTests, "6.1", test_6_1)) ||
+      (NULL == CU_add_test(insertnosplitTests, "6.2", test_6_2)) ||
+      
+      /* Step 7 */
+      (NULL == CU_add_test(insertTests, "7.1", test_7_1)) ||
+      (NULL == CU_add_test(insertTests, "7.2", test_7_2)) ||
+      (NULL == CU_add_test(insertTests, "7.3", test_7_3)) ||
+      
+      /* Step 8 */
+      (NULL == CU_add_test(indexTests, "8.1", test_8_1)) ||
+      (NULL == CU_add_test(indexTests, "8.2", test_8_2)) ||
+      (NULL == CU_add_test(indexTests, "8.3", test_8_3)) ||
+      
+      /* Step 9 */
+      (NULL == CU_add_test(freelistTests, "9.1", test_9_1)) ||
+      (NULL == CU_add_test(freelistTests, "9.2", test_9_2)) ||
+      
+      /* Step 10 */
+      (NULL == CU_add_test(deleteTests, "10.1", test_10_1)) ||
+      (NULL == CU_add_test(deleteTests, "10.2", test_10_2)) ||
+      
+      /* Step 11 */
+      (NULL == CU_add_test(overflowTests, "11.1", test_11_1)) ||
+      (NULL == CU_add_test(overflowTests, "11.2", test_11_2)) ||
+      (NULL == CU_add_test(overflowTests, "11.3", test_11_3)) ||
+      
+      /* Step 12 */
+      (NULL == CU_add_test(pagesizeTests, "12.1", test_12_1)) ||
+      (NULL == CU_add_test(pagesizeTests, "12.2", test_12_2)) ||
+      (NULL == CU_add_test(pagesizeTests, "12.3", test_12_3)) ||
+      
+      /* Step 13 */
+      (NULL == CU_add_test(coveringTests, "13.1", test_13_1)) ||
+      (NULL == CU_add_test(coveringTests, "13.2", test_13_2)) ||
+      
+      /* Step 14 */
+      (NULL == CU_add_test(bulkTests, "14.1", test_14_1)) ||
+      (NULL == CU_add_test(bulkTests, "14.2", test_14_2)) ||
+      (NULL == CU_add_test(bulkTests, "14.3", test_14_3)) ||
+      
+      /* Step 15 */
+      (NULL == CU_add_test(latchTests, "15.1", test_15_1)) ||
+      (NULL == CU_add_test(latchTests, "15.2", test_15_2)) ||
+      
+      /* Step 16 */
+      (NULL == CU_add_test(keydirTests, "16.1", test_16_1)) ||
+      (NULL == CU_add_test(keydirTests, "16.2", test_16_2)) ||
+      (NULL == CU_add_test(keydirTests, "16.3", test_16_3)) ||
+
+      /* Step 17 */
+      (NULL == CU_add_test(idxdeleteTests, "17.1", test_17_1)) ||
+      (NULL == CU_add_test(idxdeleteTests, "17.2", test_17_2)) ||
+      (NULL == CU_add_test(idxdeleteTests, "17.3", test_17_3))
       )
     {
       CU_cleanup_registry();
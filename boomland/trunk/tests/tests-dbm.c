@@ -72,7 +72,7 @@ void test_1a() {
 
     if (dbm->returned) {
       printf("Result returned ...\n");
-      chidb_DBRecord_print(dbm->result);
+      chidb_DBM_print_result(dbm);
       printf("\n");
       fflush(stdout);
     }
@@ -156,6 +156,75 @@ void test_packunpack(void)
 	}
 }
 
+void test_encode(void)
+{
+	DBRecord *dbr;
+	uint8_t *packed, *encoded;
+	uint32_t size;
+	
+	for(int i=0; i<NVALUES; i++)
+	{
+		DBRecordField fields[5] = {
+			{SQL_TEXT, 0, (uint8_t *) str_values[i], strlen(str_values[i])},
+			{SQL_NULL, 0, NULL, 0},
+			{SQL_INTEGER_1BYTE, int8_values[i], NULL, 0},
+			{SQL_INTEGER_2BYTE, int16_values[i], NULL, 0},
+			{SQL_INTEGER_4BYTE, int32_values[i], NULL, 0}
+		};
+
+		chidb_DBRecord_create(&dbr, "|s|0|i1|i2|i4|", str_values[i], int8_values[i], int16_values[i], int32_values[i]);
+		chidb_DBRecord_pack(dbr, &packed);
+
+		CU_ASSERT_EQUAL(chidb_DBRecord_encodedSize(fields, 5, &size), CHIDB_OK);
+		CU_ASSERT_EQUAL(size, dbr->packed_len);
+		encoded = malloc(size);
+		CU_ASSERT_EQUAL(chidb_DBRecord_encode(fields, 5, encoded), CHIDB_OK);
+		CU_ASSERT(memcmp(packed, encoded, size) == 0);
+
+		chidb_DBRecord_destroy(dbr);
+		free(packed);
+		free(encoded);
+	}
+}
+
+void test_view(void)
+{
+	DBRecord *dbr;
+	DBRecordView view;
+	uint8_t *packed;
+	const char *str; int len;
+	int8_t i8; int16_t i16; int32_t i32;
+	
+	for(int i=0; i<NVALUES; i++)
+	{
+		chidb_DBRecord_create(&dbr, "|i4|s|0|i1|i2|", int32_values[i % 6], str_values[i], int8_values[i], int16_values[i]);
+		chidb_DBRecord_pack(dbr, &packed);
+		chidb_DBRecordView_init(&view, packed);
+
+		CU_ASSERT_EQUAL(chidb_DBRecordView_nfields(&view), 5);
+
+		// Out of order, so the view has to go back to the start of the header
+		CU_ASSERT_EQUAL(chidb_DBRecordView_getType(&view, 4), SQL_INTEGER_2BYTE);
+		chidb_DBRecordView_getInt16(&view, 4, &i16);
+		CU_ASSERT_EQUAL(i16, int16_values[i]);
+		CU_ASSERT_EQUAL(chidb_DBRecordView_getType(&view, 1), SQL_TEXT);
+		chidb_DBRecordView_getString(&view, 1, &str, &len);
+		CU_ASSERT_EQUAL(len, strlen(str_values[i]));
+		CU_ASSERT(strncmp(str, str_values[i], len) == 0);
+		CU_ASSERT_EQUAL(chidb_DBRecordView_getType(&view, 2), SQL_NULL);
+		chidb_DBRecordView_getInt8(&view, 3, &i8);
+		CU_ASSERT_EQUAL(i8, int8_values[i]);
+		chidb_DBRecordView_getInt32(&view, 0, &i32);
+		CU_ASSERT_EQUAL(i32, int32_values[i % 6]);
+
+		CU_ASSERT_EQUAL(chidb_DBRecordView_getType(&view, 5), SQL_NOTVALID);
+		CU_ASSERT_EQUAL(chidb_DBRecordView_getInt32(&view, 5, &i32), CHIDB_EMISUSE);
+
+		chidb_DBRecord_destroy(dbr);
+		free(packed);
+	}
+}
+
 int init_tests_dbrecord()
 {
 	CU_pSuite dbrecordTests = NULL;
@@ -175,7 +244,9 @@ int init_tests_dbrecord()
 		(NULL == CU_add_test(dbrecordTests, "Single-int32 record", test_int32)) ||
 		(NULL == CU_add_test(dbrecordTests, "Single-null record", test_null))||
 		(NULL == CU_add_test(dbrecordTests, "Multiple-field record", test_multiplefields))||
-		(NULL == CU_add_test(dbrecordTests, "Packing/unpacking a record", test_packunpack))
+		(NULL == CU_add_test(dbrecordTests, "Packing/unpacking a record", test_packunpack))||
+		(NULL == CU_add_test(dbrecordTests, "Encoding a record in one pass", test_encode))||
+		(NULL == CU_add_test(dbrecordTests, "Reading a record in place", test_view))
 	   )
    	{
       CU_cleanup_registry();
@@ -1,11 +1,17 @@
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
 #include "CUnit/Basic.h"
+#include "chidb.h"
 #include "libchidb/btree.h"
 #include "libchidb/dbm.h"
+#include "libchidb/dbmInt.h"
 #include "libchidb/util.h"
 #include "libchidb/parser.h"
 #include "libchidb/gen.h"
 #include "libchidb/schemaloader.h"
+#include "libchidb/record.h"
 
 #define TESTFILE_1 ("example_dbs/volatile.singletable_singlepage.cdb")
 #define TESTFILE_2 ("example_dbs/volatile.tableindex_singlepage.cdb")
@@ -55,7 +61,7 @@ void test_Select_1()
   printf("\n\tResults ...");
   while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
     printf("\n\t");
-    chidb_DBRecord_print(dbm->result);
+    chidb_DBM_print_result(dbm);
     fflush(stdout);
   }
   CU_ASSERT(rc == CHIDB_DONE);
@@ -99,7 +105,7 @@ void test_Select_2()
   printf("\n\tResults ...");
   while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
     printf("\n\t");
-    chidb_DBRecord_print(dbm->result);
+    chidb_DBM_print_result(dbm);
     fflush(stdout);
   }
   CU_ASSERT(rc == CHIDB_DONE);
@@ -144,7 +150,7 @@ void test_Select_3()
     printf("\n\tResults ...");
     while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
       printf("\n\t");
-      chidb_DBRecord_print(dbm->result);
+      chidb_DBM_print_result(dbm);
       fflush(stdout);
     }
     CU_ASSERT(rc == CHIDB_DONE);
@@ -188,7 +194,7 @@ void test_Select_4()
     printf("\n\tResults ...");
     while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
       printf("\n\t");
-      chidb_DBRecord_print(dbm->result);
+      chidb_DBM_print_result(dbm);
       fflush(stdout);
     }
     CU_ASSERT(rc == CHIDB_DONE);
@@ -232,7 +238,7 @@ void test_Select_5()
     printf("\n\tResults ...");
     while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
       printf("\n\t");
-      chidb_DBRecord_print(dbm->result);
+      chidb_DBM_print_result(dbm);
       fflush(stdout);
     }
     CU_ASSERT(rc == CHIDB_DONE);
@@ -277,7 +283,7 @@ void test_Select_6()
   printf("\n\tResults ...");
   while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
     printf("\n\t");
-    chidb_DBRecord_print(dbm->result);
+    chidb_DBM_print_result(dbm);
     fflush(stdout);
   }
   CU_ASSERT(rc == CHIDB_DONE);
@@ -322,7 +328,7 @@ void test_Select_7()
   printf("\n\tResults ...");
   while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
     printf("\n\t");
-    chidb_DBRecord_print(dbm->result);
+    chidb_DBM_print_result(dbm);
     fflush(stdout);
   }
   CU_ASSERT(rc == CHIDB_DONE);
@@ -367,7 +373,7 @@ void test_Select_8()
   printf("\n\tResults ...");
   while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
     printf("\n\t");
-    chidb_DBRecord_print(dbm->result);
+    chidb_DBM_print_result(dbm);
     fflush(stdout);
   }
   CU_ASSERT(rc == CHIDB_DONE);
@@ -412,7 +418,7 @@ void test_Select_9()
   printf("\n\tResults ...");
   while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
     printf("\n\t");
-    chidb_DBRecord_print(dbm->result);
+    chidb_DBM_print_result(dbm);
     fflush(stdout);
   }
   CU_ASSERT(rc == CHIDB_DONE);
@@ -456,7 +462,7 @@ void test_Select_10()
   printf("\n\tResults ...");
   while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
     printf("\n\t");
-    chidb_DBRecord_print(dbm->result);
+    chidb_DBM_print_result(dbm);
     fflush(stdout);
   }
   CU_ASSERT(rc == CHIDB_DONE);
@@ -501,7 +507,7 @@ void test_Select_11()
   printf("\n\tResults ...");
   while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
     printf("\n\t");
-    chidb_DBRecord_print(dbm->result);
+    chidb_DBM_print_result(dbm);
     fflush(stdout);
   }
   CU_ASSERT(rc == CHIDB_DONE);
@@ -546,7 +552,7 @@ void test_Select_12()
   printf("\n\tResults ...");
   while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
     printf("\n\t");
-    chidb_DBRecord_print(dbm->result);
+    chidb_DBM_print_result(dbm);
     fflush(stdout);
   }
   CU_ASSERT(rc == CHIDB_DONE);
@@ -591,7 +597,7 @@ void test_Select_13()
   printf("\n\tResults ...");
   while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
     printf("\n\t");
-    chidb_DBRecord_print(dbm->result);
+    chidb_DBM_print_result(dbm);
     fflush(stdout);
   }
   CU_ASSERT(rc == CHIDB_DONE);
@@ -608,6 +614,210 @@ void test_Select_13()
 }
 
 
+void test_Aggregate_1()
+{
+  int rc;
+  chidb *db;
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(TESTFILE_1, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  DBM *dbm;
+  rc = chidb_DBM_create(db, &dbm);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  const char *sql = "SELECT COUNT(*), SUM(code), MIN(code), MAX(code), AVG(code) FROM courses;";
+  printf("\n\t%s", sql);
+  SQLStatement *stmt = (SQLStatement *)malloc(sizeof(SQLStatement));
+  chidb_parser(sql, &stmt);
+
+  Schema *schema = (Schema *) malloc(sizeof(Schema));
+  chidb_loadSchema(db, &schema);
+
+  rc = chidb_Gen(stmt, dbm, schema);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  test_print_instructions(dbm);
+
+  // Running the program...
+  printf("\n\tResults ...");
+  int32_t v;
+  rc = chidb_DBM_step(dbm);
+  CU_ASSERT(rc == CHIDB_ROW);
+  printf("\n\t");
+  chidb_DBM_print_result(dbm);
+  v = dbm->result[0]->fields.integer;
+  CU_ASSERT(v == 3);
+  v = dbm->result[1]->fields.integer;
+  CU_ASSERT(v == 72000);
+  v = dbm->result[2]->fields.integer;
+  CU_ASSERT(v == 21000);
+  v = dbm->result[3]->fields.integer;
+  CU_ASSERT(v == 27500);
+  v = dbm->result[4]->fields.integer;
+  CU_ASSERT(v == 24000);
+
+  rc = chidb_DBM_step(dbm);
+  CU_ASSERT(rc == CHIDB_DONE);
+  printf("\n");
+
+  rc = chidb_DBM_destroy(dbm);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  rc = chidb_Btree_close(db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  free(db);
+
+  return;
+}
+
+
+void test_Aggregate_2()
+{
+  int rc;
+  chidb *db;
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(TESTFILE_1, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  DBM *dbm;
+  rc = chidb_DBM_create(db, &dbm);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  const char *sql = "SELECT dept, COUNT(*) FROM courses GROUP BY dept;";
+  printf("\n\t%s", sql);
+  SQLStatement *stmt = (SQLStatement *)malloc(sizeof(SQLStatement));
+  chidb_parser(sql, &stmt);
+
+  Schema *schema = (Schema *) malloc(sizeof(Schema));
+  chidb_loadSchema(db, &schema);
+
+  rc = chidb_Gen(stmt, dbm, schema);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  test_print_instructions(dbm);
+
+  // Running the program...
+  printf("\n\tResults ...");
+  int nrows = 0, ncourses = 0;
+  while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
+    int32_t count;
+    printf("\n\t");
+    chidb_DBM_print_result(dbm);
+    count = dbm->result[1]->fields.integer;
+    ncourses += count;
+    nrows++;
+  }
+  CU_ASSERT(rc == CHIDB_DONE);
+  CU_ASSERT(nrows == 2);
+  CU_ASSERT(ncourses == 3);
+  printf("\n");
+
+  rc = chidb_DBM_destroy(dbm);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  rc = chidb_Btree_close(db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  free(db);
+
+  return;
+}
+
+
+void test_Aggregate_3()
+{
+  // The same integer held in registers of different widths is one group key
+  DBMRegister keys[4];
+  memset(keys, 0, sizeof(keys));
+  keys[0].type = DBM_BYTE_REGISTER_TYPE;
+  keys[0].fields.byte = 7;
+  keys[1].type = DBM_SMALLINT_REGISTER_TYPE;
+  keys[1].fields.smallint = 7;
+  keys[2].type = DBM_INTEGER_REGISTER_TYPE;
+  keys[2].fields.integer = 7;
+  keys[3].type = DBM_INTEGER_REGISTER_TYPE;
+  keys[3].fields.integer = 8;
+
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      CU_ASSERT(chidb_DBM_hash_registers(&keys[i], 1) == chidb_DBM_hash_registers(&keys[j], 1));
+      CU_ASSERT(chidb_DBM_registers_equal(&keys[i], &keys[j], 1));
+    }
+    CU_ASSERT(!chidb_DBM_registers_equal(&keys[i], &keys[3], 1));
+  }
+
+  DBMRegister null;
+  memset(&null, 0, sizeof(null));
+  null.type = DBM_NULL_REGISTER_TYPE;
+  CU_ASSERT(!chidb_DBM_registers_equal(&keys[2], &null, 1));
+  CU_ASSERT(!chidb_DBM_registers_equal(&null, &keys[2], 1));
+}
+
+
+void test_Param_1()
+{
+  int rc;
+  chidb *db;
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(TESTFILE_1, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  DBM *dbm;
+  rc = chidb_DBM_create(db, &dbm);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  const char *sql = "SELECT name FROM courses WHERE code = ?;";
+  printf("\n\t%s", sql);
+  SQLStatement *stmt = (SQLStatement *)malloc(sizeof(SQLStatement));
+  chidb_parser(sql, &stmt);
+  CU_ASSERT(stmt->nparams == 1);
+
+  Schema *schema = (Schema *) malloc(sizeof(Schema));
+  chidb_loadSchema(db, &schema);
+
+  rc = chidb_Gen(stmt, dbm, schema);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  test_print_instructions(dbm);
+
+  // Running the same program with different parameters...
+  int32_t codes[] = {23500, 27500};
+  const char *names[] = {"Databases", "Operating Systems"};
+  for (int i = 0; i < 2; i++) {
+    const char *name;
+    rc = chidb_DBM_bind_int(dbm, 1, codes[i]);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    printf("\n\tResults for code = %i ...", codes[i]);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_ROW);
+    printf("\n\t");
+    chidb_DBM_print_result(dbm);
+    name = (const char *) dbm->result[0]->fields.string.data;
+    CU_ASSERT(!strcmp(name, names[i]));
+
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+
+    rc = chidb_DBM_reset(dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+  }
+  printf("\n");
+
+  rc = chidb_DBM_bind_int(dbm, 2, 0);
+  CU_ASSERT(rc == CHIDB_EMISUSE);
+
+  rc = chidb_DBM_destroy(dbm);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  rc = chidb_Btree_close(db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  free(db);
+
+  return;
+}
+
+
 void test_Insert_1()
 {
     int rc;
@@ -615,31 +825,1000 @@ void test_Insert_1()
     db = malloc(sizeof(chidb));
     rc = chidb_Btree_open(TESTFILE_1, db, &db->bt);
     CU_ASSERT(rc == CHIDB_OK);
-    
-    DBM *dbm;
-    rc = chidb_DBM_create(db, &dbm);
-    CU_ASSERT(rc == CHIDB_OK);
-    
-    const char *sql = "INSERT INTO courses VALUES (32000, \"Graduate Algorithms\", 60, 42);";
-    printf("\n\t%s", sql);
-    SQLStatement *stmt = (SQLStatement *)malloc(sizeof(SQLStatement));
-    chidb_parser(sql, &stmt);
-    
+    
+    DBM *dbm;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    
+    const char *sql = "INSERT INTO courses VALUES (32000, \"Graduate Algorithms\", 60, 42);";
+    printf("\n\t%s", sql);
+    SQLStatement *stmt = (SQLStatement *)malloc(sizeof(SQLStatement));
+    chidb_parser(sql, &stmt);
+    
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+    
+    chidb_Gen(stmt, dbm, schema);
+    test_print_instructions(dbm);
+
+    // Running the program...
+    printf("\n\tInserting ...");
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    printf("\n");
+
+    rc = chidb_DBM_destroy(dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+
+void test_Insert_2()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_2, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    DBM *dbm;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    const char *sql = "INSERT INTO numbers VALUES(400, \"foo400\", 20400);";
+    printf("\n\t%s", sql);
+    SQLStatement *stmt = (SQLStatement *)malloc(sizeof(SQLStatement));
+    chidb_parser(sql, &stmt);
+
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+
+    chidb_Gen(stmt, dbm, schema);
+
+    test_print_instructions(dbm);
+
+    // Running the program...
+    printf("\n\tInserting ...");
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    printf("\n");
+
+    rc = chidb_DBM_destroy(dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+
+void test_Insert_3()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_1, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    DBM *dbm;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    const char *sql = "INSERT INTO courses VALUES (33003, \"Cs\", 7, 61), (33001, \"As\", 7, 61), (33002, \"Bs\", 7, 61);";
+    printf("\n\t%s", sql);
+    SQLStatement *stmt = (SQLStatement *)malloc(sizeof(SQLStatement));
+    rc = chidb_parser(sql, &stmt);
+    CU_ASSERT(rc == CHIDB_OK);
+    CU_ASSERT(stmt->query.insert.nrows == 3);
+
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+
+    chidb_Gen(stmt, dbm, schema);
+    test_print_instructions(dbm);
+
+    // All three rows go in with a single step
+    printf("\n\tInserting ...");
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    rc = chidb_DBM_destroy(dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    // ...and read back in key order
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser("SELECT code FROM courses WHERE dept = 61;", &stmt);
+    chidb_Gen(stmt, dbm, schema);
+
+    int32_t expected = 33001;
+    while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
+        CU_ASSERT(dbm->result[0]->fields.integer == expected);
+        expected++;
+    }
+    CU_ASSERT(rc == CHIDB_DONE);
+    CU_ASSERT(expected == 33004);
+    printf("\n");
+
+    rc = chidb_DBM_destroy(dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+void test_Insert_4()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_1, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+
+    // A name several pages long goes to overflow pages
+    char name[3000];
+    memset(name, 'x', sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    char *sql = malloc(sizeof(name) + 64);
+    sprintf(sql, "INSERT INTO courses VALUES (36001, \"%s\", 7, 64);", name);
+
+    DBM *dbm;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    SQLStatement *stmt;
+    rc = chidb_parser(sql, &stmt);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_Gen(stmt, dbm, schema);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    rc = chidb_DBM_destroy(dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(sql);
+
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser("SELECT code, name, dept FROM courses WHERE dept = 64;", &stmt);
+    chidb_Gen(stmt, dbm, schema);
+
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_ROW);
+    CU_ASSERT(dbm->result[0]->fields.integer == 36001);
+    CU_ASSERT(dbm->result[1]->fields.string.len == strlen(name));
+    CU_ASSERT(memcmp(dbm->result[1]->fields.string.data, name, strlen(name)) == 0);
+    CU_ASSERT(dbm->result[2]->fields.integer == 64);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    printf("\n");
+
+    rc = chidb_DBM_destroy(dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+/* Run a statement that returns no rows to completion */
+void test_run_statement(chidb *db, Schema *schema, const char *sql)
+{
+    int rc;
+    DBM *dbm;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    printf("\n\t%s", sql);
+    SQLStatement *stmt;
+    rc = chidb_parser(sql, &stmt);
+    CU_ASSERT(rc == CHIDB_OK);
+    rc = chidb_Gen(stmt, dbm, schema);
+    CU_ASSERT(rc == CHIDB_OK);
+    test_print_instructions(dbm);
+
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    rc = chidb_DBM_destroy(dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+}
+
+void test_Delete_1()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_1, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+
+    test_run_statement(db, schema, "INSERT INTO courses VALUES (34001, \"As\", 7, 62), (34002, \"Bs\", 7, 62), (34003, \"Cs\", 7, 62);");
+    test_run_statement(db, schema, "DELETE FROM courses WHERE dept = 62 AND code > 34001;");
+
+    // Only the first row is left...
+    DBM *dbm;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    SQLStatement *stmt;
+    chidb_parser("SELECT code FROM courses WHERE dept = 62;", &stmt);
+    chidb_Gen(stmt, dbm, schema);
+
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_ROW);
+    CU_ASSERT(dbm->result[0]->fields.integer == 34001);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    rc = chidb_DBM_destroy(dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    // ...and then it is gone too
+    test_run_statement(db, schema, "DELETE FROM courses WHERE code = 34001;");
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser("SELECT code FROM courses WHERE dept = 62;", &stmt);
+    chidb_Gen(stmt, dbm, schema);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    printf("\n");
+
+    rc = chidb_DBM_destroy(dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+void test_Update_1()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_1, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+
+    test_run_statement(db, schema, "INSERT INTO courses VALUES (35001, \"Old\", 7, 63), (35002, \"Old\", 7, 63);");
+    // A longer name moves the record, the prof is rewritten in place
+    test_run_statement(db, schema, "UPDATE courses SET name = \"Much newer\", prof = 8 WHERE code = 35001;");
+    test_run_statement(db, schema, "UPDATE courses SET prof = 9 WHERE code = 35002;");
+
+    DBM *dbm;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    SQLStatement *stmt;
+    chidb_parser("SELECT code, name, prof FROM courses WHERE dept = 63;", &stmt);
+    chidb_Gen(stmt, dbm, schema);
+
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_ROW);
+    CU_ASSERT(dbm->result[0]->fields.integer == 35001);
+    CU_ASSERT(dbm->result[1]->fields.string.len == 10);
+    CU_ASSERT(memcmp(dbm->result[1]->fields.string.data, "Much newer", 10) == 0);
+    CU_ASSERT(dbm->result[2]->fields.byte == 8);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_ROW);
+    CU_ASSERT(dbm->result[0]->fields.integer == 35002);
+    CU_ASSERT(dbm->result[1]->fields.string.len == 3);
+    CU_ASSERT(memcmp(dbm->result[1]->fields.string.data, "Old", 3) == 0);
+    CU_ASSERT(dbm->result[2]->fields.byte == 9);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    printf("\n");
+
+    rc = chidb_DBM_destroy(dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+#define INDEX_MAXROWS (64)
+
+// Builds a covering index on courses(dept, prof) INCLUDE (name) by hand,
+// the same way CREATE INDEX would, and adds it to the schema table
+npage_t test_create_covering_index(chidb *db, int nrows, int32_t *code,
+                                   int32_t *dept, int8_t *prof, char **name)
+{
+    int rc;
+    npage_t nroot;
+    uint8_t raw[256];
+    uint32_t size;
+
+    rc = chidb_Btree_newNode(db->bt, &nroot, PGTYPE_INDEX_LEAF);
+    CU_ASSERT(rc == CHIDB_OK);
+    for (int i = 0; i < nrows; i++) {
+        DBRecordField extra[2] = {
+            {SQL_INTEGER_1BYTE, prof[i], NULL, 0},
+            {SQL_TEXT, 0, (uint8_t *) name[i], strlen(name[i])}
+        };
+        chidb_DBRecord_encodedSize(extra, 2, &size);
+        chidb_DBRecord_encode(extra, 2, raw);
+        rc = chidb_Btree_insertInCoveringIndex(db->bt, nroot, dept[i], code[i], raw, size);
+        CU_ASSERT(rc == CHIDB_OK);
+    }
+
+    const char *sql = "CREATE INDEX idxDeptProf ON courses(dept, prof) INCLUDE (name)";
+    DBRecordField entry[5] = {
+        {SQL_TEXT, 0, (uint8_t *) "index", 5},
+        {SQL_TEXT, 0, (uint8_t *) "idxDeptProf", 11},
+        {SQL_TEXT, 0, (uint8_t *) "courses", 7},
+        {SQL_INTEGER_4BYTE, nroot, NULL, 0},
+        {SQL_TEXT, 0, (uint8_t *) sql, strlen(sql)}
+    };
+    chidb_DBRecord_encodedSize(entry, 5, &size);
+    chidb_DBRecord_encode(entry, 5, raw);
+    rc = chidb_Btree_insertInTable(db->bt, 1, 1000, raw, size);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    return nroot;
+}
+
+void test_Index_1()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_1, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+    npage_t table_root = chidb_getTable(schema, "courses")->rootPage;
+
+    // Only the rows the file came with: the large text inserted by an
+    // earlier test does not fit in an index cell
+    test_run_statement(db, schema, "DELETE FROM courses WHERE code > 30000;");
+
+    // Everything in the table, read the usual way
+    int nrows = 0;
+    int32_t code[INDEX_MAXROWS], dept[INDEX_MAXROWS];
+    int8_t prof[INDEX_MAXROWS];
+    char *name[INDEX_MAXROWS];
+    DBM *dbm;
+    SQLStatement *stmt;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser("SELECT code, dept, prof, name FROM courses;", &stmt);
+    chidb_Gen(stmt, dbm, schema);
+    while (CHIDB_ROW == (rc = chidb_DBM_step(dbm)) && nrows < INDEX_MAXROWS) {
+        code[nrows] = dbm->result[0]->fields.integer;
+        dept[nrows] = dbm->result[1]->fields.integer;
+        prof[nrows] = dbm->result[2]->fields.byte;
+        uint32_t len = dbm->result[3]->fields.string.len;
+        name[nrows] = malloc(len + 1);
+        memcpy(name[nrows], dbm->result[3]->fields.string.data, len);
+        name[nrows][len] = '\0';
+        nrows++;
+    }
+    CU_ASSERT(rc == CHIDB_DONE);
+    chidb_DBM_destroy(dbm);
+
+    npage_t index_root = test_create_covering_index(db, nrows, code, dept, prof, name);
+    chidb_loadSchema(db, &schema);
+
+    // The index has every column, so the table is never opened
+    const char *sql = "SELECT code, name, prof FROM courses WHERE dept = 42;";
+    printf("\n\t%s", sql);
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser(sql, &stmt);
+    rc = chidb_Gen(stmt, dbm, schema);
+    CU_ASSERT(rc == CHIDB_OK);
+    test_print_instructions(dbm);
+
+    bool index_used = false;
+    for (int i = 0; i < dbm->ninstructions; i++) {
+        if (_Integer_ == dbm->instructions[i].op) {
+            CU_ASSERT(dbm->instructions[i].p1 != table_root);
+            index_used |= (dbm->instructions[i].p1 == index_root);
+        }
+    }
+    CU_ASSERT(index_used);
+
+    // Same rows as the table, in the same (code) order
+    printf("\n\tResults ...");
+    int j = 0;
+    while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
+        printf("\n\t");
+        chidb_DBM_print_result(dbm);
+        while (j < nrows && dept[j] != 42) j++;
+        CU_ASSERT_FATAL(j < nrows);
+        CU_ASSERT(dbm->result[0]->fields.integer == code[j]);
+        CU_ASSERT(dbm->result[1]->fields.string.len == strlen(name[j]));
+        CU_ASSERT(memcmp(dbm->result[1]->fields.string.data, name[j], strlen(name[j])) == 0);
+        CU_ASSERT(dbm->result[2]->fields.byte == prof[j]);
+        j++;
+    }
+    CU_ASSERT(rc == CHIDB_DONE);
+    while (j < nrows && dept[j] != 42) j++;
+    CU_ASSERT(j == nrows);
+    chidb_DBM_destroy(dbm);
+
+    // Grouping by the first column of the index
+    sql = "SELECT dept, COUNT(*) FROM courses GROUP BY dept;";
+    printf("\n\t%s", sql);
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser(sql, &stmt);
+    rc = chidb_Gen(stmt, dbm, schema);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    printf("\n\tResults ...");
+    int ncourses = 0;
+    while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
+        int32_t count = 0;
+        printf("\n\t");
+        chidb_DBM_print_result(dbm);
+        for (int i = 0; i < nrows; i++)
+            count += (dept[i] == dbm->result[0]->fields.integer);
+        CU_ASSERT(dbm->result[1]->fields.integer == count);
+        ncourses += dbm->result[1]->fields.integer;
+    }
+    CU_ASSERT(rc == CHIDB_DONE);
+    CU_ASSERT(ncourses == nrows);
+    printf("\n");
+    chidb_DBM_destroy(dbm);
+
+    for (int i = 0; i < nrows; i++)
+        free(name[i]);
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+
+// Runs a query that is answered from an index, and returns its only row
+void test_index_row(chidb *db, Schema *schema, const char *sql, npage_t index_root, DBM **dbm)
+{
+    int rc;
+    SQLStatement *stmt;
+
+    printf("\n\t%s", sql);
+    rc = chidb_DBM_create(db, dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser(sql, &stmt);
+    rc = chidb_Gen(stmt, *dbm, schema);
+    CU_ASSERT(rc == CHIDB_OK);
+    CU_ASSERT((*dbm)->instructions[0].op == _Integer_);
+    CU_ASSERT((*dbm)->instructions[0].p1 == index_root || (*dbm)->instructions[1].p1 == index_root);
+
+    rc = chidb_DBM_step(*dbm);
+    CU_ASSERT(rc == CHIDB_ROW);
+}
+
+void test_Index_2()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_3, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+    Schema_Index *index;
+    CU_ASSERT_FATAL(chidb_getIndexes(schema, "numbers", &index) == 1);
+
+    // The new row is in the index...
+    test_run_statement(db, schema, "INSERT INTO numbers VALUES(90001, \"foo90001\", 990001);");
+    DBM *dbm;
+    test_index_row(db, schema, "SELECT code FROM numbers WHERE altcode = 990001;", index->rootPage, &dbm);
+    CU_ASSERT(dbm->result[0]->fields.integer == 90001);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    chidb_DBM_destroy(dbm);
+
+    // ...whose keys are unique
+    SQLStatement *stmt;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser("INSERT INTO numbers VALUES(90002, \"foo90002\", 990001);", &stmt);
+    chidb_Gen(stmt, dbm, schema);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_ECONSTRAINT);
+    chidb_DBM_destroy(dbm);
+    printf("\n");
+
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+void test_Index_3()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_1, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    // The covering index of test_Index_1
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+    Schema_Index *index;
+    CU_ASSERT_FATAL(chidb_getIndexes(schema, "courses", &index) == 1);
+    CU_ASSERT(index->covering);
+
+    // Two rows with the same index key, in one statement
+    test_run_statement(db, schema, "INSERT INTO courses VALUES (36002, \"Second\", 5, 65), (36001, \"First\", 6, 65);");
+
+    DBM *dbm;
+    test_index_row(db, schema, "SELECT code, name, prof FROM courses WHERE dept = 65;", index->rootPage, &dbm);
+    CU_ASSERT(dbm->result[0]->fields.integer == 36001);
+    CU_ASSERT(dbm->result[1]->fields.string.len == 5);
+    CU_ASSERT(memcmp(dbm->result[1]->fields.string.data, "First", 5) == 0);
+    CU_ASSERT(dbm->result[2]->fields.byte == 6);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_ROW);
+    CU_ASSERT(dbm->result[0]->fields.integer == 36002);
+    CU_ASSERT(dbm->result[1]->fields.string.len == 6);
+    CU_ASSERT(memcmp(dbm->result[1]->fields.string.data, "Second", 6) == 0);
+    CU_ASSERT(dbm->result[2]->fields.byte == 5);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    chidb_DBM_destroy(dbm);
+    printf("\n");
+
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+
+void test_Index_4()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_3, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+    test_run_statement(db, schema, "INSERT INTO numbers VALUES(90101, \"foo90101\", 990101);");
+
+    // Rows in the table, before there is a covering index
+    int nrows = 0;
+    DBM *dbm;
+    SQLStatement *stmt;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser("SELECT code, textcode FROM numbers;", &stmt);
+    chidb_Gen(stmt, dbm, schema);
+    while (CHIDB_ROW == (rc = chidb_DBM_step(dbm)))
+        nrows++;
+    CU_ASSERT(rc == CHIDB_DONE);
+    chidb_DBM_destroy(dbm);
+
+    test_run_statement(db, schema, "CREATE INDEX idxCovering ON numbers(altcode, textcode);");
+    chidb_loadSchema(db, &schema);
+    CU_ASSERT(chidb_getIndexes(schema, "numbers", NULL) == 2);
+    Schema_Index *index = chidb_getIndex(schema, "idxCovering");
+    CU_ASSERT_FATAL(index != NULL);
+    CU_ASSERT(index->covering);
+
+    // Every row is in the index, in altcode order...
+    int nentries = 0;
+    int32_t last = 0;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser("SELECT altcode, textcode FROM numbers;", &stmt);
+    chidb_Gen(stmt, dbm, schema);
+    CU_ASSERT(dbm->instructions[0].p1 == index->rootPage || dbm->instructions[1].p1 == index->rootPage);
+    while (CHIDB_ROW == (rc = chidb_DBM_step(dbm))) {
+        CU_ASSERT(nentries == 0 || dbm->result[0]->fields.integer >= last);
+        last = dbm->result[0]->fields.integer;
+        nentries++;
+    }
+    CU_ASSERT(rc == CHIDB_DONE);
+    CU_ASSERT(nentries == nrows);
+    chidb_DBM_destroy(dbm);
+
+    // ...and it answers queries on its own
+    test_index_row(db, schema, "SELECT code, textcode FROM numbers WHERE altcode = 990101;", index->rootPage, &dbm);
+    CU_ASSERT(dbm->result[0]->fields.integer == 90101);
+    CU_ASSERT(dbm->result[1]->fields.string.len == 8);
+    CU_ASSERT(memcmp(dbm->result[1]->fields.string.data, "foo90101", 8) == 0);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    chidb_DBM_destroy(dbm);
+
+    // An index can only be created once, on columns that exist
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser("CREATE INDEX idxCovering ON numbers(code, altcode);", &stmt);
+    CU_ASSERT(chidb_Gen(stmt, dbm, schema) == CHIDB_EINVALIDSQL);
+    chidb_DBM_destroy(dbm);
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser("CREATE INDEX idxOther ON numbers(nocode);", &stmt);
+    CU_ASSERT(chidb_Gen(stmt, dbm, schema) == CHIDB_EINVALIDSQL);
+    chidb_DBM_destroy(dbm);
+    printf("\n");
+
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+
+// Runs a query and checks that it returns no rows
+void test_no_rows(chidb *db, Schema *schema, const char *sql)
+{
+    int rc;
+    DBM *dbm;
+    SQLStatement *stmt;
+
+    printf("\n\t%s", sql);
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser(sql, &stmt);
+    rc = chidb_Gen(stmt, dbm, schema);
+    CU_ASSERT(rc == CHIDB_OK);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    chidb_DBM_destroy(dbm);
+}
+
+void test_Index_5()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_3, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    // The plain index of the file, and the covering one of test_Index_4
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+    CU_ASSERT(chidb_getIndexes(schema, "numbers", NULL) == 2);
+    Schema_Index *index = chidb_getIndex(schema, "idxCovering");
+    CU_ASSERT_FATAL(index != NULL);
+
+    test_run_statement(db, schema, "INSERT INTO numbers VALUES(90201, \"foo90201\", 990201), (90202, \"foo90202\", 990202), (90203, \"foo90203\", 990203);");
+    test_run_statement(db, schema, "DELETE FROM numbers WHERE code = 90201;");
+    test_run_statement(db, schema, "UPDATE numbers SET altcode = 990299 WHERE code = 90202;");
+    test_run_statement(db, schema, "UPDATE numbers SET textcode = \"bar90203\" WHERE code = 90203;");
+
+    // The deleted row and the old key are gone from the indexes...
+    test_no_rows(db, schema, "SELECT code FROM numbers WHERE altcode = 990201;");
+    test_no_rows(db, schema, "SELECT code FROM numbers WHERE altcode = 990202;");
+
+    // ...the new key is in them...
+    DBM *dbm;
+    test_index_row(db, schema, "SELECT code, textcode FROM numbers WHERE altcode = 990299;", index->rootPage, &dbm);
+    CU_ASSERT(dbm->result[0]->fields.integer == 90202);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    chidb_DBM_destroy(dbm);
+
+    // ...with the new values of the other columns
+    test_index_row(db, schema, "SELECT code, textcode FROM numbers WHERE altcode = 990203;", index->rootPage, &dbm);
+    CU_ASSERT(dbm->result[0]->fields.integer == 90203);
+    CU_ASSERT(dbm->result[1]->fields.string.len == 8);
+    CU_ASSERT(memcmp(dbm->result[1]->fields.string.data, "bar90203", 8) == 0);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    chidb_DBM_destroy(dbm);
+
+    // The unique plain index takes the deleted row's key again
+    test_run_statement(db, schema, "INSERT INTO numbers VALUES(90204, \"foo90204\", 990201);");
+    test_run_statement(db, schema, "DELETE FROM numbers WHERE code > 90200 AND code < 90300;");
+    test_no_rows(db, schema, "SELECT code FROM numbers WHERE altcode = 990201;");
+    test_no_rows(db, schema, "SELECT code FROM numbers WHERE altcode = 990299;");
+    printf("\n");
+
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+void test_Index_6()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_1, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    // The covering index of test_Index_1
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+    Schema_Index *index;
+    CU_ASSERT_FATAL(chidb_getIndexes(schema, "courses", &index) == 1);
+
+    test_run_statement(db, schema, "INSERT INTO courses VALUES (37001, \"Gone\", 1, 66), (37002, \"Stale\", 2, 66), (37003, \"Moved\", 3, 66);");
+    test_run_statement(db, schema, "DELETE FROM courses WHERE code = 37001;");
+    test_run_statement(db, schema, "UPDATE courses SET name = \"Fresh\", prof = 4 WHERE code = 37002;");
+    test_run_statement(db, schema, "UPDATE courses SET dept = 67 WHERE code = 37003;");
+
+    // Read from the index alone: no deleted row, no old values
+    DBM *dbm;
+    test_index_row(db, schema, "SELECT code, name, prof FROM courses WHERE dept = 66;", index->rootPage, &dbm);
+    CU_ASSERT(dbm->result[0]->fields.integer == 37002);
+    CU_ASSERT(dbm->result[1]->fields.string.len == 5);
+    CU_ASSERT(memcmp(dbm->result[1]->fields.string.data, "Fresh", 5) == 0);
+    CU_ASSERT(dbm->result[2]->fields.byte == 4);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    chidb_DBM_destroy(dbm);
+
+    test_index_row(db, schema, "SELECT code, name, prof FROM courses WHERE dept = 67;", index->rootPage, &dbm);
+    CU_ASSERT(dbm->result[0]->fields.integer == 37003);
+    CU_ASSERT(dbm->result[1]->fields.string.len == 5);
+    CU_ASSERT(memcmp(dbm->result[1]->fields.string.data, "Moved", 5) == 0);
+    CU_ASSERT(dbm->result[2]->fields.byte == 3);
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_DONE);
+    chidb_DBM_destroy(dbm);
+
+    // Once the rows are deleted, so are their entries
+    test_run_statement(db, schema, "DELETE FROM courses WHERE code > 37000 AND code < 37100;");
+    test_no_rows(db, schema, "SELECT code, name, prof FROM courses WHERE dept = 66;");
+    test_no_rows(db, schema, "SELECT code, name, prof FROM courses WHERE dept = 67;");
+    printf("\n");
+
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+
+#define PARALLEL_MAXROWS (4096)
+
+/* Run a query with its scan split across (at most) nthreads threads, and
+ * batch_size rows at a time, and keep the rows it returns as text */
+int test_parallel_rows(chidb *db, Schema *schema, const char *sql, uint32_t nthreads, uint32_t min_cells, uint32_t batch_size, char **rows, bool *split)
+{
+    int rc;
+    int nrows = 0;
+    DBM *dbm;
+    SQLStatement *stmt;
+
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser(sql, &stmt);
+    rc = chidb_Gen(stmt, dbm, schema);
+    CU_ASSERT(rc == CHIDB_OK);
+    dbm->nthreads       = nthreads;
+    dbm->scan_min_cells = min_cells;
+    dbm->batch_size     = batch_size;
+
+    *split = false;
+    while (CHIDB_ROW == (rc = chidb_DBM_step(dbm)) && nrows < PARALLEL_MAXROWS) {
+        char row[256];
+        int len = 0;
+        *split |= (NULL != dbm->scan);
+        for (uint32_t i = 0; i < dbm->nresult && len < 200; i++) {
+            DBMRegister *reg = dbm->result[i];
+            int64_t value;
+            if (DBM_STRING_REGISTER_TYPE == reg->type)
+                len += snprintf(row + len, sizeof(row) - len, "|%.*s", (int) reg->fields.string.len, (char *) reg->fields.string.data);
+            else if (CHIDB_OK == chidb_DBM_register_integer(reg, &value))
+                len += snprintf(row + len, sizeof(row) - len, "|%lld", (long long) value);
+            else
+                len += snprintf(row + len, sizeof(row) - len, "|");
+        }
+        size_t size = strlen(row) + 1;
+        rows[nrows] = malloc(size);
+        memcpy(rows[nrows++], row, size);
+    }
+    CU_ASSERT(rc == CHIDB_DONE);
+    chidb_DBM_destroy(dbm);
+    return nrows;
+}
+
+void test_Parallel_1()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_3, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+
+    // A table scan, a filtered one, and a scan of the covering index of
+    // test_Index_4: split in partitions, they return the same rows in the
+    // same order
+    const char *sqls[] = {"SELECT * FROM numbers;",
+                          "SELECT code, textcode FROM numbers WHERE altcode > 5000;",
+                          "SELECT altcode, textcode FROM numbers;"};
+    char **serial   = malloc(PARALLEL_MAXROWS * sizeof(char *));
+    char **parallel = malloc(PARALLEL_MAXROWS * sizeof(char *));
+    for (int q = 0; q < 3; q++) {
+        bool split;
+        printf("\n\t%s", sqls[q]);
+        int nserial = test_parallel_rows(db, schema, sqls[q], 1, DBM_SCAN_MIN_CELLS, 1, serial, &split);
+        CU_ASSERT(nserial > 0);
+        CU_ASSERT(!split);
+        int nparallel = test_parallel_rows(db, schema, sqls[q], 4, 64, DBM_BATCH_SIZE, parallel, &split);
+        CU_ASSERT(split);
+        CU_ASSERT_FATAL(nparallel == nserial);
+        for (int i = 0; i < nserial; i++) {
+            CU_ASSERT(strcmp(serial[i], parallel[i]) == 0);
+            free(serial[i]);
+            free(parallel[i]);
+        }
+    }
+
+    // A split scan given up after a few rows stops the workers still
+    // waiting for room in their queues
+    DBM *dbm;
+    SQLStatement *stmt;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser(sqls[0], &stmt);
+    rc = chidb_Gen(stmt, dbm, schema);
+    CU_ASSERT(rc == CHIDB_OK);
+    dbm->nthreads       = 4;
+    dbm->scan_min_cells = 64;
+    for (int i = 0; i < 3; i++) {
+        rc = chidb_DBM_step(dbm);
+        CU_ASSERT(rc == CHIDB_ROW);
+    }
+    CU_ASSERT(NULL != dbm->scan);
+    chidb_DBM_destroy(dbm);
+
+    // Tables with fewer cells than two threads' worth are not split
+    bool split;
+    int nrows = test_parallel_rows(db, schema, sqls[0], 4, 2 * PARALLEL_MAXROWS, DBM_BATCH_SIZE, serial, &split);
+    CU_ASSERT(!split);
+    for (int i = 0; i < nrows; i++)
+        free(serial[i]);
+    free(serial);
+    free(parallel);
+    printf("\n");
+
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+void test_Batch_1()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_3, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    Schema *schema = (Schema *) malloc(sizeof(Schema));
+    chidb_loadSchema(db, &schema);
+
+    // Run a batch at a time (of a size that does not divide the number of
+    // rows, and of the default size), scans return the same rows in the
+    // same order as one row at a time
+    const char *sqls[] = {"SELECT * FROM numbers;",
+                          "SELECT code, textcode FROM numbers WHERE altcode > 5000 AND code < 9000;",
+                          "SELECT altcode, textcode FROM numbers;"};
+    uint32_t sizes[] = {7, DBM_BATCH_SIZE};
+    char **serial  = malloc(PARALLEL_MAXROWS * sizeof(char *));
+    char **batched = malloc(PARALLEL_MAXROWS * sizeof(char *));
+    for (int q = 0; q < 3; q++) {
+        bool split;
+        printf("\n\t%s", sqls[q]);
+        int nserial = test_parallel_rows(db, schema, sqls[q], 1, DBM_SCAN_MIN_CELLS, 1, serial, &split);
+        CU_ASSERT(nserial > 0);
+        for (int b = 0; b < 2; b++) {
+            int nbatched = test_parallel_rows(db, schema, sqls[q], 1, DBM_SCAN_MIN_CELLS, sizes[b], batched, &split);
+            CU_ASSERT_FATAL(nbatched == nserial);
+            for (int i = 0; i < nserial; i++) {
+                CU_ASSERT(strcmp(serial[i], batched[i]) == 0);
+                free(batched[i]);
+            }
+        }
+        for (int i = 0; i < nserial; i++)
+            free(serial[i]);
+    }
+    free(serial);
+    free(batched);
+    printf("\n");
+
+    // The rows are handed out of a batch
+    DBM *dbm;
+    SQLStatement *stmt;
+    rc = chidb_DBM_create(db, &dbm);
+    CU_ASSERT(rc == CHIDB_OK);
+    chidb_parser(sqls[1], &stmt);
+    rc = chidb_Gen(stmt, dbm, schema);
+    CU_ASSERT(rc == CHIDB_OK);
+    dbm->nthreads = 1;
+    rc = chidb_DBM_step(dbm);
+    CU_ASSERT(rc == CHIDB_ROW);
+    CU_ASSERT(NULL != dbm->batch);
+    chidb_DBM_destroy(dbm);
+
+    rc = chidb_Btree_close(db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+    free(db);
+
+    return;
+}
+
+void test_Batch_2()
+{
+    int rc;
+    chidb *db;
+    db = malloc(sizeof(chidb));
+    rc = chidb_Btree_open(TESTFILE_1, db, &db->bt);
+    CU_ASSERT(rc == CHIDB_OK);
+
     Schema *schema = (Schema *) malloc(sizeof(Schema));
     chidb_loadSchema(db, &schema);
-    
-    chidb_Gen(stmt, dbm, schema);
-    test_print_instructions(dbm);
 
-    // Running the program...
-    printf("\n\tInserting ...");
-    rc = chidb_DBM_step(dbm);
-    CU_ASSERT(rc == CHIDB_DONE);
+    // Courses whose prof (a BYTE column) goes from 0 to 118, next to the
+    // ones whose prof is NULL
+    char sql[4096];
+    int len = snprintf(sql, sizeof(sql), "INSERT INTO courses VALUES ");
+    for (int i = 0; i < 60; i++)
+        len += snprintf(sql + len, sizeof(sql) - len, "%s(%d, \"Batch\", %d, 70)", i ? ", " : "", 38000 + i, 2 * i);
+    snprintf(sql + len, sizeof(sql) - len, ";");
+    test_run_statement(db, schema, sql);
+
+    // Compared with an INTEGER constant a batch at a time, they return
+    // the same rows as one row at a time
+    const char *sqls[] = {"SELECT code, prof FROM courses WHERE code > 37999 AND prof > 50;",
+                          "SELECT code, prof FROM courses WHERE code > 37999 AND prof = 40;",
+                          "SELECT code FROM courses WHERE prof <= 30;"};
+    int expected[] = {34, 1, 16}; // (the last one at least: other tests add courses too)
+    char **serial  = malloc(PARALLEL_MAXROWS * sizeof(char *));
+    char **batched = malloc(PARALLEL_MAXROWS * sizeof(char *));
+    for (int q = 0; q < 3; q++) {
+        bool split;
+        printf("\n\t%s", sqls[q]);
+        int nserial = test_parallel_rows(db, schema, sqls[q], 1, DBM_SCAN_MIN_CELLS, 1, serial, &split);
+        CU_ASSERT(q < 2 ? nserial == expected[q] : nserial >= expected[q]);
+        int nbatched = test_parallel_rows(db, schema, sqls[q], 1, DBM_SCAN_MIN_CELLS, DBM_BATCH_SIZE, batched, &split);
+        CU_ASSERT_FATAL(nbatched == nserial);
+        for (int i = 0; i < nserial; i++) {
+            CU_ASSERT(strcmp(serial[i], batched[i]) == 0);
+            free(serial[i]);
+            free(batched[i]);
+        }
+    }
+    free(serial);
+    free(batched);
+
+    test_run_statement(db, schema, "DELETE FROM courses WHERE dept = 70;");
     printf("\n");
 
-    rc = chidb_DBM_destroy(dbm);
-    CU_ASSERT(rc == CHIDB_OK);
-    
     rc = chidb_Btree_close(db->bt);
     CU_ASSERT(rc == CHIDB_OK);
     free(db);
@@ -647,49 +1826,480 @@ void test_Insert_1()
     return;
 }
 
+#define FILTER_NVALUES (200)
 
-void test_Insert_2()
+void test_Filter_1()
+{
+    // Every kernel this processor runs sets the same bits as comparing
+    // the values one by one, whatever the number of values (whole mask
+    // words or not) and however close they are to the constant
+    FilterKernel kernels[3];
+    int nkernels = 0;
+    kernels[nkernels++] = chidb_Filter_kernel();
+#ifdef FILTER_X86
+    kernels[nkernels++] = chidb_Filter_int32_sse2;
+    if (chidb_Filter_has_avx2())
+        kernels[nkernels++] = chidb_Filter_int32_avx2;
+#endif
+
+    int32_t values[FILTER_NVALUES];
+    int32_t constants[] = {0, 7, -7, INT32_MAX, INT32_MIN};
+    srand(49);
+    for (int i = 0; i < FILTER_NVALUES; i++)
+        values[i] = (i % 5 == 0) ? INT32_MIN : (i % 7 == 0) ? INT32_MAX : (rand() % 21) - 10;
+
+    uint32_t expected[FILTER_WORDS(FILTER_NVALUES)];
+    uint32_t mask[FILTER_WORDS(FILTER_NVALUES)];
+    uint32_t counts[] = {0, 1, 31, 32, 33, 64, 100, FILTER_NVALUES};
+    for (FilterOp op = FILTER_EQ; op <= FILTER_GE; op++)
+        for (int c = 0; c < 5; c++)
+            for (int n = 0; n < 8; n++) {
+                chidb_Filter_int32_scalar(op, values, counts[n], constants[c], expected);
+                for (int k = 0; k < nkernels; k++) {
+                    memset(mask, 0xAB, sizeof(mask));
+                    kernels[k](op, values, counts[n], constants[c], mask);
+                    CU_ASSERT(memcmp(mask, expected, FILTER_WORDS(counts[n]) * sizeof(uint32_t)) == 0);
+                }
+            }
+
+    // The bits of the values one by one
+    chidb_Filter_int32_scalar(FILTER_LT, values, 8, 0, expected);
+    for (int i = 0; i < 8; i++)
+        CU_ASSERT(((expected[0] >> i) & 1) == (values[i] < 0));
+}
+
+
+void test_Filter_2()
+{
+    // Every rank kernel counts the keys less than the one searched for,
+    // including keys with the top bit set and counts that are not whole
+    // vectors
+    FilterRank kernels[3];
+    int nkernels = 0;
+    kernels[nkernels++] = chidb_Filter_rankKernel();
+#ifdef FILTER_X86
+    kernels[nkernels++] = chidb_Filter_rank_sse2;
+    if (chidb_Filter_has_avx2())
+        kernels[nkernels++] = chidb_Filter_rank_avx2;
+#endif
+
+    uint32_t keys[FILTER_NVALUES];
+    for (int i = 0; i < FILTER_NVALUES; i++)
+        keys[i] = (i < FILTER_NVALUES / 2) ? 3 * i + 1 : 0x80000000u + 3 * i;
+
+    uint32_t counts[] = {0, 1, 3, 4, 7, 8, 9, 31, FILTER_NVALUES};
+    for (int n = 0; n < 9; n++)
+        for (int i = 0; i <= (int) counts[n]; i++) {
+            uint32_t probes[] = {0, UINT32_MAX, 0x7FFFFFFFu, 0x80000000u, 0, 0, 0};
+            int nprobes = 4;
+            if (i < (int) counts[n]) {
+                probes[nprobes++] = keys[i] - 1;
+                probes[nprobes++] = keys[i];
+                probes[nprobes++] = keys[i] + 1;
+            }
+            for (int p = 0; p < nprobes; p++) {
+                uint32_t expected = chidb_Filter_rank_scalar(keys, counts[n], probes[p]);
+                for (int k = 0; k < nkernels; k++)
+                    CU_ASSERT(kernels[k](keys, counts[n], probes[p]) == expected);
+            }
+        }
+
+    // The rank one key at a time
+    CU_ASSERT(chidb_Filter_rank_scalar(keys, 4, 0) == 0);
+    CU_ASSERT(chidb_Filter_rank_scalar(keys, 4, 4) == 1);
+    CU_ASSERT(chidb_Filter_rank_scalar(keys, 4, 5) == 2);
+    CU_ASSERT(chidb_Filter_rank_scalar(keys, 4, UINT32_MAX) == 4);
+    CU_ASSERT(chidb_Filter_rank(keys, FILTER_NVALUES, 0x80000000u) == FILTER_NVALUES / 2);
+}
+
+
+#define THREADS_NREADERS (4)
+#define THREADS_NQUERIES (10)
+#define THREADS_NINSERTS (20)
+
+struct ThreadsClient
+{
+    chidb *db;
+    int first;      // Rows in numbers before the writer starts
+    int failed;
+};
+
+/* Count the rows of numbers through the public API */
+int test_threads_count(chidb *db)
+{
+    chidb_stmt *stmt;
+    int nrows = 0;
+    int rc;
+
+    if (CHIDB_OK != chidb_prepare(db, "SELECT * FROM numbers;", &stmt))
+        return -1;
+    while (CHIDB_ROW == (rc = chidb_step(stmt)))
+        nrows++;
+    chidb_finalize(stmt);
+    return (CHIDB_DONE == rc) ? nrows : -1;
+}
+
+void *test_threads_reader(void *arg)
+{
+    struct ThreadsClient *client = arg;
+    int last = client->first;
+
+    // The writer only adds rows, so a reader never sees fewer than before
+    for (int i = 0; i < THREADS_NQUERIES; i++) {
+        int nrows = test_threads_count(client->db);
+        if (nrows < last || nrows > client->first + THREADS_NINSERTS)
+            client->failed++;
+        last = nrows;
+    }
+    return NULL;
+}
+
+void *test_threads_writer(void *arg)
+{
+    struct ThreadsClient *client = arg;
+
+    for (int i = 0; i < THREADS_NINSERTS; i++) {
+        char sql[128];
+        chidb_stmt *stmt;
+        snprintf(sql, sizeof(sql), "INSERT INTO numbers VALUES(%d, \"bar%d\", %d);", 96001 + i, i, 996001 + i);
+        if (CHIDB_OK != chidb_prepare(client->db, sql, &stmt)) {
+            client->failed++;
+            continue;
+        }
+        if (CHIDB_DONE != chidb_step(stmt))
+            client->failed++;
+        chidb_finalize(stmt);
+    }
+    return NULL;
+}
+
+void test_Threads_1()
 {
     int rc;
     chidb *db;
-    db = malloc(sizeof(chidb));
-    rc = chidb_Btree_open(TESTFILE_2, db, &db->bt);
+    rc = chidb_open(TESTFILE_3, &db);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+
+    // One connection, shared by several readers and a writer
+    int first = test_threads_count(db);
+    CU_ASSERT_FATAL(first > 0);
+    pthread_t threads[THREADS_NREADERS + 1];
+    struct ThreadsClient clients[THREADS_NREADERS + 1];
+    for (int t = 0; t <= THREADS_NREADERS; t++) {
+        clients[t].db     = db;
+        clients[t].first  = first;
+        clients[t].failed = 0;
+        pthread_create(&threads[t], NULL, (t < THREADS_NREADERS) ? test_threads_reader : test_threads_writer, &clients[t]);
+    }
+    for (int t = 0; t <= THREADS_NREADERS; t++) {
+        pthread_join(threads[t], NULL);
+        CU_ASSERT(clients[t].failed == 0);
+    }
+    CU_ASSERT(test_threads_count(db) == first + THREADS_NINSERTS);
+
+    rc = chidb_close(db);
     CU_ASSERT(rc == CHIDB_OK);
 
-    DBM *dbm;
-    rc = chidb_DBM_create(db, &dbm);
+    return;
+}
+
+
+#define THREADS_NWRITERS (4)
+
+struct ThreadsWriter
+{
+    chidb *db;
+    int t;
+    int failed;
+};
+
+void *test_threads_inserter(void *arg)
+{
+    struct ThreadsWriter *writer = arg;
+
+    for (int i = 0; i < THREADS_NINSERTS; i++) {
+        char sql[128];
+        chidb_stmt *stmt;
+        int key = 97001 + writer->t * THREADS_NINSERTS + i;
+        snprintf(sql, sizeof(sql), "INSERT INTO numbers VALUES(%d, \"baz%d\", %d);", key, key, 900000 + key);
+        if (CHIDB_OK != chidb_prepare(writer->db, sql, &stmt)) {
+            writer->failed++;
+            continue;
+        }
+        if (CHIDB_DONE != chidb_step(stmt))
+            writer->failed++;
+        chidb_finalize(stmt);
+    }
+    return NULL;
+}
+
+void test_Threads_2()
+{
+    int rc;
+    chidb *db;
+    rc = chidb_open(TESTFILE_3, &db);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+
+    // INSERTs from several threads run side by side
+    int first = test_threads_count(db);
+    CU_ASSERT_FATAL(first > 0);
+    pthread_t threads[THREADS_NWRITERS];
+    struct ThreadsWriter writers[THREADS_NWRITERS];
+    for (int t = 0; t < THREADS_NWRITERS; t++) {
+        writers[t].db     = db;
+        writers[t].t      = t;
+        writers[t].failed = 0;
+        pthread_create(&threads[t], NULL, test_threads_inserter, &writers[t]);
+    }
+    for (int t = 0; t < THREADS_NWRITERS; t++) {
+        pthread_join(threads[t], NULL);
+        CU_ASSERT(writers[t].failed == 0);
+    }
+    CU_ASSERT(test_threads_count(db) == first + THREADS_NWRITERS * THREADS_NINSERTS);
+
+    // The rows made it to the covering index of test_Index_4 too
+    chidb_stmt *stmt;
+    rc = chidb_prepare(db, "SELECT code, textcode FROM numbers WHERE altcode = 997042;", &stmt);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    CU_ASSERT(chidb_step(stmt) == CHIDB_ROW);
+    CU_ASSERT(chidb_column_int(stmt, 0) == 97042);
+    CU_ASSERT(chidb_column_text(stmt, 1) != NULL && strcmp(chidb_column_text(stmt, 1), "baz97042") == 0);
+    CU_ASSERT(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    rc = chidb_close(db);
     CU_ASSERT(rc == CHIDB_OK);
 
-    const char *sql = "INSERT INTO numbers VALUES(400, \"foo400\", 20400);";
-    printf("\n\t%s", sql);
-    SQLStatement *stmt = (SQLStatement *)malloc(sizeof(SQLStatement));
-    chidb_parser(sql, &stmt);
+    return;
+}
 
-    Schema *schema = (Schema *) malloc(sizeof(Schema));
-    chidb_loadSchema(db, &schema);
 
-    chidb_Gen(stmt, dbm, schema);
+#define SNAPSHOT_NINSERTS (200)
 
-    test_print_instructions(dbm);
+int test_snapshot_rows(chidb_stmt *stmt)
+{
+    int nrows = 0;
+    int rc;
 
-    // Running the program...
-    printf("\n\tInserting ...");
-    rc = chidb_DBM_step(dbm);
-    CU_ASSERT(rc == CHIDB_DONE);
-    printf("\n");
+    while (CHIDB_ROW == (rc = chidb_step(stmt)))
+        nrows++;
+    return (CHIDB_DONE == rc) ? nrows : -1;
+}
 
-    rc = chidb_DBM_destroy(dbm);
+int test_snapshot_count(chidb_stmt *stmt)
+{
+    int count;
+
+    chidb_reset(stmt);
+    if (CHIDB_ROW != chidb_step(stmt))
+        return -1;
+    count = chidb_column_int(stmt, 0);
+    return (CHIDB_DONE == chidb_step(stmt)) ? count : -1;
+}
+
+void test_Snapshot_1()
+{
+    int rc;
+    chidb *db;
+    rc = chidb_open(TESTFILE_3, &db);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+
+    // Statements prepared before the INSERTs, some already running
+    int first = test_threads_count(db);
+    CU_ASSERT_FATAL(first > 0);
+    chidb_stmt *running, *waiting, *count;
+    rc = chidb_prepare(db, "SELECT * FROM numbers;", &running);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    CU_ASSERT_FATAL(chidb_step(running) == CHIDB_ROW);
+    rc = chidb_prepare(db, "SELECT code, textcode FROM numbers;", &waiting);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    rc = chidb_prepare(db, "SELECT COUNT(*) FROM numbers;", &count);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+
+    // Enough rows to split nodes the statements read
+    for (int i = 0; i < SNAPSHOT_NINSERTS; i++) {
+        char sql[128];
+        chidb_stmt *stmt;
+        snprintf(sql, sizeof(sql), "INSERT INTO numbers VALUES(%d, \"qux%d\", %d);", 98001 + i, i, 998001 + i);
+        rc = chidb_prepare(db, sql, &stmt);
+        CU_ASSERT_FATAL(rc == CHIDB_OK);
+        CU_ASSERT(chidb_step(stmt) == CHIDB_DONE);
+        chidb_finalize(stmt);
+    }
+
+    // They see the table as it was when they were prepared, even when reset
+    CU_ASSERT(1 + test_snapshot_rows(running) == first);
+    CU_ASSERT(test_snapshot_rows(waiting) == first);
+    CU_ASSERT(test_snapshot_count(count) == first);
+    CU_ASSERT(test_snapshot_count(count) == first);
+    chidb_finalize(running);
+    chidb_finalize(waiting);
+    chidb_finalize(count);
+
+    // Statements prepared now see the new rows, and no old page is kept
+    CU_ASSERT(test_threads_count(db) == first + SNAPSHOT_NINSERTS);
+    rc = chidb_prepare(db, "SELECT COUNT(*) FROM numbers;", &count);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    CU_ASSERT(test_snapshot_count(count) == first + SNAPSHOT_NINSERTS);
+    chidb_finalize(count);
+    CU_ASSERT(chidb_Pager_countVersions(db->bt->pager) == 0);
+
+    rc = chidb_close(db);
     CU_ASSERT(rc == CHIDB_OK);
 
-    rc = chidb_Btree_close(db->bt);
+    return;
+}
+
+
+struct SnapshotWriter
+{
+    chidb *db;
+    int seen;
+};
+
+/* Count the rows with a code, as a statement prepared now sees them */
+int test_snapshot_code(chidb *db, int code)
+{
+    char sql[128];
+    chidb_stmt *stmt;
+    int nrows;
+
+    snprintf(sql, sizeof(sql), "SELECT * FROM numbers WHERE code = %d;", code);
+    if (CHIDB_OK != chidb_prepare(db, sql, &stmt))
+        return -1;
+    nrows = test_snapshot_rows(stmt);
+    chidb_finalize(stmt);
+    return nrows;
+}
+
+void *test_snapshot_writer(void *arg)
+{
+    struct SnapshotWriter *writer = arg;
+    chidb_stmt *stmt;
+
+    if (CHIDB_OK != chidb_prepare(writer->db, "INSERT INTO numbers VALUES(99501, \"own\", 999501);", &stmt))
+        return NULL;
+    if (CHIDB_DONE == chidb_step(stmt))
+        writer->seen = test_snapshot_code(writer->db, 99501);
+    chidb_finalize(stmt);
+    return NULL;
+}
+
+void test_Snapshot_2()
+{
+    int rc;
+    chidb *db;
+    rc = chidb_open(TESTFILE_3, &db);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    Pager *pager = db->bt->pager;
+
+    // Another writer is in the middle of a transaction when the INSERT runs
+    struct SnapshotWriter writer = {db, -1};
+    pthread_t thread;
+    bool closing = false;
+    chidb_Pager_beginWrite(pager);
+    pthread_create(&thread, NULL, test_snapshot_writer, &writer);
+    while (!closing) {
+        sched_yield();
+        pthread_mutex_lock(&pager->txn_lock);
+        closing = pager->closing;
+        pthread_mutex_unlock(&pager->txn_lock);
+    }
+
+    // The row is written, but nobody sees it until the other writer is done
+    CU_ASSERT(test_snapshot_code(db, 99501) == 0);
+    chidb_Pager_endWrite(pager);
+
+    // The INSERT returns once it is committed: the thread sees its own row
+    pthread_join(thread, NULL);
+    CU_ASSERT(writer.seen == 1);
+    CU_ASSERT(test_snapshot_code(db, 99501) == 1);
+    CU_ASSERT(chidb_Pager_countVersions(pager) == 0);
+
+    rc = chidb_close(db);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    return;
+}
+
+
+#define TESTFILE_NEW ("example_dbs/volatile.createtable.cdb")
+
+/* Run a statement through the chidb API, expecting no rows */
+int test_api_statement(chidb *db, const char *sql)
+{
+    chidb_stmt *stmt;
+    int rc = chidb_prepare(db, sql, &stmt);
+    if (CHIDB_OK != rc)
+        return rc;
+    rc = chidb_step(stmt);
+    chidb_finalize(stmt);
+    return rc;
+}
+
+void test_CreateTable_1()
+{
+    int rc;
+    chidb *db;
+    chidb_stmt *stmt;
+    uint32_t cookie;
+    remove(TESTFILE_NEW);
+    rc = chidb_open(TESTFILE_NEW, &db);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+
+    CU_ASSERT(test_api_statement(db, "CREATE TABLE parts (id INTEGER PRIMARY KEY, name TEXT, qty SMALLINT);") == CHIDB_DONE);
+    CU_ASSERT(test_api_statement(db, "INSERT INTO parts VALUES (7, \"bolt\", 300);") == CHIDB_DONE);
+    CU_ASSERT(test_api_statement(db, "CREATE TABLE parts (id INTEGER PRIMARY KEY);") == CHIDB_EINVALIDSQL);
+    rc = chidb_Btree_getSchemaCookie(db->bt, &cookie);
+    CU_ASSERT(rc == CHIDB_OK);
+    CU_ASSERT(cookie == 1);
+
+    // A statement compiled before the next CREATE TABLE is cached...
+    rc = chidb_prepare(db, "SELECT name, qty FROM parts;", &stmt);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    CU_ASSERT(stmt->schema_cookie == 1);
+    CU_ASSERT(chidb_step(stmt) == CHIDB_ROW);
+    CU_ASSERT(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    CU_ASSERT(test_api_statement(db, "CREATE TABLE bins (id INTEGER PRIMARY KEY, part INTEGER);") == CHIDB_DONE);
+    CU_ASSERT(test_api_statement(db, "INSERT INTO bins VALUES (1, 7);") == CHIDB_DONE);
+    rc = chidb_Btree_getSchemaCookie(db->bt, &cookie);
+    CU_ASSERT(rc == CHIDB_OK);
+    CU_ASSERT(cookie == 2);
+
+    // ...and compiled again afterwards
+    rc = chidb_prepare(db, "SELECT name, qty FROM parts;", &stmt);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    CU_ASSERT(stmt->schema_cookie == 2);
+    CU_ASSERT(chidb_step(stmt) == CHIDB_ROW);
+    CU_ASSERT(chidb_column_text(stmt, 0) != NULL && strcmp(chidb_column_text(stmt, 0), "bolt") == 0);
+    CU_ASSERT(chidb_column_int(stmt, 1) == 300);
+    CU_ASSERT(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+
+    rc = chidb_close(db);
+    CU_ASSERT(rc == CHIDB_OK);
+
+    // The tables are in the schema table of the file
+    rc = chidb_open(TESTFILE_NEW, &db);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    rc = chidb_prepare(db, "SELECT part FROM bins;", &stmt);
+    CU_ASSERT_FATAL(rc == CHIDB_OK);
+    CU_ASSERT(chidb_step(stmt) == CHIDB_ROW);
+    CU_ASSERT(chidb_column_int(stmt, 0) == 7);
+    CU_ASSERT(chidb_step(stmt) == CHIDB_DONE);
+    chidb_finalize(stmt);
+    rc = chidb_close(db);
     CU_ASSERT(rc == CHIDB_OK);
-    free(db);
 
     return;
 }
 
 
 
+
+
 int init_tests_gen() {
     CU_pSuite genTests = NULL;
 
@@ -765,6 +2375,25 @@ int init_tests_gen() {
     return CU_get_error();
     }
 
+    if ((NULL == CU_add_test(genTests, "SELECT Aggregates 1", test_Aggregate_1))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "SELECT GROUP BY 1", test_Aggregate_2))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+    if ((NULL == CU_add_test(genTests, "SELECT GROUP BY 2", test_Aggregate_3))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "SELECT Parameters 1", test_Param_1))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
     if ((NULL == CU_add_test(genTests, "INSERT 1", test_Insert_1))) {
     CU_cleanup_registry();
     return CU_get_error();
@@ -775,5 +2404,104 @@ int init_tests_gen() {
     return CU_get_error();
     }
 
+    if ((NULL == CU_add_test(genTests, "INSERT multiple rows", test_Insert_3))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "INSERT large text", test_Insert_4))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "DELETE 1", test_Delete_1))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "UPDATE 1", test_Update_1))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "SELECT covering index 1", test_Index_1))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "INSERT with index 1", test_Index_2))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "INSERT with covering index 1", test_Index_3))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "CREATE INDEX 1", test_Index_4))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "DELETE/UPDATE with indexes 1", test_Index_5))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "DELETE/UPDATE with covering index 1", test_Index_6))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "SELECT parallel scan 1", test_Parallel_1))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "SELECT from several threads 1", test_Threads_1))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "INSERT from several threads 1", test_Threads_2))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "SELECT at a snapshot 1", test_Snapshot_1))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "INSERT alongside another writer 1", test_Snapshot_2))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "CREATE TABLE 1", test_CreateTable_1))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "SELECT a batch at a time 1", test_Batch_1))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "SELECT a batch at a time 2", test_Batch_2))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
+    if ((NULL == CU_add_test(genTests, "Integer filter kernels 1", test_Filter_1))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+    if ((NULL == CU_add_test(genTests, "Key rank kernels 1", test_Filter_2))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+    }
+
     return CU_get_error();
 }
\ No newline at end of file
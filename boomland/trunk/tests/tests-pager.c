@@ -1,4 +1,8 @@
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 #include "CUnit/Basic.h"
 #include "libchidb/pager.h"
 
@@ -128,6 +132,316 @@ void test_readwrite(void)
 	}
 }
 
+void test_cache(void)
+{
+	int rc;
+	Pager *pg;
+	MemPage *page;
+	uint8_t *copies;
+	uint64_t hits, misses;
+	
+	rc = chidb_Pager_open(&pg, TESTFILE);
+	CU_ASSERT(rc == CHIDB_OK);
+	chidb_Pager_setPageSize(pg, PAGE_SIZE);
+	copies = malloc(pg->n_pages * PAGE_SIZE);
+	
+	/* The first read of a page goes to the file... */
+	for(int j=1; j<=pg->n_pages; j++)
+	{
+		rc = chidb_Pager_readPage(pg, j, &page);
+		CU_ASSERT(rc == CHIDB_OK);
+		memcpy(copies + (j-1)*PAGE_SIZE, page->data, PAGE_SIZE);
+		chidb_Pager_releaseMemPage(pg, page);
+	}
+	chidb_Pager_cacheStats(pg, &hits, &misses);
+	CU_ASSERT(hits == 0);
+	CU_ASSERT(misses == pg->n_pages);
+	
+	/* ...and the following ones to the cache, which hands out private copies */
+	for(int j=1; j<=pg->n_pages; j++)
+	{
+		rc = chidb_Pager_readPage(pg, j, &page);
+		CU_ASSERT(rc == CHIDB_OK);
+		CU_ASSERT(memcmp(copies + (j-1)*PAGE_SIZE, page->data, PAGE_SIZE) == 0);
+		page->data[0] ^= 0xFF;
+		chidb_Pager_releaseMemPage(pg, page);
+	}
+	chidb_Pager_cacheStats(pg, &hits, &misses);
+	CU_ASSERT(hits == pg->n_pages);
+	CU_ASSERT(misses == pg->n_pages);
+	
+	rc = chidb_Pager_readPage(pg, 1, &page);
+	CU_ASSERT(page->data[0] == copies[0]);
+	chidb_Pager_releaseMemPage(pg, page);
+	
+	free(copies);
+	chidb_Pager_close(pg);
+}
+
+#define NREADERS (8)
+#define NREADS (2000)
+
+struct PagerReader
+{
+	Pager *pg;
+	uint8_t *copies;
+	unsigned int seed;
+	int failed;
+};
+
+void *test_concurrent_reader(void *arg)
+{
+	struct PagerReader *reader = arg;
+	MemPage *page;
+	
+	for(int i=0; i<NREADS; i++)
+	{
+		reader->seed = reader->seed * 1103515245 + 12345;
+		npage_t npage = 1 + (reader->seed >> 16) % reader->pg->n_pages;
+		if (chidb_Pager_readPage(reader->pg, npage, &page) != CHIDB_OK)
+		{
+			reader->failed++;
+			continue;
+		}
+		if (memcmp(reader->copies + (npage-1)*reader->pg->page_size, page->data, reader->pg->page_size) != 0)
+			reader->failed++;
+		chidb_Pager_releaseMemPage(reader->pg, page);
+	}
+	
+	return NULL;
+}
+
+void test_concurrent_read(void)
+{
+	int rc;
+	Pager *pg;
+	MemPage *page;
+	uint8_t *copies;
+	pthread_t threads[NREADERS];
+	struct PagerReader readers[NREADERS];
+	
+	for(int i=0; i<NMULT; i++)
+	{
+		rc = chidb_Pager_open(&pg, TESTFILE);
+		CU_ASSERT(rc == CHIDB_OK);
+		chidb_Pager_setPageSize(pg, PAGE_SIZE * pagemult[i]);
+		copies = malloc(TESTFILESIZE);
+		for(int j=1; j<=pg->n_pages; j++)
+		{
+			chidb_Pager_readPage(pg, j, &page);
+			memcpy(copies + (j-1)*pg->page_size, page->data, pg->page_size);
+			chidb_Pager_releaseMemPage(pg, page);
+		}
+		chidb_Pager_close(pg);
+		
+		/* Several threads read from a pager with an empty cache at once */
+		rc = chidb_Pager_open(&pg, TESTFILE);
+		CU_ASSERT(rc == CHIDB_OK);
+		chidb_Pager_setPageSize(pg, PAGE_SIZE * pagemult[i]);
+		for(int t=0; t<NREADERS; t++)
+		{
+			readers[t].pg = pg;
+			readers[t].copies = copies;
+			readers[t].seed = t + 1;
+			readers[t].failed = 0;
+			pthread_create(&threads[t], NULL, test_concurrent_reader, &readers[t]);
+		}
+		for(int t=0; t<NREADERS; t++)
+		{
+			pthread_join(threads[t], NULL);
+			CU_ASSERT(readers[t].failed == 0);
+		}
+		
+		free(copies);
+		chidb_Pager_close(pg);
+	}
+}
+
+/* Write a page filled with a single byte */
+void test_fillPage(Pager *pg, npage_t npage, uint8_t value)
+{
+	MemPage *page;
+
+	chidb_Pager_readPage(pg, npage, &page);
+	memset(page->data, value, pg->page_size);
+	CU_ASSERT(chidb_Pager_writePage(pg, page) == CHIDB_OK);
+	chidb_Pager_releaseMemPage(pg, page);
+}
+
+/* Read the first byte of a page, as a snapshot sees it */
+uint8_t test_readPageAt(Pager *pg, npage_t npage, uint64_t snapshot)
+{
+	MemPage *page;
+	uint8_t value;
+
+	CU_ASSERT_FATAL(chidb_Pager_readPageAt(pg, npage, snapshot, &page) == CHIDB_OK);
+	value = page->data[pg->page_size - 1];
+	chidb_Pager_releaseMemPage(pg, page);
+	return value;
+}
+
+void test_snapshot(void)
+{
+	int rc;
+	npage_t npage, n0, n1;
+	uint64_t s0, s1;
+	Pager *pg;
+	
+	rc = chidb_Pager_open(&pg, TEMPFILE);
+	CU_ASSERT(rc == CHIDB_OK);
+	chidb_Pager_setPageSize(pg, PAGE_SIZE);
+	for(int j=1; j<=MAXPAGES; j++)
+	{
+		chidb_Pager_allocatePage(pg, &npage);
+		test_fillPage(pg, npage, j);
+	}
+
+	/* A snapshot of the file before the first transaction... */
+	rc = chidb_Pager_openSnapshot(pg, &s0, &n0);
+	CU_ASSERT(rc == CHIDB_OK);
+	CU_ASSERT(n0 == MAXPAGES);
+	
+	chidb_Pager_beginWrite(pg);
+	test_fillPage(pg, 1, 0xA1);
+	test_fillPage(pg, 2, 0xA2);
+	chidb_Pager_allocatePage(pg, &npage);
+	test_fillPage(pg, npage, 0xA9);
+	
+	/* ...and one opened while it runs, which does not see it either */
+	rc = chidb_Pager_openSnapshot(pg, &s1, &n1);
+	CU_ASSERT(rc == CHIDB_OK);
+	CU_ASSERT(s1 == s0);
+	CU_ASSERT(n1 == MAXPAGES);
+	chidb_Pager_closeSnapshot(pg, s1);
+	chidb_Pager_endWrite(pg);
+
+	/* A snapshot after the first transaction, and a second transaction */
+	rc = chidb_Pager_openSnapshot(pg, &s1, &n1);
+	CU_ASSERT(rc == CHIDB_OK);
+	CU_ASSERT(s1 == s0 + 1);
+	CU_ASSERT(n1 == MAXPAGES + 1);
+	chidb_Pager_beginWrite(pg);
+	test_fillPage(pg, 1, 0xB1);
+	chidb_Pager_endWrite(pg);
+
+	CU_ASSERT(test_readPageAt(pg, 1, s0) == 1);
+	CU_ASSERT(test_readPageAt(pg, 2, s0) == 2);
+	CU_ASSERT(test_readPageAt(pg, 3, s0) == 3);
+	CU_ASSERT(test_readPageAt(pg, 1, s1) == 0xA1);
+	CU_ASSERT(test_readPageAt(pg, 2, s1) == 0xA2);
+	CU_ASSERT(test_readPageAt(pg, MAXPAGES + 1, s1) == 0xA9);
+	CU_ASSERT(test_readPageAt(pg, 1, PAGER_LATEST) == 0xB1);
+
+	/* Page 1 was kept twice and page 2 once (the new page was not kept).
+	 * Versions go away with the snapshots that read them. */
+	CU_ASSERT(chidb_Pager_countVersions(pg) == 3);
+	chidb_Pager_closeSnapshot(pg, s0);
+	CU_ASSERT(chidb_Pager_countVersions(pg) == 1);
+	CU_ASSERT(test_readPageAt(pg, 1, s1) == 0xA1);
+	chidb_Pager_closeSnapshot(pg, s1);
+	CU_ASSERT(chidb_Pager_countVersions(pg) == 0);
+	CU_ASSERT(test_readPageAt(pg, 1, PAGER_LATEST) == 0xB1);
+	CU_ASSERT(test_readPageAt(pg, 2, PAGER_LATEST) == 0xA2);
+
+	chidb_Pager_close(pg);
+	remove(TEMPFILE);
+}
+
+struct PagerWriter
+{
+	Pager *pg;
+	npage_t npage;
+	uint8_t value;
+	int done;
+};
+
+/* Write a page in a transaction of its own, or one shared with others */
+void *test_group_writer(void *arg)
+{
+	struct PagerWriter *writer = arg;
+
+	chidb_Pager_beginWrite(writer->pg);
+	test_fillPage(writer->pg, writer->npage, writer->value);
+	chidb_Pager_endWrite(writer->pg);
+	__atomic_store_n(&writer->done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/* Number of threads in the current transaction, and whether it takes more */
+uint32_t test_writers(Pager *pg, bool *closing)
+{
+	uint32_t writers;
+
+	pthread_mutex_lock(&pg->txn_lock);
+	writers = pg->writers;
+	*closing = pg->closing;
+	pthread_mutex_unlock(&pg->txn_lock);
+	return writers;
+}
+
+void test_group_commit(void)
+{
+	int rc;
+	npage_t npage, n;
+	uint64_t s0, s1;
+	bool closing;
+	Pager *pg;
+	pthread_t first, second;
+	struct PagerWriter writers[2] = {{NULL, 1, 0xC1, 0}, {NULL, 2, 0xC2, 0}};
+	
+	rc = chidb_Pager_open(&pg, TEMPFILE);
+	CU_ASSERT(rc == CHIDB_OK);
+	chidb_Pager_setPageSize(pg, PAGE_SIZE);
+	for(int j=1; j<=MAXPAGES; j++)
+	{
+		chidb_Pager_allocatePage(pg, &npage);
+		test_fillPage(pg, npage, j);
+	}
+	writers[0].pg = writers[1].pg = pg;
+
+	/* A writer that overlaps with ours writes page 1. When it is done,
+	 * it waits for ours, and its write is not seen until then... */
+	chidb_Pager_beginWrite(pg);
+	pthread_create(&first, NULL, test_group_writer, &writers[0]);
+	while (test_writers(pg, &closing) != 1 || !closing)
+		sched_yield();
+	CU_ASSERT(__atomic_load_n(&writers[0].done, __ATOMIC_ACQUIRE) == 0);
+	rc = chidb_Pager_openSnapshot(pg, &s0, &n);
+	CU_ASSERT(rc == CHIDB_OK);
+	CU_ASSERT(test_readPageAt(pg, 1, s0) == 1);
+
+	/* ...nor does a writer that arrives now join the transaction */
+	pthread_create(&second, NULL, test_group_writer, &writers[1]);
+	usleep(10000);
+	CU_ASSERT(test_writers(pg, &closing) == 1);
+	CU_ASSERT(test_readPageAt(pg, 2, PAGER_LATEST) == 2);
+
+	/* Once ours is done the transaction commits, and the first writer
+	 * sees its write as soon as it is done */
+	chidb_Pager_endWrite(pg);
+	pthread_join(first, NULL);
+	CU_ASSERT(writers[0].done == 1);
+	rc = chidb_Pager_openSnapshot(pg, &s1, &n);
+	CU_ASSERT(rc == CHIDB_OK);
+	CU_ASSERT(s1 >= s0 + 1);
+	CU_ASSERT(test_readPageAt(pg, 1, s1) == 0xC1);
+	chidb_Pager_closeSnapshot(pg, s1);
+	pthread_join(second, NULL);
+	rc = chidb_Pager_openSnapshot(pg, &s1, &n);
+	CU_ASSERT(rc == CHIDB_OK);
+	CU_ASSERT(s1 == s0 + 2);
+	CU_ASSERT(test_readPageAt(pg, 2, s1) == 0xC2);
+	chidb_Pager_closeSnapshot(pg, s1);
+
+	CU_ASSERT(test_readPageAt(pg, 1, s0) == 1);
+	CU_ASSERT(test_readPageAt(pg, 2, s0) == 2);
+	chidb_Pager_closeSnapshot(pg, s0);
+	CU_ASSERT(chidb_Pager_countVersions(pg) == 0);
+
+	chidb_Pager_close(pg);
+	remove(TEMPFILE);
+}
+
 int init_tests_pager()
 {
 	CU_pSuite pagerTests = NULL;
@@ -143,7 +457,11 @@ int init_tests_pager()
 	if (
 		(NULL == CU_add_test(pagerTests, "Opening an existing file", test_open)) ||
 		(NULL == CU_add_test(pagerTests, "Reading pages", test_read)) ||
-		(NULL == CU_add_test(pagerTests, "Allocating/writing/reading a page", test_readwrite))
+		(NULL == CU_add_test(pagerTests, "Allocating/writing/reading a page", test_readwrite)) ||
+		(NULL == CU_add_test(pagerTests, "Caching pages", test_cache)) ||
+		(NULL == CU_add_test(pagerTests, "Reading pages from several threads", test_concurrent_read)) ||
+		(NULL == CU_add_test(pagerTests, "Reading pages at a snapshot", test_snapshot)) ||
+		(NULL == CU_add_test(pagerTests, "Committing overlapping writers", test_group_commit))
 	   )
    	{
       CU_cleanup_registry();
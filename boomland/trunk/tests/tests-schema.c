@@ -3,6 +3,7 @@
 #include "libchidb/schemaloader.h"
 
 #define TESTFILE_1 ("example_dbs/singletable_singlepage.cdb")
+#define TESTFILE_2 ("example_dbs/tableindex_singlepage.cdb")
 
 void test_schemaLoad() {
   int rc;
@@ -22,6 +23,32 @@ void test_schemaLoad() {
   free(db);
 }
 
+void test_schemaLoadIndex() {
+  int rc;
+  chidb *db;
+  db = malloc(sizeof(chidb));
+  rc = chidb_Btree_open(TESTFILE_2, db, &db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+
+  Schema *schema;
+  rc = chidb_loadSchema(db, &schema);
+  CU_ASSERT(rc == CHIDB_OK);
+  CU_ASSERT(schema->ntables == 1);
+  CU_ASSERT(schema->nindexes == 1);
+
+  Schema_Table *table = chidb_getTable(schema, "numbers");
+  CU_ASSERT_FATAL(table != NULL);
+  CU_ASSERT(table->colMap.ncols == 3);
+  CU_ASSERT(chidb_getTable(schema, "idxNumbers") == NULL);
+  CU_ASSERT(chidb_getTable(schema, "nonexistent") == NULL);
+
+  chidb_destroySchema(schema);
+
+  rc = chidb_Btree_close(db->bt);
+  CU_ASSERT(rc == CHIDB_OK);
+  free(db);
+}
+
 int init_tests_schema() {
 	CU_pSuite schemaTests = NULL;
 
@@ -33,7 +60,8 @@ int init_tests_schema() {
 	}
   
 	if (
-		(NULL == CU_add_test(schemaTests, "Load a schema", test_schemaLoad))
+		(NULL == CU_add_test(schemaTests, "Load a schema", test_schemaLoad)) ||
+		(NULL == CU_add_test(schemaTests, "Load a schema with an index", test_schemaLoadIndex))
 		) {
     CU_cleanup_registry();
     return CU_get_error();
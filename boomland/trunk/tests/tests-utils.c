@@ -1,6 +1,9 @@
 #include <stdlib.h>
+#include <string.h>
 #include "CUnit/Basic.h"
 #include "libchidb/util.h"
+#include "libchidb/arena.h"
+#include "libchidb/csv.h"
 
 #define NVALUES (8)
 
@@ -50,6 +53,71 @@ void test_varint32(void)
 	}
 }
 
+void test_arena(void)
+{
+	Arena arena;
+	chidb_Arena_init(&arena, 64);
+
+	uint8_t *a = chidb_Arena_alloc(&arena, 16);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(a);
+	memset(a, 0xAA, 16);
+
+	ArenaMark mark = chidb_Arena_mark(&arena);
+
+	// Spills over into a second block, then into one of its own
+	uint8_t *b = chidb_Arena_alloc(&arena, 48);
+	uint8_t *c = chidb_Arena_alloc(&arena, 200);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(b);
+	CU_ASSERT_PTR_NOT_NULL_FATAL(c);
+	memset(b, 0xBB, 48);
+	memset(c, 0xCC, 200);
+
+	// The latest allocation grows in place when it fits
+	uint8_t *d = chidb_Arena_alloc(&arena, 8);
+	CU_ASSERT_PTR_EQUAL(chidb_Arena_grow(&arena, d, 8, 16), d);
+
+	// Everything after the mark goes, what came before stays
+	chidb_Arena_release(&arena, mark);
+	for(int i=0; i<16; i++)
+		CU_ASSERT_EQUAL(a[i], 0xAA);
+
+	uint8_t *e = chidb_Arena_alloc(&arena, 16);
+	CU_ASSERT_PTR_EQUAL(e, a + 16);
+
+	chidb_Arena_destroy(&arena);
+}
+
+void test_csv(void)
+{
+	FILE *f = tmpfile();
+	CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+	fputs("1,plain,\r\n\n2,\"a, \"\"quoted\"\"\nfield\",x\n3", f);
+	rewind(f);
+
+	CSVReader csv;
+	CU_ASSERT(chidb_CSV_open(&csv, f) == CHIDB_OK);
+
+	CU_ASSERT(chidb_CSV_next(&csv) == CHIDB_ROW);
+	CU_ASSERT(csv.nfields == 3);
+	CU_ASSERT(!strcmp(csv.row + csv.fields[0], "1"));
+	CU_ASSERT(!strcmp(csv.row + csv.fields[1], "plain"));
+	CU_ASSERT(csv.lengths[2] == 0);
+
+	CU_ASSERT(chidb_CSV_next(&csv) == CHIDB_ROW);
+	CU_ASSERT(csv.nfields == 3);
+	CU_ASSERT(!strcmp(csv.row + csv.fields[1], "a, \"quoted\"\nfield"));
+	CU_ASSERT(!strcmp(csv.row + csv.fields[2], "x"));
+
+	CU_ASSERT(chidb_CSV_next(&csv) == CHIDB_ROW);
+	CU_ASSERT(csv.nfields == 1);
+	CU_ASSERT(!strcmp(csv.row + csv.fields[0], "3"));
+
+	CU_ASSERT(chidb_CSV_next(&csv) == CHIDB_DONE);
+
+	chidb_CSV_close(&csv);
+	fclose(f);
+}
+
 int init_tests_utils()
 {
 	CU_pSuite utilsTests = NULL;
@@ -65,7 +133,9 @@ int init_tests_utils()
 	if (
 		(NULL == CU_add_test(utilsTests, "Get/put uint16", test_getput2byte)) ||
 		(NULL == CU_add_test(utilsTests, "Get/put uint32", test_getput4byte)) ||
-		(NULL == CU_add_test(utilsTests, "Get/put varint32", test_varint32))
+		(NULL == CU_add_test(utilsTests, "Get/put varint32", test_varint32)) ||
+		(NULL == CU_add_test(utilsTests, "Arena mark/release", test_arena)) ||
+		(NULL == CU_add_test(utilsTests, "CSV reader", test_csv))
 	   )
    	{
       CU_cleanup_registry();